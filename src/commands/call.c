@@ -124,7 +124,7 @@ static command_result_t handle_hangup_command(const command_request_t *request)
 }
 
 switch_status_t command_call_register(void) {
-    if (command_register_handler("originate", handle_originate_command) != SWITCH_STATUS_SUCCESS) {
+    if (command_register_handler_lane("originate", handle_originate_command, COMMAND_LANE_BULK) != SWITCH_STATUS_SUCCESS) {
         return SWITCH_STATUS_FALSE;
     }
     if (command_register_handler("hangup", handle_hangup_command) != SWITCH_STATUS_SUCCESS) {
@@ -3,27 +3,27 @@
 
 #define COMMAND_DEFAULT_SUCCESS_MSG "Command executed"
 
-static command_stats_t g_stats = {0};
+typedef enum {
+    COMMAND_COUNTER_RECEIVED,
+    COMMAND_COUNTER_SUCCESS,
+    COMMAND_COUNTER_FAILED,
+    COMMAND_COUNTER_SKIPPED,
+    COMMAND_COUNTER_MAX
+} command_counter_t;
+
+static counter_group_t g_counters;
 
 uint64_t command_current_timestamp_us(void) {
     return (uint64_t)switch_time_now();
 }
 
-switch_bool_t should_process_request(cJSON *json) {
+switch_bool_t command_node_is_local(const char *target_node) {
     extern mod_event_agent_globals_t globals;
-    
-    cJSON *node_id_item = cJSON_GetObjectItem(json, "node_id");
-    
-    if (!node_id_item || !cJSON_IsString(node_id_item)) {
-        return SWITCH_TRUE;
-    }
-    
-    const char *target_node = node_id_item->valuestring;
-    
+
     if (globals.node_id && strcmp(target_node, globals.node_id) == 0) {
         return SWITCH_TRUE;
     }
-    
+
     switch_log_printf(SWITCH_CHANNEL_LOG,
                       SWITCH_LOG_DEBUG,
                       "[mod_event_agent] Skipping request - target node: %s, our node: %s",
@@ -32,6 +32,15 @@ switch_bool_t should_process_request(cJSON *json) {
     return SWITCH_FALSE;
 }
 
+switch_bool_t should_process_request(cJSON *json) {
+    cJSON *node_id_item = cJSON_GetObjectItem(json, "node_id");
+
+    if (!node_id_item || !cJSON_IsString(node_id_item)) {
+        return SWITCH_TRUE;
+    }
+    return command_node_is_local(node_id_item->valuestring);
+}
+
 cJSON* build_json_response_object(switch_bool_t success, const char *message) {
     extern mod_event_agent_globals_t globals;
     cJSON *json = cJSON_CreateObject();
@@ -69,21 +78,36 @@ char* build_json_response(switch_bool_t success, const char *message, const char
 }
 
 void command_stats_increment_received(void) {
-    g_stats.requests_received++;
+    counter_inc(&g_counters, COMMAND_COUNTER_RECEIVED);
+}
+
+void command_stats_add_received(uint64_t count) {
+    counter_add(&g_counters, COMMAND_COUNTER_RECEIVED, count);
 }
 
 void command_stats_increment_success(void) {
-    g_stats.requests_success++;
+    counter_inc(&g_counters, COMMAND_COUNTER_SUCCESS);
 }
 
 void command_stats_increment_failed(void) {
-    g_stats.requests_failed++;
+    counter_inc(&g_counters, COMMAND_COUNTER_FAILED);
+}
+
+void command_stats_increment_skipped(void) {
+    counter_inc(&g_counters, COMMAND_COUNTER_SKIPPED);
+}
+
+uint64_t command_stats_get_skipped(void) {
+    return counter_read(&g_counters, COMMAND_COUNTER_SKIPPED);
 }
 
 void command_stats_get(uint64_t *requests, uint64_t *success, uint64_t *failed) {
-    if (requests) *requests = g_stats.requests_received;
-    if (success) *success = g_stats.requests_success;
-    if (failed) *failed = g_stats.requests_failed;
+    uint64_t values[COMMAND_COUNTER_MAX];
+
+    counter_snapshot(&g_counters, values, COMMAND_COUNTER_MAX);
+    if (requests) *requests = values[COMMAND_COUNTER_RECEIVED];
+    if (success) *success = values[COMMAND_COUNTER_SUCCESS];
+    if (failed) *failed = values[COMMAND_COUNTER_FAILED];
 }
 
 command_result_t command_result_ok(void) {
@@ -2,6 +2,7 @@
 #define COMMAND_CORE_H
 
 #include "../mod_event_agent.h"
+#include "../core/histogram.h"
 #include <cjson/cJSON.h>
 
 typedef struct {
@@ -24,15 +25,36 @@ typedef struct command_result {
     const char *message;
 } command_result_t;
 
+/* Concurrency class a command runs in; see workers.h */
+typedef enum {
+    COMMAND_LANE_FAST,
+    COMMAND_LANE_BULK,
+    COMMAND_LANE_JOB,
+    COMMAND_LANE_MAX
+} command_lane_t;
+
 typedef command_result_t (*command_handler_fn)(const command_request_t *request);
 
+/*
+ * Routing headers, read before the payload is parsed: a node that is not
+ * the target drops the message without touching the JSON, and a command
+ * named here (or in a <prefix>.api.<command> subject) needs no "command"
+ * field in the payload.
+ */
+#define COMMAND_NODE_ID_HEADER "Event-Agent-Node-Id"
+#define COMMAND_NAME_HEADER "Event-Agent-Command"
+
 switch_bool_t should_process_request(cJSON *json);
+switch_bool_t command_node_is_local(const char *target_node);
 cJSON* build_json_response_object(switch_bool_t success, const char *message);
 char* build_json_response(switch_bool_t success, const char *message, const char *data);
 uint64_t command_current_timestamp_us(void);
 void command_stats_increment_received(void);
+void command_stats_add_received(uint64_t count);
 void command_stats_increment_success(void);
 void command_stats_increment_failed(void);
+void command_stats_increment_skipped(void);
+uint64_t command_stats_get_skipped(void);
 void command_stats_get(uint64_t *requests, uint64_t *success, uint64_t *failed);
 
 command_result_t command_result_ok(void);
@@ -40,7 +62,12 @@ command_result_t command_result_from_string(const char *value);
 command_result_t command_result_error(const char *message);
 void command_result_free(command_result_t *result);
 
+/* Registers on the fast lane; long-running handlers use command_register_handler_lane */
 switch_status_t command_register_handler(const char *name, command_handler_fn handler);
+switch_status_t command_register_handler_lane(const char *name, command_handler_fn handler, command_lane_t lane);
 void command_register_default_handler(command_handler_fn handler);
 
+typedef void (*command_latency_visitor_t)(const char *name, const latency_histogram_t *latency, void *user_data);
+void command_foreach_latency(command_latency_visitor_t visitor, void *user_data);
+
 #endif
@@ -4,15 +4,85 @@
 #include "call.h"
 #include "api.h"
 #include "status.h"
+#include "replay.h"
+#include "workers.h"
+#include "jobs.h"
+#include "../core/metrics.h"
 #include <string.h>
 
+/* Handlers that are not registered by name share the default entry's histogram */
+#define COMMAND_DEFAULT_LATENCY_NAME "api"
+
+/* API passthrough commands that only poke an existing channel; everything else the API runs goes to the bulk lane */
+#define COMMAND_DEFAULT_FAST_LANE "uuid_kill,uuid_setvar,uuid_setvar_multi,uuid_getvar,uuid_break,uuid_hold," \
+                                  "uuid_answer,uuid_park,uuid_transfer,uuid_bridge,uuid_send_dtmf,uuid_exists"
+#define COMMAND_LANE_LIST_MAX 128
+#define COMMAND_BATCH_MAX 256
+
+typedef struct {
+    command_handler_fn handler;
+    command_lane_t lane;
+    latency_histogram_t latency;
+} command_entry_t;
+
+/* A parsed request on its way to a worker; subject and reply_to are copied in behind it */
+typedef struct {
+    command_work_t work;
+    command_entry_t *entry;
+    cJSON *json;
+    const char *command;
+    const char *subject;
+    const char *reply_to;
+    switch_bool_t async;
+    char job_id[COMMAND_JOB_ID_SIZE];   /* empty unless async */
+} command_task_t;
+
+typedef struct command_batch_s command_batch_t;
+
+typedef struct {
+    command_work_t work;
+    command_batch_t *batch;
+    command_entry_t *entry;
+    cJSON *payload;
+    const char *command;
+    const char *error;      /* set when the entry could not be resolved */
+    uint32_t index;
+} command_batch_item_t;
+
+/* One allocation: the batch, its items, the per-item results, then subject and reply_to */
+struct command_batch_s {
+    cJSON *json;
+    cJSON **results;
+    command_batch_item_t *items;
+    uint32_t count;
+    uint32_t pending;       /* unfinished items plus the dispatcher's own reference */
+    uint32_t succeeded;
+    uint32_t failed;
+    uint32_t skipped;
+    switch_bool_t sequential;
+    switch_bool_t stop_on_error;
+    const char *subject;
+    const char *reply_to;
+};
+
 static event_driver_t *g_driver = NULL;
+static switch_memory_pool_t *g_pool = NULL;
 static switch_hash_t *g_registry = NULL;
-static command_handler_fn g_default_handler = NULL;
+static switch_hash_t *g_lane_overrides = NULL;
+static command_entry_t g_default_entry = {0};
+static const command_lane_t g_lane_values[COMMAND_LANE_MAX] = {COMMAND_LANE_FAST, COMMAND_LANE_BULK, COMMAND_LANE_JOB};
 static char g_subject_api[256] = {0};
 static char g_subject_node[256] = {0};
 static switch_bool_t g_node_subscription = SWITCH_FALSE;
 
+/* <prefix>.api.> subscription: the tokens after <prefix>.api. name the command; offset is where they start */
+typedef struct {
+    char subject[260];
+    size_t offset;
+} command_route_t;
+
+static command_route_t g_route_api = {{0}};
+
 static const char *commands_prefix(void) {
     extern mod_event_agent_globals_t globals;
     return (globals.subject_prefix && *globals.subject_prefix) ? globals.subject_prefix : DEFAULT_SUBJECT_PREFIX;
@@ -51,31 +121,487 @@ static void publish_response(const char *reply_to, switch_bool_t success, const
     }
 }
 
-static command_handler_fn lookup_handler(const char *name) {
-    if (!g_registry || switch_strlen_zero(name)) {
-        return NULL;
+static command_entry_t *lookup_entry(const char *name) {
+    command_entry_t *entry = NULL;
+
+    if (g_registry && !switch_strlen_zero(name)) {
+        entry = (command_entry_t *)switch_core_hash_find(g_registry, name);
+    }
+    return entry ? entry : (g_default_entry.handler ? &g_default_entry : NULL);
+}
+
+static command_lane_t lane_for(const char *name, const command_entry_t *entry) {
+    const command_lane_t *lane;
+
+    if (g_lane_overrides && (lane = (const command_lane_t *)switch_core_hash_find(g_lane_overrides, name))) {
+        return *lane;
+    }
+    return entry->lane;
+}
+
+static void add_lane_overrides(const char *list, command_lane_t lane) {
+    char *names[COMMAND_LANE_LIST_MAX];
+    char *copy;
+    int count;
+
+    if (switch_strlen_zero(list) || !(copy = switch_core_strdup(g_pool, list))) {
+        return;
+    }
+
+    count = switch_separate_string(copy, ',', names, COMMAND_LANE_LIST_MAX);
+    for (int i = 0; i < count; i++) {
+        char *name = names[i];
+
+        while (*name == ' ') name++;
+        if (*name) {
+            switch_core_hash_insert(g_lane_overrides, name, (void *)&g_lane_values[lane]);
+        }
     }
-    return (command_handler_fn)switch_core_hash_find(g_registry, name);
 }
 
 switch_status_t command_register_handler(const char *name, command_handler_fn handler) {
+    return command_register_handler_lane(name, handler, COMMAND_LANE_FAST);
+}
+
+switch_status_t command_register_handler_lane(const char *name, command_handler_fn handler, command_lane_t lane) {
+    command_entry_t *entry;
+
     if (!g_registry || switch_strlen_zero(name) || !handler) {
         return SWITCH_STATUS_FALSE;
     }
 
-    switch_core_hash_insert(g_registry, name, handler);
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Registered command handler: %s", name);
+    /* Re-registering keeps the command's latency history */
+    if (!(entry = (command_entry_t *)switch_core_hash_find(g_registry, name))) {
+        if (!(entry = switch_core_alloc(g_pool, sizeof(*entry)))) {
+            return SWITCH_STATUS_MEMERR;
+        }
+        switch_core_hash_insert(g_registry, name, entry);
+    }
+    entry->handler = handler;
+    entry->lane = lane < COMMAND_LANE_MAX ? lane : COMMAND_LANE_BULK;
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Registered command handler: %s (%s lane)", name, command_lane_name(entry->lane));
     return SWITCH_STATUS_SUCCESS;
 }
 
 void command_register_default_handler(command_handler_fn handler) {
-    g_default_handler = handler;
+    g_default_entry.handler = handler;
+    g_default_entry.lane = COMMAND_LANE_BULK;
+}
+
+void command_foreach_latency(command_latency_visitor_t visitor, void *user_data) {
+    switch_hash_index_t *hi;
+    const void *key;
+    void *val;
+
+    if (g_default_entry.handler) {
+        visitor(COMMAND_DEFAULT_LATENCY_NAME, &g_default_entry.latency, user_data);
+    }
+    if (!g_registry) {
+        return;
+    }
+    for (hi = switch_core_hash_first(g_registry); hi; hi = switch_core_hash_next(&hi)) {
+        switch_core_hash_this(hi, &key, NULL, &val);
+        visitor((const char *)key, &((command_entry_t *)val)->latency, user_data);
+    }
+}
+
+/* Runs the handler and accounts for it; result.message is always set on failure */
+static command_result_t run_handler(command_entry_t *entry, const command_request_t *request) {
+    uint64_t start = metrics_start();
+    uint64_t end;
+
+    command_result_t result = entry->handler(request);
+    if ((end = metrics_stage_lap(METRICS_STAGE_COMMAND_EXECUTE, start))) {
+        histogram_record(&entry->latency, end - start);
+    }
+
+    if (!result.error) {
+        command_stats_increment_success();
+    } else {
+        command_stats_increment_failed();
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Command %s failed: %s", request->command, result.error);
+        if (!result.message) {
+            result.message = result.error;
+        }
+    }
+    return result;
+}
+
+static void execute_command(command_work_t *work) {
+    command_task_t *task = (command_task_t *)work;
+    uint64_t start;
+
+    /* A job cancelled while it was queued is dropped without running */
+    if (*task->job_id && !command_job_begin(task->job_id)) {
+        cJSON_Delete(task->json);
+        free(task);
+        return;
+    }
+
+    command_request_t request = {
+        .payload = task->json,
+        .command = task->command,
+        .subject = task->subject,
+        .reply_to = task->reply_to,
+        .async = task->async
+    };
+
+    command_result_t result = run_handler(task->entry, &request);
+    const switch_bool_t success = result.error == NULL;
+
+    start = metrics_start();
+    if (*task->job_id) {
+        command_job_finish(task->job_id, success, result.message, result.data);
+    } else {
+        publish_response(task->reply_to, success, result.message, result.data);
+    }
+    metrics_stage_lap(METRICS_STAGE_COMMAND_REPLY, start);
+    result.data = NULL;
+
+    command_result_free(&result);
+    cJSON_Delete(task->json);
+    free(task);
+}
+
+static command_task_t *command_task_create(command_entry_t *entry, cJSON *json, const char *command,
+                                           const char *subject, const char *reply_to, switch_bool_t async) {
+    size_t subject_len = subject ? strlen(subject) + 1 : 0;
+    size_t reply_len = reply_to ? strlen(reply_to) + 1 : 0;
+    command_task_t *task = malloc(sizeof(*task) + subject_len + reply_len);
+    char *p;
+
+    if (!task) {
+        return NULL;
+    }
+    memset(task, 0, sizeof(*task));
+    task->work.run = execute_command;
+    task->entry = entry;
+    task->json = json;
+    task->command = command;
+    task->async = async;
+
+    p = (char *)(task + 1);
+    if (subject) {
+        memcpy(p, subject, subject_len);
+        task->subject = p;
+        p += subject_len;
+    }
+    if (reply_to) {
+        memcpy(p, reply_to, reply_len);
+        task->reply_to = p;
+    }
+    return task;
+}
+
+/* Answers with the job id straight away; the outcome follows on the notify subject */
+static void dispatch_job(command_task_t *task, cJSON *json) {
+    cJSON *notify_item = cJSON_GetObjectItemCaseSensitive(json, "notify");
+    const char *notify = (notify_item && cJSON_IsString(notify_item) && !switch_strlen_zero(notify_item->valuestring)) ? notify_item->valuestring : NULL;
+    char subject[512];
+
+    if (command_job_create(task->command, notify, task->job_id, sizeof(task->job_id)) != SWITCH_STATUS_SUCCESS) {
+        command_stats_increment_failed();
+        publish_response(task->reply_to, SWITCH_FALSE, "Job table full", NULL);
+        cJSON_Delete(json);
+        free(task);
+        return;
+    }
+
+    if (notify) {
+        switch_copy_string(subject, notify, sizeof(subject));
+    } else {
+        command_job_subject(task->job_id, subject, sizeof(subject));
+    }
+
+    cJSON *data = cJSON_CreateObject();
+    if (data) {
+        cJSON_AddStringToObject(data, "job_id", task->job_id);
+        cJSON_AddStringToObject(data, "subject", subject);
+    }
+    /* Published before the job is queued, so the acceptance always precedes the outcome */
+    publish_response(task->reply_to, SWITCH_TRUE, "Job accepted", data);
+
+    if (!command_workers_submit(COMMAND_LANE_JOB, &task->work)) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Could not start job thread, failing %s", task->command);
+        command_stats_increment_failed();
+        if (command_job_begin(task->job_id)) {
+            command_job_finish(task->job_id, SWITCH_FALSE, "Could not start job", NULL);
+        }
+        cJSON_Delete(json);
+        free(task);
+    }
+}
+
+static cJSON *batch_item_result(const char *command, switch_bool_t success, const char *message, cJSON *data) {
+    cJSON *item = cJSON_CreateObject();
+
+    if (!item) {
+        if (data) {
+            cJSON_Delete(data);
+        }
+        return NULL;
+    }
+    cJSON_AddStringToObject(item, "command", command ? command : "");
+    cJSON_AddBoolToObject(item, "success", success);
+    cJSON_AddStringToObject(item, "message", message ? message : (success ? "Command executed" : "Command failed"));
+    if (data) {
+        cJSON_AddItemToObject(item, "data", data);
+    }
+    return item;
+}
+
+static void batch_finish(command_batch_t *batch) {
+    const uint32_t failed = __atomic_load_n(&batch->failed, __ATOMIC_RELAXED);
+    const uint32_t skipped = __atomic_load_n(&batch->skipped, __ATOMIC_RELAXED);
+    uint64_t start = metrics_start();
+    cJSON *results;
+    cJSON *data;
+
+    if ((data = cJSON_CreateObject())) {
+        cJSON_AddStringToObject(data, "mode", batch->sequential ? "sequential" : "parallel");
+        cJSON_AddNumberToObject(data, "succeeded", (double)__atomic_load_n(&batch->succeeded, __ATOMIC_RELAXED));
+        cJSON_AddNumberToObject(data, "failed", (double)failed);
+        cJSON_AddNumberToObject(data, "skipped", (double)skipped);
+        if ((results = cJSON_CreateArray())) {
+            for (uint32_t i = 0; i < batch->count; i++) {
+                if (batch->results[i]) {
+                    cJSON_AddItemToArray(results, batch->results[i]);
+                    batch->results[i] = NULL;
+                }
+            }
+            cJSON_AddItemToObject(data, "results", results);
+        }
+    }
+
+    publish_response(batch->reply_to, (failed || skipped) ? SWITCH_FALSE : SWITCH_TRUE,
+                     (failed || skipped) ? "Batch completed with errors" : "Batch executed", data);
+    metrics_stage_lap(METRICS_STAGE_COMMAND_REPLY, start);
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        if (batch->results[i]) {
+            cJSON_Delete(batch->results[i]);
+        }
+    }
+    cJSON_Delete(batch->json);
+    free(batch);
+}
+
+/* Runs one entry and stores its result in the entry's own slot; returns whether it succeeded */
+static switch_bool_t batch_run_item(command_batch_item_t *item) {
+    command_batch_t *batch = item->batch;
+    switch_bool_t success;
+
+    if (item->error) {
+        command_stats_increment_failed();
+        batch->results[item->index] = batch_item_result(item->command, SWITCH_FALSE, item->error, NULL);
+        success = SWITCH_FALSE;
+    } else {
+        command_request_t request = {
+            .payload = item->payload,
+            .command = item->command,
+            .subject = batch->subject,
+            .reply_to = batch->reply_to,
+            .async = SWITCH_FALSE
+        };
+        command_result_t result = run_handler(item->entry, &request);
+
+        success = result.error == NULL;
+        batch->results[item->index] = batch_item_result(item->command, success, result.message, result.data);
+        result.data = NULL;
+        command_result_free(&result);
+    }
+
+    __atomic_fetch_add(success ? &batch->succeeded : &batch->failed, 1, __ATOMIC_RELAXED);
+    return success;
+}
+
+static void batch_release(command_batch_t *batch) {
+    if (__atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        batch_finish(batch);
+    }
+}
+
+/* Parallel mode: each entry is its own work item; whichever finishes last sends the reply */
+static void execute_batch_item(command_work_t *work) {
+    command_batch_item_t *item = (command_batch_item_t *)work;
+    command_batch_t *batch = item->batch;
+
+    batch_run_item(item);
+    batch_release(batch);
+}
+
+/* Sequential mode: one worker runs the entries in order */
+static void execute_batch_sequence(command_work_t *work) {
+    command_batch_t *batch = ((command_batch_item_t *)work)->batch;
+    switch_bool_t stopped = SWITCH_FALSE;
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        command_batch_item_t *item = &batch->items[i];
+
+        if (stopped) {
+            command_stats_increment_failed();
+            batch->results[i] = batch_item_result(item->command, SWITCH_FALSE, "Skipped after an earlier failure", NULL);
+            if (batch->results[i]) {
+                cJSON_AddBoolToObject(batch->results[i], "skipped", SWITCH_TRUE);
+            }
+            batch->skipped++;
+            continue;
+        }
+        if (!batch_run_item(item) && batch->stop_on_error) {
+            stopped = SWITCH_TRUE;
+        }
+    }
+    batch_finish(batch);
+}
+
+static command_batch_t *command_batch_create(cJSON *json, uint32_t count, const char *subject, const char *reply_to) {
+    size_t subject_len = subject ? strlen(subject) + 1 : 0;
+    size_t reply_len = reply_to ? strlen(reply_to) + 1 : 0;
+    size_t size = sizeof(command_batch_t) + sizeof(command_batch_item_t) * count + sizeof(cJSON *) * count;
+    command_batch_t *batch = malloc(size + subject_len + reply_len);
+    char *p;
+
+    if (!batch) {
+        return NULL;
+    }
+    memset(batch, 0, size);
+    batch->json = json;
+    batch->count = count;
+    batch->items = (command_batch_item_t *)(batch + 1);
+    batch->results = (cJSON **)(batch->items + count);
+
+    p = (char *)batch + size;
+    if (subject) {
+        memcpy(p, subject, subject_len);
+        batch->subject = p;
+        p += subject_len;
+    }
+    if (reply_to) {
+        memcpy(p, reply_to, reply_len);
+        batch->reply_to = p;
+    }
+    return batch;
+}
+
+/*
+ * {"commands": [{"command": ...}, ...], "mode": "parallel" | "sequential", "stop_on_error": true}
+ * Entries are resolved here, run on the worker lanes and answered with a single reply
+ * whose data.results follows the order of the request.
+ */
+static void dispatch_batch(cJSON *json, cJSON *commands, const char *subject, const char *reply_to) {
+    cJSON *mode_item = cJSON_GetObjectItemCaseSensitive(json, "mode");
+    cJSON *stop_item = cJSON_GetObjectItemCaseSensitive(json, "stop_on_error");
+    cJSON *async_item = cJSON_GetObjectItemCaseSensitive(json, "async");
+    command_lane_t sequence_lane = COMMAND_LANE_FAST;
+    command_batch_t *batch;
+    const char *error = NULL;
+    int count = cJSON_IsArray(commands) ? cJSON_GetArraySize(commands) : -1;
+
+    if (count < 0) {
+        error = "'commands' must be an array";
+    } else if (count == 0) {
+        error = "Empty 'commands' array";
+    } else if (count > COMMAND_BATCH_MAX) {
+        error = "Batch exceeds 256 commands; split the request";
+    } else if (async_item && cJSON_IsTrue(async_item)) {
+        error = "Batches cannot be async";
+    } else if (mode_item && (!cJSON_IsString(mode_item) ||
+                             (strcmp(mode_item->valuestring, "parallel") && strcmp(mode_item->valuestring, "sequential")))) {
+        error = "'mode' must be parallel or sequential";
+    }
+    if (error || !(batch = command_batch_create(json, (uint32_t)count, subject, reply_to))) {
+        cJSON_Delete(json);
+        command_stats_increment_failed();
+        publish_response(reply_to, SWITCH_FALSE, error ? error : "Out of memory", NULL);
+        return;
+    }
+
+    batch->sequential = (mode_item && !strcmp(mode_item->valuestring, "sequential")) ? SWITCH_TRUE : SWITCH_FALSE;
+    batch->stop_on_error = (stop_item && cJSON_IsFalse(stop_item)) ? SWITCH_FALSE : SWITCH_TRUE;
+
+    /* The batch message was counted once on arrival; every entry is a request of its own */
+    command_stats_add_received((uint64_t)count - 1);
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        command_batch_item_t *item = &batch->items[i];
+        cJSON *cmd_item;
+
+        item->batch = batch;
+        item->index = i;
+        item->payload = cJSON_GetArrayItem(commands, (int)i);
+        cmd_item = cJSON_IsObject(item->payload) ? cJSON_GetObjectItemCaseSensitive(item->payload, "command") : NULL;
+        if (!cmd_item || !cJSON_IsString(cmd_item) || switch_strlen_zero(cmd_item->valuestring)) {
+            item->error = "Missing 'command' string";
+            continue;
+        }
+        item->command = cmd_item->valuestring;
+        if (!(item->entry = lookup_entry(item->command))) {
+            item->error = "Unknown command";
+        } else if (lane_for(item->command, item->entry) != COMMAND_LANE_FAST) {
+            sequence_lane = COMMAND_LANE_BULK;
+        }
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Received batch of %u commands via %s (%s)",
+                      batch->count, subject ? subject : "<unknown>", batch->sequential ? "sequential" : "parallel");
+
+    if (batch->sequential) {
+        batch->items[0].work.run = execute_batch_sequence;
+        if (!command_workers_submit(sequence_lane, &batch->items[0].work)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Command queue full, rejecting batch");
+            for (uint32_t i = 0; i < batch->count; i++) {
+                command_stats_increment_failed();
+            }
+            publish_response(reply_to, SWITCH_FALSE, "Command queue full", NULL);
+            cJSON_Delete(json);
+            free(batch);
+        }
+        return;
+    }
+
+    batch->pending = batch->count + 1;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        command_batch_item_t *item = &batch->items[i];
+
+        if (item->error) {
+            batch_run_item(item);
+            batch_release(batch);
+            continue;
+        }
+        item->work.run = execute_batch_item;
+        if (!command_workers_submit(lane_for(item->command, item->entry), &item->work)) {
+            item->error = "Command queue full";
+            batch_run_item(item);
+            batch_release(batch);
+        }
+    }
+    batch_release(batch);
 }
 
-static void dispatch_command(const char *subject, const char *data, size_t len, const char *reply_to, void *user_data) {
+static void dispatch_command(const char *subject, const driver_header_t *headers, size_t header_count,
+                             const char *data, size_t len, const char *reply_to, void *user_data) {
+    const command_route_t *route = (const command_route_t *)user_data;
+    const char *target_node = driver_header_find(headers, header_count, COMMAND_NODE_ID_HEADER);
+    const char *routed_command = driver_header_find(headers, header_count, COMMAND_NAME_HEADER);
+    uint64_t start = metrics_start();
+
     command_stats_increment_received();
 
-    cJSON *json = cJSON_Parse(data);
+    /* Routing headers and subject tokens are checked before any JSON is parsed */
+    if (target_node && !command_node_is_local(target_node)) {
+        command_stats_increment_skipped();
+        return;
+    }
+    if (switch_strlen_zero(routed_command) && route && subject && strlen(subject) > route->offset) {
+        routed_command = subject + route->offset;
+    }
+    if (switch_strlen_zero(routed_command)) {
+        routed_command = NULL;
+    }
+
+    /* A routed command may come with an empty payload */
+    cJSON *json = (routed_command && !len) ? cJSON_CreateObject() : cJSON_Parse(data);
+    metrics_stage_lap(METRICS_STAGE_COMMAND_PARSE, start);
     if (!json) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Invalid JSON payload on subject %s", subject ? subject : "<unknown>");
         command_stats_increment_failed();
@@ -83,11 +609,24 @@ static void dispatch_command(const char *subject, const char *data, size_t len,
         return;
     }
 
-    if (!should_process_request(json)) {
+    if (!target_node && !should_process_request(json)) {
+        command_stats_increment_skipped();
         cJSON_Delete(json);
         return;
     }
 
+    cJSON *batch_item = routed_command ? NULL : cJSON_GetObjectItemCaseSensitive(json, "commands");
+    if (batch_item) {
+        dispatch_batch(json, batch_item, subject, reply_to);
+        return;
+    }
+
+    /* The routed name replaces the payload's, so handlers and the task see one "command" that outlives the message */
+    if (routed_command) {
+        cJSON_DeleteItemFromObjectCaseSensitive(json, "command");
+        cJSON_AddStringToObject(json, "command", routed_command);
+    }
+
     cJSON *cmd_item = cJSON_GetObjectItemCaseSensitive(json, "command");
     if (!cmd_item || !cJSON_IsString(cmd_item) || switch_strlen_zero(cmd_item->valuestring)) {
         cJSON_Delete(json);
@@ -111,57 +650,52 @@ static void dispatch_command(const char *subject, const char *data, size_t len,
                       reply_to ? reply_to : "<none>",
                       async == SWITCH_TRUE ? "true" : "false");
 
-    command_handler_fn handler = lookup_handler(command_name);
-    if (!handler) {
-        handler = g_default_handler;
-    }
-
-    if (!handler) {
+    command_entry_t *entry = lookup_entry(command_name);
+    if (!entry) {
         cJSON_Delete(json);
         command_stats_increment_failed();
         publish_response(reply_to, SWITCH_FALSE, "Unknown command", NULL);
         return;
     }
 
-    command_request_t request = {
-        .payload = json,
-        .command = command_name,
-        .subject = subject,
-        .reply_to = reply_to,
-        .async = async
-    };
+    command_task_t *task = command_task_create(entry, json, command_name, subject, reply_to, async);
+    if (!task) {
+        cJSON_Delete(json);
+        command_stats_increment_failed();
+        publish_response(reply_to, SWITCH_FALSE, "Out of memory", NULL);
+        return;
+    }
 
-    command_result_t result = handler(&request);
-    const switch_bool_t success = result.error == NULL;
+    if (async) {
+        dispatch_job(task, json);
+        return;
+    }
 
-    if (success) {
-        command_stats_increment_success();
-    } else {
+    /* The subscription thread only parses and routes; the handler and its reply run on the lane's workers */
+    if (!command_workers_submit(lane_for(command_name, entry), &task->work)) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Command queue full, rejecting %s", command_name);
         command_stats_increment_failed();
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Command %s failed: %s", command_name, result.error);
+        publish_response(reply_to, SWITCH_FALSE, "Command queue full", NULL);
+        cJSON_Delete(json);
+        free(task);
     }
+}
 
-    if (!async) {
-        if (!success && !result.message && result.error) {
-            result.message = result.error;
-        }
-        publish_response(reply_to, success, result.message, result.data);
-        result.data = NULL;
-    } else if (result.data) {
-        cJSON_Delete(result.data);
-        result.data = NULL;
+/* <base>.<command> carries the command name in the subject; the base subject keeps working without it */
+static void subscribe_route(command_route_t *route, const char *base) {
+    switch_snprintf(route->subject, sizeof(route->subject), "%s.>", base);
+    route->offset = strlen(base) + 1;
+    if (g_driver->subscribe(g_driver, route->subject, dispatch_command, route) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Failed to subscribe to %s", route->subject);
+        route->subject[0] = '\0';
     }
-
-    command_result_free(&result);
-    cJSON_Delete(json);
 }
 
 switch_status_t command_handler_init(event_driver_t *driver, switch_memory_pool_t *pool, dialplan_manager_t *dialplan_manager) {
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Initializing command handler");
 
     g_driver = driver;
-
-    (void)pool;
+    g_pool = pool;
 
     if (switch_core_hash_init(&g_registry) != SWITCH_STATUS_SUCCESS) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to allocate command registry");
@@ -180,18 +714,39 @@ switch_status_t command_handler_init(event_driver_t *driver, switch_memory_pool_
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to register status command");
         return SWITCH_STATUS_FALSE;
     }
+    if (command_jobs_init(driver, pool) != SWITCH_STATUS_SUCCESS || command_jobs_register() != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to register job commands");
+        return SWITCH_STATUS_FALSE;
+    }
+    if (command_replay_register() != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to register replay command");
+        return SWITCH_STATUS_FALSE;
+    }
     if (dialplan_manager && command_dialplan_init(dialplan_manager) != SWITCH_STATUS_SUCCESS) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Dialplan commands could not be registered (continuing)");
     }
 
+    extern mod_event_agent_globals_t globals;
+    if (switch_core_hash_init(&g_lane_overrides) == SWITCH_STATUS_SUCCESS) {
+        add_lane_overrides(globals.command_fast_lane ? globals.command_fast_lane : COMMAND_DEFAULT_FAST_LANE, COMMAND_LANE_FAST);
+        add_lane_overrides(globals.command_bulk_lane, COMMAND_LANE_BULK);
+    }
+
+    if (command_workers_start(pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to start command workers");
+        return SWITCH_STATUS_FALSE;
+    }
+
     const char *prefix = commands_prefix();
     switch_snprintf(g_subject_api, sizeof(g_subject_api), "%s.api", prefix);
     if (driver->subscribe(driver, g_subject_api, dispatch_command, NULL) != SWITCH_STATUS_SUCCESS) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to subscribe to %s", g_subject_api);
+        command_workers_stop();
         return SWITCH_STATUS_FALSE;
     }
 
-    extern mod_event_agent_globals_t globals;
+    subscribe_route(&g_route_api, g_subject_api);
+
     if (globals.node_id && *globals.node_id) {
         switch_snprintf(g_subject_node, sizeof(g_subject_node), "%s.node.%s", prefix, globals.node_id);
         if (driver->subscribe(driver, g_subject_node, dispatch_command, NULL) == SWITCH_STATUS_SUCCESS) {
@@ -221,14 +776,23 @@ void command_handler_shutdown(void) {
         if (g_node_subscription && *g_subject_node) {
             g_driver->unsubscribe(g_driver, g_subject_node);
         }
+        if (*g_route_api.subject) {
+            g_driver->unsubscribe(g_driver, g_route_api.subject);
+        }
     }
 
+    /* Queued commands and jobs still reply before the driver goes away */
+    command_workers_stop();
+    command_jobs_shutdown();
+
     g_driver = NULL;
     g_registry = NULL;
-    g_default_handler = NULL;
+    g_lane_overrides = NULL;
+    g_default_entry.handler = NULL;
     g_subject_api[0] = '\0';
     g_subject_node[0] = '\0';
     g_node_subscription = SWITCH_FALSE;
+    g_route_api.subject[0] = '\0';
 
     command_dialplan_shutdown();
 
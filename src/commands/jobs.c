@@ -0,0 +1,408 @@
+#include "jobs.h"
+#include <string.h>
+
+#define JOB_SWEEP_INTERVAL_US 1000000
+
+typedef enum {
+    JOB_COUNTER_CREATED,
+    JOB_COUNTER_COMPLETED,
+    JOB_COUNTER_FAILED,
+    JOB_COUNTER_CANCELLED,
+    JOB_COUNTER_EXPIRED,
+    JOB_COUNTER_REJECTED,
+    JOB_COUNTER_MAX
+} job_counter_t;
+
+/* One allocation: the struct, then the command name and notify subject */
+typedef struct command_job_s {
+    char id[COMMAND_JOB_ID_SIZE];
+    const char *command;
+    const char *notify;
+    command_job_state_t state;
+    switch_time_t created;
+    switch_time_t started;
+    switch_time_t finished;
+    char *result;                   /* serialized outcome envelope */
+    struct command_job_s *next;     /* finished jobs, oldest first */
+} command_job_t;
+
+static const char *g_state_names[] = {"queued", "running", "completed", "failed", "cancelled"};
+
+static event_driver_t *g_driver = NULL;
+static switch_mutex_t *g_mutex = NULL;
+static switch_hash_t *g_jobs = NULL;
+static command_job_t *g_finished_head = NULL;
+static command_job_t *g_finished_tail = NULL;
+static uint32_t g_count = 0;
+static uint32_t g_queued = 0;
+static uint32_t g_running = 0;
+static switch_time_t g_next_sweep = 0;
+static counter_group_t g_counters;
+
+static void job_free(command_job_t *job) {
+    switch_safe_free(job->result);
+    free(job);
+}
+
+void command_job_subject(const char *id, char *subject, size_t size) {
+    const char *prefix = (globals.subject_prefix && *globals.subject_prefix) ? globals.subject_prefix : DEFAULT_SUBJECT_PREFIX;
+
+    switch_snprintf(subject, size, "%s.jobs.%s", prefix, id);
+}
+
+static void notify_subject(const command_job_t *job, char *subject, size_t size) {
+    if (job->notify) {
+        switch_copy_string(subject, job->notify, size);
+    } else {
+        command_job_subject(job->id, subject, size);
+    }
+}
+
+/* Caller holds g_mutex */
+static void finished_append(command_job_t *job) {
+    job->next = NULL;
+    if (g_finished_tail) {
+        g_finished_tail->next = job;
+    } else {
+        g_finished_head = job;
+    }
+    g_finished_tail = job;
+}
+
+/* Caller holds g_mutex */
+static void finished_drop_head(void) {
+    command_job_t *job = g_finished_head;
+
+    if (!(g_finished_head = job->next)) {
+        g_finished_tail = NULL;
+    }
+    switch_core_hash_delete(g_jobs, job->id);
+    g_count--;
+    counter_inc(&g_counters, JOB_COUNTER_EXPIRED);
+    job_free(job);
+}
+
+/* Caller holds g_mutex; finished jobs expire in finish order, so only the head needs checking */
+static void expire_jobs(switch_time_t now) {
+    switch_time_t ttl = (switch_time_t)globals.job_ttl_ms * 1000;
+
+    while (g_finished_head && g_finished_head->finished + ttl <= now) {
+        finished_drop_head();
+    }
+    g_next_sweep = now + JOB_SWEEP_INTERVAL_US;
+}
+
+/* Caller holds g_mutex */
+static void leave_active(command_job_t *job) {
+    if (job->state == COMMAND_JOB_QUEUED) {
+        g_queued--;
+    } else if (job->state == COMMAND_JOB_RUNNING) {
+        g_running--;
+    }
+}
+
+static char *build_outcome(const char *id, const char *command, switch_bool_t success, const char *message, cJSON *data) {
+    cJSON *response = build_json_response_object(success, message ? message : (success ? "Command executed" : "Command failed"));
+    char *json_str;
+
+    if (!response) {
+        if (data) {
+            cJSON_Delete(data);
+        }
+        return NULL;
+    }
+
+    cJSON_AddStringToObject(response, "job_id", id);
+    cJSON_AddStringToObject(response, "command", command);
+    if (data) {
+        cJSON_AddItemToObject(response, "data", data);
+    }
+    json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    return json_str;
+}
+
+static void publish_outcome(const char *subject, const char *outcome) {
+    if (g_driver && outcome) {
+        g_driver->publish(g_driver, subject, outcome, strlen(outcome));
+    }
+}
+
+switch_status_t command_job_create(const char *command, const char *notify, char *id, size_t id_size) {
+    size_t command_len = strlen(command) + 1;
+    size_t notify_len = switch_strlen_zero(notify) ? 0 : strlen(notify) + 1;
+    switch_time_t now = switch_micro_time_now();
+    command_job_t *job;
+    char *p;
+
+    if (!g_jobs || id_size < COMMAND_JOB_ID_SIZE) {
+        return SWITCH_STATUS_FALSE;
+    }
+    if (!(job = malloc(sizeof(*job) + command_len + notify_len))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    memset(job, 0, sizeof(*job));
+
+    p = (char *)(job + 1);
+    memcpy(p, command, command_len);
+    job->command = p;
+    if (notify_len) {
+        memcpy(p + command_len, notify, notify_len);
+        job->notify = p + command_len;
+    }
+    job->state = COMMAND_JOB_QUEUED;
+    job->created = now;
+    switch_uuid_str(job->id, sizeof(job->id));
+
+    switch_mutex_lock(g_mutex);
+    if (now >= g_next_sweep) {
+        expire_jobs(now);
+    }
+    /* Full table: make room by dropping the oldest finished job, never an unfinished one */
+    if (g_count >= globals.job_max && g_finished_head) {
+        finished_drop_head();
+    }
+    if (g_count >= globals.job_max) {
+        switch_mutex_unlock(g_mutex);
+        counter_inc(&g_counters, JOB_COUNTER_REJECTED);
+        free(job);
+        return SWITCH_STATUS_FALSE;
+    }
+    switch_core_hash_insert(g_jobs, job->id, job);
+    g_count++;
+    g_queued++;
+    switch_mutex_unlock(g_mutex);
+
+    counter_inc(&g_counters, JOB_COUNTER_CREATED);
+    switch_copy_string(id, job->id, id_size);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_bool_t command_job_begin(const char *id) {
+    command_job_t *job;
+    switch_bool_t runnable = SWITCH_FALSE;
+
+    switch_mutex_lock(g_mutex);
+    if ((job = (command_job_t *)switch_core_hash_find(g_jobs, id)) && job->state == COMMAND_JOB_QUEUED) {
+        job->state = COMMAND_JOB_RUNNING;
+        job->started = switch_micro_time_now();
+        g_queued--;
+        g_running++;
+        runnable = SWITCH_TRUE;
+    }
+    switch_mutex_unlock(g_mutex);
+    return runnable;
+}
+
+void command_job_finish(const char *id, switch_bool_t success, const char *message, cJSON *data) {
+    char subject[512];
+    char command[256];
+    command_job_t *job;
+    char *outcome;
+
+    switch_mutex_lock(g_mutex);
+    if (!(job = (command_job_t *)switch_core_hash_find(g_jobs, id)) || job->state > COMMAND_JOB_RUNNING) {
+        switch_mutex_unlock(g_mutex);
+        if (data) {
+            cJSON_Delete(data);
+        }
+        return;
+    }
+    notify_subject(job, subject, sizeof(subject));
+    switch_copy_string(command, job->command, sizeof(command));
+    switch_mutex_unlock(g_mutex);
+
+    /* Built and published outside the lock; the job cannot expire before it is marked finished */
+    outcome = build_outcome(id, command, success, message, data);
+    publish_outcome(subject, outcome);
+
+    switch_mutex_lock(g_mutex);
+    if ((job = (command_job_t *)switch_core_hash_find(g_jobs, id)) && job->state <= COMMAND_JOB_RUNNING) {
+        leave_active(job);
+        job->state = success ? COMMAND_JOB_COMPLETED : COMMAND_JOB_FAILED;
+        job->finished = switch_micro_time_now();
+        job->result = outcome;
+        outcome = NULL;
+        finished_append(job);
+    }
+    switch_mutex_unlock(g_mutex);
+
+    switch_safe_free(outcome);
+    counter_inc(&g_counters, success ? JOB_COUNTER_COMPLETED : JOB_COUNTER_FAILED);
+}
+
+static const char *payload_job_id(const command_request_t *request) {
+    cJSON *item = request->payload ? cJSON_GetObjectItemCaseSensitive(request->payload, "job_id") : NULL;
+
+    return (item && cJSON_IsString(item) && !switch_strlen_zero(item->valuestring)) ? item->valuestring : NULL;
+}
+
+static command_result_t handle_job_status(const command_request_t *request) {
+    const char *id = payload_job_id(request);
+    command_job_state_t state;
+    switch_time_t created, started, finished;
+    char command[256];
+    char *outcome = NULL;
+    command_job_t *job;
+
+    if (!id) {
+        return command_result_error("Missing 'job_id' string");
+    }
+
+    switch_mutex_lock(g_mutex);
+    if (!(job = (command_job_t *)switch_core_hash_find(g_jobs, id))) {
+        switch_mutex_unlock(g_mutex);
+        return command_result_error("Unknown or expired job");
+    }
+    state = job->state;
+    created = job->created;
+    started = job->started;
+    finished = job->finished;
+    switch_copy_string(command, job->command, sizeof(command));
+    outcome = job->result ? strdup(job->result) : NULL;
+    switch_mutex_unlock(g_mutex);
+
+    cJSON *data = cJSON_CreateObject();
+    if (!data) {
+        switch_safe_free(outcome);
+        return command_result_error("Failed to allocate job status");
+    }
+
+    cJSON_AddStringToObject(data, "job_id", id);
+    cJSON_AddStringToObject(data, "command", command);
+    cJSON_AddStringToObject(data, "state", g_state_names[state]);
+    cJSON_AddNumberToObject(data, "created", (double)(created / 1000));
+    if (started) {
+        cJSON_AddNumberToObject(data, "wait_ms", (double)(started - created) / 1000.0);
+    }
+    if (started && finished) {
+        cJSON_AddNumberToObject(data, "run_ms", (double)(finished - started) / 1000.0);
+    }
+    if (outcome) {
+        cJSON *result = cJSON_Parse(outcome);
+        if (result) {
+            cJSON_AddItemToObject(data, "result", result);
+        }
+        free(outcome);
+    }
+
+    command_result_t result = command_result_ok();
+    result.message = "Job status";
+    result.data = data;
+    return result;
+}
+
+static command_result_t handle_job_cancel(const command_request_t *request) {
+    const char *id = payload_job_id(request);
+    char subject[512];
+    char command[256];
+    command_job_state_t state;
+    command_job_t *job;
+    char *outcome;
+
+    if (!id) {
+        return command_result_error("Missing 'job_id' string");
+    }
+
+    switch_mutex_lock(g_mutex);
+    if (!(job = (command_job_t *)switch_core_hash_find(g_jobs, id))) {
+        switch_mutex_unlock(g_mutex);
+        return command_result_error("Unknown or expired job");
+    }
+    if ((state = job->state) == COMMAND_JOB_QUEUED) {
+        /* The job thread finds it cancelled and skips it */
+        leave_active(job);
+        job->state = COMMAND_JOB_CANCELLED;
+        job->finished = switch_micro_time_now();
+        notify_subject(job, subject, sizeof(subject));
+        switch_copy_string(command, job->command, sizeof(command));
+        finished_append(job);
+    }
+    switch_mutex_unlock(g_mutex);
+
+    if (state == COMMAND_JOB_RUNNING) {
+        return command_result_error("Job is already running and cannot be cancelled");
+    }
+    if (state != COMMAND_JOB_QUEUED) {
+        return command_result_error("Job has already finished");
+    }
+
+    counter_inc(&g_counters, JOB_COUNTER_CANCELLED);
+    outcome = build_outcome(id, command, SWITCH_FALSE, "Job cancelled", NULL);
+    publish_outcome(subject, outcome);
+
+    switch_mutex_lock(g_mutex);
+    if ((job = (command_job_t *)switch_core_hash_find(g_jobs, id)) && !job->result) {
+        job->result = outcome;
+        outcome = NULL;
+    }
+    switch_mutex_unlock(g_mutex);
+    switch_safe_free(outcome);
+
+    command_result_t result = command_result_ok();
+    result.message = "Job cancelled";
+    return result;
+}
+
+void command_jobs_get_stats(command_jobs_stats_t *stats) {
+    uint64_t counters[JOB_COUNTER_MAX];
+
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = globals.job_max;
+
+    if (g_mutex) {
+        switch_mutex_lock(g_mutex);
+        stats->jobs = g_count;
+        stats->queued = g_queued;
+        stats->running = g_running;
+        switch_mutex_unlock(g_mutex);
+    }
+
+    counter_snapshot(&g_counters, counters, JOB_COUNTER_MAX);
+    stats->created = counters[JOB_COUNTER_CREATED];
+    stats->completed = counters[JOB_COUNTER_COMPLETED];
+    stats->failed = counters[JOB_COUNTER_FAILED];
+    stats->cancelled = counters[JOB_COUNTER_CANCELLED];
+    stats->expired = counters[JOB_COUNTER_EXPIRED];
+    stats->rejected = counters[JOB_COUNTER_REJECTED];
+}
+
+switch_status_t command_jobs_init(event_driver_t *driver, switch_memory_pool_t *pool) {
+    g_driver = driver;
+    if (switch_mutex_init(&g_mutex, SWITCH_MUTEX_NESTED, pool) != SWITCH_STATUS_SUCCESS ||
+        switch_core_hash_init(&g_jobs) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_FALSE;
+    }
+    g_finished_head = g_finished_tail = NULL;
+    g_count = g_queued = g_running = 0;
+    g_next_sweep = 0;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Called once the workers are stopped, so no job can change state any more */
+void command_jobs_shutdown(void) {
+    switch_hash_index_t *hi;
+    void *val;
+
+    if (!g_jobs) {
+        return;
+    }
+    for (hi = switch_core_hash_first(g_jobs); hi; hi = switch_core_hash_next(&hi)) {
+        switch_core_hash_this(hi, NULL, NULL, &val);
+        job_free((command_job_t *)val);
+    }
+    switch_core_hash_destroy(&g_jobs);
+    g_finished_head = g_finished_tail = NULL;
+    g_count = g_queued = g_running = 0;
+    g_driver = NULL;
+}
+
+switch_status_t command_jobs_register(void) {
+    if (command_register_handler("job.status", handle_job_status) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_FALSE;
+    }
+    return command_register_handler("job.cancel", handle_job_cancel);
+}
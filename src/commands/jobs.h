@@ -0,0 +1,54 @@
+#ifndef COMMAND_JOBS_H
+#define COMMAND_JOBS_H
+
+#include "core.h"
+
+/*
+ * Jobs for "async": true requests. The request is answered at once with a
+ * job id, runs on the job lane, and its outcome (the standard envelope
+ * plus job_id) is published to the request's "notify" subject or to
+ * <prefix>.jobs.<job_id>. Finished jobs stay queryable through job.status
+ * for job_ttl_ms; the table holds at most job_max jobs and evicts the
+ * oldest finished ones first. Only jobs still waiting for a worker can be
+ * cancelled.
+ */
+#define COMMAND_JOB_ID_SIZE (SWITCH_UUID_FORMATTED_LENGTH + 1)
+
+typedef enum {
+    COMMAND_JOB_QUEUED,
+    COMMAND_JOB_RUNNING,
+    COMMAND_JOB_COMPLETED,
+    COMMAND_JOB_FAILED,
+    COMMAND_JOB_CANCELLED
+} command_job_state_t;
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t jobs;
+    uint32_t queued;
+    uint32_t running;
+    uint64_t created;
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t cancelled;
+    uint64_t expired;
+    uint64_t rejected;
+} command_jobs_stats_t;
+
+switch_status_t command_jobs_init(event_driver_t *driver, switch_memory_pool_t *pool);
+void command_jobs_shutdown(void);
+switch_status_t command_jobs_register(void);
+
+/* Adds a queued job and writes its id; SWITCH_STATUS_FALSE when the table is full of unfinished jobs */
+switch_status_t command_job_create(const char *command, const char *notify, char *id, size_t id_size);
+/* Moves a queued job to running; false if it was cancelled or is gone */
+switch_bool_t command_job_begin(const char *id);
+/* Records the outcome and publishes the notification; takes ownership of data */
+void command_job_finish(const char *id, switch_bool_t success, const char *message, cJSON *data);
+
+/* Subject the job's outcome is published on when the request names no "notify" subject */
+void command_job_subject(const char *id, char *subject, size_t size);
+
+void command_jobs_get_stats(command_jobs_stats_t *stats);
+
+#endif
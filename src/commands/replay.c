@@ -0,0 +1,116 @@
+#include "replay.h"
+#include "../events/retention.h"
+#include "../events/serializer.h"
+
+/* One request may not pin more than this many payloads in memory */
+#define REPLAY_MAX_RANGE 10000
+
+#define REPLAY_SUBJECT_HEADER "Event-Agent-Subject"
+#define REPLAY_SEQ_HEADER "Event-Agent-Seq"
+#define REPLAY_DROPPED_HEADER "Event-Agent-Dropped"
+#define REPLAY_TYPE_SEQ_HEADER "Event-Agent-Type-Seq"
+
+typedef struct {
+    const char *reply_to;
+    const char *content_type;
+    uint32_t dropped;
+} replay_target_t;
+
+static switch_status_t replay_visit(uint64_t seq, const char *subject, const char *data, size_t len, uint64_t type_seq, void *user_data) {
+    replay_target_t *target = (replay_target_t *)user_data;
+    driver_header_t headers[4];
+    size_t header_count = 0;
+    char seq_str[32];
+    char type_seq_str[32];
+
+    switch_snprintf(seq_str, sizeof(seq_str), "%llu", (unsigned long long)seq);
+    headers[header_count].name = REPLAY_SUBJECT_HEADER;
+    headers[header_count++].value = subject;
+    headers[header_count].name = REPLAY_SEQ_HEADER;
+    headers[header_count++].value = seq_str;
+
+    /* Taken by an event that failed to encode: an empty message closes the hole for the consumer */
+    if (!data) {
+        switch_snprintf(type_seq_str, sizeof(type_seq_str), "%llu", (unsigned long long)type_seq);
+        headers[header_count].name = REPLAY_DROPPED_HEADER;
+        headers[header_count++].value = "true";
+        headers[header_count].name = REPLAY_TYPE_SEQ_HEADER;
+        headers[header_count++].value = type_seq_str;
+        target->dropped++;
+        return globals.driver->publish_with_headers(globals.driver, target->reply_to, headers, header_count, "", 0);
+    }
+
+    if (target->content_type) {
+        headers[header_count].name = EVENT_CONTENT_TYPE_HEADER;
+        headers[header_count++].value = target->content_type;
+    }
+
+    return globals.driver->publish_with_headers(globals.driver, target->reply_to, headers, header_count, data, len);
+}
+
+static command_result_t handle_replay_command(const command_request_t *request) {
+    cJSON *from_item = request->payload ? cJSON_GetObjectItemCaseSensitive(request->payload, "from") : NULL;
+    cJSON *to_item = request->payload ? cJSON_GetObjectItemCaseSensitive(request->payload, "to") : NULL;
+    event_retention_stats_t stats;
+    replay_target_t target = { 0 };
+    uint64_t from, to, newest;
+    uint32_t replayed, missing = 0;
+
+    if (!event_retention_enabled()) {
+        return command_result_error("Event retention is disabled");
+    }
+    if (switch_strlen_zero(request->reply_to)) {
+        return command_result_error("events.replay needs a reply inbox");
+    }
+    if (!globals.driver || !globals.driver->publish_with_headers) {
+        return command_result_error("Driver cannot publish replayed events");
+    }
+    if (!from_item || !cJSON_IsNumber(from_item) || from_item->valuedouble < 1) {
+        return command_result_error("Missing or invalid 'from' sequence");
+    }
+    if (to_item && (!cJSON_IsNumber(to_item) || to_item->valuedouble < from_item->valuedouble)) {
+        return command_result_error("Invalid 'to' sequence");
+    }
+
+    newest = event_sequence_last();
+    from = (uint64_t)from_item->valuedouble;
+    to = to_item ? (uint64_t)to_item->valuedouble : newest;
+    if (to > newest) {
+        to = newest;
+    }
+    if (from <= to && to - from + 1 > REPLAY_MAX_RANGE) {
+        return command_result_error("Range exceeds 10000 events; split the request");
+    }
+
+    target.reply_to = request->reply_to;
+    if (globals.event_format != EVENT_FORMAT_JSON) {
+        target.content_type = event_serializer_get(globals.event_format)->content_type;
+    }
+
+    replayed = from <= to ? event_retention_replay(from, to, replay_visit, &target, &missing) : 0;
+    event_retention_get_stats(&stats);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Replayed %u events (%llu-%llu) to %s, %u missing",
+                      replayed, (unsigned long long)from, (unsigned long long)to, request->reply_to, missing);
+
+    cJSON *data = cJSON_CreateObject();
+    if (!data) {
+        return command_result_error("Failed to allocate replay summary");
+    }
+    cJSON_AddNumberToObject(data, "from", (double)from);
+    cJSON_AddNumberToObject(data, "to", (double)to);
+    cJSON_AddNumberToObject(data, "replayed", (double)replayed);
+    cJSON_AddNumberToObject(data, "missing", (double)missing);
+    cJSON_AddNumberToObject(data, "dropped", (double)target.dropped);
+    cJSON_AddNumberToObject(data, "oldest_retained", (double)stats.oldest_seq);
+    cJSON_AddNumberToObject(data, "newest", (double)newest);
+
+    command_result_t result = command_result_ok();
+    result.message = "Events replayed";
+    result.data = data;
+    return result;
+}
+
+switch_status_t command_replay_register(void) {
+    return command_register_handler_lane("events.replay", handle_replay_command, COMMAND_LANE_BULK);
+}
@@ -0,0 +1,8 @@
+#ifndef COMMAND_REPLAY_H
+#define COMMAND_REPLAY_H
+
+#include "core.h"
+
+switch_status_t command_replay_register(void);
+
+#endif
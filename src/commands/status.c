@@ -1,5 +1,132 @@
 #include "status.h"
 #include "core.h"
+#include "workers.h"
+#include "jobs.h"
+#include "../events/pipeline.h"
+#include "../events/projection.h"
+#include "../events/batch.h"
+#include "../events/delta.h"
+#include "../events/ratelimit.h"
+#include "../events/predicate.h"
+#include "../events/retention.h"
+#include "../core/metrics.h"
+
+static void add_ratelimit_stats(const event_ratelimit_stats_t *stats, void *user_data) {
+    cJSON *limits = (cJSON *)user_data;
+    cJSON *limit = cJSON_CreateObject();
+    if (!limit) {
+        return;
+    }
+
+    cJSON_AddNumberToObject(limit, "rate", (double)stats->rate);
+    cJSON_AddNumberToObject(limit, "burst", (double)stats->burst);
+    cJSON_AddStringToObject(limit, "action", stats->coalesce ? "coalesce" : "drop");
+    if (stats->coalesce) {
+        cJSON_AddStringToObject(limit, "key", stats->key);
+        cJSON_AddNumberToObject(limit, "window_ms", (double)stats->window_ms);
+    }
+    cJSON_AddNumberToObject(limit, "passed", (double)stats->passed);
+    cJSON_AddNumberToObject(limit, "dropped", (double)stats->dropped);
+    if (stats->coalesce) {
+        cJSON_AddNumberToObject(limit, "held", (double)stats->held);
+        cJSON_AddNumberToObject(limit, "coalesced", (double)stats->coalesced);
+        cJSON_AddNumberToObject(limit, "flushed", (double)stats->flushed);
+        cJSON_AddNumberToObject(limit, "pending", (double)stats->pending);
+    }
+    cJSON_AddItemToObject(limits, stats->name, limit);
+}
+
+static void add_filter_stats(const event_predicate_stats_t *stats, void *user_data) {
+    cJSON *filters = (cJSON *)user_data;
+    cJSON *filter = cJSON_CreateObject();
+    if (!filter) {
+        return;
+    }
+
+    cJSON_AddStringToObject(filter, "event", stats->event_name);
+    cJSON_AddStringToObject(filter, "expr", stats->expression);
+    cJSON_AddNumberToObject(filter, "evaluated", (double)stats->evaluated);
+    cJSON_AddNumberToObject(filter, "rejected", (double)stats->rejected);
+    cJSON_AddNumberToObject(filter, "avg_eval_ns", stats->sampled ? (double)stats->sampled_ns / (double)stats->sampled : 0.0);
+    cJSON_AddItemToArray(filters, filter);
+}
+
+static cJSON *latency_to_json(const latency_histogram_t *histogram) {
+    latency_summary_t summary;
+    cJSON *obj = cJSON_CreateObject();
+    if (!obj) {
+        return NULL;
+    }
+
+    histogram_summarize(histogram, &summary);
+    cJSON_AddNumberToObject(obj, "count", (double)summary.count);
+    cJSON_AddNumberToObject(obj, "mean_us", (double)summary.mean_ns / 1000.0);
+    cJSON_AddNumberToObject(obj, "p50_us", (double)summary.p50_ns / 1000.0);
+    cJSON_AddNumberToObject(obj, "p90_us", (double)summary.p90_ns / 1000.0);
+    cJSON_AddNumberToObject(obj, "p99_us", (double)summary.p99_ns / 1000.0);
+    cJSON_AddNumberToObject(obj, "p999_us", (double)summary.p999_ns / 1000.0);
+    cJSON_AddNumberToObject(obj, "max_us", (double)summary.max_ns / 1000.0);
+    return obj;
+}
+
+static cJSON *stage_latency_to_json(void) {
+    cJSON *stages = cJSON_CreateObject();
+    if (!stages) {
+        return NULL;
+    }
+
+    for (int stage = 0; stage < METRICS_STAGE_MAX; stage++) {
+        cJSON *latency = latency_to_json(&metrics_stages[stage]);
+        if (latency) {
+            cJSON_AddItemToObject(stages, metrics_stage_name((metrics_stage_t)stage), latency);
+        }
+    }
+    return stages;
+}
+
+static void add_command_latency(const char *name, const latency_histogram_t *histogram, void *user_data) {
+    cJSON *latency = latency_to_json(histogram);
+    if (latency) {
+        cJSON_AddItemToObject((cJSON *)user_data, name, latency);
+    }
+}
+
+/* Cumulative since load, like the OpenMetrics histograms built from the same data; scrapers diff two reads */
+static command_result_t handle_metrics_command(const command_request_t *request) {
+    cJSON *data_obj = cJSON_CreateObject();
+    if (!data_obj) {
+        return command_result_error("Failed to allocate metrics payload");
+    }
+
+    cJSON_AddBoolToObject(data_obj, "enabled", globals.latency_metrics);
+
+    cJSON *stages = stage_latency_to_json();
+    if (stages) {
+        cJSON_AddItemToObject(data_obj, "stages", stages);
+    }
+
+    cJSON *commands = cJSON_CreateObject();
+    if (commands) {
+        command_foreach_latency(add_command_latency, commands);
+        cJSON_AddItemToObject(data_obj, "commands", commands);
+    }
+
+    cJSON *lane_wait = cJSON_CreateObject();
+    if (lane_wait) {
+        for (int lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+            cJSON *latency = latency_to_json(command_workers_wait_latency((command_lane_t)lane));
+            if (latency) {
+                cJSON_AddItemToObject(lane_wait, command_lane_name((command_lane_t)lane), latency);
+            }
+        }
+        cJSON_AddItemToObject(data_obj, "lane_wait", lane_wait);
+    }
+
+    command_result_t result = command_result_ok();
+    result.message = "Latency metrics";
+    result.data = data_obj;
+    return result;
+}
 
 static command_result_t handle_status_command(const command_request_t *request) {
 
@@ -25,9 +152,264 @@ static command_result_t handle_status_command(const command_request_t *request)
         cJSON_AddNumberToObject(stats, "requests_received", (double)requests_received);
         cJSON_AddNumberToObject(stats, "requests_success", (double)requests_success);
         cJSON_AddNumberToObject(stats, "requests_failed", (double)requests_failed);
+        cJSON_AddNumberToObject(stats, "requests_skipped", (double)command_stats_get_skipped());
         cJSON_AddItemToObject(data_obj, "stats", stats);
     }
 
+    cJSON *lanes = cJSON_CreateObject();
+    if (lanes) {
+        for (int id = 0; id < COMMAND_LANE_MAX; id++) {
+            command_lane_stats_t lane_stats;
+            cJSON *lane = cJSON_CreateObject();
+            if (!lane) {
+                continue;
+            }
+
+            command_workers_get_stats((command_lane_t)id, &lane_stats);
+            cJSON_AddNumberToObject(lane, "workers", (double)lane_stats.workers);
+            cJSON_AddNumberToObject(lane, "capacity", (double)lane_stats.capacity);
+            cJSON_AddNumberToObject(lane, "depth", (double)lane_stats.depth);
+            cJSON_AddNumberToObject(lane, "high_watermark", (double)lane_stats.high_watermark);
+            cJSON_AddNumberToObject(lane, "submitted", (double)lane_stats.submitted);
+            cJSON_AddNumberToObject(lane, "executed", (double)lane_stats.executed);
+            cJSON_AddNumberToObject(lane, "stolen", (double)lane_stats.stolen);
+            cJSON_AddNumberToObject(lane, "rejected", (double)lane_stats.rejected);
+            cJSON_AddNumberToObject(lane, "inline", (double)lane_stats.inline_runs);
+            if (globals.latency_metrics) {
+                cJSON *wait = latency_to_json(command_workers_wait_latency((command_lane_t)id));
+                if (wait) {
+                    cJSON_AddItemToObject(lane, "wait", wait);
+                }
+            }
+            cJSON_AddItemToObject(lanes, command_lane_name((command_lane_t)id), lane);
+        }
+        cJSON_AddItemToObject(data_obj, "command_lanes", lanes);
+    }
+
+    cJSON *jobs = cJSON_CreateObject();
+    if (jobs) {
+        command_jobs_stats_t job_stats;
+        command_jobs_get_stats(&job_stats);
+
+        cJSON_AddNumberToObject(jobs, "capacity", (double)job_stats.capacity);
+        cJSON_AddNumberToObject(jobs, "ttl_ms", (double)globals.job_ttl_ms);
+        cJSON_AddNumberToObject(jobs, "jobs", (double)job_stats.jobs);
+        cJSON_AddNumberToObject(jobs, "queued", (double)job_stats.queued);
+        cJSON_AddNumberToObject(jobs, "running", (double)job_stats.running);
+        cJSON_AddNumberToObject(jobs, "created", (double)job_stats.created);
+        cJSON_AddNumberToObject(jobs, "completed", (double)job_stats.completed);
+        cJSON_AddNumberToObject(jobs, "failed", (double)job_stats.failed);
+        cJSON_AddNumberToObject(jobs, "cancelled", (double)job_stats.cancelled);
+        cJSON_AddNumberToObject(jobs, "expired", (double)job_stats.expired);
+        cJSON_AddNumberToObject(jobs, "rejected", (double)job_stats.rejected);
+        cJSON_AddItemToObject(data_obj, "jobs", jobs);
+    }
+
+    uint64_t counters[AGENT_COUNTER_MAX];
+    counter_snapshot(&globals.counters, counters, AGENT_COUNTER_MAX);
+
+    cJSON *events = cJSON_CreateObject();
+    if (events) {
+        cJSON_AddNumberToObject(events, "published", (double)counters[AGENT_COUNTER_EVENTS_PUBLISHED]);
+        cJSON_AddNumberToObject(events, "failed", (double)counters[AGENT_COUNTER_EVENTS_FAILED]);
+        cJSON_AddNumberToObject(events, "skipped_no_subscribers", (double)counters[AGENT_COUNTER_EVENTS_SKIPPED_NO_SUBSCRIBERS]);
+        cJSON_AddNumberToObject(events, "bytes", (double)counters[AGENT_COUNTER_BYTES_PUBLISHED]);
+        cJSON_AddItemToObject(data_obj, "events", events);
+    }
+
+    event_pipeline_stats_t pipeline_stats;
+    event_pipeline_get_stats(&pipeline_stats);
+
+    cJSON *queue = cJSON_CreateObject();
+    if (queue) {
+        cJSON_AddNumberToObject(queue, "publisher_threads", (double)pipeline_stats.threads);
+        cJSON_AddNumberToObject(queue, "capacity", (double)pipeline_stats.capacity);
+        cJSON_AddNumberToObject(queue, "depth", (double)pipeline_stats.depth);
+        cJSON_AddNumberToObject(queue, "high_watermark", (double)pipeline_stats.high_watermark);
+        cJSON_AddNumberToObject(queue, "enqueued", (double)pipeline_stats.enqueued);
+        cJSON_AddNumberToObject(queue, "dropped", (double)pipeline_stats.dropped);
+        cJSON_AddNumberToObject(queue, "blocked", (double)pipeline_stats.blocked);
+        cJSON_AddStringToObject(queue, "overflow", globals.queue_overflow == EVENT_QUEUE_OVERFLOW_BLOCK ? "block" : "drop");
+
+        cJSON *shards = cJSON_CreateArray();
+        if (shards) {
+            for (uint32_t i = 0; i < pipeline_stats.threads; i++) {
+                cJSON_AddItemToArray(shards, cJSON_CreateNumber((double)pipeline_stats.shard_depth[i]));
+            }
+            cJSON_AddItemToObject(queue, "shard_depth", shards);
+        }
+        cJSON_AddItemToObject(data_obj, "queue", queue);
+    }
+
+    if (globals.batch_max_events > 1) {
+        event_batch_stats_t batch_stats;
+        event_batch_get_stats(&batch_stats);
+
+        cJSON *batch = cJSON_CreateObject();
+        if (batch) {
+            cJSON_AddNumberToObject(batch, "batches", (double)batch_stats.batches);
+            cJSON_AddNumberToObject(batch, "events", (double)batch_stats.events);
+            cJSON_AddNumberToObject(batch, "avg_batch_events", batch_stats.batches ? (double)batch_stats.events / (double)batch_stats.batches : 0.0);
+            cJSON_AddNumberToObject(batch, "max_batch_events", (double)batch_stats.max_batch_events);
+            cJSON_AddNumberToObject(batch, "avg_added_latency_us", batch_stats.events ? (double)batch_stats.latency_us_total / (double)batch_stats.events : 0.0);
+            cJSON_AddNumberToObject(batch, "max_added_latency_us", (double)batch_stats.latency_us_max);
+            cJSON_AddItemToObject(data_obj, "batch", batch);
+        }
+    }
+
+    if (globals.delta_mode) {
+        event_delta_stats_t delta_stats;
+        event_delta_get_stats(&delta_stats);
+
+        cJSON *delta = cJSON_CreateObject();
+        if (delta) {
+            cJSON_AddNumberToObject(delta, "calls", (double)delta_stats.calls);
+            cJSON_AddNumberToObject(delta, "max_calls", (double)globals.delta_max_calls);
+            cJSON_AddNumberToObject(delta, "memory_bytes", (double)delta_stats.memory_bytes);
+            cJSON_AddNumberToObject(delta, "avg_call_bytes", delta_stats.calls ? (double)delta_stats.memory_bytes / (double)delta_stats.calls : 0.0);
+            cJSON_AddNumberToObject(delta, "max_call_bytes", (double)globals.delta_max_call_bytes);
+            cJSON_AddNumberToObject(delta, "keyframes", (double)delta_stats.keyframes);
+            cJSON_AddNumberToObject(delta, "deltas", (double)delta_stats.deltas);
+            cJSON_AddNumberToObject(delta, "untracked", (double)delta_stats.untracked);
+            cJSON_AddNumberToObject(delta, "oversized", (double)delta_stats.oversized);
+            cJSON_AddNumberToObject(delta, "expired", (double)delta_stats.expired);
+            cJSON_AddItemToObject(data_obj, "delta", delta);
+        }
+    }
+
+    if (globals.driver && globals.driver->get_stats) {
+        driver_stats_t driver_stats;
+        globals.driver->get_stats(globals.driver, &driver_stats);
+
+        cJSON *driver = cJSON_CreateObject();
+        if (driver) {
+            cJSON_AddStringToObject(driver, "name", globals.driver->name);
+            cJSON_AddBoolToObject(driver, "connected", globals.driver->is_connected(globals.driver));
+            cJSON_AddNumberToObject(driver, "sent", (double)driver_stats.sent);
+            cJSON_AddNumberToObject(driver, "failed", (double)driver_stats.failed);
+            cJSON_AddNumberToObject(driver, "bytes", (double)driver_stats.bytes);
+            cJSON_AddNumberToObject(driver, "reconnects", (double)driver_stats.reconnects);
+
+            cJSON *overflow = cJSON_CreateObject();
+            if (overflow) {
+                cJSON_AddStringToObject(overflow, "policy", driver_stats.overflow_policy ? driver_stats.overflow_policy : "none");
+                cJSON_AddNumberToObject(overflow, "buffer_size", (double)driver_stats.buffer_size);
+                cJSON_AddNumberToObject(overflow, "buffered_msgs", (double)driver_stats.buffered_msgs);
+                cJSON_AddNumberToObject(overflow, "buffered_bytes", (double)driver_stats.buffered_bytes);
+                cJSON_AddNumberToObject(overflow, "dropped_newest", (double)driver_stats.dropped_newest);
+                cJSON_AddNumberToObject(overflow, "dropped_oldest", (double)driver_stats.dropped_oldest);
+                cJSON_AddNumberToObject(overflow, "blocked", (double)driver_stats.blocked);
+                cJSON_AddNumberToObject(overflow, "block_timeouts", (double)driver_stats.block_timeouts);
+                cJSON_AddItemToObject(driver, "overflow", overflow);
+            }
+
+            cJSON_AddBoolToObject(driver, "in_outage", driver_stats.in_outage);
+            cJSON_AddNumberToObject(driver, "outages", (double)driver_stats.outages);
+            cJSON_AddNumberToObject(driver, "outage_ms_total", (double)driver_stats.outage_ms_total);
+
+            cJSON *outages = cJSON_CreateArray();
+            if (outages) {
+                for (uint32_t i = 0; i < driver_stats.outage_count; i++) {
+                    cJSON *outage = cJSON_CreateObject();
+                    if (!outage) {
+                        continue;
+                    }
+                    cJSON_AddNumberToObject(outage, "started", (double)(driver_stats.outage[i].started / 1000));
+                    cJSON_AddNumberToObject(outage, "duration_ms", (double)driver_stats.outage[i].duration_ms);
+                    cJSON_AddNumberToObject(outage, "lost", (double)driver_stats.outage[i].lost);
+                    cJSON_AddItemToArray(outages, outage);
+                }
+                cJSON_AddItemToObject(driver, "recent_outages", outages);
+            }
+
+            if (driver_stats.jetstream_enabled) {
+                cJSON *jetstream = cJSON_CreateObject();
+                if (jetstream) {
+                    cJSON_AddNumberToObject(jetstream, "max_pending", (double)driver_stats.js_max_pending);
+                    cJSON_AddNumberToObject(jetstream, "inflight", (double)driver_stats.js_inflight);
+                    cJSON_AddNumberToObject(jetstream, "acked", (double)driver_stats.js_acked);
+                    cJSON_AddNumberToObject(jetstream, "retried", (double)driver_stats.js_retried);
+                    cJSON_AddNumberToObject(jetstream, "failed", (double)driver_stats.js_failed);
+                    cJSON_AddItemToObject(driver, "jetstream", jetstream);
+                }
+            }
+
+            if (driver_stats.spool_enabled) {
+                cJSON *spool = cJSON_CreateObject();
+                if (spool) {
+                    cJSON_AddNumberToObject(spool, "depth", (double)driver_stats.spool_pending);
+                    cJSON_AddNumberToObject(spool, "segments", (double)driver_stats.spool_segments);
+                    cJSON_AddNumberToObject(spool, "disk_bytes", (double)driver_stats.spool_disk_bytes);
+                    cJSON_AddNumberToObject(spool, "appended", (double)driver_stats.spool_appended);
+                    cJSON_AddNumberToObject(spool, "replayed", (double)driver_stats.spool_replayed);
+                    cJSON_AddNumberToObject(spool, "dropped", (double)driver_stats.spool_dropped);
+                    cJSON_AddNumberToObject(spool, "replay_rate_limit", (double)driver_stats.spool_replay_rate);
+                    cJSON_AddNumberToObject(spool, "replay_per_sec", (double)driver_stats.spool_replay_eps);
+                    cJSON_AddItemToObject(driver, "spool", spool);
+                }
+            }
+            cJSON_AddItemToObject(data_obj, "driver", driver);
+        }
+    }
+
+    if (globals.latency_metrics) {
+        cJSON *latency = stage_latency_to_json();
+        if (latency) {
+            cJSON_AddItemToObject(data_obj, "latency", latency);
+        }
+    }
+
+    cJSON *retention = cJSON_CreateObject();
+    if (retention) {
+        event_retention_stats_t retention_stats;
+        event_retention_get_stats(&retention_stats);
+
+        cJSON_AddNumberToObject(retention, "node_seq", (double)event_sequence_last());
+        cJSON_AddBoolToObject(retention, "enabled", event_retention_enabled());
+        cJSON_AddNumberToObject(retention, "events", (double)retention_stats.events);
+        cJSON_AddNumberToObject(retention, "memory_bytes", (double)retention_stats.memory_bytes);
+        cJSON_AddNumberToObject(retention, "oldest_seq", (double)retention_stats.oldest_seq);
+        cJSON_AddNumberToObject(retention, "newest_seq", (double)retention_stats.newest_seq);
+        cJSON_AddNumberToObject(retention, "hits", (double)retention_stats.hits);
+        cJSON_AddNumberToObject(retention, "misses", (double)retention_stats.misses);
+        cJSON_AddNumberToObject(retention, "evicted", (double)retention_stats.evicted);
+        cJSON_AddItemToObject(data_obj, "retention", retention);
+    }
+
+    cJSON *filters = cJSON_CreateArray();
+    if (filters) {
+        event_predicate_foreach_stats(add_filter_stats, filters);
+        cJSON_AddItemToObject(data_obj, "filters", filters);
+    }
+
+    cJSON *limits = cJSON_CreateObject();
+    if (limits) {
+        event_ratelimit_foreach_stats(add_ratelimit_stats, limits);
+        cJSON_AddItemToObject(data_obj, "rate_limits", limits);
+    }
+
+    cJSON *payload = cJSON_CreateObject();
+    if (payload) {
+        for (int id = 0; id < SWITCH_EVENT_ALL; id++) {
+            event_projection_stats_t type_stats;
+            event_projection_get_stats((switch_event_types_t)id, &type_stats);
+            if (!type_stats.events) {
+                continue;
+            }
+
+            cJSON *type_obj = cJSON_CreateObject();
+            if (!type_obj) {
+                continue;
+            }
+            cJSON_AddNumberToObject(type_obj, "events", (double)type_stats.events);
+            cJSON_AddNumberToObject(type_obj, "bytes", (double)type_stats.bytes);
+            cJSON_AddNumberToObject(type_obj, "bytes_unprojected", (double)type_stats.bytes_unprojected);
+            cJSON_AddBoolToObject(type_obj, "projected", event_projection_for((switch_event_types_t)id) != NULL);
+            cJSON_AddItemToObject(payload, switch_event_name((switch_event_types_t)id), type_obj);
+        }
+        cJSON_AddItemToObject(data_obj, "payload", payload);
+    }
+
     command_result_t result = command_result_ok();
     result.message = "Module status";
     result.data = data_obj;
@@ -35,5 +417,8 @@ static command_result_t handle_status_command(const command_request_t *request)
 }
 
 switch_status_t command_status_register(void) {
-    return command_register_handler("agent.status", handle_status_command);
+    if (command_register_handler("agent.status", handle_status_command) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_FALSE;
+    }
+    return command_register_handler("agent.metrics", handle_metrics_command);
 }
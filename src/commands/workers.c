@@ -0,0 +1,415 @@
+#include "workers.h"
+#include "../events/queue.h"
+#include "../core/metrics.h"
+
+#define WORKER_IDLE_WAIT_US 10000
+#define WORKER_MIN_CAPACITY 16
+
+typedef enum {
+    LANE_COUNTER_SUBMITTED,
+    LANE_COUNTER_EXECUTED,
+    LANE_COUNTER_STOLEN,
+    LANE_COUNTER_REJECTED,
+    LANE_COUNTER_INLINE,
+    LANE_COUNTER_MAX
+} lane_counter_t;
+
+struct command_lane_s;
+
+typedef struct {
+    event_queue_t *queue;
+    switch_thread_t *thread;
+    switch_mutex_t *mutex;
+    switch_thread_cond_t *cond;
+    struct command_lane_s *lane;
+    uint32_t sleeping;
+    uint32_t index;
+} command_worker_t;
+
+typedef struct command_lane_s {
+    command_worker_t *workers;
+    uint32_t count;
+    uint32_t next;
+    uint32_t high_watermark;
+    uint32_t spawn_max;     /* non-zero: no workers, each work item gets its own thread */
+    uint32_t running;
+    command_lane_t id;
+    counter_group_t counters;   /* lane_counter_t */
+    latency_histogram_t wait;
+} command_lane_ctx_t;
+
+/* Owned by the thread; the pool it was allocated from is destroyed when the work is done */
+typedef struct {
+    command_lane_ctx_t *lane;
+    command_work_t *work;
+    switch_memory_pool_t *pool;
+} command_spawn_t;
+
+static const char *g_lane_names[COMMAND_LANE_MAX] = {"fast", "bulk", "job"};
+static command_lane_ctx_t g_lanes[COMMAND_LANE_MAX];
+static uint32_t g_stopping = 0;
+
+const char *command_lane_name(command_lane_t lane) {
+    return lane < COMMAND_LANE_MAX ? g_lane_names[lane] : "unknown";
+}
+
+switch_status_t command_lane_parse(const char *name, command_lane_t *lane) {
+    for (int i = 0; i < COMMAND_LANE_MAX; i++) {
+        if (name && !strcasecmp(name, g_lane_names[i])) {
+            *lane = (command_lane_t)i;
+            return SWITCH_STATUS_SUCCESS;
+        }
+    }
+    return SWITCH_STATUS_FALSE;
+}
+
+static uint32_t lane_depth(command_lane_ctx_t *lane) {
+    uint32_t count = __atomic_load_n(&lane->count, __ATOMIC_ACQUIRE);
+    uint32_t depth = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        depth += event_queue_depth(lane->workers[i].queue);
+    }
+    return depth;
+}
+
+static void note_depth(command_lane_ctx_t *lane, uint32_t depth) {
+    uint32_t seen = __atomic_load_n(&lane->high_watermark, __ATOMIC_RELAXED);
+
+    while (depth > seen) {
+        if (__atomic_compare_exchange_n(&lane->high_watermark, &seen, depth, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+static void worker_wake(command_worker_t *worker) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&worker->sleeping, __ATOMIC_RELAXED)) {
+        switch_mutex_lock(worker->mutex);
+        switch_thread_cond_signal(worker->cond);
+        switch_mutex_unlock(worker->mutex);
+    }
+}
+
+/* Sleeps only while the whole lane is empty, so a worker never idles next to a sibling's backlog */
+static void worker_wait(command_worker_t *worker) {
+    switch_mutex_lock(worker->mutex);
+    __atomic_store_n(&worker->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (!lane_depth(worker->lane) && !__atomic_load_n(&g_stopping, __ATOMIC_RELAXED)) {
+        switch_thread_cond_timedwait(worker->cond, worker->mutex, WORKER_IDLE_WAIT_US);
+    }
+
+    __atomic_store_n(&worker->sleeping, 0, __ATOMIC_RELAXED);
+    switch_mutex_unlock(worker->mutex);
+}
+
+static void run_work(command_lane_ctx_t *lane, command_work_t *work) {
+    metrics_lap(&lane->wait, work->enqueued_ns);
+    counter_inc(&lane->counters, LANE_COUNTER_EXECUTED);
+    work->run(work);
+}
+
+static command_work_t *steal_work(command_worker_t *worker) {
+    command_lane_ctx_t *lane = worker->lane;
+    command_work_t *work;
+
+    for (uint32_t i = 1; i < lane->count; i++) {
+        command_worker_t *victim = &lane->workers[(worker->index + i) % lane->count];
+
+        if ((work = (command_work_t *)event_queue_steal(victim->queue))) {
+            counter_inc(&lane->counters, LANE_COUNTER_STOLEN);
+            return work;
+        }
+    }
+    return NULL;
+}
+
+static void *SWITCH_THREAD_FUNC command_worker_thread(switch_thread_t *thread, void *obj) {
+    command_worker_t *worker = (command_worker_t *)obj;
+    command_work_t *work;
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Command worker %s/%u started",
+                      g_lane_names[worker->lane->id], worker->index);
+
+    for (;;) {
+        if ((work = (command_work_t *)event_queue_steal(worker->queue)) || (work = steal_work(worker))) {
+            run_work(worker->lane, work);
+            continue;
+        }
+
+        if (__atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        worker_wait(worker);
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Command worker %s/%u stopped",
+                      g_lane_names[worker->lane->id], worker->index);
+    return NULL;
+}
+
+/* bgapi style: a detached thread with its own pool, so a ringing originate never holds a shared worker */
+static void *SWITCH_THREAD_FUNC command_spawn_thread(switch_thread_t *thread, void *obj) {
+    command_spawn_t *spawn = (command_spawn_t *)obj;
+    command_lane_ctx_t *lane = spawn->lane;
+    switch_memory_pool_t *pool = spawn->pool;
+
+    run_work(lane, spawn->work);
+    switch_core_destroy_memory_pool(&pool);
+    __atomic_sub_fetch(&lane->running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static switch_bool_t spawn_work(command_lane_ctx_t *lane, command_work_t *work) {
+    switch_memory_pool_t *pool = NULL;
+    switch_threadattr_t *thd_attr = NULL;
+    switch_thread_t *thread;
+    command_spawn_t *spawn;
+    uint32_t running = __atomic_add_fetch(&lane->running, 1, __ATOMIC_ACQ_REL);
+
+    if (running > lane->spawn_max) {
+        __atomic_sub_fetch(&lane->running, 1, __ATOMIC_RELEASE);
+        return SWITCH_FALSE;
+    }
+
+    if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+        __atomic_sub_fetch(&lane->running, 1, __ATOMIC_RELEASE);
+        return SWITCH_FALSE;
+    }
+    spawn = switch_core_alloc(pool, sizeof(*spawn));
+    spawn->lane = lane;
+    spawn->work = work;
+    spawn->pool = pool;
+
+    switch_threadattr_create(&thd_attr, pool);
+    switch_threadattr_detach_set(thd_attr, 1);
+    switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+    if (switch_thread_create(&thread, thd_attr, command_spawn_thread, spawn, pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to start a thread for command lane %s", g_lane_names[lane->id]);
+        switch_core_destroy_memory_pool(&pool);
+        __atomic_sub_fetch(&lane->running, 1, __ATOMIC_RELEASE);
+        return SWITCH_FALSE;
+    }
+
+    note_depth(lane, running);
+    return SWITCH_TRUE;
+}
+
+switch_status_t command_workers_start(switch_memory_pool_t *pool) {
+    const uint32_t configured[COMMAND_LANE_MAX] = {globals.command_fast_workers, globals.command_bulk_workers, 0};
+    const uint32_t sizes[COMMAND_LANE_MAX] = {globals.command_queue_size, globals.command_queue_size, 0};
+    /* Jobs block for as long as the API call does (an originate rings for seconds), so each runs on its own thread */
+    const uint32_t spawned[COMMAND_LANE_MAX] = {0, 0, globals.job_max};
+    switch_threadattr_t *thd_attr = NULL;
+
+    __atomic_store_n(&g_stopping, 0, __ATOMIC_RELEASE);
+    switch_threadattr_create(&thd_attr, pool);
+    switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+    for (int id = 0; id < COMMAND_LANE_MAX; id++) {
+        command_lane_ctx_t *lane = &g_lanes[id];
+        uint32_t workers = configured[id] > COMMAND_WORKERS_MAX ? COMMAND_WORKERS_MAX : configured[id];
+        uint32_t capacity;
+
+        lane->id = (command_lane_t)id;
+        lane->count = 0;
+        lane->workers = NULL;
+        lane->spawn_max = spawned[id];
+        if (lane->spawn_max) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Command lane %s started (one thread per command, up to %u)",
+                              g_lane_names[id], lane->spawn_max);
+            continue;
+        }
+        if (!workers) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Command lane %s has no workers, running inline", g_lane_names[id]);
+            continue;
+        }
+
+        capacity = (sizes[id] + workers - 1) / workers;
+        if (capacity < WORKER_MIN_CAPACITY) {
+            capacity = WORKER_MIN_CAPACITY;
+        }
+
+        lane->workers = switch_core_alloc(pool, sizeof(command_worker_t) * workers);
+        memset(lane->workers, 0, sizeof(command_worker_t) * workers);
+
+        /* Queues exist before any thread runs, since every worker may steal from all of them */
+        for (uint32_t i = 0; i < workers; i++) {
+            command_worker_t *worker = &lane->workers[i];
+
+            worker->lane = lane;
+            worker->index = i;
+            if (event_queue_create(&worker->queue, capacity, pool) != SWITCH_STATUS_SUCCESS) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to allocate command queue %s/%u", g_lane_names[id], i);
+                command_workers_stop();
+                return SWITCH_STATUS_FALSE;
+            }
+            switch_mutex_init(&worker->mutex, SWITCH_MUTEX_NESTED, pool);
+            switch_thread_cond_create(&worker->cond, pool);
+        }
+        __atomic_store_n(&lane->count, workers, __ATOMIC_RELEASE);
+
+        for (uint32_t i = 0; i < workers; i++) {
+            command_worker_t *worker = &lane->workers[i];
+
+            if (switch_thread_create(&worker->thread, thd_attr, command_worker_thread, worker, pool) != SWITCH_STATUS_SUCCESS) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to start command worker %s/%u", g_lane_names[id], i);
+                command_workers_stop();
+                return SWITCH_STATUS_FALSE;
+            }
+        }
+
+        switch_log_printf(SWITCH_CHANNEL_LOG,
+                          SWITCH_LOG_INFO,
+                          "[mod_event_agent] Command lane %s started (%u workers, %u slots each)",
+                          g_lane_names[id],
+                          workers,
+                          event_queue_capacity(lane->workers[0].queue));
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void command_workers_stop(void) {
+    command_work_t *work;
+
+    __atomic_store_n(&g_stopping, 1, __ATOMIC_RELEASE);
+
+    for (int id = 0; id < COMMAND_LANE_MAX; id++) {
+        command_lane_ctx_t *lane = &g_lanes[id];
+
+        for (uint32_t i = 0; i < lane->count; i++) {
+            command_worker_t *worker = &lane->workers[i];
+            switch_status_t retval;
+
+            switch_mutex_lock(worker->mutex);
+            switch_thread_cond_broadcast(worker->cond);
+            switch_mutex_unlock(worker->mutex);
+
+            if (worker->thread) {
+                switch_thread_join(&retval, worker->thread);
+                worker->thread = NULL;
+            }
+        }
+
+        /* Anything submitted while the workers were exiting still gets its reply */
+        for (uint32_t i = 0; i < lane->count; i++) {
+            while ((work = (command_work_t *)event_queue_steal(lane->workers[i].queue))) {
+                run_work(lane, work);
+            }
+        }
+
+        __atomic_store_n(&lane->count, 0, __ATOMIC_RELEASE);
+
+        /* Detached threads cannot be joined; their replies still need the driver */
+        if (__atomic_load_n(&lane->running, __ATOMIC_ACQUIRE)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Waiting for %u running commands on lane %s",
+                              __atomic_load_n(&lane->running, __ATOMIC_ACQUIRE), g_lane_names[id]);
+            while (__atomic_load_n(&lane->running, __ATOMIC_ACQUIRE)) {
+                switch_yield(WORKER_IDLE_WAIT_US);
+            }
+        }
+    }
+}
+
+switch_bool_t command_workers_submit(command_lane_t id, command_work_t *work) {
+    command_lane_ctx_t *lane;
+    command_worker_t *target = NULL;
+    uint32_t count, start;
+
+    if (id >= COMMAND_LANE_MAX || !work || !work->run) {
+        return SWITCH_FALSE;
+    }
+    lane = &g_lanes[id];
+    count = __atomic_load_n(&lane->count, __ATOMIC_ACQUIRE);
+
+    if (lane->spawn_max && !__atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE)) {
+        work->enqueued_ns = metrics_start();
+        if (!spawn_work(lane, work)) {
+            counter_inc(&lane->counters, LANE_COUNTER_REJECTED);
+            return SWITCH_FALSE;
+        }
+        counter_inc(&lane->counters, LANE_COUNTER_SUBMITTED);
+        return SWITCH_TRUE;
+    }
+
+    if (!count || __atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE)) {
+        counter_inc(&lane->counters, LANE_COUNTER_INLINE);
+        work->enqueued_ns = 0;
+        work->run(work);
+        return SWITCH_TRUE;
+    }
+
+    work->enqueued_ns = metrics_start();
+    start = __atomic_fetch_add(&lane->next, 1, __ATOMIC_RELAXED) % count;
+
+    /* Prefer a worker that is asleep; a busy one would only get it stolen */
+    for (uint32_t i = 0; i < count; i++) {
+        command_worker_t *worker = &lane->workers[(start + i) % count];
+
+        if (__atomic_load_n(&worker->sleeping, __ATOMIC_RELAXED) && event_queue_push(worker->queue, work)) {
+            target = worker;
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; !target && i < count; i++) {
+        command_worker_t *worker = &lane->workers[(start + i) % count];
+
+        if (event_queue_push(worker->queue, work)) {
+            target = worker;
+        }
+    }
+
+    if (!target) {
+        counter_inc(&lane->counters, LANE_COUNTER_REJECTED);
+        return SWITCH_FALSE;
+    }
+
+    counter_inc(&lane->counters, LANE_COUNTER_SUBMITTED);
+    note_depth(lane, lane_depth(lane));
+    worker_wake(target);
+    return SWITCH_TRUE;
+}
+
+void command_workers_get_stats(command_lane_t id, command_lane_stats_t *stats) {
+    uint64_t counters[LANE_COUNTER_MAX];
+    command_lane_ctx_t *lane;
+    uint32_t count;
+
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    if (id >= COMMAND_LANE_MAX) {
+        return;
+    }
+
+    lane = &g_lanes[id];
+    count = __atomic_load_n(&lane->count, __ATOMIC_ACQUIRE);
+    counter_snapshot(&lane->counters, counters, LANE_COUNTER_MAX);
+
+    stats->workers = count;
+    if (lane->spawn_max) {
+        stats->workers = __atomic_load_n(&lane->running, __ATOMIC_ACQUIRE);
+        stats->capacity = lane->spawn_max;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        stats->capacity += event_queue_capacity(lane->workers[i].queue);
+        stats->depth += event_queue_depth(lane->workers[i].queue);
+    }
+    stats->high_watermark = __atomic_load_n(&lane->high_watermark, __ATOMIC_RELAXED);
+    stats->submitted = counters[LANE_COUNTER_SUBMITTED];
+    stats->executed = counters[LANE_COUNTER_EXECUTED];
+    stats->stolen = counters[LANE_COUNTER_STOLEN];
+    stats->rejected = counters[LANE_COUNTER_REJECTED];
+    stats->inline_runs = counters[LANE_COUNTER_INLINE];
+}
+
+const latency_histogram_t *command_workers_wait_latency(command_lane_t id) {
+    return id < COMMAND_LANE_MAX ? &g_lanes[id].wait : NULL;
+}
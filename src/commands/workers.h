@@ -0,0 +1,54 @@
+#ifndef COMMAND_WORKERS_H
+#define COMMAND_WORKERS_H
+
+#include "core.h"
+
+#define COMMAND_WORKERS_MAX 64
+
+/*
+ * Command worker pool. Each lane has its own workers, and each worker has
+ * its own bounded queue. Submissions go to an idle worker of the lane when
+ * there is one (round robin otherwise). A worker whose queue is empty
+ * steals from its siblings, so one slow originate only delays the work
+ * queued behind it until another worker of the lane is free. Work carries
+ * its own copy of the request and reply subject, so every reply goes to
+ * its own requester whichever worker runs it. A lane with no workers runs
+ * its commands inline on the subscription thread. The job lane has no
+ * workers either: each job gets a detached thread, up to job_max at once.
+ */
+typedef struct command_work_s command_work_t;
+typedef void (*command_work_fn)(command_work_t *work);
+
+/* Embedded at the start of the submitter's own task structure; run() owns and frees it */
+struct command_work_s {
+    command_work_fn run;
+    uint64_t enqueued_ns;
+};
+
+typedef struct {
+    uint32_t workers;
+    uint32_t capacity;
+    uint32_t depth;
+    uint32_t high_watermark;
+    uint64_t submitted;
+    uint64_t executed;
+    uint64_t stolen;
+    uint64_t rejected;
+    uint64_t inline_runs;
+} command_lane_stats_t;
+
+switch_status_t command_workers_start(switch_memory_pool_t *pool);
+/* Stops accepting work, finishes what is queued and joins the workers */
+void command_workers_stop(void);
+
+/* Returns SWITCH_FALSE when the lane's queues are full; the caller keeps ownership then */
+switch_bool_t command_workers_submit(command_lane_t lane, command_work_t *work);
+
+const char *command_lane_name(command_lane_t lane);
+switch_status_t command_lane_parse(const char *name, command_lane_t *lane);
+
+void command_workers_get_stats(command_lane_t lane, command_lane_stats_t *stats);
+/* Time between submit and a worker picking the work up (latency_metrics=true) */
+const latency_histogram_t *command_workers_wait_latency(command_lane_t lane);
+
+#endif
@@ -1,10 +1,67 @@
 #include "mod_event_agent.h"
+#include "events/subject.h"
+#include "events/serializer.h"
+#include "events/projection.h"
+#include "events/ratelimit.h"
+#include "events/predicate.h"
 
 #define EVENT_FILTER_CAP 128
 
+static void filter_set_bit(uint32_t *bits, switch_event_types_t id)
+{
+    bits[id >> 5] |= 1u << (id & 31);
+}
+
+static void compile_filter_list(char **names, uint32_t count, uint32_t *bits, switch_hash_t **subclasses, const char *kind)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        switch_event_types_t id;
+        const char *name = names[i];
+
+        if (zstr(name)) continue;
+
+        while (*name == ' ') name++;
+
+        if (!strncasecmp(name, "CUSTOM ", 7)) {
+            name += 7;
+            while (*name == ' ') name++;
+        } else if (switch_name_event(name, &id) == SWITCH_STATUS_SUCCESS) {
+            if (id == SWITCH_EVENT_ALL) {
+                memset(bits, 0xff, sizeof(uint32_t) * EVENT_FILTER_WORDS);
+            } else {
+                filter_set_bit(bits, id);
+            }
+            continue;
+        } else if (!strstr(name, "::")) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Unknown event '%s' in %s list, treating it as a CUSTOM subclass", name, kind);
+        }
+
+        if (zstr(name)) continue;
+
+        if (!*subclasses) {
+            switch_core_hash_init_nocase(subclasses);
+        }
+        switch_core_hash_insert(*subclasses, name, name);
+    }
+}
+
+static void compile_event_filter(void)
+{
+    event_filter_t *filter = &globals.event_filter;
+
+    compile_filter_list(globals.include_events, globals.include_count, filter->include, &filter->include_subclasses, "include");
+    compile_filter_list(globals.exclude_events, globals.exclude_count, filter->exclude, &filter->exclude_subclasses, "exclude");
+    filter->has_include = globals.include_count > 0 ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
 switch_status_t event_agent_config_load(switch_memory_pool_t *pool)
 {
-    switch_xml_t cfg, xml, settings, param;
+    switch_xml_t cfg, xml, settings, param, projections, limits, filters;
+    switch_bool_t interest_tracking = SWITCH_FALSE;
+    char *interest_subject = NULL;
+    char *jetstream_subjects = NULL;
     const char *name, *value;
 
     switch_core_hash_init(&globals.config);
@@ -14,16 +71,47 @@ switch_status_t event_agent_config_load(switch_memory_pool_t *pool)
     globals.node_id = switch_core_sprintf(pool, "fs-node-%s", switch_core_get_switchname());
     slugify_node_id(globals.node_id);
     globals.publish_all_events = SWITCH_TRUE;
+    globals.subject_shards = 0;
+    globals.event_format = EVENT_FORMAT_JSON;
     globals.include_events = NULL;
     globals.exclude_events = NULL;
     globals.include_count = 0;
     globals.exclude_count = 0;
+    memset(&globals.event_filter, 0, sizeof(globals.event_filter));
+    event_projections_reset();
+    event_ratelimits_reset();
+    event_predicates_reset();
+    globals.publisher_threads = 2;
+    globals.queue_size = 16384;
+    globals.queue_overflow = EVENT_QUEUE_OVERFLOW_DROP;
+    globals.queue_block_timeout_ms = 1000;
+    globals.queue_drain_timeout_ms = 5000;
+    globals.batch_max_events = 0;
+    globals.batch_max_bytes = 256 * 1024;
+    globals.batch_linger_ms = 5;
+    globals.batch_subject = NULL;
+    globals.delta_mode = SWITCH_FALSE;
+    globals.delta_keyframe_interval = 50;
+    globals.delta_max_calls = 20000;
+    globals.delta_max_call_bytes = 32 * 1024;
+    globals.delta_idle_timeout = 7200;
+    globals.command_fast_workers = 2;
+    globals.command_bulk_workers = 4;
+    globals.command_queue_size = 1024;
+    globals.command_fast_lane = NULL;
+    globals.command_bulk_lane = NULL;
+    globals.job_max = 10000;
+    globals.job_ttl_ms = 300000;
+    globals.jetstream = SWITCH_FALSE;
+    globals.latency_metrics = SWITCH_TRUE;
+    globals.retention_max_events = 0;
+    globals.retention_max_bytes = 16 * 1024 * 1024;
 
     switch_core_hash_insert(globals.config, "url", "nats://127.0.0.1:4222");
 
     if (!(xml = switch_xml_open_cfg("event_agent.conf", &cfg, NULL))) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Failed to open event_agent.conf.xml, using defaults");
-        return SWITCH_STATUS_SUCCESS;
+        return event_subjects_init(pool);
     }
 
     if (!(settings = switch_xml_child(cfg, "settings"))) {
@@ -52,6 +140,10 @@ switch_status_t event_agent_config_load(switch_memory_pool_t *pool)
         else if (!strcasecmp(name, "subject_prefix")) {
             globals.subject_prefix = switch_core_strdup(pool, value);
         }
+        else if (!strcasecmp(name, "subject_shards")) {
+            int shards = atoi(value);
+            globals.subject_shards = shards > 1 ? (uint32_t)shards : 0;
+        }
         else if (!strcasecmp(name, "node_id")) {
             globals.node_id = switch_core_strdup(pool, value);
             slugify_node_id(globals.node_id);
@@ -60,6 +152,141 @@ switch_status_t event_agent_config_load(switch_memory_pool_t *pool)
         else if (!strcasecmp(name, "publish_all_events")) {
             globals.publish_all_events = switch_true(value);
         }
+        else if (!strcasecmp(name, "format")) {
+            if (event_serializer_parse_format(value, &globals.event_format) != SWITCH_STATUS_SUCCESS) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Unknown event format '%s', using json", value);
+                globals.event_format = EVENT_FORMAT_JSON;
+            }
+        }
+        else if (!strcasecmp(name, "interest_tracking")) {
+            interest_tracking = switch_true(value);
+        }
+        else if (!strcasecmp(name, "interest_subject")) {
+            interest_subject = switch_core_strdup(pool, value);
+        }
+        else if (!strcasecmp(name, "interest_ttl_ms")) {
+            switch_core_hash_insert(globals.config, "interest_ttl_ms", switch_core_strdup(pool, value));
+        }
+        else if (!strcasecmp(name, "latency_metrics")) {
+            globals.latency_metrics = switch_true(value);
+        }
+        else if (!strcasecmp(name, "metrics_publish_interval_ms")) {
+            int interval = atoi(value);
+            globals.metrics_publish_interval_ms = interval > 0 ? (uint32_t)interval : 0;
+        }
+        else if (!strcasecmp(name, "retention_max_events")) {
+            int events = atoi(value);
+            globals.retention_max_events = events > 0 ? (uint32_t)events : 0;
+        }
+        else if (!strcasecmp(name, "retention_max_bytes")) {
+            globals.retention_max_bytes = (uint64_t)strtoull(value, NULL, 10);
+        }
+        else if (!strcasecmp(name, "jetstream")) {
+            globals.jetstream = switch_true(value);
+        }
+        else if (!strcasecmp(name, "jetstream_subjects")) {
+            jetstream_subjects = switch_core_strdup(pool, value);
+        }
+        else if (!strcasecmp(name, "jetstream_max_pending") || !strcasecmp(name, "jetstream_ack_wait_ms") ||
+                 !strcasecmp(name, "jetstream_max_retries")) {
+            switch_core_hash_insert(globals.config, name, switch_core_strdup(pool, value));
+        }
+        else if (!strcasecmp(name, "reconnect_buffer_size") || !strcasecmp(name, "overflow_policy") ||
+                 !strcasecmp(name, "overflow_block_timeout_ms") || !strcasecmp(name, "priority_subjects") ||
+                 !strcasecmp(name, "spool_dir") || !strcasecmp(name, "spool_segment_size") ||
+                 !strcasecmp(name, "spool_max_bytes") || !strcasecmp(name, "spool_replay_rate") ||
+                 !strcasecmp(name, "loopback_ring_size") || !strcasecmp(name, "loopback_dispatch")) {
+            switch_core_hash_insert(globals.config, name, switch_core_strdup(pool, value));
+        }
+        else if (!strcasecmp(name, "publisher_threads")) {
+            int threads = atoi(value);
+            globals.publisher_threads = threads > 0 ? (uint32_t)threads : 1;
+        }
+        else if (!strcasecmp(name, "queue_size")) {
+            int size = atoi(value);
+            if (size > 0) globals.queue_size = (uint32_t)size;
+        }
+        else if (!strcasecmp(name, "queue_overflow")) {
+            if (!strcasecmp(value, "block")) {
+                globals.queue_overflow = EVENT_QUEUE_OVERFLOW_BLOCK;
+            } else if (!strcasecmp(value, "drop")) {
+                globals.queue_overflow = EVENT_QUEUE_OVERFLOW_DROP;
+            } else {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Unknown queue_overflow '%s', using drop", value);
+                globals.queue_overflow = EVENT_QUEUE_OVERFLOW_DROP;
+            }
+        }
+        else if (!strcasecmp(name, "queue_block_timeout_ms")) {
+            int timeout = atoi(value);
+            globals.queue_block_timeout_ms = timeout > 0 ? (uint32_t)timeout : 0;
+        }
+        else if (!strcasecmp(name, "queue_drain_timeout_ms")) {
+            int timeout = atoi(value);
+            globals.queue_drain_timeout_ms = timeout > 0 ? (uint32_t)timeout : 0;
+        }
+        else if (!strcasecmp(name, "command_fast_workers")) {
+            int workers = atoi(value);
+            globals.command_fast_workers = workers > 0 ? (uint32_t)workers : 0;
+        }
+        else if (!strcasecmp(name, "command_bulk_workers")) {
+            int workers = atoi(value);
+            globals.command_bulk_workers = workers > 0 ? (uint32_t)workers : 0;
+        }
+        else if (!strcasecmp(name, "command_queue_size")) {
+            int size = atoi(value);
+            if (size > 0) globals.command_queue_size = (uint32_t)size;
+        }
+        else if (!strcasecmp(name, "command_fast_lane")) {
+            globals.command_fast_lane = switch_core_strdup(pool, value);
+        }
+        else if (!strcasecmp(name, "command_bulk_lane")) {
+            globals.command_bulk_lane = switch_core_strdup(pool, value);
+        }
+        else if (!strcasecmp(name, "job_workers")) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] job_workers is ignored: every job runs on its own thread, up to job_max");
+        }
+        else if (!strcasecmp(name, "job_max")) {
+            int jobs = atoi(value);
+            if (jobs > 0) globals.job_max = (uint32_t)jobs;
+        }
+        else if (!strcasecmp(name, "job_ttl_ms")) {
+            int ttl = atoi(value);
+            globals.job_ttl_ms = ttl > 0 ? (uint32_t)ttl : 0;
+        }
+        else if (!strcasecmp(name, "batch_max_events")) {
+            int events = atoi(value);
+            globals.batch_max_events = events > 0 ? (uint32_t)events : 0;
+        }
+        else if (!strcasecmp(name, "batch_max_bytes")) {
+            int bytes = atoi(value);
+            if (bytes > 0) globals.batch_max_bytes = (uint32_t)bytes;
+        }
+        else if (!strcasecmp(name, "linger_ms")) {
+            int linger = atoi(value);
+            globals.batch_linger_ms = linger > 0 ? (uint32_t)linger : 0;
+        }
+        else if (!strcasecmp(name, "batch_subject")) {
+            globals.batch_subject = switch_core_strdup(pool, value);
+        }
+        else if (!strcasecmp(name, "delta_mode")) {
+            globals.delta_mode = switch_true(value);
+        }
+        else if (!strcasecmp(name, "delta_keyframe_interval")) {
+            int interval = atoi(value);
+            globals.delta_keyframe_interval = interval > 0 ? (uint32_t)interval : 1;
+        }
+        else if (!strcasecmp(name, "delta_max_calls")) {
+            int calls = atoi(value);
+            globals.delta_max_calls = calls > 0 ? (uint32_t)calls : 0;
+        }
+        else if (!strcasecmp(name, "delta_max_call_bytes")) {
+            int bytes = atoi(value);
+            if (bytes > 0) globals.delta_max_call_bytes = (uint32_t)bytes;
+        }
+        else if (!strcasecmp(name, "delta_idle_timeout")) {
+            int timeout = atoi(value);
+            globals.delta_idle_timeout = timeout > 0 ? (uint32_t)timeout : 0;
+        }
         else if (!strcasecmp(name, "include")) {
             globals.include_count = 0;
             globals.include_events = NULL;
@@ -86,8 +313,68 @@ switch_status_t event_agent_config_load(switch_memory_pool_t *pool)
         }
     }
 
+    if ((projections = switch_xml_child(cfg, "projections"))) {
+        for (param = switch_xml_child(projections, "projection"); param; param = param->next) {
+            const char *event_name = switch_xml_attr_soft(param, "event");
+            const char *mode = switch_xml_attr_soft(param, "mode");
+            const char *headers = switch_xml_attr_soft(param, "headers");
+
+            event_projection_add(pool, event_name, !strcasecmp(mode, "deny") ? SWITCH_TRUE : SWITCH_FALSE, headers);
+        }
+    }
+
+    if ((filters = switch_xml_child(cfg, "filters"))) {
+        for (param = switch_xml_child(filters, "filter"); param; param = param->next) {
+            event_predicate_add(pool, switch_xml_attr_soft(param, "event"), switch_xml_attr_soft(param, "expr"));
+        }
+    }
+
+    if ((limits = switch_xml_child(cfg, "rate-limits"))) {
+        for (param = switch_xml_child(limits, "limit"); param; param = param->next) {
+            int rate = atoi(switch_xml_attr_soft(param, "rate"));
+            int burst = atoi(switch_xml_attr_soft(param, "burst"));
+            int window_ms = atoi(switch_xml_attr_soft(param, "window_ms"));
+            int max_keys = atoi(switch_xml_attr_soft(param, "max_keys"));
+
+            event_ratelimit_add(pool,
+                                switch_xml_attr_soft(param, "event"),
+                                rate > 0 ? (uint32_t)rate : 0,
+                                burst > 0 ? (uint32_t)burst : 0,
+                                switch_xml_attr_soft(param, "action"),
+                                switch_xml_attr_soft(param, "key"),
+                                window_ms > 0 ? (uint32_t)window_ms : 0,
+                                max_keys > 0 ? (uint32_t)max_keys : 0);
+        }
+    }
+
 done:
     switch_xml_free(xml);
+
+    if (interest_tracking) {
+        if (!interest_subject) {
+            interest_subject = switch_core_sprintf(pool, "%s.interest", globals.subject_prefix);
+        }
+        switch_core_hash_insert(globals.config, "interest_subject", interest_subject);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Interest tracking enabled on %s", interest_subject);
+    }
+
+    /* Lets the driver tell events (which it may hold, evict or spool) from command replies */
+    switch_core_hash_insert(globals.config, "event_subjects", switch_core_sprintf(pool, "%s.events.>", globals.subject_prefix));
+
+    if (globals.jetstream) {
+        if (!jetstream_subjects) {
+            jetstream_subjects = switch_core_sprintf(pool, "%s.events.>", globals.subject_prefix);
+        }
+        switch_core_hash_insert(globals.config, "jetstream", "true");
+        switch_core_hash_insert(globals.config, "jetstream_subjects", jetstream_subjects);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] JetStream publishing for %s", jetstream_subjects);
+    }
+
+    compile_event_filter();
+
+    if (event_subjects_init(pool) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_FALSE;
+    }
     
     switch_log_printf(SWITCH_CHANNEL_LOG,
                       SWITCH_LOG_INFO,
@@ -100,6 +387,15 @@ done:
 
 void event_agent_config_destroy(void)
 {
+    event_subjects_destroy();
+    event_ratelimits_destroy();
+
+    if (globals.event_filter.include_subclasses) {
+        switch_core_hash_destroy(&globals.event_filter.include_subclasses);
+    }
+    if (globals.event_filter.exclude_subclasses) {
+        switch_core_hash_destroy(&globals.event_filter.exclude_subclasses);
+    }
     if (globals.config) {
         switch_core_hash_destroy(&globals.config);
     }
@@ -0,0 +1,46 @@
+#include "counters.h"
+
+__thread uint32_t counter_thread_shard = 0;
+static uint32_t g_next_shard = 0;
+
+uint32_t counter_assign_shard(void)
+{
+    counter_thread_shard = (__atomic_fetch_add(&g_next_shard, 1, __ATOMIC_RELAXED) % COUNTER_SHARDS) + 1;
+    return counter_thread_shard;
+}
+
+counter_group_t *counter_group_create(switch_memory_pool_t *pool)
+{
+    uintptr_t addr;
+    char *mem;
+
+    /* Pool memory is only pointer aligned */
+    if (!(mem = switch_core_alloc(pool, sizeof(counter_group_t) + COUNTER_CACHE_LINE))) {
+        return NULL;
+    }
+    addr = ((uintptr_t)mem + COUNTER_CACHE_LINE - 1) & ~(uintptr_t)(COUNTER_CACHE_LINE - 1);
+    return (counter_group_t *)addr;
+}
+
+void counter_snapshot(const counter_group_t *group, uint64_t *values, uint32_t count)
+{
+    uint32_t shard, field;
+
+    memset(values, 0, count * sizeof(uint64_t));
+    for (shard = 0; shard < COUNTER_SHARDS; shard++) {
+        for (field = 0; field < count; field++) {
+            values[field] += __atomic_load_n(&group->shard[shard].value[field], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+uint64_t counter_read(const counter_group_t *group, uint32_t field)
+{
+    uint64_t value = 0;
+    uint32_t shard;
+
+    for (shard = 0; shard < COUNTER_SHARDS; shard++) {
+        value += __atomic_load_n(&group->shard[shard].value[field], __ATOMIC_RELAXED);
+    }
+    return value;
+}
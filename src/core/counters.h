@@ -0,0 +1,49 @@
+#ifndef CORE_COUNTERS_H
+#define CORE_COUNTERS_H
+
+#include <switch.h>
+
+#define COUNTER_CACHE_LINE 64
+#define COUNTER_SHARDS 32
+#define COUNTER_FIELDS (COUNTER_CACHE_LINE / sizeof(uint64_t))
+
+/*
+ * Sharded statistics counters. A group holds up to COUNTER_FIELDS related
+ * counters; every thread is given one shard on first use and only writes that
+ * shard's cache line, so increments from the event, publisher and NATS threads
+ * do not bounce lines between cores. Readers sum all shards.
+ */
+typedef struct {
+    uint64_t value[COUNTER_FIELDS];
+} __attribute__((aligned(COUNTER_CACHE_LINE))) counter_shard_t;
+
+typedef struct {
+    counter_shard_t shard[COUNTER_SHARDS];
+} counter_group_t;
+
+/* 1-based so zero-initialised TLS means "not assigned yet" */
+extern __thread uint32_t counter_thread_shard;
+uint32_t counter_assign_shard(void);
+
+/* Shards can still be shared once there are more threads than shards, hence the atomic add */
+static inline void counter_add(counter_group_t *group, uint32_t field, uint64_t n) {
+    uint32_t shard = counter_thread_shard;
+
+    if (__builtin_expect(!shard, 0)) {
+        shard = counter_assign_shard();
+    }
+    __atomic_fetch_add(&group->shard[shard - 1].value[field], n, __ATOMIC_RELAXED);
+}
+
+static inline void counter_inc(counter_group_t *group, uint32_t field) {
+    counter_add(group, field, 1);
+}
+
+/* Cache-line aligned group from a pool, for contexts that are pool allocated */
+counter_group_t *counter_group_create(switch_memory_pool_t *pool);
+
+/* Sums fields [0, count) in one pass over the shards */
+void counter_snapshot(const counter_group_t *group, uint64_t *values, uint32_t count);
+uint64_t counter_read(const counter_group_t *group, uint32_t field);
+
+#endif /* CORE_COUNTERS_H */
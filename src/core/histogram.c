@@ -0,0 +1,150 @@
+#include "histogram.h"
+
+static uint32_t bucket_index(uint64_t value)
+{
+    uint32_t shift;
+
+    if (value < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return (uint32_t)value;
+    }
+
+    shift = (uint32_t)(63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS;
+    if (shift > HISTOGRAM_MAX_SHIFT) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (uint32_t)(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+/* Highest value that maps to the bucket, so percentiles never under-report */
+static uint64_t bucket_upper(uint32_t index)
+{
+    uint32_t shift;
+    uint64_t sub;
+
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    sub = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+static uint64_t bucket_mid(uint32_t index)
+{
+    uint32_t shift;
+
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    return bucket_upper(index) - ((1ULL << shift) >> 1);
+}
+
+void histogram_record(latency_histogram_t *histogram, uint64_t value_ns)
+{
+    uint32_t id = counter_thread_shard;
+    histogram_shard_t *shard;
+    uint64_t seen;
+
+    if (__builtin_expect(!id, 0)) {
+        id = counter_assign_shard();
+    }
+    shard = &histogram->shard[(id - 1) % HISTOGRAM_SHARDS];
+
+    __atomic_fetch_add(&shard->buckets[bucket_index(value_ns)], 1, __ATOMIC_RELAXED);
+
+    /* Only a new maximum writes; threads sharing a shard settle it with a CAS */
+    seen = __atomic_load_n(&shard->max_ns, __ATOMIC_RELAXED);
+    while (value_ns > seen && !__atomic_compare_exchange_n(&shard->max_ns, &seen, value_ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* Sums the shards into counts; returns the largest max_ns */
+static uint64_t histogram_merge(const latency_histogram_t *histogram, uint64_t *counts)
+{
+    uint64_t max_ns = 0;
+    uint32_t s, i;
+
+    memset(counts, 0, HISTOGRAM_BUCKETS * sizeof(uint64_t));
+    for (s = 0; s < HISTOGRAM_SHARDS; s++) {
+        const histogram_shard_t *shard = &histogram->shard[s];
+        uint64_t shard_max = __atomic_load_n(&shard->max_ns, __ATOMIC_RELAXED);
+
+        for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            counts[i] += __atomic_load_n(&shard->buckets[i], __ATOMIC_RELAXED);
+        }
+        if (shard_max > max_ns) {
+            max_ns = shard_max;
+        }
+    }
+    return max_ns;
+}
+
+void histogram_summarize(const latency_histogram_t *histogram, latency_summary_t *summary)
+{
+    static const double quantiles[] = { 0.50, 0.90, 0.99, 0.999 };
+    uint64_t *targets[] = { &summary->p50_ns, &summary->p90_ns, &summary->p99_ns, &summary->p999_ns };
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = 0, seen = 0, max_ns;
+    double sum = 0;
+    uint32_t i, q = 0;
+
+    memset(summary, 0, sizeof(*summary));
+
+    max_ns = histogram_merge(histogram, counts);
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        total += counts[i];
+        sum += (double)counts[i] * (double)bucket_mid(i);
+    }
+    if (!total) {
+        return;
+    }
+
+    summary->count = total;
+    summary->mean_ns = (uint64_t)(sum / (double)total);
+    summary->max_ns = max_ns;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS && q < 4; i++) {
+        seen += counts[i];
+        while (q < 4 && (double)seen >= quantiles[q] * (double)total) {
+            *targets[q++] = bucket_upper(i) < summary->max_ns ? bucket_upper(i) : summary->max_ns;
+        }
+    }
+}
+
+void histogram_reset(latency_histogram_t *histogram)
+{
+    uint32_t s, i;
+
+    for (s = 0; s < HISTOGRAM_SHARDS; s++) {
+        for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            __atomic_store_n(&histogram->shard[s].buckets[i], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&histogram->shard[s].max_ns, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void histogram_cumulative(const latency_histogram_t *histogram, const uint64_t *bounds_ns, uint32_t bound_count,
+                          uint64_t *counts, uint64_t *total, double *sum_ns)
+{
+    uint64_t merged[HISTOGRAM_BUCKETS];
+    uint64_t seen = 0;
+    uint32_t i, b = 0;
+
+    histogram_merge(histogram, merged);
+    *sum_ns = 0;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        uint64_t count = merged[i];
+
+        while (b < bound_count && bucket_upper(i) > bounds_ns[b]) {
+            counts[b++] = seen;
+        }
+        seen += count;
+        *sum_ns += (double)count * (double)bucket_mid(i);
+    }
+    while (b < bound_count) {
+        counts[b++] = seen;
+    }
+    *total = seen;
+}
@@ -0,0 +1,65 @@
+#ifndef CORE_HISTOGRAM_H
+#define CORE_HISTOGRAM_H
+
+#include <switch.h>
+#include "counters.h"
+
+/*
+ * Log-linear latency histogram in nanoseconds, HDR style: every power of two
+ * is split into 16 linear sub-buckets, so any recorded value is reported
+ * within 6.25%. Values up to 2^41 ns (~37 minutes) are tracked; larger ones
+ * land in the last bucket.
+ *
+ * Latencies cluster, so neighbouring buckets share cache lines and would be
+ * hit by every thread at once. Like counter_group_t, a histogram keeps
+ * HISTOGRAM_SHARDS copies, picked by the thread's counter shard, and the
+ * readers merge them. Each record is one relaxed add on its own copy; the
+ * copy's max_ns is only written when the value beats it after a plain read.
+ */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_SHIFT 37
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_SHIFT + 2) * HISTOGRAM_SUB_BUCKETS)
+#define HISTOGRAM_SHARDS 4
+
+/* Padded to whole cache lines; histograms are embedded in pool memory, so no alignment is assumed */
+typedef struct {
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t max_ns;
+    uint64_t pad[COUNTER_FIELDS - 1];
+} histogram_shard_t;
+
+typedef struct {
+    histogram_shard_t shard[HISTOGRAM_SHARDS];
+} latency_histogram_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} latency_summary_t;
+
+static inline uint64_t histogram_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void histogram_record(latency_histogram_t *histogram, uint64_t value_ns);
+void histogram_summarize(const latency_histogram_t *histogram, latency_summary_t *summary);
+void histogram_reset(latency_histogram_t *histogram);
+
+/*
+ * Prometheus-style view: counts[i] is the number of values <= bounds_ns[i]
+ * (bounds ascending, accurate to the bucket width); *total and *sum_ns cover
+ * every recorded value.
+ */
+void histogram_cumulative(const latency_histogram_t *histogram, const uint64_t *bounds_ns, uint32_t bound_count,
+                          uint64_t *counts, uint64_t *total, double *sum_ns);
+
+#endif /* CORE_HISTOGRAM_H */
@@ -0,0 +1,17 @@
+#include "metrics.h"
+
+latency_histogram_t metrics_stages[METRICS_STAGE_MAX];
+
+static const char *g_stage_names[METRICS_STAGE_MAX] = {
+    "event_filter",
+    "event_serialize",
+    "event_publish",
+    "command_parse",
+    "command_execute",
+    "command_reply"
+};
+
+const char *metrics_stage_name(metrics_stage_t stage)
+{
+    return stage < METRICS_STAGE_MAX ? g_stage_names[stage] : "unknown";
+}
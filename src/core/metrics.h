@@ -0,0 +1,43 @@
+#ifndef CORE_METRICS_H
+#define CORE_METRICS_H
+
+#include "../mod_event_agent.h"
+#include "histogram.h"
+
+/* Pipeline stages timed with latency histograms (latency_metrics=true) */
+typedef enum {
+    METRICS_STAGE_EVENT_FILTER,
+    METRICS_STAGE_EVENT_SERIALIZE,
+    METRICS_STAGE_EVENT_PUBLISH,
+    METRICS_STAGE_COMMAND_PARSE,
+    METRICS_STAGE_COMMAND_EXECUTE,
+    METRICS_STAGE_COMMAND_REPLY,
+    METRICS_STAGE_MAX
+} metrics_stage_t;
+
+extern latency_histogram_t metrics_stages[METRICS_STAGE_MAX];
+
+const char *metrics_stage_name(metrics_stage_t stage);
+
+/* Start of a timed section; 0 when latency metrics are off */
+static inline uint64_t metrics_start(void) {
+    return globals.latency_metrics ? histogram_now_ns() : 0;
+}
+
+/* Records the time since start and returns now, so consecutive stages can chain */
+static inline uint64_t metrics_lap(latency_histogram_t *histogram, uint64_t start) {
+    uint64_t now;
+
+    if (!start) {
+        return 0;
+    }
+    now = histogram_now_ns();
+    histogram_record(histogram, now - start);
+    return now;
+}
+
+static inline uint64_t metrics_stage_lap(metrics_stage_t stage, uint64_t start) {
+    return metrics_lap(&metrics_stages[stage], start);
+}
+
+#endif /* CORE_METRICS_H */
@@ -0,0 +1,444 @@
+#include "openmetrics.h"
+#include "metrics.h"
+#include "../events/pipeline.h"
+#include "../events/projection.h"
+#include "../events/batch.h"
+#include "../events/ratelimit.h"
+#include "../events/retention.h"
+#include "../events/buffer.h"
+#include "../events/serializer.h"
+#include "../commands/core.h"
+#include "../commands/workers.h"
+#include "../commands/jobs.h"
+#include <stdarg.h>
+
+#define OPENMETRICS_CHUNK 4096
+#define OPENMETRICS_LABEL_MAX 256
+#define OPENMETRICS_PUBLISH_TICK_US 100000
+
+/* Histogram buckets reported to Prometheus; finer buckets are folded into these */
+static const uint64_t g_bounds_ns[] = {
+    250, 1000, 2500, 10000, 25000, 100000, 250000, 1000000, 2500000,
+    10000000, 25000000, 100000000, 250000000, 1000000000ULL, 2500000000ULL, 10000000000ULL
+};
+static const char *g_bounds_le[] = {
+    "2.5e-07", "1e-06", "2.5e-06", "1e-05", "2.5e-05", "0.0001", "0.00025", "0.001", "0.0025",
+    "0.01", "0.025", "0.1", "0.25", "1.0", "2.5", "10.0"
+};
+#define OPENMETRICS_BOUNDS (sizeof(g_bounds_ns) / sizeof(g_bounds_ns[0]))
+
+typedef struct {
+    char buf[OPENMETRICS_CHUNK];
+    size_t len;
+    openmetrics_sink_t sink;
+    void *user_data;
+} om_writer_t;
+
+static switch_thread_t *g_thread = NULL;
+static volatile switch_bool_t g_running = SWITCH_FALSE;
+static char g_subject[256] = {0};
+
+static void om_flush(om_writer_t *w)
+{
+    if (w->len) {
+        w->buf[w->len] = '\0';
+        w->sink(w->buf, w->len, w->user_data);
+        w->len = 0;
+    }
+}
+
+static void om_printf(om_writer_t *w, const char *fmt, ...)
+{
+    size_t room = sizeof(w->buf) - w->len;
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(w->buf + w->len, room, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return;
+    }
+
+    if ((size_t)n >= room) {
+        om_flush(w);
+        va_start(ap, fmt);
+        n = vsnprintf(w->buf, sizeof(w->buf), fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n >= sizeof(w->buf)) {
+            n = sizeof(w->buf) - 1;
+        }
+    }
+    w->len += (size_t)n;
+}
+
+/* Label values may contain anything a dialplan or config allows */
+static const char *om_escape(const char *in, char *out, size_t size)
+{
+    size_t o = 0;
+
+    for (; in && *in && o + 2 < size; in++) {
+        if (*in == '\\' || *in == '"') {
+            out[o++] = '\\';
+            out[o++] = *in;
+        } else if (*in == '\n') {
+            out[o++] = '\\';
+            out[o++] = 'n';
+        } else {
+            out[o++] = *in;
+        }
+    }
+    out[o] = '\0';
+    return out;
+}
+
+static void om_family(om_writer_t *w, const char *name, const char *type, const char *help)
+{
+    om_printf(w, "# TYPE event_agent_%s %s\n# HELP event_agent_%s %s\n", name, type, name, help);
+}
+
+static void om_counter(om_writer_t *w, const char *name, const char *help, uint64_t value)
+{
+    om_family(w, name, "counter", help);
+    om_printf(w, "event_agent_%s_total %llu\n", name, (unsigned long long)value);
+}
+
+static void om_gauge(om_writer_t *w, const char *name, const char *help, uint64_t value)
+{
+    om_family(w, name, "gauge", help);
+    om_printf(w, "event_agent_%s %llu\n", name, (unsigned long long)value);
+}
+
+static void om_histogram(om_writer_t *w, const char *name, const char *label, const char *value, const latency_histogram_t *histogram)
+{
+    uint64_t counts[OPENMETRICS_BOUNDS];
+    char escaped[OPENMETRICS_LABEL_MAX];
+    uint64_t total;
+    double sum_ns;
+    uint32_t i;
+
+    histogram_cumulative(histogram, g_bounds_ns, OPENMETRICS_BOUNDS, counts, &total, &sum_ns);
+    om_escape(value, escaped, sizeof(escaped));
+
+    for (i = 0; i < OPENMETRICS_BOUNDS; i++) {
+        om_printf(w, "event_agent_%s_bucket{%s=\"%s\",le=\"%s\"} %llu\n", name, label, escaped, g_bounds_le[i], (unsigned long long)counts[i]);
+    }
+    om_printf(w, "event_agent_%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, escaped, (unsigned long long)total);
+    om_printf(w, "event_agent_%s_count{%s=\"%s\"} %llu\n", name, label, escaped, (unsigned long long)total);
+    om_printf(w, "event_agent_%s_sum{%s=\"%s\"} %.9f\n", name, label, escaped, sum_ns / 1e9);
+}
+
+static void render_events(om_writer_t *w)
+{
+    uint64_t counters[AGENT_COUNTER_MAX];
+    event_projection_stats_t type_stats;
+    int id;
+
+    counter_snapshot(&globals.counters, counters, AGENT_COUNTER_MAX);
+    om_counter(w, "events_published", "Events handed to the driver.", counters[AGENT_COUNTER_EVENTS_PUBLISHED]);
+    om_counter(w, "events_failed", "Events lost after serialization.", counters[AGENT_COUNTER_EVENTS_FAILED]);
+    om_counter(w, "events_skipped_no_subscribers", "Events not serialized because no consumer showed interest.", counters[AGENT_COUNTER_EVENTS_SKIPPED_NO_SUBSCRIBERS]);
+    om_counter(w, "published_bytes", "Serialized event bytes handed to the driver.", counters[AGENT_COUNTER_BYTES_PUBLISHED]);
+
+    om_family(w, "events_by_type", "counter", "Serialized events per FreeSWITCH event type.");
+    for (id = 0; id < SWITCH_EVENT_ALL; id++) {
+        event_projection_get_stats((switch_event_types_t)id, &type_stats);
+        if (type_stats.events) {
+            om_printf(w, "event_agent_events_by_type_total{type=\"%s\"} %llu\n", switch_event_name((switch_event_types_t)id), (unsigned long long)type_stats.events);
+        }
+    }
+
+    om_family(w, "event_bytes_by_type", "counter", "Serialized event bytes per FreeSWITCH event type.");
+    for (id = 0; id < SWITCH_EVENT_ALL; id++) {
+        event_projection_get_stats((switch_event_types_t)id, &type_stats);
+        if (type_stats.events) {
+            om_printf(w, "event_agent_event_bytes_by_type_total{type=\"%s\"} %llu\n", switch_event_name((switch_event_types_t)id), (unsigned long long)type_stats.bytes);
+        }
+    }
+}
+
+static void render_queue(om_writer_t *w)
+{
+    event_pipeline_stats_t stats;
+    uint32_t i;
+
+    event_pipeline_get_stats(&stats);
+    om_gauge(w, "queue_depth", "Events waiting for a publisher thread.", stats.depth);
+    om_gauge(w, "queue_capacity", "Publish queue capacity across all shards.", stats.capacity);
+    om_gauge(w, "queue_high_watermark", "Deepest the publish queue has been.", stats.high_watermark);
+    om_counter(w, "queue_enqueued", "Events queued for publishing.", stats.enqueued);
+    om_counter(w, "queue_dropped", "Events dropped because the publish queue was full.", stats.dropped);
+    om_counter(w, "queue_blocked", "Times the event thread waited for queue space.", stats.blocked);
+
+    om_family(w, "queue_shard_depth", "gauge", "Events waiting per publisher thread.");
+    for (i = 0; i < stats.threads; i++) {
+        om_printf(w, "event_agent_queue_shard_depth{shard=\"%u\"} %u\n", i, stats.shard_depth[i]);
+    }
+
+    if (globals.batch_max_events > 1) {
+        event_batch_stats_t batch;
+
+        event_batch_get_stats(&batch);
+        om_counter(w, "batches", "Batched messages published.", batch.batches);
+        om_counter(w, "batch_events", "Events published inside batches.", batch.events);
+    }
+}
+
+static void render_ratelimit_passed(const event_ratelimit_stats_t *stats, void *user_data)
+{
+    char escaped[OPENMETRICS_LABEL_MAX];
+
+    om_printf((om_writer_t *)user_data, "event_agent_ratelimit_passed_total{limit=\"%s\"} %llu\n",
+              om_escape(stats->name, escaped, sizeof(escaped)), (unsigned long long)stats->passed);
+}
+
+static void render_ratelimit_dropped(const event_ratelimit_stats_t *stats, void *user_data)
+{
+    char escaped[OPENMETRICS_LABEL_MAX];
+
+    om_printf((om_writer_t *)user_data, "event_agent_ratelimit_dropped_total{limit=\"%s\"} %llu\n",
+              om_escape(stats->name, escaped, sizeof(escaped)), (unsigned long long)stats->dropped);
+}
+
+static void render_ratelimits(om_writer_t *w)
+{
+    om_family(w, "ratelimit_passed", "counter", "Events let through per rate limit.");
+    event_ratelimit_foreach_stats(render_ratelimit_passed, w);
+    om_family(w, "ratelimit_dropped", "counter", "Events dropped per rate limit.");
+    event_ratelimit_foreach_stats(render_ratelimit_dropped, w);
+}
+
+static void render_retention(om_writer_t *w)
+{
+    event_retention_stats_t stats;
+
+    event_retention_get_stats(&stats);
+    om_gauge(w, "node_seq", "Last event sequence number assigned on this node.", event_sequence_last());
+    om_gauge(w, "retention_events", "Events held for events.replay.", stats.events);
+    om_gauge(w, "retention_memory_bytes", "Memory held by the replay retention ring.", stats.memory_bytes);
+    om_counter(w, "replay_hits", "Requested sequences found in retention.", stats.hits);
+    om_counter(w, "replay_misses", "Requested sequences no longer retained.", stats.misses);
+}
+
+static void render_driver(om_writer_t *w)
+{
+    driver_stats_t stats;
+
+    if (!globals.driver || !globals.driver->get_stats) {
+        return;
+    }
+    globals.driver->get_stats(globals.driver, &stats);
+
+    om_gauge(w, "driver_connected", "1 while the broker connection is up.", globals.driver->is_connected(globals.driver) ? 1 : 0);
+    om_counter(w, "driver_sent", "Messages the driver handed to the broker.", stats.sent);
+    om_counter(w, "driver_failed", "Messages the driver lost.", stats.failed);
+    om_counter(w, "driver_bytes", "Payload bytes the driver handed to the broker.", stats.bytes);
+    om_counter(w, "driver_reconnects", "Broker reconnects.", stats.reconnects);
+    om_gauge(w, "driver_buffered_messages", "Messages held while reconnecting.", stats.buffered_msgs);
+    om_gauge(w, "driver_buffered_bytes", "Bytes held while reconnecting.", stats.buffered_bytes);
+
+    om_family(w, "driver_overflow_dropped", "counter", "Messages dropped by the reconnect overflow policy.");
+    om_printf(w, "event_agent_driver_overflow_dropped_total{which=\"newest\"} %llu\n", (unsigned long long)stats.dropped_newest);
+    om_printf(w, "event_agent_driver_overflow_dropped_total{which=\"oldest\"} %llu\n", (unsigned long long)stats.dropped_oldest);
+    om_counter(w, "driver_overflow_blocked", "Publishes that waited for reconnect buffer space.", stats.blocked);
+    om_counter(w, "driver_overflow_block_timeouts", "Publishes dropped after waiting for buffer space.", stats.block_timeouts);
+
+    om_gauge(w, "driver_in_outage", "1 while the driver is reconnecting.", stats.in_outage ? 1 : 0);
+    om_counter(w, "driver_outages", "Completed broker outages.", stats.outages);
+    om_family(w, "driver_outage_seconds", "counter", "Time spent in completed broker outages.");
+    om_printf(w, "event_agent_driver_outage_seconds_total %.3f\n", (double)stats.outage_ms_total / 1000.0);
+
+    if (stats.spool_enabled) {
+        om_gauge(w, "spool_depth", "Spooled messages waiting for replay.", stats.spool_pending);
+        om_gauge(w, "spool_segments", "Spool segment files on disk.", stats.spool_segments);
+        om_gauge(w, "spool_disk_bytes", "Disk used by spool segments.", stats.spool_disk_bytes);
+        om_counter(w, "spool_appended", "Messages written to the spool.", stats.spool_appended);
+        om_counter(w, "spool_replayed", "Messages replayed from the spool.", stats.spool_replayed);
+        om_counter(w, "spool_dropped", "Messages dropped because the spool was full.", stats.spool_dropped);
+    }
+
+    if (stats.jetstream_enabled) {
+        om_gauge(w, "jetstream_inflight", "JetStream publishes awaiting an ack.", stats.js_inflight);
+        om_counter(w, "jetstream_acked", "JetStream publishes acknowledged.", stats.js_acked);
+        om_counter(w, "jetstream_retried", "JetStream publishes retried after a failed ack.", stats.js_retried);
+        om_counter(w, "jetstream_failed", "JetStream publishes given up on.", stats.js_failed);
+    }
+}
+
+static void render_command_latency(const char *name, const latency_histogram_t *latency, void *user_data)
+{
+    om_histogram((om_writer_t *)user_data, "command_latency_seconds", "command", name, latency);
+}
+
+static void render_command_lanes(om_writer_t *w)
+{
+    command_lane_stats_t stats[COMMAND_LANE_MAX];
+    int lane;
+
+    for (lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+        command_workers_get_stats((command_lane_t)lane, &stats[lane]);
+    }
+
+    om_family(w, "command_lane_workers", "gauge", "Worker threads per command lane.");
+    for (lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+        om_printf(w, "event_agent_command_lane_workers{lane=\"%s\"} %u\n", command_lane_name((command_lane_t)lane), stats[lane].workers);
+    }
+    om_family(w, "command_lane_depth", "gauge", "Commands waiting for a worker per lane.");
+    for (lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+        om_printf(w, "event_agent_command_lane_depth{lane=\"%s\"} %u\n", command_lane_name((command_lane_t)lane), stats[lane].depth);
+    }
+    om_family(w, "command_lane_executed", "counter", "Commands run by the lane's workers.");
+    for (lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+        om_printf(w, "event_agent_command_lane_executed_total{lane=\"%s\"} %llu\n", command_lane_name((command_lane_t)lane), (unsigned long long)stats[lane].executed);
+    }
+    om_family(w, "command_lane_stolen", "counter", "Commands a worker took from a sibling's queue.");
+    for (lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+        om_printf(w, "event_agent_command_lane_stolen_total{lane=\"%s\"} %llu\n", command_lane_name((command_lane_t)lane), (unsigned long long)stats[lane].stolen);
+    }
+    om_family(w, "command_lane_rejected", "counter", "Commands rejected because the lane's queues were full.");
+    for (lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+        om_printf(w, "event_agent_command_lane_rejected_total{lane=\"%s\"} %llu\n", command_lane_name((command_lane_t)lane), (unsigned long long)stats[lane].rejected);
+    }
+}
+
+static void render_jobs(om_writer_t *w)
+{
+    command_jobs_stats_t stats;
+
+    command_jobs_get_stats(&stats);
+    om_gauge(w, "jobs_queued", "Async jobs waiting for a job worker.", stats.queued);
+    om_gauge(w, "jobs_running", "Async jobs being executed.", stats.running);
+    om_gauge(w, "jobs_table", "Jobs held in the job table, finished ones included.", stats.jobs);
+    om_counter(w, "jobs_created", "Async jobs accepted.", stats.created);
+    om_counter(w, "jobs_completed", "Async jobs that succeeded.", stats.completed);
+    om_counter(w, "jobs_failed", "Async jobs that failed.", stats.failed);
+    om_counter(w, "jobs_cancelled", "Async jobs cancelled before they ran.", stats.cancelled);
+    om_counter(w, "jobs_rejected", "Async requests refused because the job table was full.", stats.rejected);
+}
+
+static void render_commands(om_writer_t *w)
+{
+    uint64_t received = 0, success = 0, failed = 0;
+    int stage, lane;
+
+    command_stats_get(&received, &success, &failed);
+    om_counter(w, "command_requests", "Command requests received.", received);
+    om_counter(w, "command_success", "Command requests that succeeded.", success);
+    om_counter(w, "command_failed", "Command requests that failed.", failed);
+    om_counter(w, "command_skipped", "Command requests addressed to another node.", command_stats_get_skipped());
+    render_command_lanes(w);
+    render_jobs(w);
+
+    if (!globals.latency_metrics) {
+        return;
+    }
+
+    om_family(w, "stage_latency_seconds", "histogram", "Time spent per event and command pipeline stage.");
+    for (stage = 0; stage < METRICS_STAGE_MAX; stage++) {
+        om_histogram(w, "stage_latency_seconds", "stage", metrics_stage_name((metrics_stage_t)stage), &metrics_stages[stage]);
+    }
+
+    om_family(w, "command_latency_seconds", "histogram", "Handler execution time per command.");
+    command_foreach_latency(render_command_latency, w);
+
+    om_family(w, "command_lane_wait_seconds", "histogram", "Time commands waited in a lane queue before a worker ran them.");
+    for (lane = 0; lane < COMMAND_LANE_MAX; lane++) {
+        om_histogram(w, "command_lane_wait_seconds", "lane", command_lane_name((command_lane_t)lane), command_workers_wait_latency((command_lane_t)lane));
+    }
+}
+
+void openmetrics_render(openmetrics_sink_t sink, void *user_data)
+{
+    om_writer_t w;
+    char node[OPENMETRICS_LABEL_MAX];
+
+    w.len = 0;
+    w.sink = sink;
+    w.user_data = user_data;
+
+    om_family(&w, "build", "info", "Module version, node and driver.");
+    om_printf(&w, "event_agent_build_info{version=\"%s\",node_id=\"%s\",driver=\"%s\"} 1\n", MOD_EVENT_AGENT_VERSION,
+              om_escape(globals.node_id ? globals.node_id : "", node, sizeof(node)), globals.driver ? globals.driver->name : "none");
+    om_gauge(&w, "uptime_seconds", "Seconds since the module loaded.", (uint64_t)(time(NULL) - globals.startup_time));
+
+    render_events(&w);
+    render_queue(&w);
+    render_ratelimits(&w);
+    render_retention(&w);
+    render_driver(&w);
+    render_commands(&w);
+
+    om_printf(&w, "# EOF\n");
+    om_flush(&w);
+}
+
+static void buffer_sink(const char *data, size_t len, void *user_data)
+{
+    event_buffer_append((event_buffer_t *)user_data, data, len);
+}
+
+static void *SWITCH_THREAD_FUNC openmetrics_publisher_thread(switch_thread_t *thread, void *obj)
+{
+    const switch_interval_time_t interval = (switch_interval_time_t)globals.metrics_publish_interval_ms * 1000;
+    const driver_header_t header = { EVENT_CONTENT_TYPE_HEADER, OPENMETRICS_CONTENT_TYPE };
+    event_buffer_t buf = {0};
+    switch_time_t next = switch_micro_time_now() + interval;
+
+    while (g_running) {
+        switch_time_t now = switch_micro_time_now();
+
+        if (now >= next) {
+            next = now + interval;
+            if (globals.driver && globals.driver->is_connected(globals.driver)) {
+                event_buffer_reset(&buf);
+                openmetrics_render(buffer_sink, &buf);
+                if (globals.driver->publish_with_headers) {
+                    globals.driver->publish_with_headers(globals.driver, g_subject, &header, 1, buf.data, buf.len);
+                } else {
+                    globals.driver->publish(globals.driver, g_subject, buf.data, buf.len);
+                }
+            }
+        }
+        switch_yield(OPENMETRICS_PUBLISH_TICK_US);
+    }
+
+    event_buffer_free(&buf);
+    return NULL;
+}
+
+switch_status_t openmetrics_publisher_start(switch_memory_pool_t *pool)
+{
+    switch_threadattr_t *thd_attr = NULL;
+
+    if (!globals.metrics_publish_interval_ms || zstr(globals.node_id)) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    switch_snprintf(g_subject, sizeof(g_subject), "%s.node.%s.metrics", globals.subject_prefix, globals.node_id);
+    g_running = SWITCH_TRUE;
+    switch_threadattr_create(&thd_attr, pool);
+    switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+    if (switch_thread_create(&g_thread, thd_attr, openmetrics_publisher_thread, NULL, pool) != SWITCH_STATUS_SUCCESS) {
+        g_running = SWITCH_FALSE;
+        g_thread = NULL;
+        return SWITCH_STATUS_FALSE;
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Publishing metrics on %s every %u ms", g_subject, globals.metrics_publish_interval_ms);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void openmetrics_publisher_stop(void)
+{
+    switch_status_t retval;
+
+    if (!g_thread) {
+        return;
+    }
+    g_running = SWITCH_FALSE;
+    switch_thread_join(&retval, g_thread);
+    g_thread = NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef CORE_OPENMETRICS_H
+#define CORE_OPENMETRICS_H
+
+#include "../mod_event_agent.h"
+
+#define OPENMETRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/*
+ * OpenMetrics text exposition of the module's counters, queue, driver,
+ * command and latency statistics. Output is rendered into a fixed stack
+ * buffer and handed to the sink in chunks, so a scrape allocates nothing.
+ */
+typedef void (*openmetrics_sink_t)(const char *data, size_t len, void *user_data);
+
+void openmetrics_render(openmetrics_sink_t sink, void *user_data);
+
+/* Periodic publish on <prefix>.node.<node_id>.metrics (metrics_publish_interval_ms) */
+switch_status_t openmetrics_publisher_start(switch_memory_pool_t *pool);
+void openmetrics_publisher_stop(void);
+
+#endif /* CORE_OPENMETRICS_H */
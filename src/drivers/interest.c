@@ -0,0 +1,242 @@
+#include "interest.h"
+#include "../mod_event_agent.h"
+#include <cjson/cJSON.h>
+
+#define INTEREST_MAX_PATTERNS 4096
+#define INTEREST_NEVER INT64_MAX
+/* Per-thread, direct-mapped by subject hash; subjects are few (one per event type) */
+#define INTEREST_CACHE_SLOTS 128
+#define INTEREST_CACHE_SUBJECT_MAX 120
+
+typedef struct {
+    char *pattern;
+    switch_time_t expires;
+} interest_entry_t;
+
+struct driver_interest_s {
+    switch_thread_rwlock_t *rwlock;
+    interest_entry_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t default_ttl_ms;
+    uint64_t generation;        /* renewed under the write lock whenever the live set changes */
+    switch_time_t next_expiry;  /* earliest expires in entries */
+    switch_time_t grace_until;
+};
+
+typedef struct {
+    const driver_interest_t *owner;
+    uint64_t generation;
+    uint32_t hash;
+    int count;
+    char subject[INTEREST_CACHE_SUBJECT_MAX];
+} interest_cache_slot_t;
+
+static __thread interest_cache_slot_t g_cache[INTEREST_CACHE_SLOTS];
+/* Shared by all trackers so a cache slot can never mistake a new tracker for an old one */
+static uint64_t g_generation = 0;
+
+driver_interest_t *driver_interest_create(switch_memory_pool_t *pool, uint32_t default_ttl_ms)
+{
+    driver_interest_t *interest = switch_core_alloc(pool, sizeof(*interest));
+
+    memset(interest, 0, sizeof(*interest));
+    interest->default_ttl_ms = default_ttl_ms;
+    interest->generation = __atomic_add_fetch(&g_generation, 1, __ATOMIC_RELAXED);
+    interest->next_expiry = INTEREST_NEVER;
+    switch_thread_rwlock_create(&interest->rwlock, pool);
+    return interest;
+}
+
+void driver_interest_destroy(driver_interest_t *interest)
+{
+    uint32_t i;
+
+    if (!interest) {
+        return;
+    }
+
+    switch_thread_rwlock_wrlock(interest->rwlock);
+    for (i = 0; i < interest->count; i++) {
+        free(interest->entries[i].pattern);
+    }
+    free(interest->entries);
+    interest->entries = NULL;
+    interest->count = interest->capacity = 0;
+    __atomic_store_n(&interest->next_expiry, INTEREST_NEVER, __ATOMIC_RELAXED);
+    __atomic_store_n(&interest->generation, __atomic_add_fetch(&g_generation, 1, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+    switch_thread_rwlock_unlock(interest->rwlock);
+}
+
+/* Write lock held; returns whether any pattern went away */
+static switch_bool_t purge_expired(driver_interest_t *interest, switch_time_t now)
+{
+    switch_time_t next = INTEREST_NEVER;
+    uint32_t count = interest->count;
+    uint32_t i = 0;
+
+    while (i < interest->count) {
+        if (interest->entries[i].expires <= now) {
+            free(interest->entries[i].pattern);
+            interest->entries[i] = interest->entries[--interest->count];
+        } else {
+            if (interest->entries[i].expires < next) {
+                next = interest->entries[i].expires;
+            }
+            i++;
+        }
+    }
+
+    __atomic_store_n(&interest->next_expiry, next, __ATOMIC_RELAXED);
+    return interest->count != count ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+void driver_interest_announce(driver_interest_t *interest, const char *pattern, uint32_t ttl_ms)
+{
+    switch_time_t now = switch_micro_time_now();
+    switch_bool_t changed;
+    uint32_t i;
+
+    if (!interest || zstr(pattern)) {
+        return;
+    }
+
+    switch_thread_rwlock_wrlock(interest->rwlock);
+    changed = purge_expired(interest, now);
+
+    for (i = 0; i < interest->count; i++) {
+        if (!strcmp(interest->entries[i].pattern, pattern)) {
+            break;
+        }
+    }
+
+    if (!ttl_ms) {
+        if (i < interest->count) {
+            free(interest->entries[i].pattern);
+            interest->entries[i] = interest->entries[--interest->count];
+            changed = SWITCH_TRUE;
+        }
+        goto done;
+    }
+
+    if (i == interest->count) {
+        if (interest->count == interest->capacity) {
+            uint32_t capacity = interest->capacity ? interest->capacity * 2 : 16;
+            interest_entry_t *entries;
+
+            if (capacity > INTEREST_MAX_PATTERNS || !(entries = realloc(interest->entries, capacity * sizeof(interest_entry_t)))) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Interest table full, ignoring '%s'", pattern);
+                goto done;
+            }
+            interest->entries = entries;
+            interest->capacity = capacity;
+        }
+        if (!(interest->entries[i].pattern = strdup(pattern))) {
+            goto done;
+        }
+        interest->count++;
+        changed = SWITCH_TRUE;
+    }
+    interest->entries[i].expires = now + (switch_time_t)ttl_ms * 1000;
+    if (interest->entries[i].expires < interest->next_expiry) {
+        __atomic_store_n(&interest->next_expiry, interest->entries[i].expires, __ATOMIC_RELAXED);
+    }
+
+  done:
+    if (changed) {
+        __atomic_store_n(&interest->generation, __atomic_add_fetch(&g_generation, 1, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+    }
+    switch_thread_rwlock_unlock(interest->rwlock);
+}
+
+void driver_interest_handle_message(driver_interest_t *interest, const char *data, size_t len)
+{
+    cJSON *json, *subjects, *item;
+    uint32_t ttl_ms;
+
+    if (!interest || !data || !len || !(json = cJSON_ParseWithLength(data, len))) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Ignoring malformed interest announcement");
+        return;
+    }
+
+    ttl_ms = interest->default_ttl_ms;
+    item = cJSON_GetObjectItemCaseSensitive(json, "ttl_ms");
+    if (cJSON_IsNumber(item)) {
+        ttl_ms = item->valuedouble > 0 ? (uint32_t)item->valuedouble : 0;
+    }
+
+    subjects = cJSON_GetObjectItemCaseSensitive(json, "subjects");
+    if (cJSON_IsArray(subjects)) {
+        cJSON_ArrayForEach(item, subjects) {
+            if (cJSON_IsString(item)) {
+                driver_interest_announce(interest, item->valuestring, ttl_ms);
+            }
+        }
+    } else if (cJSON_IsString((item = cJSON_GetObjectItemCaseSensitive(json, "subject")))) {
+        driver_interest_announce(interest, item->valuestring, ttl_ms);
+    }
+
+    cJSON_Delete(json);
+}
+
+void driver_interest_start_grace(driver_interest_t *interest, uint32_t grace_ms)
+{
+    if (interest) {
+        __atomic_store_n(&interest->grace_until, switch_micro_time_now() + (switch_time_t)grace_ms * 1000, __ATOMIC_RELEASE);
+    }
+}
+
+static int count_matches(driver_interest_t *interest, const char *subject)
+{
+    int count = 0;
+    uint32_t i;
+
+    for (i = 0; i < interest->count; i++) {
+        if (driver_interest_match(interest->entries[i].pattern, subject)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Counts are cached per thread and subject, valid while the generation holds; expiry bumps it like an announce */
+int driver_interest_count(driver_interest_t *interest, const char *subject)
+{
+    switch_time_t now = switch_micro_time_now();
+    interest_cache_slot_t *slot;
+    size_t len;
+    uint32_t hash;
+    int count;
+
+    if (now < __atomic_load_n(&interest->grace_until, __ATOMIC_ACQUIRE)) {
+        return 1;
+    }
+
+    if (now >= __atomic_load_n(&interest->next_expiry, __ATOMIC_RELAXED)) {
+        switch_thread_rwlock_wrlock(interest->rwlock);
+        if (purge_expired(interest, now)) {
+            __atomic_store_n(&interest->generation, __atomic_add_fetch(&g_generation, 1, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+        }
+        switch_thread_rwlock_unlock(interest->rwlock);
+    }
+
+    hash = event_agent_hash(subject);
+    slot = &g_cache[hash & (INTEREST_CACHE_SLOTS - 1)];
+    if (slot->owner == interest && slot->hash == hash && slot->generation == __atomic_load_n(&interest->generation, __ATOMIC_ACQUIRE) &&
+        !strcmp(slot->subject, subject)) {
+        return slot->count;
+    }
+
+    switch_thread_rwlock_rdlock(interest->rwlock);
+    count = count_matches(interest, subject);
+    if ((len = strlen(subject)) < INTEREST_CACHE_SUBJECT_MAX) {
+        slot->owner = interest;
+        slot->generation = interest->generation;
+        slot->hash = hash;
+        slot->count = count;
+        memcpy(slot->subject, subject, len + 1);
+    }
+    switch_thread_rwlock_unlock(interest->rwlock);
+
+    return count;
+}
@@ -0,0 +1,66 @@
+#ifndef DRIVER_INTEREST_H
+#define DRIVER_INTEREST_H
+
+#include <switch.h>
+
+/*
+ * Subscriber interest announced by consumers on a control subject:
+ *   {"subjects": ["freeswitch.events.channel.>", ...], "ttl_ms": 60000}
+ * Patterns use NATS wildcards ('*' one token, '>' the rest) and expire
+ * unless re-announced; ttl_ms 0 withdraws them.
+ */
+typedef struct driver_interest_s driver_interest_t;
+
+driver_interest_t *driver_interest_create(switch_memory_pool_t *pool, uint32_t default_ttl_ms);
+void driver_interest_destroy(driver_interest_t *interest);
+
+void driver_interest_announce(driver_interest_t *interest, const char *pattern, uint32_t ttl_ms);
+void driver_interest_handle_message(driver_interest_t *interest, const char *data, size_t len);
+
+/* Treats every subject as wanted until grace_ms from now, while consumers re-announce */
+void driver_interest_start_grace(driver_interest_t *interest, uint32_t grace_ms);
+
+/* Number of live patterns matching subject; one cached lookup per call until the pattern set changes or a pattern expires */
+int driver_interest_count(driver_interest_t *interest, const char *subject);
+
+/* Token-wise NATS wildcard match; inline so drivers can use it without the interest tracker */
+static inline switch_bool_t driver_interest_match(const char *pattern, const char *subject)
+{
+    const char *p = pattern;
+    const char *s = subject;
+
+    while (*p && *s) {
+        /* Wildcards stand for whole, non-empty tokens */
+        if (p[0] == '>' && p[1] == '\0') {
+            return *s != '.' ? SWITCH_TRUE : SWITCH_FALSE;
+        }
+
+        if (p[0] == '*' && (p[1] == '.' || p[1] == '\0')) {
+            if (*s == '.') {
+                return SWITCH_FALSE;
+            }
+            p++;
+            while (*s && *s != '.') s++;
+        } else {
+            while (*p && *p != '.' && *p == *s) {
+                p++;
+                s++;
+            }
+            if ((*p && *p != '.') || (*s && *s != '.')) {
+                return SWITCH_FALSE;
+            }
+        }
+
+        if (*p != *s) {
+            return SWITCH_FALSE;
+        }
+        if (*p == '.') {
+            p++;
+            s++;
+        }
+    }
+
+    return (*p == '\0' && *s == '\0') ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+#endif /* DRIVER_INTEREST_H */
@@ -4,7 +4,86 @@
 #include <switch.h>
 
 typedef struct event_driver_s event_driver_t;
-typedef void (*message_handler_t)(const char *subject, const char *data, size_t len, const char *reply_to, void *user_data);
+
+typedef struct {
+    const char *name;
+    const char *value;
+} driver_header_t;
+
+/* Messages carrying several events declare how many */
+#define DRIVER_MESSAGE_COUNT_HEADER "Event-Agent-Batch-Count"
+/* De-duplication id, honoured by NATS JetStream */
+#define DRIVER_MSG_ID_HEADER "Nats-Msg-Id"
+
+#define DRIVER_OUTAGE_HISTORY 8
+
+typedef struct {
+    switch_time_t started;
+    uint64_t duration_ms;
+    uint64_t lost;
+} driver_outage_t;
+
+typedef struct {
+    uint64_t sent;
+    uint64_t failed;
+    uint64_t bytes;
+    uint64_t reconnects;
+
+    /* Overflow handling while the broker is unreachable */
+    const char *overflow_policy;
+    uint64_t buffer_size;
+    uint64_t dropped_newest;
+    uint64_t dropped_oldest;
+    uint64_t blocked;
+    uint64_t block_timeouts;
+    uint64_t buffered_msgs;
+    uint64_t buffered_bytes;
+
+    /* Completed outages, most recent first */
+    switch_bool_t in_outage;
+    uint64_t outages;
+    uint64_t outage_ms_total;
+    uint32_t outage_count;
+    driver_outage_t outage[DRIVER_OUTAGE_HISTORY];
+
+    /* Disk spool, when configured */
+    switch_bool_t spool_enabled;
+    uint32_t spool_segments;
+    uint64_t spool_disk_bytes;
+    uint64_t spool_pending;
+    uint64_t spool_appended;
+    uint64_t spool_replayed;
+    uint64_t spool_dropped;
+    uint32_t spool_replay_rate;
+    uint64_t spool_replay_eps;
+
+    /* JetStream acknowledged publishing, when enabled */
+    switch_bool_t jetstream_enabled;
+    uint64_t js_max_pending;
+    uint64_t js_inflight;
+    uint64_t js_acked;
+    uint64_t js_retried;
+    uint64_t js_failed;
+} driver_stats_t;
+
+/* Headers delivered with a received message; drivers pass at most this many */
+#define DRIVER_MAX_HEADERS 16
+
+/* headers are only valid during the call and may be NULL when header_count is 0 */
+typedef void (*message_handler_t)(const char *subject, const driver_header_t *headers, size_t header_count,
+                                  const char *data, size_t len, const char *reply_to, void *user_data);
+
+static inline const char *driver_header_find(const driver_header_t *headers, size_t header_count, const char *name) {
+    for (size_t i = 0; i < header_count; i++) {
+        if (headers[i].name && !strcasecmp(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+/* Reports events lost after publish() had returned success, e.g. JetStream publishes never acknowledged */
+typedef void (*driver_failure_handler_t)(event_driver_t *driver, const char *subject, uint32_t events, void *user_data);
 
 struct event_driver_s {
     const char *name;
@@ -17,18 +96,25 @@ struct event_driver_s {
     switch_status_t (*shutdown)(event_driver_t *driver);
     
     switch_status_t (*publish)(event_driver_t *driver, const char *subject, const char *data, size_t len);
+    switch_status_t (*publish_with_headers)(event_driver_t *driver, const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len);
     switch_status_t (*has_subscribers)(event_driver_t *driver, const char *subject, int *count);
     
     switch_status_t (*subscribe)(event_driver_t *driver, const char *subject, message_handler_t handler, void *user_data);
     switch_status_t (*unsubscribe)(event_driver_t *driver, const char *subject);
     
     switch_bool_t (*is_connected)(event_driver_t *driver);
-    void (*get_stats)(event_driver_t *driver, uint64_t *sent, uint64_t *failed, uint64_t *bytes);
+    void (*get_stats)(event_driver_t *driver, driver_stats_t *stats);
+    
+    driver_failure_handler_t failure_handler;
+    void *failure_data;
 };
 
 event_driver_t *driver_create(const char *name);
 void driver_destroy(event_driver_t *driver);
 
+/* In-process ring, no broker (benchmarks and tests) */
+event_driver_t *driver_loopback_create(switch_memory_pool_t *pool);
+
 #ifdef WITH_NATS
 event_driver_t *driver_nats_create(switch_memory_pool_t *pool);
 #endif
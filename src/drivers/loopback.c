@@ -0,0 +1,428 @@
+#include "loopback.h"
+#include "interest.h"
+#include "../core/counters.h"
+#include "../events/queue.h"
+
+#define LOOPBACK_DEFAULT_RING_SIZE 65536
+#define LOOPBACK_MAX_RING_SIZE (16 * 1024 * 1024)
+#define LOOPBACK_IDLE_WAIT_US 10000
+
+typedef enum {
+    LOOPBACK_COUNTER_PUBLISHED,
+    LOOPBACK_COUNTER_DELIVERED,
+    LOOPBACK_COUNTER_UNROUTED,
+    LOOPBACK_COUNTER_DROPPED,
+    LOOPBACK_COUNTER_BYTES,
+    LOOPBACK_COUNTER_MAX
+} loopback_counter_t;
+
+/* Allocated in one block: the struct, the header array, then subject, reply subject, header strings and data */
+typedef struct {
+    const char *subject;
+    const char *reply_to;
+    const driver_header_t *headers;
+    size_t header_count;
+    const char *data;
+    size_t len;
+} loopback_msg_t;
+
+/* Prepend-only list read without the lock; unsubscribe just deactivates */
+typedef struct loopback_subscription_s {
+    const char *subject;
+    message_handler_t handler;
+    void *user_data;
+    switch_bool_t active;
+    struct loopback_subscription_s *next;
+} loopback_subscription_t;
+
+typedef struct {
+    event_queue_t *queue;   /* loopback_msg_t *, stolen so pump() and the dispatcher may both drain it */
+    loopback_subscription_t *subscriptions;
+    switch_mutex_t *mutex;
+    switch_thread_cond_t *cond;
+    uint32_t idle;
+
+    switch_bool_t manual;
+    switch_bool_t connected;
+    switch_bool_t running;
+    switch_thread_t *thread;
+    counter_group_t *counters;  /* loopback_counter_t */
+} loopback_ctx_t;
+
+static loopback_msg_t *msg_create(const char *subject, const driver_header_t *headers, size_t header_count,
+                                  const char *reply_to, const char *data, size_t len)
+{
+    size_t subject_len = strlen(subject) + 1;
+    size_t reply_len = reply_to ? strlen(reply_to) + 1 : 0;
+    size_t header_len = 0, i;
+    driver_header_t *copies;
+    loopback_msg_t *msg;
+    char *p;
+
+    if (header_count > DRIVER_MAX_HEADERS) {
+        header_count = DRIVER_MAX_HEADERS;
+    }
+    for (i = 0; i < header_count; i++) {
+        header_len += strlen(headers[i].name) + strlen(headers[i].value) + 2;
+    }
+
+    if (!(msg = malloc(sizeof(*msg) + header_count * sizeof(driver_header_t) + subject_len + reply_len + header_len + len + 1))) {
+        return NULL;
+    }
+    copies = (driver_header_t *)(msg + 1);
+    p = (char *)(copies + header_count);
+
+    memcpy(p, subject, subject_len);
+    msg->subject = p;
+    p += subject_len;
+
+    msg->reply_to = NULL;
+    if (reply_to) {
+        memcpy(p, reply_to, reply_len);
+        msg->reply_to = p;
+        p += reply_len;
+    }
+
+    for (i = 0; i < header_count; i++) {
+        size_t name_len = strlen(headers[i].name) + 1;
+        size_t value_len = strlen(headers[i].value) + 1;
+
+        memcpy(p, headers[i].name, name_len);
+        copies[i].name = p;
+        p += name_len;
+        memcpy(p, headers[i].value, value_len);
+        copies[i].value = p;
+        p += value_len;
+    }
+    msg->headers = header_count ? copies : NULL;
+    msg->header_count = header_count;
+
+    if (len) {
+        memcpy(p, data, len);
+    }
+    p[len] = '\0';
+    msg->data = p;
+    msg->len = len;
+    return msg;
+}
+
+static switch_status_t enqueue(loopback_ctx_t *ctx, loopback_msg_t *msg)
+{
+    if (!event_queue_push(ctx->queue, msg)) {
+        free(msg);
+        counter_inc(ctx->counters, LOOPBACK_COUNTER_DROPPED);
+        return SWITCH_STATUS_FALSE;
+    }
+
+    /* Pairs with the dispatcher setting idle before its last look at the ring */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ctx->idle, __ATOMIC_RELAXED)) {
+        switch_mutex_lock(ctx->mutex);
+        switch_thread_cond_signal(ctx->cond);
+        switch_mutex_unlock(ctx->mutex);
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static void deliver(loopback_ctx_t *ctx, loopback_msg_t *msg)
+{
+    loopback_subscription_t *sub = __atomic_load_n(&ctx->subscriptions, __ATOMIC_ACQUIRE);
+    switch_bool_t routed = SWITCH_FALSE;
+
+    for (; sub; sub = sub->next) {
+        if (__atomic_load_n(&sub->active, __ATOMIC_ACQUIRE) && driver_interest_match(sub->subject, msg->subject)) {
+            sub->handler(msg->subject, msg->headers, msg->header_count, msg->data, msg->len, msg->reply_to, sub->user_data);
+            routed = SWITCH_TRUE;
+        }
+    }
+
+    counter_inc(ctx->counters, routed ? LOOPBACK_COUNTER_DELIVERED : LOOPBACK_COUNTER_UNROUTED);
+    free(msg);
+}
+
+static void *SWITCH_THREAD_FUNC loopback_dispatch_thread(switch_thread_t *thread, void *obj)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)obj;
+    loopback_msg_t *msg;
+
+    while (__atomic_load_n(&ctx->running, __ATOMIC_ACQUIRE)) {
+        if ((msg = event_queue_steal(ctx->queue))) {
+            deliver(ctx, msg);
+            continue;
+        }
+
+        switch_mutex_lock(ctx->mutex);
+        __atomic_store_n(&ctx->idle, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!event_queue_depth(ctx->queue) && __atomic_load_n(&ctx->running, __ATOMIC_ACQUIRE)) {
+            switch_thread_cond_timedwait(ctx->cond, ctx->mutex, LOOPBACK_IDLE_WAIT_US);
+        }
+        __atomic_store_n(&ctx->idle, 0, __ATOMIC_RELAXED);
+        switch_mutex_unlock(ctx->mutex);
+    }
+
+    return NULL;
+}
+
+static switch_status_t loopback_init(event_driver_t *driver, switch_hash_t *config)
+{
+    loopback_ctx_t *ctx;
+    const char *value;
+    uint64_t size = LOOPBACK_DEFAULT_RING_SIZE;
+
+    ctx = switch_core_alloc(driver->pool, sizeof(loopback_ctx_t));
+    memset(ctx, 0, sizeof(loopback_ctx_t));
+    driver->handle = ctx;
+
+    if (!(ctx->counters = counter_group_create(driver->pool))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    if ((value = switch_core_hash_find(config, "loopback_ring_size")) && atoi(value) > 0) {
+        size = (uint64_t)atoi(value);
+    }
+    if (size > LOOPBACK_MAX_RING_SIZE) {
+        size = LOOPBACK_MAX_RING_SIZE;
+    }
+    if ((value = switch_core_hash_find(config, "loopback_dispatch"))) {
+        if (!strcasecmp(value, "manual")) {
+            ctx->manual = SWITCH_TRUE;
+        } else if (strcasecmp(value, "thread")) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Unknown loopback_dispatch '%s', using thread", value);
+        }
+    }
+
+    if (event_queue_create(&ctx->queue, (uint32_t)size, driver->pool) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    switch_mutex_init(&ctx->mutex, SWITCH_MUTEX_NESTED, driver->pool);
+    switch_thread_cond_create(&ctx->cond, driver->pool);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Loopback driver: %u slot ring, %s dispatch",
+                      event_queue_capacity(ctx->queue), ctx->manual ? "manual" : "thread");
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t loopback_connect(event_driver_t *driver)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    switch_threadattr_t *thd_attr = NULL;
+
+    if (!ctx->manual && !ctx->thread) {
+        __atomic_store_n(&ctx->running, SWITCH_TRUE, __ATOMIC_RELEASE);
+        switch_threadattr_create(&thd_attr, driver->pool);
+        switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+        if (switch_thread_create(&ctx->thread, thd_attr, loopback_dispatch_thread, ctx, driver->pool) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to start loopback dispatch thread");
+            ctx->running = SWITCH_FALSE;
+            ctx->thread = NULL;
+            return SWITCH_STATUS_FALSE;
+        }
+    }
+
+    ctx->connected = SWITCH_TRUE;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t loopback_disconnect(event_driver_t *driver)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    switch_status_t st;
+
+    ctx->connected = SWITCH_FALSE;
+
+    if (ctx->thread) {
+        switch_mutex_lock(ctx->mutex);
+        __atomic_store_n(&ctx->running, SWITCH_FALSE, __ATOMIC_RELEASE);
+        switch_thread_cond_signal(ctx->cond);
+        switch_mutex_unlock(ctx->mutex);
+        switch_thread_join(&st, ctx->thread);
+        ctx->thread = NULL;
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t loopback_shutdown(event_driver_t *driver)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    loopback_msg_t *msg;
+
+    if (!ctx) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    loopback_disconnect(driver);
+
+    if (ctx->queue) {
+        while ((msg = event_queue_steal(ctx->queue))) {
+            free(msg);
+        }
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t loopback_publish_with_headers(event_driver_t *driver, const char *subject, const driver_header_t *headers,
+                                                     size_t header_count, const char *data, size_t len)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    loopback_msg_t *msg;
+
+    if (!(msg = msg_create(subject, headers, header_count, NULL, data, len))) {
+        counter_inc(ctx->counters, LOOPBACK_COUNTER_DROPPED);
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    if (enqueue(ctx, msg) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_FALSE;
+    }
+
+    counter_inc(ctx->counters, LOOPBACK_COUNTER_PUBLISHED);
+    counter_add(ctx->counters, LOOPBACK_COUNTER_BYTES, len);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t loopback_publish(event_driver_t *driver, const char *subject, const char *data, size_t len)
+{
+    return loopback_publish_with_headers(driver, subject, NULL, 0, data, len);
+}
+
+/* Unlike a broker, the loopback knows exactly who is listening */
+static switch_status_t loopback_has_subscribers(event_driver_t *driver, const char *subject, int *count)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    loopback_subscription_t *sub = __atomic_load_n(&ctx->subscriptions, __ATOMIC_ACQUIRE);
+
+    *count = 0;
+    for (; sub; sub = sub->next) {
+        if (__atomic_load_n(&sub->active, __ATOMIC_ACQUIRE) && driver_interest_match(sub->subject, subject)) {
+            (*count)++;
+        }
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t loopback_subscribe(event_driver_t *driver, const char *subject, message_handler_t handler, void *user_data)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    loopback_subscription_t *sub;
+
+    sub = switch_core_alloc(driver->pool, sizeof(loopback_subscription_t));
+    sub->subject = switch_core_strdup(driver->pool, subject);
+    sub->handler = handler;
+    sub->user_data = user_data;
+    sub->active = SWITCH_TRUE;
+
+    switch_mutex_lock(ctx->mutex);
+    sub->next = ctx->subscriptions;
+    __atomic_store_n(&ctx->subscriptions, sub, __ATOMIC_RELEASE);
+    switch_mutex_unlock(ctx->mutex);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Loopback subscribed to %s", subject);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t loopback_unsubscribe(event_driver_t *driver, const char *subject)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    loopback_subscription_t *sub;
+
+    switch_mutex_lock(ctx->mutex);
+    for (sub = ctx->subscriptions; sub; sub = sub->next) {
+        if (!strcmp(sub->subject, subject)) {
+            __atomic_store_n(&sub->active, SWITCH_FALSE, __ATOMIC_RELEASE);
+        }
+    }
+    switch_mutex_unlock(ctx->mutex);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_bool_t loopback_is_connected(event_driver_t *driver)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    return ctx->connected;
+}
+
+static void loopback_get_stats(event_driver_t *driver, driver_stats_t *stats)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    driver_loopback_stats_t counts;
+
+    memset(stats, 0, sizeof(*stats));
+    driver_loopback_get_counts(driver, &counts);
+    stats->sent = counts.published;
+    stats->failed = counts.dropped;
+    stats->bytes = counter_read(ctx->counters, LOOPBACK_COUNTER_BYTES);
+    stats->overflow_policy = "drop-newest";
+    stats->buffer_size = counts.capacity;
+    stats->buffered_msgs = counts.depth;
+}
+
+switch_status_t driver_loopback_inject(event_driver_t *driver, const char *subject, const char *reply_to, const char *data, size_t len)
+{
+    return driver_loopback_inject_with_headers(driver, subject, NULL, 0, reply_to, data, len);
+}
+
+switch_status_t driver_loopback_inject_with_headers(event_driver_t *driver, const char *subject, const driver_header_t *headers,
+                                                    size_t header_count, const char *reply_to, const char *data, size_t len)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    loopback_msg_t *msg;
+
+    if (!(msg = msg_create(subject, headers, header_count, reply_to, data, len))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    return enqueue(ctx, msg);
+}
+
+uint32_t driver_loopback_pump(event_driver_t *driver, uint32_t max)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    loopback_msg_t *msg;
+    uint32_t count = 0;
+
+    while ((!max || count < max) && (msg = event_queue_steal(ctx->queue))) {
+        deliver(ctx, msg);
+        count++;
+    }
+    return count;
+}
+
+void driver_loopback_get_counts(event_driver_t *driver, driver_loopback_stats_t *stats)
+{
+    loopback_ctx_t *ctx = (loopback_ctx_t *)driver->handle;
+    uint64_t counters[LOOPBACK_COUNTER_MAX];
+
+    counter_snapshot(ctx->counters, counters, LOOPBACK_COUNTER_MAX);
+    stats->published = counters[LOOPBACK_COUNTER_PUBLISHED];
+    stats->delivered = counters[LOOPBACK_COUNTER_DELIVERED];
+    stats->unrouted = counters[LOOPBACK_COUNTER_UNROUTED];
+    stats->dropped = counters[LOOPBACK_COUNTER_DROPPED];
+    stats->depth = event_queue_depth(ctx->queue);
+    stats->capacity = event_queue_capacity(ctx->queue);
+}
+
+event_driver_t *driver_loopback_create(switch_memory_pool_t *pool)
+{
+    event_driver_t *driver = switch_core_alloc(pool, sizeof(event_driver_t));
+
+    driver->name = "loopback";
+    driver->pool = pool;
+    driver->handle = NULL;
+    driver->init = loopback_init;
+    driver->connect = loopback_connect;
+    driver->disconnect = loopback_disconnect;
+    driver->shutdown = loopback_shutdown;
+    driver->publish = loopback_publish;
+    driver->publish_with_headers = loopback_publish_with_headers;
+    driver->has_subscribers = loopback_has_subscribers;
+    driver->subscribe = loopback_subscribe;
+    driver->unsubscribe = loopback_unsubscribe;
+    driver->is_connected = loopback_is_connected;
+    driver->get_stats = loopback_get_stats;
+
+    return driver;
+}
@@ -0,0 +1,36 @@
+#ifndef DRIVER_LOOPBACK_H
+#define DRIVER_LOOPBACK_H
+
+#include "interface.h"
+
+/*
+ * In-process driver: published messages go into a bounded lock-free ring
+ * and are delivered to matching subscribe() handlers, either by a
+ * dispatcher thread (loopback_dispatch=thread, default) or by whoever
+ * calls driver_loopback_pump() (loopback_dispatch=manual). No broker or
+ * network is involved, so commands and events can be measured
+ * deterministically. Headers given to publish_with_headers() are
+ * delivered with the message. A full ring rejects the publish
+ * (drop-newest).
+ */
+typedef struct {
+    uint64_t published;
+    uint64_t delivered;
+    uint64_t unrouted;
+    uint64_t dropped;
+    uint64_t depth;
+    uint64_t capacity;
+} driver_loopback_stats_t;
+
+/* Queues a message as if it had arrived from the broker, e.g. a command request with its reply subject */
+switch_status_t driver_loopback_inject(event_driver_t *driver, const char *subject, const char *reply_to, const char *data, size_t len);
+/* Same, with message headers (e.g. command routing headers); at most DRIVER_MAX_HEADERS are kept */
+switch_status_t driver_loopback_inject_with_headers(event_driver_t *driver, const char *subject, const driver_header_t *headers,
+                                                    size_t header_count, const char *reply_to, const char *data, size_t len);
+
+/* Delivers up to max queued messages on the calling thread (0 = until empty); returns how many were dequeued */
+uint32_t driver_loopback_pump(event_driver_t *driver, uint32_t max);
+
+void driver_loopback_get_counts(event_driver_t *driver, driver_loopback_stats_t *stats);
+
+#endif /* DRIVER_LOOPBACK_H */
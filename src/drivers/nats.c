@@ -1,16 +1,98 @@
 #include "interface.h"
+#include "interest.h"
+#include "spool.h"
+#include "../core/counters.h"
 #include <nats/nats.h>
 
+#define NATS_DEFAULT_BUFFER_SIZE (8 * 1024 * 1024)
+#define NATS_MAX_PRIORITY_SUBJECTS 32
+#define NATS_REPLAY_TICK_MS 100
+/* Used when the module does not pass event_subjects */
+#define NATS_DEFAULT_EVENT_SUBJECTS "freeswitch.events.>"
+
+typedef enum {
+    NATS_OVERFLOW_DROP_NEWEST,
+    NATS_OVERFLOW_DROP_OLDEST_BY_PRIORITY,
+    NATS_OVERFLOW_BLOCK
+} nats_overflow_policy_t;
+
+static const char *nats_overflow_names[] = { "drop-newest", "drop-oldest-by-priority", "block-with-timeout" };
+
+/* Message held by the driver while disconnected (drop-oldest-by-priority) */
+typedef struct nats_pending_s {
+    natsMsg *msg;
+    size_t size;
+    switch_bool_t priority;
+    struct nats_pending_s *next;
+} nats_pending_t;
+
+typedef enum {
+    NATS_COUNTER_SENT,
+    NATS_COUNTER_FAILED,
+    NATS_COUNTER_BYTES,
+    NATS_COUNTER_DROPPED_NEWEST,
+    NATS_COUNTER_BLOCKED,
+    NATS_COUNTER_BLOCK_TIMEOUTS,
+    NATS_COUNTER_MAX
+} nats_counter_t;
+
 typedef struct {
+    event_driver_t *driver;
     natsConnection *conn;
     natsOptions *opts;
     switch_hash_t *subscriptions;
     switch_mutex_t *mutex;
+    switch_thread_cond_t *cond;
     switch_bool_t connected;
-    uint64_t sent;
-    uint64_t failed;
-    uint64_t bytes;
+    counter_group_t *counters;  /* nats_counter_t */
     uint64_t reconnects;
+    
+    nats_overflow_policy_t overflow_policy;
+    uint32_t block_timeout_ms;
+    uint64_t buffer_size;
+    char *priority_subjects[NATS_MAX_PRIORITY_SUBJECTS];
+    uint32_t priority_count;
+    /* Only events are held and evicted by the driver; command replies go straight to the client */
+    char *event_subjects[NATS_MAX_PRIORITY_SUBJECTS];
+    uint32_t event_subject_count;
+    nats_pending_t *pending_head;
+    nats_pending_t *pending_tail;
+    uint64_t pending_msgs;
+    uint64_t pending_bytes;
+    uint64_t dropped_oldest;
+    
+    switch_time_t outage_started;
+    uint64_t outage_lost;  /* atomic; reset under ctx->mutex when an outage begins */
+    uint64_t outages;
+    uint64_t outage_ms_total;
+    driver_outage_t outage_history[DRIVER_OUTAGE_HISTORY];
+    uint32_t outage_next;
+    uint32_t outage_recorded;
+    
+    driver_spool_t *spool;
+    uint32_t spool_replay_rate;
+    switch_thread_t *replay_thread;
+    volatile switch_bool_t replay_running;
+    uint64_t replay_eps;
+    
+    /* JetStream: subjects matching js_subjects are published async with acks */
+    jsCtx *js;
+    char *js_subjects[NATS_MAX_PRIORITY_SUBJECTS];
+    uint32_t js_subject_count;
+    int64_t js_max_pending;
+    int64_t js_ack_wait_ms;
+    uint32_t js_max_retries;
+    switch_hash_t *js_retries;
+    uint32_t js_retrying;
+    uint64_t js_inflight;
+    uint64_t js_acked;
+    uint64_t js_retried;
+    uint64_t js_failed;
+    
+    driver_interest_t *interest;
+    const char *interest_subject;
+    uint32_t interest_ttl_ms;
+    natsSubscription *interest_sub;
 } nats_driver_ctx_t;
 
 typedef struct {
@@ -19,20 +101,238 @@ typedef struct {
     natsSubscription *sub;
 } nats_subscription_t;
 
+static void nats_note_lost(nats_driver_ctx_t *ctx) {
+    counter_inc(ctx->counters, NATS_COUNTER_FAILED);
+    if (ctx->outage_started) {
+        __atomic_fetch_add(&ctx->outage_lost, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void nats_outage_begin(nats_driver_ctx_t *ctx) {
+    switch_mutex_lock(ctx->mutex);
+    if (!ctx->outage_started) {
+        __atomic_store_n(&ctx->outage_lost, 0, __ATOMIC_RELAXED);
+        ctx->outage_started = switch_micro_time_now();
+        ctx->outages++;
+    }
+    switch_mutex_unlock(ctx->mutex);
+}
+
+/* Caller holds ctx->mutex */
+static void nats_outage_end(nats_driver_ctx_t *ctx) {
+    driver_outage_t *outage;
+    
+    if (!ctx->outage_started) {
+        return;
+    }
+    
+    outage = &ctx->outage_history[ctx->outage_next];
+    outage->started = ctx->outage_started;
+    outage->duration_ms = (uint64_t)(switch_micro_time_now() - ctx->outage_started) / 1000;
+    outage->lost = __atomic_load_n(&ctx->outage_lost, __ATOMIC_RELAXED);
+    ctx->outage_next = (ctx->outage_next + 1) % DRIVER_OUTAGE_HISTORY;
+    if (ctx->outage_recorded < DRIVER_OUTAGE_HISTORY) ctx->outage_recorded++;
+    ctx->outage_ms_total += outage->duration_ms;
+    ctx->outage_started = 0;
+    
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] NATS outage ended after %llu ms, %llu events lost\n",
+                      (unsigned long long)outage->duration_ms, (unsigned long long)outage->lost);
+}
+
+static switch_bool_t nats_is_priority(nats_driver_ctx_t *ctx, const char *subject) {
+    uint32_t i;
+    
+    for (i = 0; i < ctx->priority_count; i++) {
+        if (driver_interest_match(ctx->priority_subjects[i], subject)) {
+            return SWITCH_TRUE;
+        }
+    }
+    return SWITCH_FALSE;
+}
+
+static switch_bool_t nats_is_event(nats_driver_ctx_t *ctx, const char *subject) {
+    uint32_t i;
+    
+    for (i = 0; i < ctx->event_subject_count; i++) {
+        if (driver_interest_match(ctx->event_subjects[i], subject)) {
+            return SWITCH_TRUE;
+        }
+    }
+    return SWITCH_FALSE;
+}
+
+static switch_bool_t nats_use_jetstream(nats_driver_ctx_t *ctx, const char *subject) {
+    uint32_t i;
+    
+    if (!ctx->js) {
+        return SWITCH_FALSE;
+    }
+    for (i = 0; i < ctx->js_subject_count; i++) {
+        if (driver_interest_match(ctx->js_subjects[i], subject)) {
+            return SWITCH_TRUE;
+        }
+    }
+    return SWITCH_FALSE;
+}
+
+/* Takes ownership of *msg on a successful JetStream publish (sets it to NULL) */
+static natsStatus nats_dispatch(nats_driver_ctx_t *ctx, natsMsg **msg, switch_bool_t jetstream) {
+    jsPubOptions opts;
+    natsStatus s;
+    
+    if (!jetstream) {
+        return natsConnection_PublishMsg(ctx->conn, *msg);
+    }
+    
+    jsPubOptions_Init(&opts);
+    opts.MaxWait = ctx->js_ack_wait_ms;
+    __atomic_fetch_add(&ctx->js_inflight, 1, __ATOMIC_RELAXED);
+    if ((s = js_PublishMsgAsync(ctx->js, msg, &opts)) != NATS_OK) {
+        __atomic_fetch_sub(&ctx->js_inflight, 1, __ATOMIC_RELAXED);
+    }
+    return s;
+}
+
+static uint32_t nats_msg_events(natsMsg *msg) {
+    const char *count = NULL;
+    int events;
+    
+    if (natsMsgHeader_Get(msg, DRIVER_MESSAGE_COUNT_HEADER, &count) == NATS_OK && count && (events = atoi(count)) > 0) {
+        return (uint32_t)events;
+    }
+    return 1;
+}
+
+/* Attempts are only tracked for messages that have failed at least once */
+static switch_bool_t nats_js_take_retry(nats_driver_ctx_t *ctx, const char *msg_id) {
+    intptr_t attempts;
+    switch_bool_t retry;
+    
+    switch_mutex_lock(ctx->mutex);
+    attempts = (intptr_t)switch_core_hash_find(ctx->js_retries, msg_id);
+    retry = attempts < (intptr_t)ctx->js_max_retries ? SWITCH_TRUE : SWITCH_FALSE;
+    if (retry) {
+        if (!attempts) ctx->js_retrying++;
+        switch_core_hash_insert(ctx->js_retries, msg_id, (void *)(attempts + 1));
+    } else if (attempts) {
+        switch_core_hash_delete(ctx->js_retries, msg_id);
+        ctx->js_retrying--;
+    }
+    switch_mutex_unlock(ctx->mutex);
+    
+    return retry;
+}
+
+static void nats_js_forget(nats_driver_ctx_t *ctx, const char *msg_id) {
+    switch_mutex_lock(ctx->mutex);
+    if (switch_core_hash_find(ctx->js_retries, msg_id)) {
+        switch_core_hash_delete(ctx->js_retries, msg_id);
+        ctx->js_retrying--;
+    }
+    switch_mutex_unlock(ctx->mutex);
+}
+
+static void nats_js_ack_cb(jsCtx *js, natsMsg *msg, jsPubAck *pa, jsPubAckErr *pae, void *closure) {
+    nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)closure;
+    const char *msg_id = NULL;
+    
+    natsMsgHeader_Get(msg, DRIVER_MSG_ID_HEADER, &msg_id);
+    
+    if (pa) {
+        ctx->js_acked++;
+        if (msg_id && ctx->js_retrying) {
+            nats_js_forget(ctx, msg_id);
+        }
+    } else if (pae) {
+        /* Same Nats-Msg-Id on every attempt, so the server drops duplicates of a late ack */
+        if (msg_id && nats_js_take_retry(ctx, msg_id)) {
+            jsPubOptions opts;
+            
+            jsPubOptions_Init(&opts);
+            opts.MaxWait = ctx->js_ack_wait_ms;
+            if (js_PublishMsgAsync(js, &msg, &opts) == NATS_OK) {
+                ctx->js_retried++;
+                return;
+            }
+            nats_js_forget(ctx, msg_id);
+        }
+        
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] JetStream publish to %s failed: %s\n",
+                          natsMsg_GetSubject(msg), pae->ErrText ? pae->ErrText : natsStatus_GetText(pae->Err));
+        ctx->js_failed++;
+        counter_inc(ctx->counters, NATS_COUNTER_FAILED);
+        if (ctx->driver->failure_handler) {
+            ctx->driver->failure_handler(ctx->driver, natsMsg_GetSubject(msg), nats_msg_events(msg), ctx->driver->failure_data);
+        }
+    }
+    
+    __atomic_fetch_sub(&ctx->js_inflight, 1, __ATOMIC_RELAXED);
+    natsMsg_Destroy(msg);
+}
+
+static void nats_pending_free(nats_pending_t *pending) {
+    natsMsg_Destroy(pending->msg);
+    free(pending);
+}
+
+/*
+ * Replays messages held during the outage in order. Caller holds ctx->mutex;
+ * it is released while each detached batch is published, because a full
+ * JetStream window makes the publish wait for acks whose handler takes the
+ * mutex. connected stays false until the list is empty, so events published
+ * meanwhile are queued behind the batch rather than overtaking it.
+ */
+static void nats_drain_pending(nats_driver_ctx_t *ctx) {
+    nats_pending_t *pending, *next;
+    
+    while ((pending = ctx->pending_head)) {
+        ctx->pending_head = ctx->pending_tail = NULL;
+        ctx->pending_msgs = 0;
+        ctx->pending_bytes = 0;
+        switch_mutex_unlock(ctx->mutex);
+        
+        for (; pending; pending = next) {
+            int len = natsMsg_GetDataLength(pending->msg);
+            
+            next = pending->next;
+            if (nats_dispatch(ctx, &pending->msg, nats_use_jetstream(ctx, natsMsg_GetSubject(pending->msg))) == NATS_OK) {
+                counter_inc(ctx->counters, NATS_COUNTER_SENT);
+                counter_add(ctx->counters, NATS_COUNTER_BYTES, len);
+            } else {
+                nats_note_lost(ctx);
+            }
+            nats_pending_free(pending);
+        }
+        
+        switch_mutex_lock(ctx->mutex);
+    }
+}
+
 static void nats_connection_closed_cb(natsConnection *nc, void *closure) {
     nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)closure;
     ctx->connected = SWITCH_FALSE;
+    
+    switch_mutex_lock(ctx->mutex);
+    switch_thread_cond_broadcast(ctx->cond);
+    switch_mutex_unlock(ctx->mutex);
 }
 
 static void nats_disconnected_cb(natsConnection *nc, void *closure) {
     nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)closure;
     ctx->connected = SWITCH_FALSE;
+    nats_outage_begin(ctx);
 }
 
 static void nats_reconnected_cb(natsConnection *nc, void *closure) {
     nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)closure;
+    
+    switch_mutex_lock(ctx->mutex);
+    nats_drain_pending(ctx);
     ctx->connected = SWITCH_TRUE;
     ctx->reconnects++;
+    nats_outage_end(ctx);
+    switch_thread_cond_broadcast(ctx->cond);
+    switch_mutex_unlock(ctx->mutex);
 }
 
 static void nats_error_cb(natsConnection *nc, natsSubscription *sub, natsStatus err, void *closure) {
@@ -44,25 +344,205 @@ static void nats_message_cb(natsConnection *nc, natsSubscription *sub, natsMsg *
     const char *subject = natsMsg_GetSubject(msg);
     const char *data = natsMsg_GetData(msg);
     const char *reply = natsMsg_GetReply(msg);
-    
+    driver_header_t headers[DRIVER_MAX_HEADERS];
+    size_t header_count = 0;
+    const char **keys = NULL;
+    int key_count = 0;
+
     if (nsub && nsub->handler) {
-        nsub->handler(subject, data, natsMsg_GetDataLength(msg), reply, nsub->user_data);
+        /* NATS_NOT_FOUND for the common case of a message without headers */
+        if (natsMsgHeader_Keys(msg, &keys, &key_count) == NATS_OK) {
+            for (int i = 0; i < key_count && header_count < DRIVER_MAX_HEADERS; i++) {
+                const char *value = NULL;
+
+                if (natsMsgHeader_Get(msg, keys[i], &value) == NATS_OK) {
+                    headers[header_count].name = keys[i];
+                    headers[header_count].value = value;
+                    header_count++;
+                }
+            }
+        }
+        nsub->handler(subject, headers, header_count, data, natsMsg_GetDataLength(msg), reply, nsub->user_data);
+        free((void *)keys);
     }
-    
+
+    natsMsg_Destroy(msg);
+}
+
+static void nats_interest_cb(natsConnection *nc, natsSubscription *sub, natsMsg *msg, void *closure) {
+    nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)closure;
+
+    driver_interest_handle_message(ctx->interest, natsMsg_GetData(msg), (size_t)natsMsg_GetDataLength(msg));
     natsMsg_Destroy(msg);
 }
 
+static natsStatus nats_build_msg(natsMsg **msg, const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len) {
+    natsStatus s;
+    size_t i;
+    
+    s = natsMsg_Create(msg, subject, NULL, data, (int)len);
+    for (i = 0; s == NATS_OK && i < header_count; i++) {
+        s = natsMsgHeader_Set(*msg, headers[i].name, headers[i].value);
+    }
+    if (s != NATS_OK) {
+        natsMsg_Destroy(*msg);
+        *msg = NULL;
+    }
+    return s;
+}
+
+static natsStatus nats_send(nats_driver_ctx_t *ctx, const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len) {
+    switch_bool_t jetstream = nats_use_jetstream(ctx, subject);
+    natsMsg *msg = NULL;
+    natsStatus s;
+    
+    if (!header_count && !jetstream) {
+        return natsConnection_Publish(ctx->conn, subject, (const void *)data, (int)len);
+    }
+    
+    if ((s = nats_build_msg(&msg, subject, headers, header_count, data, len)) == NATS_OK) {
+        s = nats_dispatch(ctx, &msg, jetstream);
+        natsMsg_Destroy(msg);
+    }
+    return s;
+}
+
+static switch_status_t nats_spool_sink(const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len, void *user_data) {
+    nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)user_data;
+    
+    if (!ctx->connected || nats_send(ctx, subject, headers, header_count, data, len) != NATS_OK) {
+        return SWITCH_STATUS_FALSE;
+    }
+    counter_inc(ctx->counters, NATS_COUNTER_SENT);
+    counter_add(ctx->counters, NATS_COUNTER_BYTES, len);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/*
+ * Replays the spool in order whenever the connection is up. The backlog drains
+ * at spool_replay_rate events/s; events appended while connected are live
+ * traffic queued behind it and are replayed on top of that budget, so the
+ * rate never throttles live publishing and the backlog always shrinks.
+ */
+static void *SWITCH_THREAD_FUNC nats_replay_thread(switch_thread_t *thread, void *obj) {
+    nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)obj;
+    uint32_t per_tick = ctx->spool_replay_rate * NATS_REPLAY_TICK_MS / 1000;
+    switch_time_t window_start = switch_micro_time_now();
+    uint64_t window_replayed = 0;
+    uint64_t appended_seen = 0;
+    driver_spool_stats_t spool_stats;
+    
+    if (!per_tick) per_tick = 1;
+    
+    while (ctx->replay_running) {
+        switch_time_t now;
+        
+        driver_spool_get_stats(ctx->spool, &spool_stats);
+        if (ctx->connected && spool_stats.pending) {
+            uint64_t budget = spool_stats.appended - appended_seen + per_tick;
+            
+            window_replayed += driver_spool_replay(ctx->spool, nats_spool_sink, ctx, budget < UINT32_MAX ? (uint32_t)budget : UINT32_MAX);
+        }
+        appended_seen = spool_stats.appended;
+        
+        now = switch_micro_time_now();
+        if (now - window_start >= 1000000) {
+            ctx->replay_eps = window_replayed * 1000000 / (uint64_t)(now - window_start);
+            window_start = now;
+            window_replayed = 0;
+        }
+        
+        switch_mutex_lock(ctx->mutex);
+        if (ctx->replay_running) {
+            switch_thread_cond_timedwait(ctx->cond, ctx->mutex, NATS_REPLAY_TICK_MS * 1000);
+        }
+        switch_mutex_unlock(ctx->mutex);
+    }
+    
+    return NULL;
+}
+
 static switch_status_t nats_init(event_driver_t *driver, switch_hash_t *config) {
     natsStatus s;
     nats_driver_ctx_t *ctx;
-    const char *url, *token, *nkey_seed;
+    const char *url, *token, *nkey_seed, *value;
     
     ctx = switch_core_alloc(driver->pool, sizeof(nats_driver_ctx_t));
     memset(ctx, 0, sizeof(nats_driver_ctx_t));
     driver->handle = ctx;
     
+    if (!(ctx->counters = counter_group_create(driver->pool))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    
+    ctx->driver = driver;
     switch_core_hash_init(&ctx->subscriptions);
     switch_mutex_init(&ctx->mutex, SWITCH_MUTEX_NESTED, driver->pool);
+    switch_thread_cond_create(&ctx->cond, driver->pool);
+    
+    ctx->buffer_size = NATS_DEFAULT_BUFFER_SIZE;
+    if ((value = switch_core_hash_find(config, "reconnect_buffer_size")) && atoi(value) > 0) {
+        ctx->buffer_size = (uint64_t)atoi(value);
+    }
+    
+    ctx->overflow_policy = NATS_OVERFLOW_DROP_NEWEST;
+    if ((value = switch_core_hash_find(config, "overflow_policy"))) {
+        if (!strcasecmp(value, "drop-oldest-by-priority")) {
+            ctx->overflow_policy = NATS_OVERFLOW_DROP_OLDEST_BY_PRIORITY;
+        } else if (!strcasecmp(value, "block-with-timeout")) {
+            ctx->overflow_policy = NATS_OVERFLOW_BLOCK;
+        } else if (strcasecmp(value, "drop-newest")) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Unknown NATS overflow_policy '%s', using drop-newest\n", value);
+        }
+    }
+    
+    ctx->block_timeout_ms = 1000;
+    if ((value = switch_core_hash_find(config, "overflow_block_timeout_ms"))) {
+        ctx->block_timeout_ms = (uint32_t)atoi(value);
+    }
+    
+    if ((value = switch_core_hash_find(config, "priority_subjects")) && !zstr(value)) {
+        char *copy = switch_core_strdup(driver->pool, value);
+        ctx->priority_count = switch_separate_string(copy, ',', ctx->priority_subjects, NATS_MAX_PRIORITY_SUBJECTS);
+    }
+    
+    if ((value = switch_core_hash_find(config, "event_subjects")) && !zstr(value)) {
+        char *copy = switch_core_strdup(driver->pool, value);
+        ctx->event_subject_count = switch_separate_string(copy, ',', ctx->event_subjects, NATS_MAX_PRIORITY_SUBJECTS);
+    } else {
+        ctx->event_subjects[0] = (char *)NATS_DEFAULT_EVENT_SUBJECTS;
+        ctx->event_subject_count = 1;
+    }
+    
+    if ((value = switch_core_hash_find(config, "jetstream")) && switch_true(value)) {
+        const char *subjects = switch_core_hash_find(config, "jetstream_subjects");
+        
+        if (!zstr(subjects)) {
+            char *copy = switch_core_strdup(driver->pool, subjects);
+            ctx->js_subject_count = switch_separate_string(copy, ',', ctx->js_subjects, NATS_MAX_PRIORITY_SUBJECTS);
+        }
+        ctx->js_max_pending = (value = switch_core_hash_find(config, "jetstream_max_pending")) ? atoi(value) : 0;
+        if (ctx->js_max_pending <= 0) ctx->js_max_pending = 4096;
+        ctx->js_ack_wait_ms = (value = switch_core_hash_find(config, "jetstream_ack_wait_ms")) ? atoi(value) : 0;
+        if (ctx->js_ack_wait_ms <= 0) ctx->js_ack_wait_ms = 5000;
+        ctx->js_max_retries = (value = switch_core_hash_find(config, "jetstream_max_retries")) ? (uint32_t)atoi(value) : 3;
+        switch_core_hash_init(&ctx->js_retries);
+    }
+    
+    if ((value = switch_core_hash_find(config, "spool_dir")) && !zstr(value)) {
+        const char *segment_size = switch_core_hash_find(config, "spool_segment_size");
+        const char *max_bytes = switch_core_hash_find(config, "spool_max_bytes");
+        const char *rate = switch_core_hash_find(config, "spool_replay_rate");
+        
+        ctx->spool = driver_spool_open(driver->pool, value,
+                                       segment_size ? (uint32_t)strtoul(segment_size, NULL, 10) : 16 * 1024 * 1024,
+                                       max_bytes ? (uint64_t)strtoull(max_bytes, NULL, 10) : 256 * 1024 * 1024);
+        ctx->spool_replay_rate = rate ? (uint32_t)atoi(rate) : 0;
+        if (!ctx->spool_replay_rate) ctx->spool_replay_rate = 1000;
+        if (!ctx->spool) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Spool disabled, events will be lost during broker outages\n");
+        }
+    }
     
     url = switch_core_hash_find(config, "url");
     if (!url) url = "nats://127.0.0.1:4222";
@@ -86,13 +566,21 @@ static switch_status_t nats_init(event_driver_t *driver, switch_hash_t *config)
         natsOptions_SetNKeyFromSeed(ctx->opts, NULL, nkey_seed);
     }
     
+    ctx->interest_subject = switch_core_hash_find(config, "interest_subject");
+    if (ctx->interest_subject && strlen(ctx->interest_subject) > 0) {
+        const char *ttl = switch_core_hash_find(config, "interest_ttl_ms");
+        ctx->interest_ttl_ms = ttl ? (uint32_t)atoi(ttl) : 0;
+        if (!ctx->interest_ttl_ms) ctx->interest_ttl_ms = 60000;
+        ctx->interest = driver_interest_create(driver->pool, ctx->interest_ttl_ms);
+    }
+    
     natsOptions_SetClosedCB(ctx->opts, nats_connection_closed_cb, ctx);
     natsOptions_SetDisconnectedCB(ctx->opts, nats_disconnected_cb, ctx);
     natsOptions_SetReconnectedCB(ctx->opts, nats_reconnected_cb, ctx);
     natsOptions_SetErrorHandler(ctx->opts, nats_error_cb, ctx);
     natsOptions_SetMaxReconnect(ctx->opts, 60);
     natsOptions_SetReconnectWait(ctx->opts, 1000);
-    natsOptions_SetReconnectBufSize(ctx->opts, 8 * 1024 * 1024);
+    natsOptions_SetReconnectBufSize(ctx->opts, (int)ctx->buffer_size);
     
     return SWITCH_STATUS_SUCCESS;
 }
@@ -108,12 +596,70 @@ static switch_status_t nats_connect(event_driver_t *driver) {
     }
     
     ctx->connected = SWITCH_TRUE;
+    
+    if (ctx->js_subject_count) {
+        jsOptions js_opts;
+        
+        jsOptions_Init(&js_opts);
+        js_opts.PublishAsync.MaxPending = ctx->js_max_pending;
+        js_opts.PublishAsync.AckHandler = nats_js_ack_cb;
+        js_opts.PublishAsync.AckHandlerClosure = ctx;
+        
+        s = natsConnection_JetStream(&ctx->js, ctx->conn, &js_opts);
+        if (s != NATS_OK) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "NATS JetStream context failed: %s\n", natsStatus_GetText(s));
+            return SWITCH_STATUS_FALSE;
+        }
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] JetStream publishing enabled (window %lld)\n", (long long)ctx->js_max_pending);
+    }
+    
+    if (ctx->interest) {
+        char sync_subject[256];
+        
+        s = natsConnection_Subscribe(&ctx->interest_sub, ctx->conn, ctx->interest_subject, nats_interest_cb, ctx);
+        if (s != NATS_OK) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "NATS interest subscription on %s failed: %s\n", ctx->interest_subject, natsStatus_GetText(s));
+            return SWITCH_STATUS_FALSE;
+        }
+        
+        /* Publish everything for one TTL while consumers answer the sync request */
+        driver_interest_start_grace(ctx->interest, ctx->interest_ttl_ms);
+        switch_snprintf(sync_subject, sizeof(sync_subject), "%s.sync", ctx->interest_subject);
+        natsConnection_Publish(ctx->conn, sync_subject, NULL, 0);
+    }
+    
+    /* Also drains anything spooled before a restart */
+    if (ctx->spool && !ctx->replay_thread) {
+        switch_threadattr_t *thd_attr = NULL;
+        
+        ctx->replay_running = SWITCH_TRUE;
+        switch_threadattr_create(&thd_attr, driver->pool);
+        switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+        if (switch_thread_create(&ctx->replay_thread, thd_attr, nats_replay_thread, ctx, driver->pool) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to start spool replay thread\n");
+            ctx->replay_running = SWITCH_FALSE;
+            ctx->replay_thread = NULL;
+        }
+    }
+    
     return SWITCH_STATUS_SUCCESS;
 }
 
 static switch_status_t nats_disconnect(event_driver_t *driver) {
     nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)driver->handle;
     
+    if (ctx->js) {
+        jsPubOptions opts;
+        
+        /* Give outstanding acks one ack wait to arrive before the connection goes */
+        jsPubOptions_Init(&opts);
+        opts.MaxWait = ctx->js_ack_wait_ms;
+        if (js_PublishAsyncComplete(ctx->js, &opts) != NATS_OK) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] %llu JetStream publishes still unacknowledged at disconnect\n",
+                              (unsigned long long)__atomic_load_n(&ctx->js_inflight, __ATOMIC_RELAXED));
+        }
+    }
+    
     if (ctx->conn) {
         natsConnection_Close(ctx->conn);
         ctx->connected = SWITCH_FALSE;
@@ -125,6 +671,27 @@ static switch_status_t nats_disconnect(event_driver_t *driver) {
 static switch_status_t nats_shutdown(event_driver_t *driver) {
     nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)driver->handle;
     
+    if (ctx->replay_thread) {
+        switch_status_t retval;
+        
+        switch_mutex_lock(ctx->mutex);
+        ctx->replay_running = SWITCH_FALSE;
+        switch_thread_cond_broadcast(ctx->cond);
+        switch_mutex_unlock(ctx->mutex);
+        switch_thread_join(&retval, ctx->replay_thread);
+        ctx->replay_thread = NULL;
+    }
+    
+    if (ctx->interest_sub) {
+        natsSubscription_Destroy(ctx->interest_sub);
+        ctx->interest_sub = NULL;
+    }
+    
+    if (ctx->js) {
+        jsCtx_Destroy(ctx->js);
+        ctx->js = NULL;
+    }
+    
     if (ctx->conn) {
         natsConnection_Destroy(ctx->conn);
         ctx->conn = NULL;
@@ -139,31 +706,184 @@ static switch_status_t nats_shutdown(event_driver_t *driver) {
         switch_core_hash_destroy(&ctx->subscriptions);
     }
     
+    driver_interest_destroy(ctx->interest);
+    
+    if (ctx->js_retries) {
+        switch_core_hash_destroy(&ctx->js_retries);
+    }
+    
+    while (ctx->pending_head) {
+        nats_pending_t *pending = ctx->pending_head;
+        ctx->pending_head = pending->next;
+        nats_pending_free(pending);
+    }
+    ctx->pending_tail = NULL;
+    ctx->pending_msgs = ctx->pending_bytes = 0;
+    
+    /* Whatever is still pending stays on disk for the next start */
+    driver_spool_close(ctx->spool);
+    ctx->spool = NULL;
+    
     return SWITCH_STATUS_SUCCESS;
 }
 
-static switch_status_t nats_publish(event_driver_t *driver, const char *subject, const char *data, size_t len) {
+/*
+ * drop-oldest-by-priority: while disconnected the driver holds events itself
+ * so it can choose what to evict. Returns SWITCH_FALSE when the connection is
+ * up and nothing is queued ahead, so the caller publishes directly.
+ */
+static switch_bool_t nats_buffer_msg(nats_driver_ctx_t *ctx, const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len) {
+    nats_pending_t *pending, *prev, *victim, *victim_prev;
+    switch_bool_t priority = nats_is_priority(ctx, subject);
+    size_t size = len + strlen(subject);
+    size_t i;
+    
+    for (i = 0; i < header_count; i++) {
+        size += strlen(headers[i].name) + strlen(headers[i].value);
+    }
+    
+    switch_mutex_lock(ctx->mutex);
+    
+    if ((ctx->connected && !ctx->pending_head) || natsConnection_IsClosed(ctx->conn)) {
+        switch_mutex_unlock(ctx->mutex);
+        return SWITCH_FALSE;
+    }
+    
+    /* Evict oldest low-priority messages first; high-priority ones only make room for each other */
+    while (ctx->pending_head && ctx->pending_bytes + size > ctx->buffer_size) {
+        victim = victim_prev = NULL;
+        for (prev = NULL, pending = ctx->pending_head; pending; prev = pending, pending = pending->next) {
+            if (!pending->priority) {
+                victim = pending;
+                victim_prev = prev;
+                break;
+            }
+        }
+        if (!victim && priority) {
+            victim = ctx->pending_head;
+        }
+        if (!victim) {
+            break;
+        }
+        
+        if (victim_prev) {
+            victim_prev->next = victim->next;
+        } else {
+            ctx->pending_head = victim->next;
+        }
+        if (ctx->pending_tail == victim) {
+            ctx->pending_tail = victim_prev;
+        }
+        ctx->pending_msgs--;
+        ctx->pending_bytes -= victim->size;
+        ctx->dropped_oldest++;
+        nats_note_lost(ctx);
+        nats_pending_free(victim);
+    }
+    
+    pending = NULL;
+    if (ctx->pending_bytes + size > ctx->buffer_size ||
+        !(pending = calloc(1, sizeof(*pending))) ||
+        nats_build_msg(&pending->msg, subject, headers, header_count, data, len) != NATS_OK) {
+        switch_safe_free(pending);
+        counter_inc(ctx->counters, NATS_COUNTER_DROPPED_NEWEST);
+        nats_note_lost(ctx);
+        switch_mutex_unlock(ctx->mutex);
+        return SWITCH_TRUE;
+    }
+    
+    pending->size = size;
+    pending->priority = priority;
+    if (ctx->pending_tail) {
+        ctx->pending_tail->next = pending;
+    } else {
+        ctx->pending_head = pending;
+    }
+    ctx->pending_tail = pending;
+    ctx->pending_msgs++;
+    ctx->pending_bytes += size;
+    
+    switch_mutex_unlock(ctx->mutex);
+    return SWITCH_TRUE;
+}
+
+/* block-with-timeout: wait for the reconnected callback, up to timeout_ms */
+static switch_bool_t nats_wait_connected(nats_driver_ctx_t *ctx, uint32_t timeout_ms) {
+    switch_time_t deadline = switch_micro_time_now() + (switch_time_t)timeout_ms * 1000;
+    switch_time_t now;
+    
+    switch_mutex_lock(ctx->mutex);
+    while (!ctx->connected && !natsConnection_IsClosed(ctx->conn) && (now = switch_micro_time_now()) < deadline) {
+        switch_thread_cond_timedwait(ctx->cond, ctx->mutex, deadline - now);
+    }
+    switch_mutex_unlock(ctx->mutex);
+    
+    return ctx->connected;
+}
+
+static switch_status_t nats_publish_with_headers(event_driver_t *driver, const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len) {
     nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)driver->handle;
     natsStatus s;
     
-    if (!ctx->conn || !ctx->connected) {
-        ctx->failed++;
+    if (!ctx->conn) {
+        nats_note_lost(ctx);
         return SWITCH_STATUS_FALSE;
     }
     
-    s = natsConnection_Publish(ctx->conn, subject, (const void *)data, (int)len);
+    /* Keep order: once anything is spooled, new events queue behind it until replay catches up.
+       Command replies and other non-event subjects are never spooled */
+    if (ctx->spool && (!ctx->connected || driver_spool_pending(ctx->spool)) && nats_is_event(ctx, subject)) {
+        if (driver_spool_append(ctx->spool, subject, headers, header_count, data, len) == SWITCH_STATUS_SUCCESS) {
+            return SWITCH_STATUS_SUCCESS;
+        }
+    }
+    
+    /* While reconnecting the client library buffers up to reconnect_buffer_size;
+       the overflow policy decides what happens once that is full */
+    if (ctx->overflow_policy == NATS_OVERFLOW_DROP_OLDEST_BY_PRIORITY && (!ctx->connected || ctx->pending_head) && nats_is_event(ctx, subject)) {
+        if (nats_buffer_msg(ctx, subject, headers, header_count, data, len)) {
+            return SWITCH_STATUS_SUCCESS;
+        }
+    }
+    
+    s = nats_send(ctx, subject, headers, header_count, data, len);
+    
+    if (s != NATS_OK && ctx->spool && nats_is_event(ctx, subject) && driver_spool_append(ctx->spool, subject, headers, header_count, data, len) == SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+    
+    if (s == NATS_INSUFFICIENT_BUFFER) {
+        if (ctx->overflow_policy == NATS_OVERFLOW_BLOCK) {
+            counter_inc(ctx->counters, NATS_COUNTER_BLOCKED);
+            if (nats_wait_connected(ctx, ctx->block_timeout_ms)) {
+                s = nats_send(ctx, subject, headers, header_count, data, len);
+            } else {
+                counter_inc(ctx->counters, NATS_COUNTER_BLOCK_TIMEOUTS);
+            }
+        } else {
+            counter_inc(ctx->counters, NATS_COUNTER_DROPPED_NEWEST);
+        }
+    }
+    
     if (s != NATS_OK) {
-        ctx->failed++;
+        nats_note_lost(ctx);
         return SWITCH_STATUS_FALSE;
     }
     
-    ctx->sent++;
-    ctx->bytes += len;
+    counter_inc(ctx->counters, NATS_COUNTER_SENT);
+    counter_add(ctx->counters, NATS_COUNTER_BYTES, len);
     return SWITCH_STATUS_SUCCESS;
 }
 
+static switch_status_t nats_publish(event_driver_t *driver, const char *subject, const char *data, size_t len) {
+    return nats_publish_with_headers(driver, subject, NULL, 0, data, len);
+}
+
 static switch_status_t nats_has_subscribers(event_driver_t *driver, const char *subject, int *count) {
-    *count = 1;
+    nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)driver->handle;
+    
+    /* Without interest tracking every subject counts as wanted */
+    *count = ctx->interest ? driver_interest_count(ctx->interest, subject) : 1;
     return SWITCH_STATUS_SUCCESS;
 }
 
@@ -213,11 +933,66 @@ static switch_bool_t nats_is_connected(event_driver_t *driver) {
     return ctx->connected;
 }
 
-static void nats_get_stats(event_driver_t *driver, uint64_t *sent, uint64_t *failed, uint64_t *bytes) {
+static void nats_get_stats(event_driver_t *driver, driver_stats_t *stats) {
     nats_driver_ctx_t *ctx = (nats_driver_ctx_t *)driver->handle;
-    if (sent) *sent = ctx->sent;
-    if (failed) *failed = ctx->failed;
-    if (bytes) *bytes = ctx->bytes;
+    uint64_t counters[NATS_COUNTER_MAX];
+    uint32_t i;
+    
+    memset(stats, 0, sizeof(*stats));
+    counter_snapshot(ctx->counters, counters, NATS_COUNTER_MAX);
+    stats->sent = counters[NATS_COUNTER_SENT];
+    stats->failed = counters[NATS_COUNTER_FAILED];
+    stats->bytes = counters[NATS_COUNTER_BYTES];
+    stats->reconnects = ctx->reconnects;
+    stats->overflow_policy = nats_overflow_names[ctx->overflow_policy];
+    stats->buffer_size = ctx->buffer_size;
+    stats->dropped_newest = counters[NATS_COUNTER_DROPPED_NEWEST];
+    stats->blocked = counters[NATS_COUNTER_BLOCKED];
+    stats->block_timeouts = counters[NATS_COUNTER_BLOCK_TIMEOUTS];
+    
+    switch_mutex_lock(ctx->mutex);
+    stats->dropped_oldest = ctx->dropped_oldest;
+    if (ctx->overflow_policy == NATS_OVERFLOW_DROP_OLDEST_BY_PRIORITY) {
+        stats->buffered_msgs = ctx->pending_msgs;
+        stats->buffered_bytes = ctx->pending_bytes;
+    } else if (ctx->conn && !ctx->connected) {
+        int pending = natsConnection_Buffered(ctx->conn);
+        stats->buffered_bytes = pending > 0 ? (uint64_t)pending : 0;
+    }
+    stats->in_outage = ctx->outage_started ? SWITCH_TRUE : SWITCH_FALSE;
+    stats->outages = ctx->outages;
+    stats->outage_ms_total = ctx->outage_ms_total;
+    
+    /* Most recent first */
+    for (i = 0; i < ctx->outage_recorded; i++) {
+        stats->outage[i] = ctx->outage_history[(ctx->outage_next + DRIVER_OUTAGE_HISTORY - 1 - i) % DRIVER_OUTAGE_HISTORY];
+    }
+    stats->outage_count = ctx->outage_recorded;
+    switch_mutex_unlock(ctx->mutex);
+    
+    if (ctx->spool) {
+        driver_spool_stats_t spool_stats;
+        
+        driver_spool_get_stats(ctx->spool, &spool_stats);
+        stats->spool_enabled = SWITCH_TRUE;
+        stats->spool_segments = spool_stats.segments;
+        stats->spool_disk_bytes = spool_stats.disk_bytes;
+        stats->spool_pending = spool_stats.pending;
+        stats->spool_appended = spool_stats.appended;
+        stats->spool_replayed = spool_stats.replayed;
+        stats->spool_dropped = spool_stats.dropped;
+        stats->spool_replay_rate = ctx->spool_replay_rate;
+        stats->spool_replay_eps = ctx->replay_eps;
+    }
+    
+    if (ctx->js_subject_count) {
+        stats->jetstream_enabled = SWITCH_TRUE;
+        stats->js_max_pending = (uint64_t)ctx->js_max_pending;
+        stats->js_inflight = __atomic_load_n(&ctx->js_inflight, __ATOMIC_RELAXED);
+        stats->js_acked = ctx->js_acked;
+        stats->js_retried = ctx->js_retried;
+        stats->js_failed = ctx->js_failed;
+    }
 }
 
 event_driver_t *driver_nats_create(switch_memory_pool_t *pool) {
@@ -231,6 +1006,7 @@ event_driver_t *driver_nats_create(switch_memory_pool_t *pool) {
     driver->disconnect = nats_disconnect;
     driver->shutdown = nats_shutdown;
     driver->publish = nats_publish;
+    driver->publish_with_headers = nats_publish_with_headers;
     driver->has_subscribers = nats_has_subscribers;
     driver->subscribe = nats_subscribe;
     driver->unsubscribe = nats_unsubscribe;
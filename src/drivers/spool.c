@@ -0,0 +1,472 @@
+#include "spool.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define SPOOL_MAGIC "EASPOOL1"
+#define SPOOL_HEADER_SIZE 64
+#define SPOOL_MAX_HEADERS 16
+#define SPOOL_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+typedef struct {
+    char magic[8];
+    uint64_t seq;
+    uint64_t read_offset;
+} spool_segment_header_t;
+
+/*
+ * Record layout, 8-byte aligned:
+ *   uint32 record length (written last; 0 marks the end of the segment)
+ *   uint32 data length, uint16 header count, uint16 subject length
+ *   subject\0, name\0value\0 per header, data
+ */
+#define SPOOL_RECORD_FIXED 12
+
+struct driver_spool_s {
+    switch_mutex_t *mutex;
+    const char *dir;
+    uint32_t segment_size;
+    uint64_t max_bytes;
+
+    /* Segment sequence numbers, oldest first */
+    uint64_t *seqs;
+    uint32_t count;
+    uint32_t capacity;
+
+    char *head;
+    size_t head_size;
+    size_t head_end;
+    char *tail;
+    size_t tail_size;
+    size_t tail_offset;
+
+    uint64_t pending;
+    uint64_t appended;
+    uint64_t replayed;
+    uint64_t dropped;
+    switch_bool_t replaying;
+};
+
+static void segment_path(driver_spool_t *spool, uint64_t seq, char *buf, size_t len)
+{
+    switch_snprintf(buf, len, "%s%s%020llu.seg", spool->dir, SWITCH_PATH_SEPARATOR, (unsigned long long)seq);
+}
+
+static char *segment_map(driver_spool_t *spool, uint64_t seq, switch_bool_t create, size_t *size)
+{
+    spool_segment_header_t *header;
+    char path[1024];
+    struct stat st;
+    char *map;
+    int fd;
+
+    segment_path(spool, seq, path, sizeof(path));
+
+    if ((fd = open(path, create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0640)) < 0) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Cannot open spool segment %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    if (create && ftruncate(fd, spool->segment_size) != 0) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Cannot size spool segment %s: %s", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < SPOOL_HEADER_SIZE) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Ignoring truncated spool segment %s", path);
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Cannot map spool segment %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    header = (spool_segment_header_t *)map;
+    if (create) {
+        memcpy(header->magic, SPOOL_MAGIC, sizeof(header->magic));
+        header->seq = seq;
+        header->read_offset = SPOOL_HEADER_SIZE;
+    } else if (memcmp(header->magic, SPOOL_MAGIC, sizeof(header->magic))) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Ignoring spool segment %s with bad magic", path);
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+
+    *size = (size_t)st.st_size;
+    return map;
+}
+
+/* Offset just past the last complete record */
+static size_t segment_end(const char *map, size_t size)
+{
+    size_t offset = SPOOL_HEADER_SIZE;
+    uint32_t len;
+
+    while (offset + SPOOL_RECORD_FIXED <= size) {
+        len = __atomic_load_n((const uint32_t *)(map + offset), __ATOMIC_ACQUIRE);
+        if (!len || len > size - offset) {
+            break;
+        }
+        offset += len;
+    }
+    return offset;
+}
+
+static uint64_t segment_records(const char *map, size_t from, size_t end)
+{
+    uint64_t records = 0;
+
+    while (from < end) {
+        from += *(const uint32_t *)(map + from);
+        records++;
+    }
+    return records;
+}
+
+static switch_status_t push_seq(driver_spool_t *spool, uint64_t seq)
+{
+    if (spool->count == spool->capacity) {
+        uint32_t capacity = spool->capacity ? spool->capacity * 2 : 16;
+        uint64_t *seqs = realloc(spool->seqs, capacity * sizeof(uint64_t));
+
+        if (!seqs) {
+            return SWITCH_STATUS_MEMERR;
+        }
+        spool->seqs = seqs;
+        spool->capacity = capacity;
+    }
+    spool->seqs[spool->count++] = seq;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static int compare_seq(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Starts a new tail segment; caller holds the mutex */
+static switch_status_t rotate(driver_spool_t *spool)
+{
+    uint64_t seq = spool->count ? spool->seqs[spool->count - 1] + 1 : 1;
+    size_t size;
+    char *map;
+
+    if (push_seq(spool, seq) != SWITCH_STATUS_SUCCESS || !(map = segment_map(spool, seq, SWITCH_TRUE, &size))) {
+        if (spool->count && spool->seqs[spool->count - 1] == seq) {
+            spool->count--;
+        }
+        return SWITCH_STATUS_FALSE;
+    }
+
+    if (spool->tail == spool->head) {
+        spool->head_end = spool->tail_offset;
+    } else if (spool->tail) {
+        munmap(spool->tail, spool->tail_size);
+    }
+
+    spool->tail = map;
+    spool->tail_size = size;
+    spool->tail_offset = SPOOL_HEADER_SIZE;
+    if (!spool->head) {
+        spool->head = map;
+        spool->head_size = size;
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Deletes the fully replayed head segment and maps the next one; caller holds the mutex */
+static void retire_head(driver_spool_t *spool)
+{
+    char path[1024];
+
+    munmap(spool->head, spool->head_size);
+    segment_path(spool, spool->seqs[0], path, sizeof(path));
+    unlink(path);
+
+    memmove(spool->seqs, spool->seqs + 1, (spool->count - 1) * sizeof(uint64_t));
+    spool->count--;
+    spool->head = NULL;
+
+    while (spool->count > 1) {
+        if ((spool->head = segment_map(spool, spool->seqs[0], SWITCH_FALSE, &spool->head_size))) {
+            spool->head_end = segment_end(spool->head, spool->head_size);
+            return;
+        }
+        /* Unreadable segment: leave the file for inspection and move on */
+        memmove(spool->seqs, spool->seqs + 1, (spool->count - 1) * sizeof(uint64_t));
+        spool->count--;
+    }
+
+    spool->head = spool->tail;
+    spool->head_size = spool->tail_size;
+}
+
+driver_spool_t *driver_spool_open(switch_memory_pool_t *pool, const char *dir, uint32_t segment_size, uint64_t max_bytes)
+{
+    driver_spool_t *spool;
+    switch_dir_t *dirp = NULL;
+    const char *name;
+    char buf[256];
+    uint32_t i, valid = 0;
+
+    if (zstr(dir)) {
+        return NULL;
+    }
+
+    spool = switch_core_alloc(pool, sizeof(*spool));
+    memset(spool, 0, sizeof(*spool));
+    spool->dir = switch_core_strdup(pool, dir);
+    spool->segment_size = segment_size > SPOOL_HEADER_SIZE * 16 ? (uint32_t)SPOOL_ALIGN(segment_size) : SPOOL_HEADER_SIZE * 16;
+    spool->max_bytes = max_bytes > spool->segment_size ? max_bytes : spool->segment_size;
+    switch_mutex_init(&spool->mutex, SWITCH_MUTEX_NESTED, pool);
+
+    if (switch_dir_make_recursive(dir, SWITCH_DEFAULT_DIR_PERMS, pool) != SWITCH_STATUS_SUCCESS ||
+        switch_dir_open(&dirp, dir, pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Cannot open spool directory %s", dir);
+        return NULL;
+    }
+
+    while ((name = switch_dir_next_file(dirp, buf, sizeof(buf)))) {
+        unsigned long long seq;
+        char suffix[8];
+
+        if (sscanf(name, "%20llu%7s", &seq, suffix) == 2 && !strcmp(suffix, ".seg") && seq) {
+            push_seq(spool, (uint64_t)seq);
+        }
+    }
+    switch_dir_close(dirp);
+
+    if (spool->count) {
+        qsort(spool->seqs, spool->count, sizeof(uint64_t), compare_seq);
+    }
+
+    /* Recover segments left by a previous run, keeping only head and tail mapped */
+    for (i = 0; i < spool->count; i++) {
+        spool_segment_header_t *header;
+        size_t size, end;
+        char *map;
+
+        if (!(map = segment_map(spool, spool->seqs[i], SWITCH_FALSE, &size))) {
+            continue;
+        }
+
+        header = (spool_segment_header_t *)map;
+        end = segment_end(map, size);
+        if (header->read_offset < SPOOL_HEADER_SIZE || header->read_offset > end) {
+            header->read_offset = end;
+        }
+        spool->pending += segment_records(map, (size_t)header->read_offset, end);
+        spool->seqs[valid++] = spool->seqs[i];
+
+        if (spool->tail && spool->tail != spool->head) {
+            munmap(spool->tail, spool->tail_size);
+        }
+        if (!spool->head) {
+            spool->head = map;
+            spool->head_size = size;
+        } else if (spool->head == spool->tail) {
+            spool->head_end = spool->tail_offset;
+        }
+        spool->tail = map;
+        spool->tail_size = size;
+        spool->tail_offset = end;
+    }
+    spool->count = valid;
+
+    /* Clear whatever a crash left past the last complete record before appending after it */
+    if (spool->tail) {
+        memset(spool->tail + spool->tail_offset, 0, spool->tail_size - spool->tail_offset);
+    }
+
+    if (!spool->tail && rotate(spool) != SWITCH_STATUS_SUCCESS) {
+        free(spool->seqs);
+        return NULL;
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Spool %s opened: %u segments, %llu pending",
+                      dir, spool->count, (unsigned long long)spool->pending);
+    return spool;
+}
+
+void driver_spool_close(driver_spool_t *spool)
+{
+    if (!spool) {
+        return;
+    }
+
+    switch_mutex_lock(spool->mutex);
+    if (spool->head && spool->head != spool->tail) {
+        msync(spool->head, spool->head_size, MS_SYNC);
+        munmap(spool->head, spool->head_size);
+    }
+    if (spool->tail) {
+        msync(spool->tail, spool->tail_size, MS_SYNC);
+        munmap(spool->tail, spool->tail_size);
+    }
+    spool->head = spool->tail = NULL;
+    switch_safe_free(spool->seqs);
+    spool->count = spool->capacity = 0;
+    switch_mutex_unlock(spool->mutex);
+}
+
+switch_status_t driver_spool_append(driver_spool_t *spool, const char *subject, const driver_header_t *headers, size_t header_count,
+                                    const char *data, size_t len)
+{
+    size_t subject_len = strlen(subject);
+    size_t body = SPOOL_RECORD_FIXED + subject_len + 1 + len;
+    size_t need, i;
+    char *record, *p;
+
+    for (i = 0; i < header_count; i++) {
+        body += strlen(headers[i].name) + strlen(headers[i].value) + 2;
+    }
+    need = SPOOL_ALIGN(body);
+
+    switch_mutex_lock(spool->mutex);
+
+    if (header_count > SPOOL_MAX_HEADERS || subject_len > UINT16_MAX || need > spool->segment_size - SPOOL_HEADER_SIZE) {
+        goto drop;
+    }
+
+    if (spool->tail_offset + need > spool->tail_size) {
+        if ((uint64_t)(spool->count + 1) * spool->segment_size > spool->max_bytes || rotate(spool) != SWITCH_STATUS_SUCCESS) {
+            goto drop;
+        }
+    }
+
+    record = spool->tail + spool->tail_offset;
+    p = record + 4;
+    *(uint32_t *)p = (uint32_t)len;
+    *(uint16_t *)(p + 4) = (uint16_t)header_count;
+    *(uint16_t *)(p + 6) = (uint16_t)subject_len;
+    p = record + SPOOL_RECORD_FIXED;
+    memcpy(p, subject, subject_len + 1);
+    p += subject_len + 1;
+    for (i = 0; i < header_count; i++) {
+        size_t n = strlen(headers[i].name) + 1;
+        size_t v = strlen(headers[i].value) + 1;
+
+        memcpy(p, headers[i].name, n);
+        memcpy(p + n, headers[i].value, v);
+        p += n + v;
+    }
+    if (len) {
+        memcpy(p, data, len);
+    }
+
+    /* Publish the length last so a crash never exposes a partial record */
+    __atomic_store_n((uint32_t *)record, (uint32_t)need, __ATOMIC_RELEASE);
+    spool->tail_offset += need;
+    spool->pending++;
+    spool->appended++;
+
+    switch_mutex_unlock(spool->mutex);
+    return SWITCH_STATUS_SUCCESS;
+
+  drop:
+    spool->dropped++;
+    switch_mutex_unlock(spool->mutex);
+    return SWITCH_STATUS_FALSE;
+}
+
+uint32_t driver_spool_replay(driver_spool_t *spool, driver_spool_sink_t sink, void *user_data, uint32_t max)
+{
+    driver_header_t headers[SPOOL_MAX_HEADERS];
+    spool_segment_header_t *header;
+    uint32_t replayed = 0;
+    switch_status_t status;
+
+    switch_mutex_lock(spool->mutex);
+
+    if (spool->replaying) {
+        switch_mutex_unlock(spool->mutex);
+        return 0;
+    }
+    spool->replaying = SWITCH_TRUE;
+
+    while (replayed < max && spool->pending) {
+        size_t end = spool->head == spool->tail ? spool->tail_offset : spool->head_end;
+        size_t offset, header_count, i;
+        uint32_t len, data_len;
+        const char *record, *subject, *p;
+
+        header = (spool_segment_header_t *)spool->head;
+        offset = (size_t)header->read_offset;
+
+        if (offset >= end) {
+            if (spool->head == spool->tail) {
+                spool->pending = 0;
+                break;
+            }
+            retire_head(spool);
+            continue;
+        }
+
+        record = spool->head + offset;
+        len = *(const uint32_t *)record;
+        data_len = *(const uint32_t *)(record + 4);
+        header_count = *(const uint16_t *)(record + 8);
+        subject = record + SPOOL_RECORD_FIXED;
+        p = subject + *(const uint16_t *)(record + 10) + 1;
+        for (i = 0; i < header_count && i < SPOOL_MAX_HEADERS; i++) {
+            headers[i].name = p;
+            p += strlen(p) + 1;
+            headers[i].value = p;
+            p += strlen(p) + 1;
+        }
+
+        /* Only the replayer retires or wipes the head, so the record stays mapped while the sink publishes unlocked */
+        switch_mutex_unlock(spool->mutex);
+        status = sink(subject, headers, i, p, data_len, user_data);
+        switch_mutex_lock(spool->mutex);
+        if (status != SWITCH_STATUS_SUCCESS) {
+            break;
+        }
+
+        header->read_offset = offset + len;
+        spool->pending--;
+        spool->replayed++;
+        replayed++;
+    }
+
+    /* Drained: wipe the single remaining segment and reuse it */
+    header = (spool_segment_header_t *)spool->head;
+    if (spool->head == spool->tail && header->read_offset >= spool->tail_offset && spool->tail_offset > SPOOL_HEADER_SIZE) {
+        memset(spool->tail + SPOOL_HEADER_SIZE, 0, spool->tail_offset - SPOOL_HEADER_SIZE);
+        header->read_offset = SPOOL_HEADER_SIZE;
+        spool->tail_offset = SPOOL_HEADER_SIZE;
+        spool->pending = 0;
+    }
+
+    spool->replaying = SWITCH_FALSE;
+    switch_mutex_unlock(spool->mutex);
+    return replayed;
+}
+
+uint64_t driver_spool_pending(driver_spool_t *spool)
+{
+    return __atomic_load_n(&spool->pending, __ATOMIC_RELAXED);
+}
+
+void driver_spool_get_stats(driver_spool_t *spool, driver_spool_stats_t *stats)
+{
+    switch_mutex_lock(spool->mutex);
+    stats->segments = spool->count;
+    stats->disk_bytes = (uint64_t)spool->count * spool->segment_size;
+    stats->pending = spool->pending;
+    stats->appended = spool->appended;
+    stats->replayed = spool->replayed;
+    stats->dropped = spool->dropped;
+    switch_mutex_unlock(spool->mutex);
+}
@@ -0,0 +1,41 @@
+#ifndef DRIVER_SPOOL_H
+#define DRIVER_SPOOL_H
+
+#include "interface.h"
+
+/*
+ * Append-only disk spool for messages the broker could not take. The spool
+ * directory holds fixed-size memory-mapped segments named <seq>.seg; a
+ * segment header records how far it has been replayed, so pending messages
+ * survive restarts. Fully replayed segments are deleted.
+ */
+typedef struct driver_spool_s driver_spool_t;
+
+typedef struct {
+    uint32_t segments;
+    uint64_t disk_bytes;
+    uint64_t pending;
+    uint64_t appended;
+    uint64_t replayed;
+    uint64_t dropped;
+} driver_spool_stats_t;
+
+/* Called for each replayed message in order; a failure stops replay and keeps the message */
+typedef switch_status_t (*driver_spool_sink_t)(const char *subject, const driver_header_t *headers, size_t header_count,
+                                               const char *data, size_t len, void *user_data);
+
+driver_spool_t *driver_spool_open(switch_memory_pool_t *pool, const char *dir, uint32_t segment_size, uint64_t max_bytes);
+void driver_spool_close(driver_spool_t *spool);
+
+/* Fails when the message would exceed max_bytes or a whole segment */
+switch_status_t driver_spool_append(driver_spool_t *spool, const char *subject, const driver_header_t *headers, size_t header_count,
+                                    const char *data, size_t len);
+
+/* Replays at most max messages; returns how many were delivered. The sink runs without the spool lock,
+   so appends carry on meanwhile; a concurrent second replay returns 0 */
+uint32_t driver_spool_replay(driver_spool_t *spool, driver_spool_sink_t sink, void *user_data, uint32_t max);
+
+uint64_t driver_spool_pending(driver_spool_t *spool);
+void driver_spool_get_stats(driver_spool_t *spool, driver_spool_stats_t *stats);
+
+#endif /* DRIVER_SPOOL_H */
@@ -1,71 +1,70 @@
 #include "mod_event_agent.h"
+#include "pipeline.h"
+#include "subject.h"
+#include "serializer.h"
+#include "batch.h"
+#include "ratelimit.h"
+#include "predicate.h"
+#include "retention.h"
+#include "../core/metrics.h"
 
 static switch_bool_t should_publish_event(switch_event_t *event)
 {
-    const char *event_name;
-    uint32_t i;
+    const event_filter_t *filter = &globals.event_filter;
+    const switch_bool_t custom = event->event_id == SWITCH_EVENT_CUSTOM && !zstr(event->subclass_name);
 
-    if (!event) {
+    if (event->event_id >= SWITCH_EVENT_ALL) {
         return SWITCH_FALSE;
     }
 
-    event_name = switch_event_name(event->event_id);
+    if (event_filter_test(filter->exclude, event->event_id)) {
+        return SWITCH_FALSE;
+    }
 
-    if (globals.exclude_count > 0) {
-        for (i = 0; i < globals.exclude_count; i++) {
-            if (globals.exclude_events[i] && 
-                !strcasecmp(event_name, globals.exclude_events[i])) {
-                return SWITCH_FALSE;
-            }
-        }
+    if (custom && filter->exclude_subclasses && switch_core_hash_find(filter->exclude_subclasses, event->subclass_name)) {
+        return SWITCH_FALSE;
     }
 
-    if (globals.include_count > 0) {
-        for (i = 0; i < globals.include_count; i++) {
-            if (globals.include_events[i] && 
-                !strcasecmp(event_name, globals.include_events[i])) {
-                return SWITCH_TRUE;
-            }
+    if (filter->has_include) {
+        if (!event_filter_test(filter->include, event->event_id) &&
+            !(custom && filter->include_subclasses && switch_core_hash_find(filter->include_subclasses, event->subclass_name))) {
+            return SWITCH_FALSE;
         }
+    } else if (!globals.publish_all_events) {
         return SWITCH_FALSE;
     }
 
-    return globals.publish_all_events;
+    return event_predicate_allows(event);
 }
 
-static char *build_subject(switch_event_t *event)
+/* Checked before the event is copied into the pipeline, so unheard events cost no dup or serialization */
+static switch_bool_t has_interest(switch_event_t *event, const char *event_name)
 {
-    const char *event_name;
-    char *subject;
-    char lowercase_name[256];
-    char *p;
+    char subject_buf[EVENT_SUBJECT_MAX];
+    const char *subject;
+    int num_subscribers = 0;
 
-    if (!event) {
-        return NULL;
+    if (!(subject = event_subject_lookup(event, subject_buf, sizeof(subject_buf)))) {
+        return SWITCH_TRUE;
     }
 
-    event_name = switch_event_name(event->event_id);
-    
-    switch_copy_string(lowercase_name, event_name, sizeof(lowercase_name));
-    for (p = lowercase_name; *p; p++) {
-        *p = tolower(*p);
-        if (*p == '_') {
-            *p = '.';
-        }
+    if (globals.driver->has_subscribers(globals.driver, subject, &num_subscribers) != SWITCH_STATUS_SUCCESS) {
+        num_subscribers = 1;
     }
 
-    subject = switch_mprintf("%s.events.%s", globals.subject_prefix, lowercase_name);
-
-    return subject;
+    if (num_subscribers == 0) {
+        counter_inc(&globals.counters, AGENT_COUNTER_EVENTS_SKIPPED_NO_SUBSCRIBERS);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Skipping event %s: no subscribers on %s", event_name ? event_name : "unknown", subject);
+        return SWITCH_FALSE;
+    }
+    return SWITCH_TRUE;
 }
 
 void event_callback(switch_event_t *event)
 {
-    char *json_str = NULL;
-    char *subject = NULL;
-    switch_status_t status;
-    int num_subscribers = 0;
     const char *event_name = NULL;
+    event_ratelimit_result_t verdict;
+    uint64_t start;
 
     if (!event) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] event_callback invoked with NULL event");
@@ -73,67 +72,142 @@ void event_callback(switch_event_t *event)
     }
 
     event_name = switch_event_name(event->event_id);
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] event_callback entered (%s)", event_name ? event_name : "unknown");
 
-    if (!globals.running || !globals.driver || !globals.driver->is_connected(globals.driver)) {
+    /* Disconnects are left to the driver's overflow policy so outage losses are counted */
+    if (!globals.running || !globals.driver) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Skipping event %s: driver not ready", event_name ? event_name : "unknown");
         return;
     }
 
+    start = metrics_start();
+
     if (!should_publish_event(event)) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Event %s filtered out (include/exclude rules)", event_name ? event_name : "unknown");
+        metrics_stage_lap(METRICS_STAGE_EVENT_FILTER, start);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Event %s filtered out (include/exclude/filter rules)", event_name ? event_name : "unknown");
         return;
     }
 
-    subject = build_subject(event);
+    if (!has_interest(event, event_name)) {
+        metrics_stage_lap(METRICS_STAGE_EVENT_FILTER, start);
+        return;
+    }
+
+    verdict = event_ratelimit_check(event);
+    metrics_stage_lap(METRICS_STAGE_EVENT_FILTER, start);
+
+    switch (verdict) {
+    case EVENT_RATELIMIT_DROP:
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Event %s dropped: over rate limit", event_name ? event_name : "unknown");
+        return;
+    case EVENT_RATELIMIT_HELD:
+        return;
+    default:
+        break;
+    }
+
+    if (!event_pipeline_submit(event)) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Event %s dropped: publish queue full", event_name ? event_name : "unknown");
+    }
+}
+
+void event_adapter_publish(switch_event_t *event, event_publisher_t *publisher)
+{
+    const event_serializer_t *serializer = event_serializer_get(globals.event_format);
+    const char *payload = NULL;
+    size_t payload_len = 0;
+    char subject_buf[EVENT_SUBJECT_MAX];
+    const char *subject;
+    switch_status_t status;
+    const char *event_name = switch_event_name(event->event_id);
+    driver_header_t headers[2];
+    size_t header_count = 0;
+    char msg_id[256];
+    uint64_t node_seq, type_seq;
+    uint64_t start;
+
+    subject = event_subject_lookup(event, subject_buf, sizeof(subject_buf));
     if (!subject) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to build subject for event %s", event_name ? event_name : "unknown");
         return;
     }
 
-    if (globals.driver->has_subscribers(globals.driver, subject, &num_subscribers) != SWITCH_STATUS_SUCCESS) {
-        num_subscribers = 1;
-    }
-    
-    if (num_subscribers == 0) {
-        globals.events_skipped_no_subscribers++;
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Skipping event %s: no subscribers on %s", event_name ? event_name : "unknown", subject);
-        switch_safe_free(subject);
+    start = metrics_start();
+    node_seq = event_sequence_next();
+    type_seq = event_subject_sequence_next(event);
+    payload = event_serialize(serializer, event, globals.node_id, node_seq, type_seq, publisher ? publisher->delta : NULL, &payload_len);
+    metrics_stage_lap(METRICS_STAGE_EVENT_SERIALIZE, start);
+    if (!payload) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to serialize event %s to %s", event_name ? event_name : "unknown", serializer->name);
+        /* The sequences are already spent; let replay report the hole instead of leaving it open */
+        event_retention_store_dropped(node_seq, subject, type_seq);
         return;
     }
 
-    json_str = serialize_event_to_json(event, globals.node_id);
-    if (!json_str) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to serialize event %s to JSON", event_name ? event_name : "unknown");
-        switch_safe_free(subject);
+    event_retention_store(node_seq, subject, payload, payload_len);
+
+    if (publisher && publisher->batcher) {
+        event_batcher_add(publisher->batcher, subject, payload, payload_len, serializer->name);
         return;
     }
 
-    size_t payload_len = strlen(json_str);
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Publishing event %s to %s (%zu bytes)", event_name ? event_name : "unknown", subject, payload_len);
 
-    status = globals.driver->publish(globals.driver, subject, json_str, payload_len);
+    /* JSON stays header-less so existing consumers see the same messages; a missing Content-Type means JSON */
+    if (globals.event_format != EVENT_FORMAT_JSON) {
+        headers[header_count].name = EVENT_CONTENT_TYPE_HEADER;
+        headers[header_count++].value = serializer->content_type;
+    }
+
+    /* Stable across retries and spool replays: node, FreeSWITCH Event-Sequence and call */
+    if (globals.jetstream) {
+        const char *sequence = switch_event_get_header(event, "Event-Sequence");
+        const char *uuid = switch_event_get_header(event, "Unique-ID");
+
+        switch_snprintf(msg_id, sizeof(msg_id), "%s-%s-%s", globals.node_id, sequence ? sequence : "0", uuid ? uuid : "none");
+        headers[header_count].name = DRIVER_MSG_ID_HEADER;
+        headers[header_count++].value = msg_id;
+    }
+
+    start = metrics_start();
+    if (header_count && globals.driver->publish_with_headers) {
+        status = globals.driver->publish_with_headers(globals.driver, subject, headers, header_count, payload, payload_len);
+    } else {
+        status = globals.driver->publish(globals.driver, subject, payload, payload_len);
+    }
+    metrics_stage_lap(METRICS_STAGE_EVENT_PUBLISH, start);
     if (status != SWITCH_STATUS_SUCCESS) {
-        globals.events_failed++;
+        counter_inc(&globals.counters, AGENT_COUNTER_EVENTS_FAILED);
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Driver failed to publish event %s to %s", event_name ? event_name : "unknown", subject);
     } else {
-        globals.events_published++;
-        globals.bytes_published += payload_len;
+        counter_inc(&globals.counters, AGENT_COUNTER_EVENTS_PUBLISHED);
+        counter_add(&globals.counters, AGENT_COUNTER_BYTES_PUBLISHED, payload_len);
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Event %s published successfully", event_name ? event_name : "unknown");
     }
+}
 
-    free_serialized_event(json_str);
-    switch_safe_free(subject);
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] event_callback exit (%s)", event_name ? event_name : "unknown");
+void event_adapter_publish_failed(event_driver_t *driver, const char *subject, uint32_t events, void *user_data)
+{
+    counter_add(&globals.counters, AGENT_COUNTER_EVENTS_FAILED, events);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] %u events to %s lost after publish", events, subject);
 }
 
 switch_status_t event_adapter_init(void)
 {
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Initializing event adapter");
 
+    if (event_retention_init(globals.retention_max_events, globals.retention_max_bytes) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Failed to allocate retention ring, events.replay disabled");
+    }
+
+    if (event_pipeline_start(globals.pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to start publishing pipeline");
+        return SWITCH_STATUS_FALSE;
+    }
+
     if (switch_event_bind("mod_event_agent", SWITCH_EVENT_ALL, SWITCH_EVENT_SUBCLASS_ANY,
                          event_callback, NULL) != SWITCH_STATUS_SUCCESS) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to bind to FreeSWITCH events");
+        event_pipeline_stop();
         return SWITCH_STATUS_FALSE;
     }
 
@@ -146,6 +220,9 @@ switch_status_t event_adapter_shutdown(void)
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Shutting down event adapter");
     
     switch_event_unbind_callback(event_callback);
+    event_ratelimit_flush_all();
+    event_pipeline_stop();
+    event_retention_destroy();
     
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Event adapter shutdown complete");
     return SWITCH_STATUS_SUCCESS;
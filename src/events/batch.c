@@ -0,0 +1,241 @@
+#include "batch.h"
+#include "buffer.h"
+#include "subject.h"
+#include "../core/metrics.h"
+
+#define BATCH_MAX_OPEN 32
+#define BATCH_RECORD_OVERHEAD 6
+
+typedef struct {
+    char subject[EVENT_SUBJECT_MAX];
+    uint32_t hash;
+    const char *format;
+    event_buffer_t buf;
+    uint32_t count;
+    switch_time_t opened;
+    uint64_t append_time_total;
+} event_batch_t;
+
+struct event_batcher_s {
+    event_batch_t batches[BATCH_MAX_OPEN];
+    uint32_t open;
+};
+
+static event_batch_stats_t g_stats = {0};
+
+/* Batch message ids for JetStream de-duplication */
+static uint64_t g_batch_seq = 0;
+
+static void put_be(char *dst, uint32_t value, int width)
+{
+    int i;
+
+    for (i = 0; i < width; i++) {
+        dst[i] = (char)((value >> ((width - 1 - i) * 8)) & 0xff);
+    }
+}
+
+event_batcher_t *event_batcher_create(switch_memory_pool_t *pool)
+{
+    event_batcher_t *batcher = switch_core_alloc(pool, sizeof(*batcher));
+
+    memset(batcher, 0, sizeof(*batcher));
+    return batcher;
+}
+
+void event_batcher_destroy(event_batcher_t *batcher)
+{
+    uint32_t i;
+
+    if (!batcher) {
+        return;
+    }
+
+    for (i = 0; i < BATCH_MAX_OPEN; i++) {
+        event_buffer_free(&batcher->batches[i].buf);
+    }
+}
+
+static void batch_flush(event_batcher_t *batcher, uint32_t index)
+{
+    event_batch_t *batch = &batcher->batches[index];
+    switch_time_t now = switch_time_now();
+    uint64_t latency_total;
+    uint64_t latency_max;
+    uint64_t seen;
+    uint64_t start;
+    switch_status_t status = SWITCH_STATUS_FALSE;
+    char count_str[16];
+    char msg_id[128];
+    driver_header_t headers[4] = {
+        { "Content-Type", EVENT_BATCH_CONTENT_TYPE },
+        { EVENT_BATCH_FORMAT_HEADER, batch->format },
+        { EVENT_BATCH_COUNT_HEADER, count_str },
+        { DRIVER_MSG_ID_HEADER, msg_id }
+    };
+
+    if (!batch->count) {
+        return;
+    }
+
+    switch_snprintf(count_str, sizeof(count_str), "%u", batch->count);
+    if (globals.jetstream) {
+        switch_snprintf(msg_id, sizeof(msg_id), "%s-b%ld-%llu", globals.node_id, (long)globals.startup_time,
+                        (unsigned long long)__atomic_add_fetch(&g_batch_seq, 1, __ATOMIC_RELAXED));
+    }
+
+    start = metrics_start();
+    if (globals.driver && globals.driver->publish_with_headers) {
+        status = globals.driver->publish_with_headers(globals.driver, batch->subject, headers, globals.jetstream ? 4 : 3, batch->buf.data, batch->buf.len);
+    }
+    metrics_stage_lap(METRICS_STAGE_EVENT_PUBLISH, start);
+
+    if (status == SWITCH_STATUS_SUCCESS) {
+        counter_add(&globals.counters, AGENT_COUNTER_EVENTS_PUBLISHED, batch->count);
+        counter_add(&globals.counters, AGENT_COUNTER_BYTES_PUBLISHED, batch->buf.len);
+    } else {
+        counter_add(&globals.counters, AGENT_COUNTER_EVENTS_FAILED, batch->count);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Driver failed to publish batch of %u events to %s", batch->count, batch->subject);
+    }
+
+    /* Added latency: how long each event waited in the batch */
+    latency_total = (uint64_t)now * batch->count - batch->append_time_total;
+    latency_max = (uint64_t)(now - batch->opened);
+
+    __atomic_fetch_add(&g_stats.batches, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_stats.events, batch->count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_stats.latency_us_total, latency_total, __ATOMIC_RELAXED);
+
+    seen = __atomic_load_n(&g_stats.max_batch_events, __ATOMIC_RELAXED);
+    while (batch->count > seen && !__atomic_compare_exchange_n(&g_stats.max_batch_events, &seen, batch->count, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    seen = __atomic_load_n(&g_stats.latency_us_max, __ATOMIC_RELAXED);
+    while (latency_max > seen && !__atomic_compare_exchange_n(&g_stats.latency_us_max, &seen, latency_max, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    batch->count = 0;
+    batch->append_time_total = 0;
+    event_buffer_reset(&batch->buf);
+
+    /* Keep open batches packed at the front */
+    if (index != batcher->open - 1) {
+        event_batch_t tmp = batcher->batches[index];
+        batcher->batches[index] = batcher->batches[batcher->open - 1];
+        batcher->batches[batcher->open - 1] = tmp;
+    }
+    batcher->open--;
+}
+
+static uint32_t batch_open(event_batcher_t *batcher, const char *subject, uint32_t hash, const char *format, switch_time_t now)
+{
+    uint32_t oldest = 0;
+    uint32_t i;
+    event_batch_t *batch;
+
+    if (batcher->open == BATCH_MAX_OPEN) {
+        for (i = 1; i < batcher->open; i++) {
+            if (batcher->batches[i].opened < batcher->batches[oldest].opened) {
+                oldest = i;
+            }
+        }
+        batch_flush(batcher, oldest);
+    }
+
+    batch = &batcher->batches[batcher->open];
+    switch_copy_string(batch->subject, subject, sizeof(batch->subject));
+    batch->hash = hash;
+    batch->format = format;
+    batch->count = 0;
+    batch->opened = now;
+    batch->append_time_total = 0;
+    event_buffer_reset(&batch->buf);
+
+    return batcher->open++;
+}
+
+void event_batcher_add(event_batcher_t *batcher, const char *subject, const char *payload, size_t len, const char *format)
+{
+    const char *target = zstr(globals.batch_subject) ? subject : globals.batch_subject;
+    size_t subject_len = strlen(subject);
+    size_t record_len = subject_len + len + BATCH_RECORD_OVERHEAD;
+    uint32_t hash = event_agent_hash(target);
+    switch_time_t now = switch_time_now();
+    event_batch_t *batch = NULL;
+    uint32_t index = 0;
+    uint32_t i;
+
+    for (i = 0; i < batcher->open; i++) {
+        if (batcher->batches[i].hash == hash && !strcmp(batcher->batches[i].subject, target)) {
+            index = i;
+            batch = &batcher->batches[i];
+            break;
+        }
+    }
+
+    if (batch && batch->count && batch->buf.len + record_len > globals.batch_max_bytes) {
+        batch_flush(batcher, index);
+        batch = NULL;
+    }
+
+    if (!batch) {
+        index = batch_open(batcher, target, hash, format, now);
+        batch = &batcher->batches[index];
+    }
+
+    if (!event_buffer_reserve(&batch->buf, record_len)) {
+        counter_inc(&globals.counters, AGENT_COUNTER_EVENTS_FAILED);
+        return;
+    }
+
+    put_be(batch->buf.data + batch->buf.len, (uint32_t)subject_len, 2);
+    batch->buf.len += 2;
+    memcpy(batch->buf.data + batch->buf.len, subject, subject_len);
+    batch->buf.len += subject_len;
+    put_be(batch->buf.data + batch->buf.len, (uint32_t)len, 4);
+    batch->buf.len += 4;
+    memcpy(batch->buf.data + batch->buf.len, payload, len);
+    batch->buf.len += len;
+
+    batch->count++;
+    batch->append_time_total += (uint64_t)now;
+
+    if (batch->count >= globals.batch_max_events || batch->buf.len >= globals.batch_max_bytes) {
+        batch_flush(batcher, index);
+    }
+}
+
+switch_interval_time_t event_batcher_flush_due(event_batcher_t *batcher, switch_time_t now)
+{
+    switch_interval_time_t linger = (switch_interval_time_t)globals.batch_linger_ms * 1000;
+    switch_interval_time_t next = 0;
+    uint32_t i = 0;
+
+    while (i < batcher->open) {
+        switch_interval_time_t age = now - batcher->batches[i].opened;
+
+        if (age >= linger) {
+            batch_flush(batcher, i);
+            continue;
+        }
+        if (!next || linger - age < next) {
+            next = linger - age;
+        }
+        i++;
+    }
+
+    return next;
+}
+
+void event_batcher_flush_all(event_batcher_t *batcher)
+{
+    while (batcher->open) {
+        batch_flush(batcher, batcher->open - 1);
+    }
+}
+
+void event_batch_get_stats(event_batch_stats_t *stats)
+{
+    stats->batches = __atomic_load_n(&g_stats.batches, __ATOMIC_RELAXED);
+    stats->events = __atomic_load_n(&g_stats.events, __ATOMIC_RELAXED);
+    stats->max_batch_events = __atomic_load_n(&g_stats.max_batch_events, __ATOMIC_RELAXED);
+    stats->latency_us_total = __atomic_load_n(&g_stats.latency_us_total, __ATOMIC_RELAXED);
+    stats->latency_us_max = __atomic_load_n(&g_stats.latency_us_max, __ATOMIC_RELAXED);
+}
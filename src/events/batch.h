@@ -0,0 +1,36 @@
+#ifndef EVENTS_BATCH_H
+#define EVENTS_BATCH_H
+
+#include "../mod_event_agent.h"
+
+#define EVENT_BATCH_CONTENT_TYPE "application/vnd.event-agent.batch"
+#define EVENT_BATCH_FORMAT_HEADER "Event-Agent-Format"
+#define EVENT_BATCH_COUNT_HEADER DRIVER_MESSAGE_COUNT_HEADER
+
+/*
+ * Batch envelope: a sequence of records, each
+ *   uint16 subject length (big endian), subject bytes,
+ *   uint32 payload length (big endian), payload bytes.
+ * One batcher per publisher thread, so no locking is involved.
+ */
+typedef struct event_batcher_s event_batcher_t;
+
+typedef struct {
+    uint64_t batches;
+    uint64_t events;
+    uint64_t max_batch_events;
+    uint64_t latency_us_total;
+    uint64_t latency_us_max;
+} event_batch_stats_t;
+
+event_batcher_t *event_batcher_create(switch_memory_pool_t *pool);
+void event_batcher_destroy(event_batcher_t *batcher);
+void event_batcher_add(event_batcher_t *batcher, const char *subject, const char *payload, size_t len, const char *format);
+
+/* Flushes batches whose linger expired; returns microseconds until the next deadline (0 if none pending) */
+switch_interval_time_t event_batcher_flush_due(event_batcher_t *batcher, switch_time_t now);
+void event_batcher_flush_all(event_batcher_t *batcher);
+
+void event_batch_get_stats(event_batch_stats_t *stats);
+
+#endif /* EVENTS_BATCH_H */
@@ -0,0 +1,41 @@
+#include "buffer.h"
+
+#define EVENT_BUFFER_INITIAL_SIZE 4096
+
+static __thread event_buffer_t g_thread_buffer = {0};
+
+switch_bool_t event_buffer_grow(event_buffer_t *buf, size_t extra)
+{
+    size_t cap = buf->cap ? buf->cap : EVENT_BUFFER_INITIAL_SIZE;
+    char *data;
+
+    while (cap < buf->len + extra) {
+        cap <<= 1;
+    }
+
+    data = realloc(buf->data, cap);
+    if (!data) {
+        return SWITCH_FALSE;
+    }
+
+    buf->data = data;
+    buf->cap = cap;
+    return SWITCH_TRUE;
+}
+
+void event_buffer_free(event_buffer_t *buf)
+{
+    switch_safe_free(buf->data);
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+event_buffer_t *event_buffer_thread_local(void)
+{
+    return &g_thread_buffer;
+}
+
+void event_buffer_thread_release(void)
+{
+    event_buffer_free(&g_thread_buffer);
+}
@@ -0,0 +1,76 @@
+#ifndef EVENTS_BUFFER_H
+#define EVENTS_BUFFER_H
+
+#include <switch.h>
+
+/* Growable byte buffer reused across events; never shrinks */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} event_buffer_t;
+
+switch_bool_t event_buffer_grow(event_buffer_t *buf, size_t extra);
+void event_buffer_free(event_buffer_t *buf);
+
+/* Per-thread scratch buffer used by the serializers */
+event_buffer_t *event_buffer_thread_local(void);
+void event_buffer_thread_release(void);
+
+static inline switch_bool_t event_buffer_reserve(event_buffer_t *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) {
+        return SWITCH_TRUE;
+    }
+    return event_buffer_grow(buf, extra);
+}
+
+static inline void event_buffer_reset(event_buffer_t *buf) {
+    buf->len = 0;
+}
+
+static inline switch_bool_t event_buffer_append(event_buffer_t *buf, const void *data, size_t len) {
+    if (!event_buffer_reserve(buf, len)) {
+        return SWITCH_FALSE;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return SWITCH_TRUE;
+}
+
+static inline switch_bool_t event_buffer_append_char(event_buffer_t *buf, char c) {
+    if (!event_buffer_reserve(buf, 1)) {
+        return SWITCH_FALSE;
+    }
+    buf->data[buf->len++] = c;
+    return SWITCH_TRUE;
+}
+
+static inline switch_bool_t event_buffer_append_str(event_buffer_t *buf, const char *str) {
+    return event_buffer_append(buf, str, strlen(str));
+}
+
+/* Leaves room for a length prefix that is only known once what follows has been written */
+static inline switch_bool_t event_buffer_hole(event_buffer_t *buf, size_t size, size_t *offset) {
+    if (!event_buffer_reserve(buf, size)) {
+        return SWITCH_FALSE;
+    }
+    *offset = buf->len;
+    buf->len += size;
+    return SWITCH_TRUE;
+}
+
+/* Writes head over a hole reserved earlier; head must be exactly as wide as the hole, so nothing moves */
+static inline void event_buffer_fill_hole(event_buffer_t *buf, size_t offset, const char *head, size_t head_len) {
+    memcpy(buf->data + offset, head, head_len);
+}
+
+/* NUL-terminates without counting the terminator in len */
+static inline switch_bool_t event_buffer_terminate(event_buffer_t *buf) {
+    if (!event_buffer_reserve(buf, 1)) {
+        return SWITCH_FALSE;
+    }
+    buf->data[buf->len] = '\0';
+    return SWITCH_TRUE;
+}
+
+#endif /* EVENTS_BUFFER_H */
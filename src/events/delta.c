@@ -0,0 +1,464 @@
+#include "delta.h"
+
+#define DELTA_MIN_SLOTS 64
+#define DELTA_EXPIRE_BATCH 64
+#define DELTA_EXPIRE_INTERVAL_US 1000000
+
+typedef struct {
+    uint32_t hash;
+    uint32_t mark;
+    char *name;     /* name and value share one allocation */
+    char *value;
+    size_t size;
+} delta_entry_t;
+
+typedef struct {
+    delta_entry_t *slots;
+    uint32_t size;
+    uint32_t count;
+    uint32_t generation;
+    uint32_t sequence;
+    uint32_t since_keyframe;
+    size_t bytes;
+    switch_time_t last_seen;
+    switch_bool_t untracked;    /* over delta_max_call_bytes: headers dropped, published in full until it ends */
+} delta_call_t;
+
+struct event_delta_state_s {
+    switch_hash_t *calls;
+    delta_call_t *purge;
+    delta_call_t *current;      /* call updated by the last compute, forgotten if its encode fails */
+    const char *current_uuid;
+    const char *end_uuid;
+    const switch_event_header_t **changed;
+    uint32_t changed_cap;
+    const char **removed;
+    uint32_t removed_cap;
+    event_delta_t delta;
+    switch_time_t last_expire;
+};
+
+static event_delta_stats_t g_stats = {0};
+
+static void account_bytes(delta_call_t *call, ssize_t bytes)
+{
+    call->bytes += bytes;
+    if (bytes >= 0) {
+        __atomic_fetch_add(&g_stats.memory_bytes, (uint64_t)bytes, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_sub(&g_stats.memory_bytes, (uint64_t)-bytes, __ATOMIC_RELAXED);
+    }
+}
+
+static switch_bool_t entry_set(delta_call_t *call, delta_entry_t *entry, const char *name, size_t name_len, const char *value)
+{
+    size_t value_len = strlen(value);
+    size_t size = name_len + value_len + 2;
+    char *data = realloc(entry->name, size);
+
+    if (!data) {
+        return SWITCH_FALSE;
+    }
+    if (!entry->name) {
+        memcpy(data, name, name_len + 1);
+    }
+    memcpy(data + name_len + 1, value, value_len + 1);
+
+    account_bytes(call, (ssize_t)size - (ssize_t)entry->size);
+    entry->name = data;
+    entry->value = data + name_len + 1;
+    entry->size = size;
+    return SWITCH_TRUE;
+}
+
+static void entry_free(delta_call_t *call, delta_entry_t *entry)
+{
+    account_bytes(call, -(ssize_t)entry->size);
+    free(entry->name);
+    entry->name = NULL;
+    entry->value = NULL;
+    entry->size = 0;
+}
+
+/* Moves every live entry into a fresh table; stale ones (mark != keep) are freed unless keep is 0 */
+static switch_bool_t call_rebuild(delta_call_t *call, uint32_t size, uint32_t keep)
+{
+    delta_entry_t *slots = calloc(size, sizeof(delta_entry_t));
+    uint32_t i;
+
+    if (!slots) {
+        return SWITCH_FALSE;
+    }
+
+    call->count = 0;
+    for (i = 0; i < call->size; i++) {
+        delta_entry_t *entry = &call->slots[i];
+        uint32_t pos;
+
+        if (!entry->name) {
+            continue;
+        }
+        if (keep && entry->mark != keep) {
+            entry_free(call, entry);
+            continue;
+        }
+        for (pos = entry->hash & (size - 1); slots[pos].name; pos = (pos + 1) & (size - 1));
+        slots[pos] = *entry;
+        call->count++;
+    }
+
+    account_bytes(call, ((ssize_t)size - (ssize_t)call->size) * (ssize_t)sizeof(delta_entry_t));
+    free(call->slots);
+    call->slots = slots;
+    call->size = size;
+    return SWITCH_TRUE;
+}
+
+static delta_call_t *call_create(void)
+{
+    delta_call_t *call = calloc(1, sizeof(delta_call_t));
+
+    if (!call) {
+        return NULL;
+    }
+    account_bytes(call, sizeof(delta_call_t));
+    if (!call_rebuild(call, DELTA_MIN_SLOTS, 0)) {
+        account_bytes(call, -(ssize_t)sizeof(delta_call_t));
+        free(call);
+        return NULL;
+    }
+    __atomic_fetch_add(&g_stats.calls, 1, __ATOMIC_RELAXED);
+    return call;
+}
+
+static void call_destroy(delta_call_t *call)
+{
+    uint32_t i;
+
+    for (i = 0; i < call->size; i++) {
+        if (call->slots[i].name) {
+            entry_free(call, &call->slots[i]);
+        }
+    }
+    account_bytes(call, -(ssize_t)call->bytes);
+    free(call->slots);
+    if (!call->untracked) {
+        __atomic_fetch_sub(&g_stats.calls, 1, __ATOMIC_RELAXED);
+    }
+    free(call);
+}
+
+/* Frees the stored headers but keeps the entry as a marker, so later events of the call skip straight to a full publish */
+static void call_untrack(delta_call_t *call)
+{
+    uint32_t i;
+
+    for (i = 0; i < call->size; i++) {
+        if (call->slots[i].name) {
+            entry_free(call, &call->slots[i]);
+        }
+    }
+    account_bytes(call, -(ssize_t)(call->size * sizeof(delta_entry_t)));
+    free(call->slots);
+    call->slots = NULL;
+    call->size = 0;
+    call->count = 0;
+    call->untracked = SWITCH_TRUE;
+    __atomic_fetch_sub(&g_stats.calls, 1, __ATOMIC_RELAXED);
+}
+
+static void state_forget(event_delta_state_t *state, const char *uuid, delta_call_t *call)
+{
+    if (state->purge == call) {
+        state->purge = NULL;
+    }
+    if (state->current == call) {
+        state->current = NULL;
+    }
+    switch_core_hash_delete(state->calls, uuid);
+    call_destroy(call);
+}
+
+static switch_bool_t grow_list(void *list, uint32_t *cap, uint32_t need)
+{
+    void **items = (void **)list;
+    uint32_t new_cap = *cap ? *cap : 64;
+    void *grown;
+
+    if (need <= *cap) {
+        return SWITCH_TRUE;
+    }
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    if (!(grown = realloc(*items, new_cap * sizeof(void *)))) {
+        return SWITCH_FALSE;
+    }
+    *items = grown;
+    *cap = new_cap;
+    return SWITCH_TRUE;
+}
+
+event_delta_state_t *event_delta_state_create(void)
+{
+    event_delta_state_t *state = calloc(1, sizeof(event_delta_state_t));
+
+    if (!state) {
+        return NULL;
+    }
+    if (switch_core_hash_init(&state->calls) != SWITCH_STATUS_SUCCESS) {
+        free(state);
+        return NULL;
+    }
+    return state;
+}
+
+void event_delta_state_destroy(event_delta_state_t *state)
+{
+    switch_hash_index_t *hi;
+    void *val;
+
+    if (!state) {
+        return;
+    }
+
+    for (hi = switch_core_hash_first(state->calls); hi; hi = switch_core_hash_next(&hi)) {
+        switch_core_hash_this(hi, NULL, NULL, &val);
+        call_destroy((delta_call_t *)val);
+    }
+    switch_core_hash_destroy(&state->calls);
+    free(state->changed);
+    free(state->removed);
+    free(state);
+}
+
+const event_delta_t *event_delta_compute(event_delta_state_t *state, event_record_t *record)
+{
+    switch_event_t *event = record->event;
+    const char *event_name = switch_event_name(event->event_id);
+    const char *uuid;
+    const switch_event_header_t *hp;
+    delta_call_t *call;
+    switch_bool_t keyframe;
+    uint32_t stale = 0;
+    uint32_t i;
+
+    if (!state) {
+        return NULL;
+    }
+    state->purge = NULL;
+    state->current = NULL;
+    state->end_uuid = NULL;
+
+    if (!event_name || strncmp(event_name, "CHANNEL_", 8)) {
+        return NULL;
+    }
+    if (!(uuid = switch_event_get_header(event, "Unique-ID"))) {
+        return NULL;
+    }
+
+    if (!(call = (delta_call_t *)switch_core_hash_find(state->calls, uuid))) {
+        if (event->event_id == SWITCH_EVENT_CHANNEL_DESTROY ||
+            __atomic_load_n(&g_stats.calls, __ATOMIC_RELAXED) >= globals.delta_max_calls || !(call = call_create())) {
+            __atomic_fetch_add(&g_stats.untracked, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        switch_core_hash_insert(state->calls, uuid, call);
+    } else if (call->untracked) {
+        call->last_seen = switch_micro_time_now();
+        if (event->event_id == SWITCH_EVENT_CHANNEL_DESTROY) {
+            state->end_uuid = uuid;
+        }
+        __atomic_fetch_add(&g_stats.oversized, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    keyframe = (call->sequence == 0 || call->since_keyframe + 1 >= globals.delta_keyframe_interval);
+    state->delta.changed_count = 0;
+    state->delta.removed_count = 0;
+    if (++call->generation == 0) {
+        call->generation = 1;
+    }
+
+    for (hp = event->headers; hp; hp = hp->next) {
+        size_t name_len;
+        uint32_t hash;
+        uint32_t pos;
+        delta_entry_t *entry;
+        switch_bool_t changed = keyframe;
+
+        if (!event_record_keep_header(record, hp, SWITCH_FALSE)) {
+            continue;
+        }
+
+        name_len = strlen(hp->name);
+        hash = event_agent_hash(hp->name);
+        for (pos = hash & (call->size - 1); (entry = &call->slots[pos])->name; pos = (pos + 1) & (call->size - 1)) {
+            if (entry->hash == hash && !strcmp(entry->name, hp->name)) {
+                break;
+            }
+        }
+
+        if (!entry->name || strcmp(entry->value, hp->value)) {
+            if (!entry->name) {
+                entry->hash = hash;
+                call->count++;
+            }
+            if (!entry_set(call, entry, hp->name, name_len, hp->value)) {
+                goto untrack;
+            }
+            changed = SWITCH_TRUE;
+        }
+        entry->mark = call->generation;
+
+        if (changed) {
+            if (!grow_list(&state->changed, &state->changed_cap, state->delta.changed_count + 1)) {
+                goto untrack;
+            }
+            state->changed[state->delta.changed_count++] = hp;
+        }
+
+        if (call->count * 2 >= call->size && !call_rebuild(call, call->size * 2, 0)) {
+            goto untrack;
+        }
+    }
+
+    if (call->bytes > globals.delta_max_call_bytes) {
+        __atomic_fetch_add(&g_stats.oversized, 1, __ATOMIC_RELAXED);
+        call_untrack(call);
+        call->last_seen = switch_micro_time_now();
+        if (event->event_id == SWITCH_EVENT_CHANNEL_DESTROY) {
+            state->end_uuid = uuid;
+        }
+        return NULL;
+    }
+
+    for (i = 0; i < call->size; i++) {
+        delta_entry_t *entry = &call->slots[i];
+
+        if (!entry->name || entry->mark == call->generation) {
+            continue;
+        }
+        stale++;
+        if (!keyframe) {
+            if (!grow_list(&state->removed, &state->removed_cap, state->delta.removed_count + 1)) {
+                goto untrack;
+            }
+            state->removed[state->delta.removed_count++] = entry->name;
+        }
+    }
+
+    if (stale) {
+        state->purge = call;
+    }
+    if (event->event_id == SWITCH_EVENT_CHANNEL_DESTROY) {
+        state->end_uuid = uuid;
+    }
+
+    call->since_keyframe = keyframe ? 0 : call->since_keyframe + 1;
+    call->last_seen = switch_micro_time_now();
+
+    state->current = call;
+    state->current_uuid = uuid;
+    state->delta.keyframe = keyframe;
+    state->delta.sequence = ++call->sequence;
+    state->delta.changed = state->changed;
+    state->delta.removed = state->removed;
+
+    __atomic_fetch_add(keyframe ? &g_stats.keyframes : &g_stats.deltas, 1, __ATOMIC_RELAXED);
+    return &state->delta;
+
+  untrack:
+    /* Out of memory mid-update: the stored set is unreliable, start over with a keyframe */
+    __atomic_fetch_add(&g_stats.untracked, 1, __ATOMIC_RELAXED);
+    state_forget(state, uuid, call);
+    return NULL;
+}
+
+void event_delta_commit(event_delta_state_t *state)
+{
+    delta_call_t *call;
+
+    if (!state) {
+        return;
+    }
+
+    if (state->end_uuid) {
+        if ((call = (delta_call_t *)switch_core_hash_find(state->calls, state->end_uuid))) {
+            state_forget(state, state->end_uuid, call);
+        }
+    } else if ((call = state->purge)) {
+        call_rebuild(call, call->size, call->generation);
+    }
+
+    state->purge = NULL;
+    state->current = NULL;
+    state->end_uuid = NULL;
+}
+
+void event_delta_abort(event_delta_state_t *state)
+{
+    if (!state) {
+        return;
+    }
+
+    /* The stored set already holds headers the consumer never got */
+    if (state->current) {
+        __atomic_fetch_add(&g_stats.untracked, 1, __ATOMIC_RELAXED);
+        state_forget(state, state->current_uuid, state->current);
+    }
+    event_delta_commit(state);
+}
+
+void event_delta_expire(event_delta_state_t *state, switch_time_t now)
+{
+    switch_hash_index_t *hi;
+    const void *keys[DELTA_EXPIRE_BATCH];
+    delta_call_t *calls[DELTA_EXPIRE_BATCH];
+    switch_time_t cutoff;
+    uint32_t count = 0;
+    uint32_t i;
+
+    if (!state || !globals.delta_idle_timeout || now - state->last_expire < DELTA_EXPIRE_INTERVAL_US) {
+        return;
+    }
+    state->last_expire = now;
+    cutoff = now - (switch_time_t)globals.delta_idle_timeout * 1000000;
+
+    for (hi = switch_core_hash_first(state->calls); hi; hi = switch_core_hash_next(&hi)) {
+        const void *key;
+        void *val;
+
+        switch_core_hash_this(hi, &key, NULL, &val);
+        if (((delta_call_t *)val)->last_seen < cutoff) {
+            keys[count] = key;
+            calls[count] = (delta_call_t *)val;
+            if (++count == DELTA_EXPIRE_BATCH) {
+                switch_safe_free(hi);
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        state_forget(state, (const char *)keys[i], calls[i]);
+    }
+    if (count) {
+        __atomic_fetch_add(&g_stats.expired, count, __ATOMIC_RELAXED);
+    }
+}
+
+void event_delta_get_stats(event_delta_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    stats->calls = __atomic_load_n(&g_stats.calls, __ATOMIC_RELAXED);
+    stats->memory_bytes = __atomic_load_n(&g_stats.memory_bytes, __ATOMIC_RELAXED);
+    stats->keyframes = __atomic_load_n(&g_stats.keyframes, __ATOMIC_RELAXED);
+    stats->deltas = __atomic_load_n(&g_stats.deltas, __ATOMIC_RELAXED);
+    stats->untracked = __atomic_load_n(&g_stats.untracked, __ATOMIC_RELAXED);
+    stats->oversized = __atomic_load_n(&g_stats.oversized, __ATOMIC_RELAXED);
+    stats->expired = __atomic_load_n(&g_stats.expired, __ATOMIC_RELAXED);
+}
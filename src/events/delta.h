@@ -0,0 +1,42 @@
+#ifndef EVENTS_DELTA_H
+#define EVENTS_DELTA_H
+
+#include "serializer.h"
+
+/*
+ * Delta mode: for CHANNEL_* events the last published header set of every
+ * call (keyed by Unique-ID) is kept, and only added/changed headers plus the
+ * names of removed ones are encoded. Every call starts with a keyframe and
+ * gets another one every delta_keyframe_interval events. One state per
+ * publisher thread; calls are pinned to a thread so no locking is needed.
+ */
+typedef struct event_delta_state_s event_delta_state_t;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t memory_bytes;
+    uint64_t keyframes;
+    uint64_t deltas;
+    uint64_t untracked;
+    uint64_t oversized;
+    uint64_t expired;
+} event_delta_stats_t;
+
+event_delta_state_t *event_delta_state_create(void);
+void event_delta_state_destroy(event_delta_state_t *state);
+
+/* Returns NULL when the event has to go out in full (not a channel event, or a limit was hit) */
+const event_delta_t *event_delta_compute(event_delta_state_t *state, event_record_t *record);
+
+/* Called after the record has been encoded: frees removed headers and ended calls */
+void event_delta_commit(event_delta_state_t *state);
+
+/* Called instead of commit when the encode failed: forgets the call, so its next event is a keyframe */
+void event_delta_abort(event_delta_state_t *state);
+
+/* Forgets calls without events for delta_idle_timeout seconds */
+void event_delta_expire(event_delta_state_t *state, switch_time_t now);
+
+void event_delta_get_stats(event_delta_stats_t *stats);
+
+#endif /* EVENTS_DELTA_H */
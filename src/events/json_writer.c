@@ -0,0 +1,104 @@
+#include "json_writer.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static inline switch_bool_t json_needs_escape(unsigned char c)
+{
+    return c < 32 || c == '"' || c == '\\';
+}
+
+switch_bool_t json_write_string(event_buffer_t *buf, const char *value)
+{
+    const unsigned char *p = (const unsigned char *)value;
+    const unsigned char *run;
+
+    if (!event_buffer_append_char(buf, '"')) {
+        return SWITCH_FALSE;
+    }
+
+    while (*p) {
+        run = p;
+        while (*p && !json_needs_escape(*p)) {
+            p++;
+        }
+        if (p > run && !event_buffer_append(buf, run, (size_t)(p - run))) {
+            return SWITCH_FALSE;
+        }
+        if (!*p) {
+            break;
+        }
+
+        if (!event_buffer_reserve(buf, 6)) {
+            return SWITCH_FALSE;
+        }
+
+        char *out = buf->data + buf->len;
+        out[0] = '\\';
+        switch (*p) {
+        case '"': out[1] = '"'; buf->len += 2; break;
+        case '\\': out[1] = '\\'; buf->len += 2; break;
+        case '\b': out[1] = 'b'; buf->len += 2; break;
+        case '\f': out[1] = 'f'; buf->len += 2; break;
+        case '\n': out[1] = 'n'; buf->len += 2; break;
+        case '\r': out[1] = 'r'; buf->len += 2; break;
+        case '\t': out[1] = 't'; buf->len += 2; break;
+        default:
+            out[1] = 'u';
+            out[2] = '0';
+            out[3] = '0';
+            out[4] = hex_digits[*p >> 4];
+            out[5] = hex_digits[*p & 0xf];
+            buf->len += 6;
+            break;
+        }
+        p++;
+    }
+
+    return event_buffer_append_char(buf, '"');
+}
+
+switch_bool_t json_write_u64(event_buffer_t *buf, uint64_t value)
+{
+    char digits[24];
+    int count = 0;
+    int i;
+
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    if (!event_buffer_reserve(buf, (size_t)count + 6)) {
+        return SWITCH_FALSE;
+    }
+
+    /*
+     * cJSON prints numbers with "%1.15g" whenever that round-trips. For a
+     * 16 digit integer ending in 0 (e.g. a microsecond timestamp) that is the
+     * exponent form, so mirror it to keep the output identical.
+     */
+    if (count == 16 && digits[0] == '0') {
+        int last = 1;
+
+        while (last < 15 && digits[last] == '0') {
+            last++;
+        }
+
+        buf->data[buf->len++] = digits[15];
+        if (last < 15) {
+            buf->data[buf->len++] = '.';
+            for (i = 14; i >= last; i--) {
+                buf->data[buf->len++] = digits[i];
+            }
+        }
+        memcpy(buf->data + buf->len, "e+15", 4);
+        buf->len += 4;
+        return SWITCH_TRUE;
+    }
+
+    for (i = count - 1; i >= 0; i--) {
+        buf->data[buf->len++] = digits[i];
+    }
+
+    return SWITCH_TRUE;
+}
@@ -0,0 +1,24 @@
+#ifndef EVENTS_JSON_WRITER_H
+#define EVENTS_JSON_WRITER_H
+
+#include "buffer.h"
+
+/*
+ * Streaming JSON primitives. Output matches cJSON_PrintUnformatted byte for
+ * byte so consumers see no difference from the former cJSON-based path.
+ */
+switch_bool_t json_write_string(event_buffer_t *buf, const char *value);
+switch_bool_t json_write_u64(event_buffer_t *buf, uint64_t value);
+
+/* Writes ,"key": (the comma only when first is false) */
+static inline switch_bool_t json_write_key(event_buffer_t *buf, const char *key, switch_bool_t first) {
+    if (!first && !event_buffer_append_char(buf, ',')) {
+        return SWITCH_FALSE;
+    }
+    if (!json_write_string(buf, key)) {
+        return SWITCH_FALSE;
+    }
+    return event_buffer_append_char(buf, ':');
+}
+
+#endif /* EVENTS_JSON_WRITER_H */
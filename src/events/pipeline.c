@@ -0,0 +1,325 @@
+#include "pipeline.h"
+#include "queue.h"
+#include "buffer.h"
+#include "batch.h"
+#include "delta.h"
+#include "ratelimit.h"
+
+#define PIPELINE_IDLE_WAIT_US 100000
+#define PIPELINE_MIN_SHARD_CAPACITY 64
+
+typedef struct {
+    event_queue_t *queue;
+    switch_thread_t *thread;
+    switch_mutex_t *mutex;
+    switch_thread_cond_t *cond;
+    event_publisher_t publisher;
+    uint32_t sleeping;
+    uint32_t index;
+} event_pipeline_shard_t;
+
+static event_pipeline_shard_t *g_shards = NULL;
+static uint32_t g_shard_count = 0;
+static uint32_t g_stopping = 0;
+static switch_time_t g_drain_deadline = 0;
+
+static uint64_t g_enqueued = 0;
+static uint64_t g_dropped = 0;
+static uint64_t g_blocked = 0;
+static uint32_t g_high_watermark = 0;
+
+static void shard_wake(event_pipeline_shard_t *shard)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shard->sleeping, __ATOMIC_RELAXED)) {
+        switch_mutex_lock(shard->mutex);
+        switch_thread_cond_signal(shard->cond);
+        switch_mutex_unlock(shard->mutex);
+    }
+}
+
+static void shard_wait(event_pipeline_shard_t *shard, switch_interval_time_t timeout)
+{
+    switch_mutex_lock(shard->mutex);
+    __atomic_store_n(&shard->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (!event_queue_depth(shard->queue) && !__atomic_load_n(&g_stopping, __ATOMIC_RELAXED)) {
+        switch_thread_cond_timedwait(shard->cond, shard->mutex, timeout);
+    }
+
+    __atomic_store_n(&shard->sleeping, 0, __ATOMIC_RELAXED);
+    switch_mutex_unlock(shard->mutex);
+}
+
+static void note_depth(uint32_t depth)
+{
+    uint32_t seen = __atomic_load_n(&g_high_watermark, __ATOMIC_RELAXED);
+
+    while (depth > seen) {
+        if (__atomic_compare_exchange_n(&g_high_watermark, &seen, depth, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+static void *SWITCH_THREAD_FUNC publisher_thread(switch_thread_t *thread, void *obj)
+{
+    event_pipeline_shard_t *shard = (event_pipeline_shard_t *)obj;
+    switch_event_t *event;
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Publisher thread %u started", shard->index);
+
+    for (;;) {
+        switch_interval_time_t timeout = PIPELINE_IDLE_WAIT_US;
+        switch_bool_t popped = SWITCH_FALSE;
+
+        if ((event = (switch_event_t *)event_queue_pop(shard->queue))) {
+            popped = SWITCH_TRUE;
+            if (__atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE) && switch_time_now() > g_drain_deadline) {
+                __atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+            } else {
+                event_adapter_publish(event, &shard->publisher);
+            }
+            switch_event_destroy(&event);
+        }
+
+        if (shard->publisher.batcher) {
+            switch_interval_time_t next = event_batcher_flush_due(shard->publisher.batcher, switch_time_now());
+            if (next && next < timeout) {
+                timeout = next;
+            }
+        }
+
+        if (shard->publisher.delta) {
+            event_delta_expire(shard->publisher.delta, switch_time_now());
+        }
+
+        /* Coalesced rate-limited events are released by the first publisher */
+        if (shard->index == 0) {
+            switch_interval_time_t next = event_ratelimit_flush_due(switch_micro_time_now());
+            if (next && next < timeout) {
+                timeout = next;
+            }
+        }
+
+        if (popped) {
+            continue;
+        }
+
+        if (__atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE) && !event_queue_depth(shard->queue)) {
+            break;
+        }
+
+        shard_wait(shard, timeout);
+    }
+
+    if (shard->publisher.batcher) {
+        event_batcher_flush_all(shard->publisher.batcher);
+        event_batcher_destroy(shard->publisher.batcher);
+    }
+    event_delta_state_destroy(shard->publisher.delta);
+    event_buffer_thread_release();
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Publisher thread %u stopped", shard->index);
+    return NULL;
+}
+
+switch_status_t event_pipeline_start(switch_memory_pool_t *pool)
+{
+    switch_threadattr_t *thd_attr = NULL;
+    uint32_t threads = globals.publisher_threads;
+    uint32_t capacity;
+    uint32_t i;
+
+    if (threads == 0) {
+        threads = 1;
+    } else if (threads > EVENT_PIPELINE_MAX_THREADS) {
+        threads = EVENT_PIPELINE_MAX_THREADS;
+    }
+
+    capacity = (globals.queue_size + threads - 1) / threads;
+    if (capacity < PIPELINE_MIN_SHARD_CAPACITY) {
+        capacity = PIPELINE_MIN_SHARD_CAPACITY;
+    }
+
+    g_shards = switch_core_alloc(pool, sizeof(event_pipeline_shard_t) * threads);
+    memset(g_shards, 0, sizeof(event_pipeline_shard_t) * threads);
+    g_shard_count = 0;
+    __atomic_store_n(&g_stopping, 0, __ATOMIC_RELEASE);
+
+    switch_threadattr_create(&thd_attr, pool);
+    switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+    for (i = 0; i < threads; i++) {
+        event_pipeline_shard_t *shard = &g_shards[i];
+
+        shard->index = i;
+        if (event_queue_create(&shard->queue, capacity, pool) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to allocate publish queue %u", i);
+            event_pipeline_stop();
+            return SWITCH_STATUS_FALSE;
+        }
+        switch_mutex_init(&shard->mutex, SWITCH_MUTEX_NESTED, pool);
+        switch_thread_cond_create(&shard->cond, pool);
+        if (globals.batch_max_events > 1) {
+            shard->publisher.batcher = event_batcher_create(pool);
+        }
+        if (globals.delta_mode && !(shard->publisher.delta = event_delta_state_create())) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Failed to allocate delta state for publisher %u, publishing full events", i);
+        }
+
+        if (switch_thread_create(&shard->thread, thd_attr, publisher_thread, shard, pool) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to start publisher thread %u", i);
+            event_pipeline_stop();
+            return SWITCH_STATUS_FALSE;
+        }
+        g_shard_count++;
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG,
+                      SWITCH_LOG_INFO,
+                      "[mod_event_agent] Publishing pipeline started (%u threads, %u slots each, overflow=%s)",
+                      g_shard_count,
+                      event_queue_capacity(g_shards[0].queue),
+                      globals.queue_overflow == EVENT_QUEUE_OVERFLOW_BLOCK ? "block" : "drop");
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t event_pipeline_stop(void)
+{
+    uint32_t i;
+
+    if (!g_shards) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    g_drain_deadline = switch_time_now() + (switch_time_t)globals.queue_drain_timeout_ms * 1000;
+    __atomic_store_n(&g_stopping, 1, __ATOMIC_RELEASE);
+
+    for (i = 0; i < g_shard_count; i++) {
+        event_pipeline_shard_t *shard = &g_shards[i];
+        switch_status_t retval;
+
+        switch_mutex_lock(shard->mutex);
+        switch_thread_cond_broadcast(shard->cond);
+        switch_mutex_unlock(shard->mutex);
+
+        if (shard->thread) {
+            switch_thread_join(&retval, shard->thread);
+            shard->thread = NULL;
+        }
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG,
+                      SWITCH_LOG_INFO,
+                      "[mod_event_agent] Publishing pipeline drained (enqueued: %llu, dropped: %llu)",
+                      (unsigned long long)__atomic_load_n(&g_enqueued, __ATOMIC_RELAXED),
+                      (unsigned long long)__atomic_load_n(&g_dropped, __ATOMIC_RELAXED));
+
+    g_shards = NULL;
+    g_shard_count = 0;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static event_pipeline_shard_t *shard_for(switch_event_t *event)
+{
+    const char *uuid = switch_event_get_header(event, "Unique-ID");
+    uint32_t hash = uuid ? event_agent_hash(uuid) : (uint32_t)event->event_id;
+
+    /* Events of one call always land on the same shard so they stay ordered */
+    return &g_shards[hash % g_shard_count];
+}
+
+static switch_bool_t shard_push(event_pipeline_shard_t *shard, switch_event_t *clone, switch_bool_t may_block)
+{
+    if (!event_queue_push(shard->queue, clone)) {
+        switch_bool_t pushed = SWITCH_FALSE;
+
+        if (may_block && globals.queue_overflow == EVENT_QUEUE_OVERFLOW_BLOCK) {
+            switch_time_t deadline = switch_time_now() + (switch_time_t)globals.queue_block_timeout_ms * 1000;
+
+            __atomic_fetch_add(&g_blocked, 1, __ATOMIC_RELAXED);
+            shard_wake(shard);
+
+            while (!__atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE)) {
+                if ((pushed = event_queue_push(shard->queue, clone))) {
+                    break;
+                }
+                if (globals.queue_block_timeout_ms && switch_time_now() > deadline) {
+                    break;
+                }
+                switch_cond_next();
+            }
+        }
+
+        if (!pushed) {
+            switch_event_destroy(&clone);
+            __atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+            return SWITCH_FALSE;
+        }
+    }
+
+    __atomic_fetch_add(&g_enqueued, 1, __ATOMIC_RELAXED);
+    note_depth(event_queue_depth(shard->queue));
+    shard_wake(shard);
+
+    return SWITCH_TRUE;
+}
+
+switch_bool_t event_pipeline_submit(switch_event_t *event)
+{
+    event_pipeline_shard_t *shard;
+    switch_event_t *clone = NULL;
+
+    if (!g_shard_count || __atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE)) {
+        return SWITCH_FALSE;
+    }
+
+    shard = shard_for(event);
+
+    if (globals.queue_overflow == EVENT_QUEUE_OVERFLOW_DROP &&
+        event_queue_depth(shard->queue) >= event_queue_capacity(shard->queue)) {
+        __atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+        return SWITCH_FALSE;
+    }
+
+    if (switch_event_dup(&clone, event) != SWITCH_STATUS_SUCCESS || !clone) {
+        __atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+        return SWITCH_FALSE;
+    }
+
+    return shard_push(shard, clone, SWITCH_TRUE);
+}
+
+switch_bool_t event_pipeline_requeue(switch_event_t *event)
+{
+    if (!g_shard_count || __atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE)) {
+        switch_event_destroy(&event);
+        return SWITCH_FALSE;
+    }
+
+    return shard_push(shard_for(event), event, SWITCH_FALSE);
+}
+
+void event_pipeline_get_stats(event_pipeline_stats_t *stats)
+{
+    uint32_t i;
+
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = g_shard_count;
+    stats->enqueued = __atomic_load_n(&g_enqueued, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&g_dropped, __ATOMIC_RELAXED);
+    stats->blocked = __atomic_load_n(&g_blocked, __ATOMIC_RELAXED);
+    stats->high_watermark = __atomic_load_n(&g_high_watermark, __ATOMIC_RELAXED);
+
+    for (i = 0; i < g_shard_count; i++) {
+        stats->shard_depth[i] = event_queue_depth(g_shards[i].queue);
+        stats->depth += stats->shard_depth[i];
+        stats->capacity += event_queue_capacity(g_shards[i].queue);
+    }
+}
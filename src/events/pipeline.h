@@ -0,0 +1,32 @@
+#ifndef EVENTS_PIPELINE_H
+#define EVENTS_PIPELINE_H
+
+#include "../mod_event_agent.h"
+
+#define EVENT_PIPELINE_MAX_THREADS 64
+
+/* Per-thread publishing context handed to event_adapter_publish */
+typedef struct event_publisher_s {
+    struct event_batcher_s *batcher;
+    struct event_delta_state_s *delta;
+} event_publisher_t;
+
+typedef struct {
+    uint32_t threads;
+    uint32_t capacity;
+    uint32_t depth;
+    uint32_t high_watermark;
+    uint64_t enqueued;
+    uint64_t dropped;
+    uint64_t blocked;
+    uint32_t shard_depth[EVENT_PIPELINE_MAX_THREADS];
+} event_pipeline_stats_t;
+
+switch_status_t event_pipeline_start(switch_memory_pool_t *pool);
+switch_status_t event_pipeline_stop(void);
+switch_bool_t event_pipeline_submit(switch_event_t *event);
+/* Queues an event the caller already owns; never blocks, destroys the event on failure */
+switch_bool_t event_pipeline_requeue(switch_event_t *event);
+void event_pipeline_get_stats(event_pipeline_stats_t *stats);
+
+#endif /* EVENTS_PIPELINE_H */
@@ -0,0 +1,478 @@
+#include "predicate.h"
+#include <time.h>
+
+#define PREDICATE_MAX_CODE 128
+#define PREDICATE_MAX_DEPTH 32
+#define PREDICATE_SAMPLE_MASK 63
+
+typedef enum {
+    PRED_OP_EQ,
+    PRED_OP_NE,
+    PRED_OP_PREFIX,
+    PRED_OP_EXISTS,
+    PRED_OP_NOT,
+    PRED_OP_JUMP_FALSE,
+    PRED_OP_JUMP_TRUE
+} predicate_op_t;
+
+typedef struct {
+    predicate_op_t op;
+    uint32_t target;
+    const char *name;
+    const char *value;
+    size_t value_len;
+} predicate_insn_t;
+
+struct event_predicate_s {
+    const char *source;
+    predicate_insn_t *code;
+    uint32_t length;
+};
+
+typedef enum {
+    TOK_END,
+    TOK_WORD,
+    TOK_STRING,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_EQ,
+    TOK_NE,
+    TOK_PREFIX,
+    TOK_AND,
+    TOK_OR,
+    TOK_NOT,
+    TOK_ERROR
+} predicate_token_t;
+
+typedef struct {
+    switch_memory_pool_t *pool;
+    const char *pos;
+    predicate_token_t token;
+    char *text;
+    predicate_insn_t code[PREDICATE_MAX_CODE];
+    uint32_t length;
+    uint32_t depth;
+    const char *error;
+} predicate_parser_t;
+
+typedef struct event_predicate_filter_s {
+    const char *event_name;
+    event_predicate_t *predicate;
+    uint64_t evaluated;
+    uint64_t rejected;
+    uint64_t sampled;
+    uint64_t sampled_ns;
+    struct event_predicate_filter_s *next;
+} event_predicate_filter_t;
+
+static event_predicate_filter_t *g_by_id[SWITCH_EVENT_ALL];
+static uint32_t g_explicit[EVENT_FILTER_WORDS];
+static event_predicate_filter_t *g_filters = NULL;
+
+static int is_word_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '-' || c == ':' || c == '.' || c == '*' || c == '/' || c == '@';
+}
+
+static void next_token(predicate_parser_t *parser)
+{
+    const char *p = parser->pos;
+    const char *start;
+
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+
+    parser->text = NULL;
+
+    if (!*p) {
+        parser->token = TOK_END;
+    } else if (*p == '(') {
+        parser->token = TOK_LPAREN;
+        p++;
+    } else if (*p == ')') {
+        parser->token = TOK_RPAREN;
+        p++;
+    } else if (p[0] == '=' && p[1] == '=') {
+        parser->token = TOK_EQ;
+        p += 2;
+    } else if (p[0] == '!' && p[1] == '=') {
+        parser->token = TOK_NE;
+        p += 2;
+    } else if (p[0] == '^' && p[1] == '=') {
+        parser->token = TOK_PREFIX;
+        p += 2;
+    } else if (p[0] == '&' && p[1] == '&') {
+        parser->token = TOK_AND;
+        p += 2;
+    } else if (p[0] == '|' && p[1] == '|') {
+        parser->token = TOK_OR;
+        p += 2;
+    } else if (*p == '!') {
+        parser->token = TOK_NOT;
+        p++;
+    } else if (*p == '\'' || *p == '"') {
+        char quote = *p++;
+
+        start = p;
+        while (*p && *p != quote) p++;
+        if (!*p) {
+            parser->token = TOK_ERROR;
+            parser->error = "unterminated string";
+        } else {
+            parser->token = TOK_STRING;
+            parser->text = switch_core_strndup(parser->pool, start, (switch_size_t)(p - start));
+            p++;
+        }
+    } else if (is_word_char(*p)) {
+        start = p;
+        while (is_word_char(*p)) p++;
+        parser->text = switch_core_strndup(parser->pool, start, (switch_size_t)(p - start));
+
+        if (!strcasecmp(parser->text, "and")) {
+            parser->token = TOK_AND;
+        } else if (!strcasecmp(parser->text, "or")) {
+            parser->token = TOK_OR;
+        } else if (!strcasecmp(parser->text, "not")) {
+            parser->token = TOK_NOT;
+        } else {
+            parser->token = TOK_WORD;
+        }
+    } else {
+        parser->token = TOK_ERROR;
+        parser->error = "unexpected character";
+    }
+
+    parser->pos = p;
+}
+
+static predicate_insn_t *emit(predicate_parser_t *parser, predicate_op_t op)
+{
+    predicate_insn_t *insn;
+
+    if (parser->length >= PREDICATE_MAX_CODE) {
+        parser->error = "expression too long";
+        return NULL;
+    }
+    insn = &parser->code[parser->length++];
+    memset(insn, 0, sizeof(*insn));
+    insn->op = op;
+    return insn;
+}
+
+static switch_bool_t parse_or(predicate_parser_t *parser);
+
+static switch_bool_t parse_unary(predicate_parser_t *parser)
+{
+    predicate_insn_t *insn;
+    char *name;
+    predicate_op_t op;
+
+    if (++parser->depth > PREDICATE_MAX_DEPTH) {
+        parser->error = "expression nested too deeply";
+        return SWITCH_FALSE;
+    }
+
+    switch (parser->token) {
+    case TOK_NOT:
+        next_token(parser);
+        if (!parse_unary(parser) || !emit(parser, PRED_OP_NOT)) {
+            return SWITCH_FALSE;
+        }
+        break;
+
+    case TOK_LPAREN:
+        next_token(parser);
+        if (!parse_or(parser)) {
+            return SWITCH_FALSE;
+        }
+        if (parser->token != TOK_RPAREN) {
+            parser->error = "expected ')'";
+            return SWITCH_FALSE;
+        }
+        next_token(parser);
+        break;
+
+    case TOK_WORD:
+        name = parser->text;
+        next_token(parser);
+
+        if (!strcasecmp(name, "exists") && parser->token == TOK_LPAREN) {
+            next_token(parser);
+            if (parser->token != TOK_WORD && parser->token != TOK_STRING) {
+                parser->error = "expected header name in exists()";
+                return SWITCH_FALSE;
+            }
+            if (!(insn = emit(parser, PRED_OP_EXISTS))) {
+                return SWITCH_FALSE;
+            }
+            insn->name = parser->text;
+            next_token(parser);
+            if (parser->token != TOK_RPAREN) {
+                parser->error = "expected ')' after exists(";
+                return SWITCH_FALSE;
+            }
+            next_token(parser);
+            break;
+        }
+
+        if (parser->token == TOK_EQ) {
+            op = PRED_OP_EQ;
+        } else if (parser->token == TOK_NE) {
+            op = PRED_OP_NE;
+        } else if (parser->token == TOK_PREFIX) {
+            op = PRED_OP_PREFIX;
+        } else {
+            parser->error = "expected ==, != or ^= after header name";
+            return SWITCH_FALSE;
+        }
+
+        next_token(parser);
+        if (parser->token != TOK_WORD && parser->token != TOK_STRING) {
+            parser->error = "expected value";
+            return SWITCH_FALSE;
+        }
+        if (!(insn = emit(parser, op))) {
+            return SWITCH_FALSE;
+        }
+        insn->name = name;
+        insn->value = parser->text;
+        insn->value_len = strlen(parser->text);
+        next_token(parser);
+        break;
+
+    default:
+        if (!parser->error) {
+            parser->error = "expected condition";
+        }
+        return SWITCH_FALSE;
+    }
+
+    parser->depth--;
+    return SWITCH_TRUE;
+}
+
+static switch_bool_t parse_binary(predicate_parser_t *parser, predicate_token_t token, predicate_op_t jump,
+                                  switch_bool_t (*operand)(predicate_parser_t *parser))
+{
+    if (!operand(parser)) {
+        return SWITCH_FALSE;
+    }
+
+    while (parser->token == token) {
+        uint32_t at = parser->length;
+
+        /* Left value decides: skip the right side, leaving it in the accumulator */
+        if (!emit(parser, jump)) {
+            return SWITCH_FALSE;
+        }
+        next_token(parser);
+        if (!operand(parser)) {
+            return SWITCH_FALSE;
+        }
+        parser->code[at].target = parser->length;
+    }
+    return SWITCH_TRUE;
+}
+
+static switch_bool_t parse_and(predicate_parser_t *parser)
+{
+    return parse_binary(parser, TOK_AND, PRED_OP_JUMP_FALSE, parse_unary);
+}
+
+static switch_bool_t parse_or(predicate_parser_t *parser)
+{
+    return parse_binary(parser, TOK_OR, PRED_OP_JUMP_TRUE, parse_and);
+}
+
+event_predicate_t *event_predicate_compile(switch_memory_pool_t *pool, const char *expression)
+{
+    predicate_parser_t parser;
+    event_predicate_t *predicate;
+
+    if (zstr(expression)) {
+        return NULL;
+    }
+
+    memset(&parser, 0, sizeof(parser));
+    parser.pool = pool;
+    parser.pos = expression;
+    next_token(&parser);
+
+    if (!parse_or(&parser) || parser.token != TOK_END) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Invalid filter expression '%s': %s near '%s'",
+                          expression, parser.error ? parser.error : "unexpected token", parser.pos);
+        return NULL;
+    }
+
+    predicate = switch_core_alloc(pool, sizeof(*predicate));
+    predicate->source = switch_core_strdup(pool, expression);
+    predicate->length = parser.length;
+    predicate->code = switch_core_alloc(pool, sizeof(predicate_insn_t) * parser.length);
+    memcpy(predicate->code, parser.code, sizeof(predicate_insn_t) * parser.length);
+    return predicate;
+}
+
+switch_bool_t event_predicate_eval(const event_predicate_t *predicate, switch_event_t *event)
+{
+    const predicate_insn_t *code = predicate->code;
+    uint32_t pc = 0;
+    switch_bool_t acc = SWITCH_FALSE;
+    const char *value;
+
+    while (pc < predicate->length) {
+        const predicate_insn_t *insn = &code[pc++];
+
+        switch (insn->op) {
+        case PRED_OP_EQ:
+            value = switch_event_get_header(event, insn->name);
+            acc = (value && !strcmp(value, insn->value)) ? SWITCH_TRUE : SWITCH_FALSE;
+            break;
+        case PRED_OP_NE:
+            value = switch_event_get_header(event, insn->name);
+            acc = (!value || strcmp(value, insn->value)) ? SWITCH_TRUE : SWITCH_FALSE;
+            break;
+        case PRED_OP_PREFIX:
+            value = switch_event_get_header(event, insn->name);
+            acc = (value && !strncmp(value, insn->value, insn->value_len)) ? SWITCH_TRUE : SWITCH_FALSE;
+            break;
+        case PRED_OP_EXISTS:
+            acc = switch_event_get_header(event, insn->name) ? SWITCH_TRUE : SWITCH_FALSE;
+            break;
+        case PRED_OP_NOT:
+            acc = !acc;
+            break;
+        case PRED_OP_JUMP_FALSE:
+            if (!acc) pc = insn->target;
+            break;
+        case PRED_OP_JUMP_TRUE:
+            if (acc) pc = insn->target;
+            break;
+        }
+    }
+
+    return acc;
+}
+
+void event_predicates_reset(void)
+{
+    memset(g_by_id, 0, sizeof(g_by_id));
+    memset(g_explicit, 0, sizeof(g_explicit));
+    g_filters = NULL;
+}
+
+static void assign(event_predicate_filter_t *filter, switch_event_types_t id, switch_bool_t fallback)
+{
+    if (fallback) {
+        if (!event_filter_test(g_explicit, id)) {
+            g_by_id[id] = filter;
+        }
+        return;
+    }
+    g_explicit[id >> 5] |= 1u << (id & 31);
+    g_by_id[id] = filter;
+}
+
+switch_status_t event_predicate_add(switch_memory_pool_t *pool, const char *event_name, const char *expression)
+{
+    event_predicate_filter_t *filter;
+    event_predicate_t *predicate;
+    switch_event_types_t id;
+    size_t len;
+    uint32_t matched = 0;
+
+    if (zstr(event_name)) {
+        event_name = "ALL";
+    }
+
+    if (!(predicate = event_predicate_compile(pool, expression))) {
+        return SWITCH_STATUS_FALSE;
+    }
+
+    filter = switch_core_alloc(pool, sizeof(*filter));
+    memset(filter, 0, sizeof(*filter));
+    filter->event_name = switch_core_strdup(pool, event_name);
+    filter->predicate = predicate;
+
+    len = strlen(event_name);
+    if (!strcasecmp(event_name, "ALL")) {
+        for (id = 0; id < SWITCH_EVENT_ALL; id++) {
+            assign(filter, id, SWITCH_TRUE);
+        }
+        matched = SWITCH_EVENT_ALL;
+    } else if (event_name[len - 1] == '*') {
+        for (id = 0; id < SWITCH_EVENT_ALL; id++) {
+            const char *name = switch_event_name(id);
+            if (name && !strncasecmp(name, event_name, len - 1)) {
+                assign(filter, id, SWITCH_FALSE);
+                matched++;
+            }
+        }
+    } else if (switch_name_event(event_name, &id) == SWITCH_STATUS_SUCCESS && id < SWITCH_EVENT_ALL) {
+        assign(filter, id, SWITCH_FALSE);
+        matched = 1;
+    }
+
+    if (!matched) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Filter for '%s' matches no event type", event_name);
+        return SWITCH_STATUS_FALSE;
+    }
+
+    filter->next = g_filters;
+    g_filters = filter;
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Filter for %s: %s (%u instructions)", event_name, predicate->source, predicate->length);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+switch_bool_t event_predicate_allows(switch_event_t *event)
+{
+    event_predicate_filter_t *filter;
+    switch_bool_t allowed;
+    uint64_t seq;
+
+    if (event->event_id >= SWITCH_EVENT_ALL || !(filter = g_by_id[event->event_id])) {
+        return SWITCH_TRUE;
+    }
+
+    seq = __atomic_fetch_add(&filter->evaluated, 1, __ATOMIC_RELAXED);
+
+    /* Time one evaluation in 64 so the clock reads stay off the common path */
+    if (!(seq & PREDICATE_SAMPLE_MASK)) {
+        uint64_t start = monotonic_ns();
+
+        allowed = event_predicate_eval(filter->predicate, event);
+        __atomic_fetch_add(&filter->sampled_ns, monotonic_ns() - start, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&filter->sampled, 1, __ATOMIC_RELAXED);
+    } else {
+        allowed = event_predicate_eval(filter->predicate, event);
+    }
+
+    if (!allowed) {
+        __atomic_fetch_add(&filter->rejected, 1, __ATOMIC_RELAXED);
+    }
+    return allowed;
+}
+
+void event_predicate_foreach_stats(event_predicate_stats_callback_t callback, void *user_data)
+{
+    event_predicate_filter_t *filter;
+
+    for (filter = g_filters; filter; filter = filter->next) {
+        event_predicate_stats_t stats;
+
+        stats.event_name = filter->event_name;
+        stats.expression = filter->predicate->source;
+        stats.evaluated = __atomic_load_n(&filter->evaluated, __ATOMIC_RELAXED);
+        stats.rejected = __atomic_load_n(&filter->rejected, __ATOMIC_RELAXED);
+        stats.sampled = __atomic_load_n(&filter->sampled, __ATOMIC_RELAXED);
+        stats.sampled_ns = __atomic_load_n(&filter->sampled_ns, __ATOMIC_RELAXED);
+        callback(&stats, user_data);
+    }
+}
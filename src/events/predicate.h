@@ -0,0 +1,36 @@
+#ifndef EVENTS_PREDICATE_H
+#define EVENTS_PREDICATE_H
+
+#include "../mod_event_agent.h"
+
+/*
+ * Header predicates, e.g.
+ *   variable_direction == 'inbound' and not exists(variable_loopback_from_uuid)
+ *   variable_domain_name ^= 'tenant1.' or Caller-Context == public
+ * Operators: == != ^= (prefix), exists(name), and/&&, or/||, not/!, parens.
+ * Compiled at config load into flat accumulator bytecode with short-circuit
+ * jumps; evaluation allocates nothing.
+ */
+typedef struct event_predicate_s event_predicate_t;
+
+typedef struct {
+    const char *event_name;
+    const char *expression;
+    uint64_t evaluated;
+    uint64_t rejected;
+    uint64_t sampled;
+    uint64_t sampled_ns;
+} event_predicate_stats_t;
+
+typedef void (*event_predicate_stats_callback_t)(const event_predicate_stats_t *stats, void *user_data);
+
+event_predicate_t *event_predicate_compile(switch_memory_pool_t *pool, const char *expression);
+switch_bool_t event_predicate_eval(const event_predicate_t *predicate, switch_event_t *event);
+
+void event_predicates_reset(void);
+/* event_name may be a single event, "CHANNEL_*" style prefix, or ALL (types without their own filter) */
+switch_status_t event_predicate_add(switch_memory_pool_t *pool, const char *event_name, const char *expression);
+switch_bool_t event_predicate_allows(switch_event_t *event);
+void event_predicate_foreach_stats(event_predicate_stats_callback_t callback, void *user_data);
+
+#endif /* EVENTS_PREDICATE_H */
@@ -0,0 +1,225 @@
+#include "projection.h"
+
+#define PROJECTION_MAX_PATTERNS 256
+
+typedef struct {
+    uint32_t hash;
+    const char *name;
+} projection_exact_t;
+
+typedef struct {
+    const char *prefix;
+    size_t len;
+} projection_prefix_t;
+
+struct event_projection_s {
+    switch_bool_t deny;
+    switch_bool_t match_all;
+    projection_exact_t *exact;
+    uint32_t exact_mask;
+    uint32_t exact_first[8]; /* bitmap of the exact names' lowercase first characters */
+    projection_prefix_t *prefixes;
+    uint32_t prefix_count;
+    /* Prefixes sorted by lowercase first character; a header only tries its own run */
+    uint16_t first_start[256];
+    uint16_t first_count[256];
+};
+
+static const event_projection_t *g_projections[SWITCH_EVENT_ALL];
+static event_projection_stats_t g_stats[SWITCH_EVENT_ALL];
+
+static uint32_t hash_nocase(const char *value)
+{
+    uint32_t hash = 2166136261u;
+    const unsigned char *p;
+
+    for (p = (const unsigned char *)value; *p; p++) {
+        hash ^= (uint32_t)tolower(*p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline void first_bit_set(uint32_t *bits, unsigned char c)
+{
+    bits[c >> 5] |= 1u << (c & 31);
+}
+
+static inline switch_bool_t first_bit_test(const uint32_t *bits, unsigned char c)
+{
+    return (bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static int compare_prefix_first(const void *a, const void *b)
+{
+    return tolower((unsigned char)((const projection_prefix_t *)a)->prefix[0]) -
+           tolower((unsigned char)((const projection_prefix_t *)b)->prefix[0]);
+}
+
+void event_projections_reset(void)
+{
+    memset((void *)g_projections, 0, sizeof(g_projections));
+    memset(g_stats, 0, sizeof(g_stats));
+}
+
+switch_status_t event_projection_add(switch_memory_pool_t *pool, const char *event_name, switch_bool_t deny, const char *patterns)
+{
+    event_projection_t *projection;
+    switch_event_types_t id;
+    char *items[PROJECTION_MAX_PATTERNS];
+    char *exact[PROJECTION_MAX_PATTERNS];
+    char *copy;
+    uint32_t count, exact_count = 0, slots = 2, i;
+
+    if (zstr(event_name) || switch_name_event(event_name, &id) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Ignoring projection for unknown event '%s'", event_name ? event_name : "");
+        return SWITCH_STATUS_FALSE;
+    }
+
+    copy = switch_core_strdup(pool, zstr(patterns) ? "" : patterns);
+    count = switch_separate_string(copy, ',', items, PROJECTION_MAX_PATTERNS);
+
+    projection = switch_core_alloc(pool, sizeof(*projection));
+    memset(projection, 0, sizeof(*projection));
+    projection->deny = deny;
+    projection->prefixes = switch_core_alloc(pool, sizeof(projection_prefix_t) * (count ? count : 1));
+
+    for (i = 0; i < count; i++) {
+        char *item = items[i];
+        size_t len;
+
+        while (*item == ' ') item++;
+        len = strlen(item);
+        while (len && item[len - 1] == ' ') item[--len] = '\0';
+        if (!len) continue;
+
+        if (item[len - 1] == '*') {
+            item[len - 1] = '\0';
+            if (len == 1) {
+                projection->match_all = SWITCH_TRUE;
+                continue;
+            }
+            projection->prefixes[projection->prefix_count].prefix = item;
+            projection->prefixes[projection->prefix_count].len = len - 1;
+            projection->prefix_count++;
+        } else {
+            exact[exact_count++] = item;
+        }
+    }
+
+    qsort(projection->prefixes, projection->prefix_count, sizeof(projection_prefix_t), compare_prefix_first);
+    for (i = projection->prefix_count; i-- > 0;) {
+        unsigned char first = (unsigned char)tolower((unsigned char)projection->prefixes[i].prefix[0]);
+
+        projection->first_start[first] = (uint16_t)i;
+        projection->first_count[first]++;
+    }
+
+    /* Open addressing at <= 50% load keeps probes short */
+    while (slots < exact_count * 2) {
+        slots <<= 1;
+    }
+    projection->exact_mask = slots - 1;
+    projection->exact = switch_core_alloc(pool, sizeof(projection_exact_t) * slots);
+    memset(projection->exact, 0, sizeof(projection_exact_t) * slots);
+
+    for (i = 0; i < exact_count; i++) {
+        uint32_t hash = hash_nocase(exact[i]);
+        uint32_t slot = hash & projection->exact_mask;
+
+        while (projection->exact[slot].name) {
+            slot = (slot + 1) & projection->exact_mask;
+        }
+        projection->exact[slot].hash = hash;
+        projection->exact[slot].name = exact[i];
+        first_bit_set(projection->exact_first, (unsigned char)tolower((unsigned char)exact[i][0]));
+    }
+
+    if (id == SWITCH_EVENT_ALL) {
+        int t;
+        for (t = 0; t < SWITCH_EVENT_ALL; t++) {
+            if (!g_projections[t]) {
+                g_projections[t] = projection;
+            }
+        }
+    } else {
+        g_projections[id] = projection;
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG,
+                      SWITCH_LOG_INFO,
+                      "[mod_event_agent] Projection for %s: %s %u exact, %u prefix patterns",
+                      event_name,
+                      deny ? "deny" : "allow",
+                      exact_count,
+                      projection->prefix_count + (projection->match_all ? 1 : 0));
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+const event_projection_t *event_projection_for(switch_event_types_t id)
+{
+    return (uint32_t)id < SWITCH_EVENT_ALL ? g_projections[id] : NULL;
+}
+
+switch_bool_t event_projection_allows(const event_projection_t *projection, const char *name)
+{
+    uint32_t hash, slot, i, end;
+    unsigned char first;
+    switch_bool_t matched = SWITCH_FALSE;
+
+    if (!projection) {
+        return SWITCH_TRUE;
+    }
+    if (projection->match_all) {
+        return !projection->deny;
+    }
+
+    first = (unsigned char)tolower((unsigned char)*name);
+    end = (uint32_t)projection->first_start[first] + projection->first_count[first];
+    for (i = projection->first_start[first]; i < end; i++) {
+        if (!strncasecmp(name, projection->prefixes[i].prefix, projection->prefixes[i].len)) {
+            matched = SWITCH_TRUE;
+            break;
+        }
+    }
+
+    /* Most dropped headers share no first character with an exact name and are never hashed */
+    if (!matched && first_bit_test(projection->exact_first, first)) {
+        hash = hash_nocase(name);
+        for (slot = hash & projection->exact_mask; projection->exact[slot].name; slot = (slot + 1) & projection->exact_mask) {
+            if (projection->exact[slot].hash == hash && !strcasecmp(projection->exact[slot].name, name)) {
+                matched = SWITCH_TRUE;
+                break;
+            }
+        }
+    }
+
+    return projection->deny ? !matched : matched;
+}
+
+void event_projection_account(switch_event_types_t id, size_t bytes, size_t skipped_bytes)
+{
+    event_projection_stats_t *stats;
+
+    if ((uint32_t)id >= SWITCH_EVENT_ALL) {
+        return;
+    }
+
+    stats = &g_stats[id];
+    __atomic_fetch_add(&stats->events, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->bytes_unprojected, bytes + skipped_bytes, __ATOMIC_RELAXED);
+}
+
+void event_projection_get_stats(switch_event_types_t id, event_projection_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if ((uint32_t)id >= SWITCH_EVENT_ALL) {
+        return;
+    }
+
+    stats->events = __atomic_load_n(&g_stats[id].events, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&g_stats[id].bytes, __ATOMIC_RELAXED);
+    stats->bytes_unprojected = __atomic_load_n(&g_stats[id].bytes_unprojected, __ATOMIC_RELAXED);
+}
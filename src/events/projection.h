@@ -0,0 +1,26 @@
+#ifndef EVENTS_PROJECTION_H
+#define EVENTS_PROJECTION_H
+
+#include "../mod_event_agent.h"
+
+/*
+ * Per event type header projection. Patterns are exact header names or
+ * prefixes ending in '*', matched case-insensitively like FreeSWITCH does.
+ */
+typedef struct event_projection_s event_projection_t;
+
+typedef struct {
+    uint64_t events;
+    uint64_t bytes;
+    uint64_t bytes_unprojected;
+} event_projection_stats_t;
+
+void event_projections_reset(void);
+switch_status_t event_projection_add(switch_memory_pool_t *pool, const char *event_name, switch_bool_t deny, const char *patterns);
+const event_projection_t *event_projection_for(switch_event_types_t id);
+switch_bool_t event_projection_allows(const event_projection_t *projection, const char *name);
+
+void event_projection_account(switch_event_types_t id, size_t bytes, size_t skipped_bytes);
+void event_projection_get_stats(switch_event_types_t id, event_projection_stats_t *stats);
+
+#endif /* EVENTS_PROJECTION_H */
@@ -0,0 +1,138 @@
+#include "queue.h"
+
+#define QUEUE_CACHE_LINE 64
+
+typedef struct {
+    uint64_t sequence;
+    void *data;
+} event_queue_cell_t;
+
+struct event_queue_s {
+    event_queue_cell_t *cells;
+    uint64_t mask;
+    char pad0[QUEUE_CACHE_LINE];
+    uint64_t tail;      /* next slot claimed by producers */
+    char pad1[QUEUE_CACHE_LINE];
+    uint64_t head;      /* next slot read by the consumer */
+    char pad2[QUEUE_CACHE_LINE];
+};
+
+switch_status_t event_queue_create(event_queue_t **queue, uint32_t capacity, switch_memory_pool_t *pool)
+{
+    event_queue_t *q;
+    uint64_t size = 2;
+    uint64_t i;
+
+    if (!queue || !pool || capacity == 0) {
+        return SWITCH_STATUS_FALSE;
+    }
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    q = switch_core_alloc(pool, sizeof(*q));
+    q->cells = switch_core_alloc(pool, sizeof(event_queue_cell_t) * size);
+    if (!q->cells) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    for (i = 0; i < size; i++) {
+        q->cells[i].sequence = i;
+        q->cells[i].data = NULL;
+    }
+
+    q->mask = size - 1;
+    q->tail = 0;
+    q->head = 0;
+
+    *queue = q;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_bool_t event_queue_push(event_queue_t *queue, void *item)
+{
+    event_queue_cell_t *cell;
+    uint64_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        uint64_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return SWITCH_FALSE;
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = item;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return SWITCH_TRUE;
+}
+
+void *event_queue_pop(event_queue_t *queue)
+{
+    uint64_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    event_queue_cell_t *cell = &queue->cells[pos & queue->mask];
+    uint64_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    void *item;
+
+    if ((int64_t)seq - (int64_t)(pos + 1) < 0) {
+        return NULL;
+    }
+
+    item = cell->data;
+    cell->data = NULL;
+    __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&queue->head, pos + 1, __ATOMIC_RELAXED);
+
+    return item;
+}
+
+void *event_queue_steal(event_queue_t *queue)
+{
+    event_queue_cell_t *cell;
+    uint64_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    void *item;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        uint64_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    item = cell->data;
+    cell->data = NULL;
+    __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+
+    return item;
+}
+
+uint32_t event_queue_depth(event_queue_t *queue)
+{
+    uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+
+    return tail > head ? (uint32_t)(tail - head) : 0;
+}
+
+uint32_t event_queue_capacity(event_queue_t *queue)
+{
+    return (uint32_t)(queue->mask + 1);
+}
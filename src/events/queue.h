@@ -0,0 +1,24 @@
+#ifndef EVENTS_QUEUE_H
+#define EVENTS_QUEUE_H
+
+#include <switch.h>
+
+/*
+ * Bounded lock-free ring. Any number of threads may push, a single thread
+ * pops. Capacity is rounded up to a power of two.
+ */
+typedef struct event_queue_s event_queue_t;
+
+switch_status_t event_queue_create(event_queue_t **queue, uint32_t capacity, switch_memory_pool_t *pool);
+switch_bool_t event_queue_push(event_queue_t *queue, void *item);
+void *event_queue_pop(event_queue_t *queue);
+/*
+ * Pop that tolerates concurrent consumers, for queues that other threads
+ * steal from. A queue must be drained either with this or with
+ * event_queue_pop, never both.
+ */
+void *event_queue_steal(event_queue_t *queue);
+uint32_t event_queue_depth(event_queue_t *queue);
+uint32_t event_queue_capacity(event_queue_t *queue);
+
+#endif /* EVENTS_QUEUE_H */
@@ -0,0 +1,355 @@
+#include "ratelimit.h"
+#include "pipeline.h"
+
+#define RATELIMIT_TOKEN 1000000
+#define RATELIMIT_DEFAULT_WINDOW_MS 1000
+#define RATELIMIT_DEFAULT_MAX_KEYS 10000
+
+typedef struct event_ratelimit_s {
+    const char *name;
+    uint32_t rate;
+    uint32_t burst;
+    switch_bool_t coalesce;
+    const char *key;
+    uint32_t window_ms;
+    uint32_t max_keys;
+
+    switch_mutex_t *mutex;
+    int64_t tokens;             /* in millionths of a token */
+    switch_time_t refilled;
+    switch_hash_t *pending;
+    uint32_t pending_count;
+    switch_time_t flush_at;
+
+    uint64_t passed;
+    uint64_t dropped;
+    uint64_t held;
+    uint64_t coalesced;
+    uint64_t flushed;
+
+    struct event_ratelimit_s *next;
+} event_ratelimit_t;
+
+static event_ratelimit_t *g_by_id[SWITCH_EVENT_ALL];
+static switch_hash_t *g_by_subclass = NULL;
+static event_ratelimit_t *g_limits = NULL;
+static switch_bool_t g_coalescing = SWITCH_FALSE;
+static uint32_t g_pending_total = 0;
+
+void event_ratelimits_reset(void)
+{
+    memset(g_by_id, 0, sizeof(g_by_id));
+    g_by_subclass = NULL;
+    g_limits = NULL;
+    g_coalescing = SWITCH_FALSE;
+    __atomic_store_n(&g_pending_total, 0, __ATOMIC_RELAXED);
+}
+
+static void destroy_pending(switch_hash_t **pending)
+{
+    switch_hash_index_t *hi;
+    void *val;
+
+    for (hi = switch_core_hash_first(*pending); hi; hi = switch_core_hash_next(&hi)) {
+        switch_event_t *event;
+
+        switch_core_hash_this(hi, NULL, NULL, &val);
+        event = (switch_event_t *)val;
+        switch_event_destroy(&event);
+    }
+    switch_core_hash_destroy(pending);
+}
+
+void event_ratelimits_destroy(void)
+{
+    event_ratelimit_t *limit;
+
+    for (limit = g_limits; limit; limit = limit->next) {
+        if (limit->pending) {
+            destroy_pending(&limit->pending);
+        }
+    }
+    if (g_by_subclass) {
+        switch_core_hash_destroy(&g_by_subclass);
+    }
+    event_ratelimits_reset();
+}
+
+switch_status_t event_ratelimit_add(switch_memory_pool_t *pool, const char *event_name, uint32_t rate, uint32_t burst,
+                                    const char *action, const char *key, uint32_t window_ms, uint32_t max_keys)
+{
+    event_ratelimit_t *limit;
+    switch_event_types_t id = SWITCH_EVENT_CUSTOM;
+    const char *subclass = NULL;
+
+    if (zstr(event_name)) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Ignoring rate limit without event name");
+        return SWITCH_STATUS_FALSE;
+    }
+
+    if (!strncasecmp(event_name, "CUSTOM ", 7)) {
+        subclass = event_name + 7;
+        while (*subclass == ' ') subclass++;
+    } else if (strstr(event_name, "::")) {
+        subclass = event_name;
+    } else if (switch_name_event(event_name, &id) != SWITCH_STATUS_SUCCESS || id >= SWITCH_EVENT_ALL) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Ignoring rate limit for unknown event '%s'", event_name);
+        return SWITCH_STATUS_FALSE;
+    }
+
+    if (!rate) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Ignoring rate limit for '%s': rate must be > 0", event_name);
+        return SWITCH_STATUS_FALSE;
+    }
+
+    limit = switch_core_alloc(pool, sizeof(*limit));
+    memset(limit, 0, sizeof(*limit));
+    limit->name = switch_core_strdup(pool, subclass ? subclass : switch_event_name(id));
+    limit->rate = rate;
+    limit->burst = burst ? burst : rate;
+    limit->window_ms = window_ms ? window_ms : RATELIMIT_DEFAULT_WINDOW_MS;
+    limit->max_keys = max_keys ? max_keys : RATELIMIT_DEFAULT_MAX_KEYS;
+    limit->tokens = (int64_t)limit->burst * RATELIMIT_TOKEN;
+    limit->refilled = switch_micro_time_now();
+
+    if (!zstr(action) && !strcasecmp(action, "coalesce")) {
+        if (zstr(key)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Rate limit for '%s' coalesces without a key header, dropping instead", limit->name);
+        } else {
+            limit->coalesce = SWITCH_TRUE;
+            limit->key = switch_core_strdup(pool, key);
+            switch_core_hash_init(&limit->pending);
+            g_coalescing = SWITCH_TRUE;
+        }
+    } else if (!zstr(action) && strcasecmp(action, "drop")) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Unknown rate limit action '%s' for '%s', using drop", action, limit->name);
+    }
+
+    switch_mutex_init(&limit->mutex, SWITCH_MUTEX_NESTED, pool);
+
+    if (subclass) {
+        if (!g_by_subclass) {
+            switch_core_hash_init_nocase(&g_by_subclass);
+        }
+        switch_core_hash_insert(g_by_subclass, limit->name, limit);
+    } else {
+        g_by_id[id] = limit;
+    }
+
+    limit->next = g_limits;
+    g_limits = limit;
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Rate limit for %s: %u/s, burst %u, %s",
+                      limit->name, limit->rate, limit->burst, limit->coalesce ? "coalesce" : "drop");
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static event_ratelimit_t *limit_for(switch_event_t *event)
+{
+    event_ratelimit_t *limit = NULL;
+
+    if (event->event_id == SWITCH_EVENT_CUSTOM && g_by_subclass && !zstr(event->subclass_name)) {
+        limit = (event_ratelimit_t *)switch_core_hash_find(g_by_subclass, event->subclass_name);
+    }
+    if (!limit && event->event_id < SWITCH_EVENT_ALL) {
+        limit = g_by_id[event->event_id];
+    }
+    return limit;
+}
+
+static switch_bool_t take_token(event_ratelimit_t *limit, switch_time_t now)
+{
+    int64_t cap = (int64_t)limit->burst * RATELIMIT_TOKEN;
+
+    if (now > limit->refilled) {
+        limit->tokens += (int64_t)(now - limit->refilled) * limit->rate;
+        if (limit->tokens > cap) {
+            limit->tokens = cap;
+        }
+        limit->refilled = now;
+    }
+
+    if (limit->tokens >= RATELIMIT_TOKEN) {
+        limit->tokens -= RATELIMIT_TOKEN;
+        return SWITCH_TRUE;
+    }
+    return SWITCH_FALSE;
+}
+
+event_ratelimit_result_t event_ratelimit_check(switch_event_t *event)
+{
+    event_ratelimit_t *limit = limit_for(event);
+    switch_event_t *clone = NULL;
+    switch_event_t *stale;
+    const char *key;
+    switch_time_t now;
+
+    if (!limit) {
+        return EVENT_RATELIMIT_PASS;
+    }
+
+    now = switch_micro_time_now();
+    key = limit->coalesce ? switch_event_get_header(event, limit->key) : NULL;
+
+    switch_mutex_lock(limit->mutex);
+    if (take_token(limit, now)) {
+        limit->passed++;
+        /* A parked event for the same key is older than this one */
+        if (key && limit->pending_count && (stale = (switch_event_t *)switch_core_hash_delete(limit->pending, key))) {
+            limit->pending_count--;
+            limit->coalesced++;
+            __atomic_fetch_sub(&g_pending_total, 1, __ATOMIC_RELAXED);
+            switch_mutex_unlock(limit->mutex);
+            switch_event_destroy(&stale);
+            return EVENT_RATELIMIT_PASS;
+        }
+        switch_mutex_unlock(limit->mutex);
+        return EVENT_RATELIMIT_PASS;
+    }
+    if (!key) {
+        limit->dropped++;
+        switch_mutex_unlock(limit->mutex);
+        return EVENT_RATELIMIT_DROP;
+    }
+    switch_mutex_unlock(limit->mutex);
+
+    if (switch_event_dup(&clone, event) != SWITCH_STATUS_SUCCESS || !clone) {
+        switch_mutex_lock(limit->mutex);
+        limit->dropped++;
+        switch_mutex_unlock(limit->mutex);
+        return EVENT_RATELIMIT_DROP;
+    }
+
+    switch_mutex_lock(limit->mutex);
+    if ((stale = (switch_event_t *)switch_core_hash_find(limit->pending, key))) {
+        limit->coalesced++;
+    } else if (limit->pending_count >= limit->max_keys) {
+        limit->dropped++;
+        switch_mutex_unlock(limit->mutex);
+        switch_event_destroy(&clone);
+        return EVENT_RATELIMIT_DROP;
+    } else {
+        if (!limit->pending_count) {
+            limit->flush_at = now + (switch_time_t)limit->window_ms * 1000;
+        }
+        limit->pending_count++;
+        __atomic_fetch_add(&g_pending_total, 1, __ATOMIC_RELAXED);
+    }
+    switch_core_hash_insert(limit->pending, key, clone);
+    limit->held++;
+    switch_mutex_unlock(limit->mutex);
+
+    if (stale) {
+        switch_event_destroy(&stale);
+    }
+    return EVENT_RATELIMIT_HELD;
+}
+
+static void flush_limit(event_ratelimit_t *limit)
+{
+    switch_hash_t *pending = NULL;
+    switch_hash_index_t *hi;
+    uint32_t flushed = 0;
+    void *val;
+
+    if (switch_core_hash_init(&pending) != SWITCH_STATUS_SUCCESS) {
+        return;
+    }
+
+    switch_mutex_lock(limit->mutex);
+    if (!limit->pending_count) {
+        switch_mutex_unlock(limit->mutex);
+        switch_core_hash_destroy(&pending);
+        return;
+    }
+    val = limit->pending;
+    limit->pending = pending;
+    pending = (switch_hash_t *)val;
+    __atomic_fetch_sub(&g_pending_total, limit->pending_count, __ATOMIC_RELAXED);
+    limit->pending_count = 0;
+    limit->flush_at = 0;
+    switch_mutex_unlock(limit->mutex);
+
+    for (hi = switch_core_hash_first(pending); hi; hi = switch_core_hash_next(&hi)) {
+        switch_core_hash_this(hi, NULL, NULL, &val);
+        if (event_pipeline_requeue((switch_event_t *)val)) {
+            flushed++;
+        }
+    }
+    switch_core_hash_destroy(&pending);
+
+    switch_mutex_lock(limit->mutex);
+    limit->flushed += flushed;
+    switch_mutex_unlock(limit->mutex);
+}
+
+switch_interval_time_t event_ratelimit_flush_due(switch_time_t now)
+{
+    event_ratelimit_t *limit;
+    switch_interval_time_t next = 0;
+
+    if (!g_coalescing || !__atomic_load_n(&g_pending_total, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    for (limit = g_limits; limit; limit = limit->next) {
+        switch_time_t flush_at;
+
+        if (!limit->coalesce) {
+            continue;
+        }
+
+        switch_mutex_lock(limit->mutex);
+        flush_at = limit->pending_count ? limit->flush_at : 0;
+        switch_mutex_unlock(limit->mutex);
+
+        if (!flush_at) {
+            continue;
+        }
+        if (flush_at <= now) {
+            flush_limit(limit);
+        } else if (!next || flush_at - now < next) {
+            next = flush_at - now;
+        }
+    }
+
+    return next;
+}
+
+void event_ratelimit_flush_all(void)
+{
+    event_ratelimit_t *limit;
+
+    for (limit = g_limits; limit; limit = limit->next) {
+        if (limit->coalesce) {
+            flush_limit(limit);
+        }
+    }
+}
+
+void event_ratelimit_foreach_stats(event_ratelimit_stats_callback_t callback, void *user_data)
+{
+    event_ratelimit_t *limit;
+
+    for (limit = g_limits; limit; limit = limit->next) {
+        event_ratelimit_stats_t stats;
+
+        stats.name = limit->name;
+        stats.rate = limit->rate;
+        stats.burst = limit->burst;
+        stats.coalesce = limit->coalesce;
+        stats.key = limit->key;
+        stats.window_ms = limit->window_ms;
+
+        switch_mutex_lock(limit->mutex);
+        stats.passed = limit->passed;
+        stats.dropped = limit->dropped;
+        stats.held = limit->held;
+        stats.coalesced = limit->coalesced;
+        stats.flushed = limit->flushed;
+        stats.pending = limit->pending_count;
+        switch_mutex_unlock(limit->mutex);
+
+        callback(&stats, user_data);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef EVENTS_RATELIMIT_H
+#define EVENTS_RATELIMIT_H
+
+#include "../mod_event_agent.h"
+
+/*
+ * Token buckets per event type (or CUSTOM subclass), checked on the core
+ * thread before an event is queued. Over-limit events are dropped, or with
+ * action="coalesce" parked per key header and only the latest one per key
+ * is published when the window closes.
+ */
+typedef enum {
+    EVENT_RATELIMIT_PASS,
+    EVENT_RATELIMIT_DROP,
+    EVENT_RATELIMIT_HELD
+} event_ratelimit_result_t;
+
+typedef struct {
+    const char *name;
+    uint32_t rate;
+    uint32_t burst;
+    switch_bool_t coalesce;
+    const char *key;
+    uint32_t window_ms;
+    uint64_t passed;
+    uint64_t dropped;
+    uint64_t held;
+    uint64_t coalesced;
+    uint64_t flushed;
+    uint32_t pending;
+} event_ratelimit_stats_t;
+
+typedef void (*event_ratelimit_stats_callback_t)(const event_ratelimit_stats_t *stats, void *user_data);
+
+void event_ratelimits_reset(void);
+void event_ratelimits_destroy(void);
+switch_status_t event_ratelimit_add(switch_memory_pool_t *pool, const char *event_name, uint32_t rate, uint32_t burst,
+                                    const char *action, const char *key, uint32_t window_ms, uint32_t max_keys);
+
+event_ratelimit_result_t event_ratelimit_check(switch_event_t *event);
+
+/* Publishes coalesced events whose window closed; returns microseconds until the next window closes (0 if none) */
+switch_interval_time_t event_ratelimit_flush_due(switch_time_t now);
+void event_ratelimit_flush_all(void);
+
+void event_ratelimit_foreach_stats(event_ratelimit_stats_callback_t callback, void *user_data);
+
+#endif /* EVENTS_RATELIMIT_H */
@@ -0,0 +1,227 @@
+#include "retention.h"
+
+typedef struct {
+    uint64_t seq;
+    char *entry;    /* subject\0data */
+    uint32_t subject_len;
+    uint32_t len;
+    uint64_t type_seq;
+    switch_bool_t dropped;
+} retention_slot_t;
+
+static retention_slot_t *g_ring = NULL;
+static uint64_t g_mask = 0;
+static uint64_t g_max_bytes = 0;
+static switch_mutex_t *g_mutex = NULL;
+
+static uint64_t g_next_seq = 0;
+static uint64_t g_oldest = 1;
+static uint64_t g_newest = 0;
+static uint64_t g_events = 0;
+static uint64_t g_bytes = 0;
+static uint64_t g_hits = 0;
+static uint64_t g_misses = 0;
+static uint64_t g_evicted = 0;
+
+uint64_t event_sequence_next(void)
+{
+    return __atomic_add_fetch(&g_next_seq, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t event_sequence_last(void)
+{
+    return __atomic_load_n(&g_next_seq, __ATOMIC_RELAXED);
+}
+
+switch_status_t event_retention_init(uint32_t max_events, uint64_t max_bytes)
+{
+    uint64_t slots = 1;
+
+    if (!max_events || !max_bytes) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    while (slots < max_events) {
+        slots <<= 1;
+    }
+
+    if (!(g_ring = calloc(slots, sizeof(retention_slot_t)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    g_mask = slots - 1;
+    g_max_bytes = max_bytes;
+    g_oldest = 1;
+    g_newest = 0;
+    g_events = g_bytes = g_hits = g_misses = g_evicted = 0;
+    switch_mutex_init(&g_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Retaining up to %llu events / %llu bytes for replay",
+                      (unsigned long long)slots, (unsigned long long)max_bytes);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Drops the oldest sequence; caller holds g_mutex */
+static void evict_oldest(void)
+{
+    retention_slot_t *slot = &g_ring[g_oldest & g_mask];
+
+    if (slot->entry && slot->seq == g_oldest) {
+        g_bytes -= slot->subject_len + 1 + slot->len;
+        g_events--;
+        g_evicted++;
+        switch_safe_free(slot->entry);
+    }
+    g_oldest++;
+}
+
+void event_retention_destroy(void)
+{
+    uint64_t i;
+
+    if (!g_ring) {
+        return;
+    }
+
+    switch_mutex_lock(g_mutex);
+    for (i = 0; i <= g_mask; i++) {
+        switch_safe_free(g_ring[i].entry);
+    }
+    free(g_ring);
+    g_ring = NULL;
+    g_events = g_bytes = 0;
+    switch_mutex_unlock(g_mutex);
+}
+
+switch_bool_t event_retention_enabled(void)
+{
+    return g_ring ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static void retain(uint64_t seq, const char *subject, const char *data, size_t len, uint64_t type_seq, switch_bool_t dropped)
+{
+    retention_slot_t *slot;
+    size_t subject_len;
+    char *entry;
+
+    if (!g_ring || (subject_len = strlen(subject)) + 1 + len > g_max_bytes) {
+        return;
+    }
+
+    if (!(entry = malloc(subject_len + 1 + len))) {
+        return;
+    }
+    memcpy(entry, subject, subject_len + 1);
+    if (len) {
+        memcpy(entry + subject_len + 1, data, len);
+    }
+
+    switch_mutex_lock(g_mutex);
+
+    /* Publisher threads store out of order; a sequence older than the window is already gone */
+    if (seq < g_oldest) {
+        switch_mutex_unlock(g_mutex);
+        free(entry);
+        return;
+    }
+    while (seq > g_oldest + g_mask) {
+        evict_oldest();
+    }
+
+    slot = &g_ring[seq & g_mask];
+    slot->seq = seq;
+    slot->entry = entry;
+    slot->subject_len = (uint32_t)subject_len;
+    slot->len = (uint32_t)len;
+    slot->type_seq = type_seq;
+    slot->dropped = dropped;
+    g_bytes += subject_len + 1 + len;
+    g_events++;
+    if (seq > g_newest) {
+        g_newest = seq;
+    }
+
+    while (g_bytes > g_max_bytes && g_oldest <= g_newest) {
+        evict_oldest();
+    }
+
+    switch_mutex_unlock(g_mutex);
+}
+
+void event_retention_store(uint64_t seq, const char *subject, const char *data, size_t len)
+{
+    retain(seq, subject, data, len, 0, SWITCH_FALSE);
+}
+
+void event_retention_store_dropped(uint64_t seq, const char *subject, uint64_t type_seq)
+{
+    retain(seq, subject, NULL, 0, type_seq, SWITCH_TRUE);
+}
+
+uint32_t event_retention_replay(uint64_t from, uint64_t to, event_retention_visitor_t visitor, void *user_data, uint32_t *missing)
+{
+    retention_slot_t *copies;
+    uint32_t count = 0, visited = 0, i;
+    uint64_t seq;
+
+    *missing = (uint32_t)(to - from + 1);
+    if (!g_ring || to < from || !(copies = calloc((size_t)(to - from + 1), sizeof(retention_slot_t)))) {
+        return 0;
+    }
+
+    /* Copy under the lock, publish after it so publisher threads are not held up */
+    switch_mutex_lock(g_mutex);
+    for (seq = from; seq <= to; seq++) {
+        retention_slot_t *slot = &g_ring[seq & g_mask];
+        size_t size;
+
+        if (seq < g_oldest || !slot->entry || slot->seq != seq) {
+            continue;
+        }
+        size = slot->subject_len + 1 + slot->len;
+        if (!(copies[count].entry = malloc(size))) {
+            break;
+        }
+        memcpy(copies[count].entry, slot->entry, size);
+        copies[count].seq = seq;
+        copies[count].subject_len = slot->subject_len;
+        copies[count].len = slot->len;
+        copies[count].type_seq = slot->type_seq;
+        copies[count].dropped = slot->dropped;
+        count++;
+    }
+    g_hits += count;
+    g_misses += (to - from + 1) - count;
+    switch_mutex_unlock(g_mutex);
+
+    for (i = 0; i < count; i++) {
+        retention_slot_t *copy = &copies[i];
+        const char *data = copy->dropped ? NULL : copy->entry + copy->subject_len + 1;
+
+        if (visitor(copy->seq, copy->entry, data, copy->len, copy->type_seq, user_data) == SWITCH_STATUS_SUCCESS) {
+            visited++;
+        }
+        free(copy->entry);
+    }
+    free(copies);
+
+    *missing = (uint32_t)(to - from + 1) - visited;
+    return visited;
+}
+
+void event_retention_get_stats(event_retention_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!g_ring) {
+        return;
+    }
+
+    switch_mutex_lock(g_mutex);
+    stats->events = g_events;
+    stats->memory_bytes = g_bytes + (g_mask + 1) * sizeof(retention_slot_t);
+    stats->oldest_seq = g_events ? g_oldest : 0;
+    stats->newest_seq = g_newest;
+    stats->hits = g_hits;
+    stats->misses = g_misses;
+    stats->evicted = g_evicted;
+    switch_mutex_unlock(g_mutex);
+}
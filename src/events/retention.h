@@ -0,0 +1,55 @@
+#ifndef EVENTS_RETENTION_H
+#define EVENTS_RETENTION_H
+
+#include "../mod_event_agent.h"
+
+/*
+ * Recently published payloads indexed by node_seq, for consumers that
+ * detect a gap and ask for it again (events.replay). Bounded by
+ * retention_max_events slots and retention_max_bytes; the oldest
+ * sequences are evicted first.
+ *
+ * The sequence is node-wide, but each publisher thread takes its number
+ * when it serializes, so with publisher_threads > 1 messages reach the
+ * broker out of sequence order. Only a consumer of every event subject
+ * can tell a gap from reordering; one subject alone always shows jumps.
+ * Events also carry type_seq (see event_subject_sequence_next), which
+ * lets a consumer of one event type check its own stream.
+ *
+ * Both numbers are written into the payload, so they are taken before
+ * encoding; an event that then fails to encode leaves a dropped marker
+ * here, so a replay can tell the consumer that hole will never fill.
+ */
+typedef struct {
+    uint64_t events;
+    uint64_t memory_bytes;
+    uint64_t oldest_seq;
+    uint64_t newest_seq;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evicted;
+} event_retention_stats_t;
+
+/* Called outside the retention lock, in sequence order. data is NULL for a dropped marker, which carries its type_seq */
+typedef switch_status_t (*event_retention_visitor_t)(uint64_t seq, const char *subject, const char *data, size_t len, uint64_t type_seq,
+                                                     void *user_data);
+
+switch_status_t event_retention_init(uint32_t max_events, uint64_t max_bytes);
+void event_retention_destroy(void);
+switch_bool_t event_retention_enabled(void);
+
+/* Next per-node sequence number; starts at 1 on every module load */
+uint64_t event_sequence_next(void);
+uint64_t event_sequence_last(void);
+
+void event_retention_store(uint64_t seq, const char *subject, const char *data, size_t len);
+
+/* Records that seq (and type_seq on subject) were taken by an event that was never published */
+void event_retention_store_dropped(uint64_t seq, const char *subject, uint64_t type_seq);
+
+/* Visits retained events in [from, to]; returns how many were visited, *missing counts the rest */
+uint32_t event_retention_replay(uint64_t from, uint64_t to, event_retention_visitor_t visitor, void *user_data, uint32_t *missing);
+
+void event_retention_get_stats(event_retention_stats_t *stats);
+
+#endif /* EVENTS_RETENTION_H */
@@ -1,61 +1,139 @@
-#include "mod_event_agent.h"
-#include <switch_json.h>
+#include "serializer.h"
+#include "json_writer.h"
+#include "delta.h"
 
-char *serialize_event_to_json(switch_event_t *event, const char *node_id)
+static const event_serializer_t g_serializers[] = {
+    [EVENT_FORMAT_JSON] = { "json", "application/json", event_encode_json },
+    [EVENT_FORMAT_MSGPACK] = { "msgpack", "application/msgpack", event_encode_msgpack },
+    [EVENT_FORMAT_CBOR] = { "cbor", "application/cbor", event_encode_cbor },
+};
+
+const event_serializer_t *event_serializer_get(event_format_t format)
 {
-    cJSON *json_event = NULL;
-    cJSON *headers = NULL;
-    char *json_str = NULL;
-    switch_event_header_t *hp;
+    if ((size_t)format >= sizeof(g_serializers) / sizeof(g_serializers[0])) {
+        return &g_serializers[EVENT_FORMAT_JSON];
+    }
+    return &g_serializers[format];
+}
 
-    if (!event) {
-        return NULL;
+switch_status_t event_serializer_parse_format(const char *name, event_format_t *format)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(g_serializers) / sizeof(g_serializers[0]); i++) {
+        if (!strcasecmp(name, g_serializers[i].name)) {
+            *format = (event_format_t)i;
+            return SWITCH_STATUS_SUCCESS;
+        }
     }
+    return SWITCH_STATUS_FALSE;
+}
 
-    json_event = cJSON_CreateObject();
-    if (!json_event) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to create JSON object");
-        return NULL;
+switch_bool_t event_encode_json(event_buffer_t *buf, event_record_t *record)
+{
+    switch_event_t *event = record->event;
+    const switch_event_header_t *hp;
+    event_header_iter_t iter;
+    const char *event_name = switch_event_name(event->event_id);
+    const char *uuid = switch_event_get_header(event, "Unique-ID");
+    switch_bool_t first = SWITCH_TRUE;
+    uint32_t i;
+    switch_bool_t ok = event_buffer_append_char(buf, '{');
+
+    if (event_name) {
+        ok = ok && json_write_key(buf, "event_name", first) && json_write_string(buf, event_name);
+        first = SWITCH_FALSE;
     }
 
-    cJSON_AddStringToObject(json_event, "event_name", 
-                           switch_event_name(event->event_id));
-    
-    cJSON_AddNumberToObject(json_event, "timestamp", 
-                           (double)switch_micro_time_now());
+    ok = ok && json_write_key(buf, "timestamp", first) && json_write_u64(buf, record->timestamp);
 
-    if (node_id) {
-        cJSON_AddStringToObject(json_event, "node_id", node_id);
+    if (record->node_id) {
+        ok = ok && json_write_key(buf, "node_id", SWITCH_FALSE) && json_write_string(buf, record->node_id);
+    }
+
+    if (record->node_seq) {
+        ok = ok && json_write_key(buf, "node_seq", SWITCH_FALSE) && json_write_u64(buf, record->node_seq);
+    }
+
+    if (record->type_seq) {
+        ok = ok && json_write_key(buf, "type_seq", SWITCH_FALSE) && json_write_u64(buf, record->type_seq);
     }
 
-    const char *uuid = switch_event_get_header(event, "Unique-ID");
     if (uuid) {
-        cJSON_AddStringToObject(json_event, "uuid", uuid);
+        ok = ok && json_write_key(buf, "uuid", SWITCH_FALSE) && json_write_string(buf, uuid);
+    }
+
+    if (record->delta) {
+        ok = ok && json_write_key(buf, "delta", SWITCH_FALSE) && event_buffer_append_char(buf, '{') &&
+             json_write_key(buf, "keyframe", SWITCH_TRUE) && event_buffer_append_str(buf, record->delta->keyframe ? "true" : "false") &&
+             json_write_key(buf, "seq", SWITCH_FALSE) && json_write_u64(buf, record->delta->sequence) &&
+             event_buffer_append_char(buf, '}');
+    }
+
+    ok = ok && json_write_key(buf, "headers", SWITCH_FALSE) && event_buffer_append_char(buf, '{');
+    first = SWITCH_TRUE;
+    event_record_iter_init(record, &iter);
+    while (ok && (hp = event_record_next_header(record, &iter, SWITCH_TRUE))) {
+        ok = json_write_key(buf, hp->name, first) && json_write_string(buf, hp->value);
+        first = SWITCH_FALSE;
     }
+    ok = ok && event_buffer_append_char(buf, '}');
 
-    headers = cJSON_CreateObject();
-    if (headers) {
-        for (hp = event->headers; hp; hp = hp->next) {
-            if (hp->name && hp->value) {
-                cJSON_AddStringToObject(headers, hp->name, hp->value);
-            }
+    if (record->delta && record->delta->removed_count) {
+        ok = ok && json_write_key(buf, "removed", SWITCH_FALSE) && event_buffer_append_char(buf, '[');
+        for (i = 0; ok && i < record->delta->removed_count; i++) {
+            ok = (!i || event_buffer_append_char(buf, ',')) && json_write_string(buf, record->delta->removed[i]);
         }
-        cJSON_AddItemToObject(json_event, "headers", headers);
+        ok = ok && event_buffer_append_char(buf, ']');
     }
 
     if (event->body) {
-        cJSON_AddStringToObject(json_event, "body", event->body);
+        ok = ok && json_write_key(buf, "body", SWITCH_FALSE) && json_write_string(buf, event->body);
     }
 
-    json_str = cJSON_PrintUnformatted(json_event);
-    cJSON_Delete(json_event);
-
-    return json_str;
+    return ok && event_buffer_append_char(buf, '}') && event_buffer_terminate(buf);
 }
 
-void free_serialized_event(char *json)
+const char *event_serialize(const event_serializer_t *serializer, switch_event_t *event, const char *node_id, uint64_t node_seq,
+                            uint64_t type_seq, event_delta_state_t *delta_state, size_t *len)
 {
-    if (json) {
-        cJSON_free(json);
+    event_buffer_t *buf = event_buffer_thread_local();
+    event_record_t record;
+
+    if (!event || !serializer) {
+        return NULL;
+    }
+
+    record.event = event;
+    record.node_id = node_id;
+    record.node_seq = node_seq;
+    record.type_seq = type_seq;
+    record.timestamp = (uint64_t)switch_micro_time_now();
+    record.projection = event_projection_for(event->event_id);
+    record.delta = NULL;
+    record.skipped_bytes = 0;
+
+    if (delta_state) {
+        record.delta = event_delta_compute(delta_state, &record);
     }
+
+    event_buffer_reset(buf);
+    if (!serializer->encode(buf, &record)) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to grow serialization buffer (%s)", serializer->name);
+        event_delta_abort(delta_state);
+        return NULL;
+    }
+    event_delta_commit(delta_state);
+
+    event_projection_account(event->event_id, buf->len, record.skipped_bytes);
+
+    if (len) {
+        *len = buf->len;
+    }
+    return buf->data;
+}
+
+const char *serialize_event_to_json(switch_event_t *event, const char *node_id, size_t *len)
+{
+    return event_serialize(&g_serializers[EVENT_FORMAT_JSON], event, node_id, 0, 0, NULL, len);
 }
@@ -0,0 +1,91 @@
+#ifndef EVENTS_SERIALIZER_H
+#define EVENTS_SERIALIZER_H
+
+#include "../mod_event_agent.h"
+#include "buffer.h"
+#include "projection.h"
+
+#define EVENT_CONTENT_TYPE_HEADER "Content-Type"
+
+/* Headers that changed since the last event of the same call (delta mode) */
+typedef struct {
+    switch_bool_t keyframe;
+    uint32_t sequence;
+    const switch_event_header_t **changed;
+    uint32_t changed_count;
+    const char **removed;
+    uint32_t removed_count;
+} event_delta_t;
+
+typedef struct {
+    switch_event_t *event;
+    const char *node_id;
+    uint64_t node_seq;
+    uint64_t type_seq;
+    uint64_t timestamp;
+    const event_projection_t *projection;
+    const event_delta_t *delta;
+    size_t skipped_bytes;
+} event_record_t;
+
+typedef struct {
+    const switch_event_header_t *next;
+    uint32_t index;
+} event_header_iter_t;
+
+/* Projection check shared by the encoders; dropped headers are tallied (roughly) for the payload stats */
+static inline switch_bool_t event_record_keep_header(event_record_t *record, const switch_event_header_t *hp, switch_bool_t account) {
+    if (!hp->name || !hp->value) {
+        return SWITCH_FALSE;
+    }
+    if (record->projection && !event_projection_allows(record->projection, hp->name)) {
+        if (account) {
+            record->skipped_bytes += strlen(hp->name) + strlen(hp->value) + 6;
+        }
+        return SWITCH_FALSE;
+    }
+    return SWITCH_TRUE;
+}
+
+static inline void event_record_iter_init(const event_record_t *record, event_header_iter_t *iter) {
+    iter->next = record->event->headers;
+    iter->index = 0;
+}
+
+/* Walks the headers to encode: the delta's changed list, or the projected event headers */
+static inline const switch_event_header_t *event_record_next_header(event_record_t *record, event_header_iter_t *iter, switch_bool_t account) {
+    const switch_event_header_t *hp;
+
+    if (record->delta) {
+        return iter->index < record->delta->changed_count ? record->delta->changed[iter->index++] : NULL;
+    }
+
+    while ((hp = iter->next)) {
+        iter->next = hp->next;
+        if (event_record_keep_header(record, hp, account)) {
+            return hp;
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    const char *name;
+    const char *content_type;
+    switch_bool_t (*encode)(event_buffer_t *buf, event_record_t *record);
+} event_serializer_t;
+
+const event_serializer_t *event_serializer_get(event_format_t format);
+switch_status_t event_serializer_parse_format(const char *name, event_format_t *format);
+
+/* Encodes into the per-thread buffer; valid until the next call on the same thread. A sequence of 0 is omitted */
+struct event_delta_state_s;
+const char *event_serialize(const event_serializer_t *serializer, switch_event_t *event, const char *node_id, uint64_t node_seq,
+                            uint64_t type_seq, struct event_delta_state_s *delta_state, size_t *len);
+const char *serialize_event_to_json(switch_event_t *event, const char *node_id, size_t *len);
+
+switch_bool_t event_encode_json(event_buffer_t *buf, event_record_t *record);
+switch_bool_t event_encode_msgpack(event_buffer_t *buf, event_record_t *record);
+switch_bool_t event_encode_cbor(event_buffer_t *buf, event_record_t *record);
+
+#endif /* EVENTS_SERIALIZER_H */
@@ -0,0 +1,135 @@
+#include "serializer.h"
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+/* The headers map is written before its size is known: always with a 32-bit count (decoders accept non-minimal sizes) into a hole */
+#define CBOR_MAP32_HEAD 5
+#define CBOR_INFO_UINT32 26
+
+static switch_bool_t cbor_write_head(event_buffer_t *buf, uint8_t major, uint64_t value)
+{
+    uint8_t info;
+    int width;
+    int i;
+
+    if (value < 24) {
+        return event_buffer_append_char(buf, (char)((major << 5) | value));
+    } else if (value <= 0xff) {
+        info = 24; width = 1;
+    } else if (value <= 0xffff) {
+        info = 25; width = 2;
+    } else if (value <= 0xffffffffULL) {
+        info = 26; width = 4;
+    } else {
+        info = 27; width = 8;
+    }
+
+    if (!event_buffer_reserve(buf, (size_t)width + 1)) {
+        return SWITCH_FALSE;
+    }
+    buf->data[buf->len++] = (char)((major << 5) | info);
+    for (i = width - 1; i >= 0; i--) {
+        buf->data[buf->len++] = (char)((value >> (i * 8)) & 0xff);
+    }
+    return SWITCH_TRUE;
+}
+
+/* Fixed-width form of cbor_write_head, for heads written into a hole */
+static switch_bool_t cbor_write_head32(event_buffer_t *buf, uint8_t major, uint32_t value)
+{
+    int i;
+
+    if (!event_buffer_reserve(buf, CBOR_MAP32_HEAD)) {
+        return SWITCH_FALSE;
+    }
+    buf->data[buf->len++] = (char)((major << 5) | CBOR_INFO_UINT32);
+    for (i = 3; i >= 0; i--) {
+        buf->data[buf->len++] = (char)((value >> (i * 8)) & 0xff);
+    }
+    return SWITCH_TRUE;
+}
+
+static switch_bool_t cbor_write_text(event_buffer_t *buf, const char *value)
+{
+    size_t len = strlen(value);
+    return cbor_write_head(buf, CBOR_MAJOR_TEXT, len) && event_buffer_append(buf, value, len);
+}
+
+/* Same document as the JSON encoder, using definite-length maps */
+switch_bool_t event_encode_cbor(event_buffer_t *buf, event_record_t *record)
+{
+    switch_event_t *event = record->event;
+    const switch_event_header_t *hp;
+    event_header_iter_t iter;
+    const char *event_name = switch_event_name(event->event_id);
+    const char *uuid = switch_event_get_header(event, "Unique-ID");
+    const event_delta_t *delta = record->delta;
+    uint32_t fields = 2;
+    uint32_t headers = 0;
+    uint32_t i;
+    size_t hole = 0;
+    char head[CBOR_MAP32_HEAD];
+    event_buffer_t head_buf = { head, 0, sizeof(head) };
+    switch_bool_t ok;
+
+    if (event_name) fields++;
+    if (record->node_id) fields++;
+    if (record->node_seq) fields++;
+    if (record->type_seq) fields++;
+    if (uuid) fields++;
+    if (event->body) fields++;
+    if (delta) fields += delta->removed_count ? 2 : 1;
+
+    ok = cbor_write_head(buf, CBOR_MAJOR_MAP, fields);
+
+    if (event_name) {
+        ok = ok && cbor_write_text(buf, "event_name") && cbor_write_text(buf, event_name);
+    }
+    ok = ok && cbor_write_text(buf, "timestamp") && cbor_write_head(buf, CBOR_MAJOR_UINT, record->timestamp);
+    if (record->node_id) {
+        ok = ok && cbor_write_text(buf, "node_id") && cbor_write_text(buf, record->node_id);
+    }
+    if (record->node_seq) {
+        ok = ok && cbor_write_text(buf, "node_seq") && cbor_write_head(buf, CBOR_MAJOR_UINT, record->node_seq);
+    }
+    if (record->type_seq) {
+        ok = ok && cbor_write_text(buf, "type_seq") && cbor_write_head(buf, CBOR_MAJOR_UINT, record->type_seq);
+    }
+    if (uuid) {
+        ok = ok && cbor_write_text(buf, "uuid") && cbor_write_text(buf, uuid);
+    }
+
+    if (delta) {
+        ok = ok && cbor_write_text(buf, "delta") && cbor_write_head(buf, CBOR_MAJOR_MAP, 2) &&
+             cbor_write_text(buf, "keyframe") && event_buffer_append_char(buf, (char)(delta->keyframe ? CBOR_TRUE : CBOR_FALSE)) &&
+             cbor_write_text(buf, "seq") && cbor_write_head(buf, CBOR_MAJOR_UINT, delta->sequence);
+    }
+
+    ok = ok && cbor_write_text(buf, "headers") && event_buffer_hole(buf, CBOR_MAP32_HEAD, &hole);
+    event_record_iter_init(record, &iter);
+    while (ok && (hp = event_record_next_header(record, &iter, SWITCH_TRUE))) {
+        ok = cbor_write_text(buf, hp->name) && cbor_write_text(buf, hp->value);
+        headers++;
+    }
+    ok = ok && cbor_write_head32(&head_buf, CBOR_MAJOR_MAP, headers);
+    if (ok) {
+        event_buffer_fill_hole(buf, hole, head, head_buf.len);
+    }
+
+    if (delta && delta->removed_count) {
+        ok = ok && cbor_write_text(buf, "removed") && cbor_write_head(buf, CBOR_MAJOR_ARRAY, delta->removed_count);
+        for (i = 0; ok && i < delta->removed_count; i++) {
+            ok = cbor_write_text(buf, delta->removed[i]);
+        }
+    }
+
+    if (event->body) {
+        ok = ok && cbor_write_text(buf, "body") && cbor_write_text(buf, event->body);
+    }
+
+    return ok;
+}
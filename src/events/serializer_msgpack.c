@@ -0,0 +1,130 @@
+#include "serializer.h"
+
+static switch_bool_t mp_write_be(event_buffer_t *buf, uint8_t tag, uint64_t value, int width)
+{
+    int i;
+
+    if (!event_buffer_reserve(buf, (size_t)width + 1)) {
+        return SWITCH_FALSE;
+    }
+    buf->data[buf->len++] = (char)tag;
+    for (i = width - 1; i >= 0; i--) {
+        buf->data[buf->len++] = (char)((value >> (i * 8)) & 0xff);
+    }
+    return SWITCH_TRUE;
+}
+
+static switch_bool_t mp_write_uint(event_buffer_t *buf, uint64_t value)
+{
+    if (value < 0x80) return event_buffer_append_char(buf, (char)value);
+    if (value <= 0xff) return mp_write_be(buf, 0xcc, value, 1);
+    if (value <= 0xffff) return mp_write_be(buf, 0xcd, value, 2);
+    if (value <= 0xffffffffULL) return mp_write_be(buf, 0xce, value, 4);
+    return mp_write_be(buf, 0xcf, value, 8);
+}
+
+static switch_bool_t mp_write_map(event_buffer_t *buf, uint32_t count)
+{
+    if (count < 16) return event_buffer_append_char(buf, (char)(0x80 | count));
+    if (count <= 0xffff) return mp_write_be(buf, 0xde, count, 2);
+    return mp_write_be(buf, 0xdf, count, 4);
+}
+
+static switch_bool_t mp_write_array(event_buffer_t *buf, uint32_t count)
+{
+    if (count < 16) return event_buffer_append_char(buf, (char)(0x90 | count));
+    if (count <= 0xffff) return mp_write_be(buf, 0xdc, count, 2);
+    return mp_write_be(buf, 0xdd, count, 4);
+}
+
+/* The headers map is written before its size is known: always as map32 (decoders accept non-minimal sizes) into a hole */
+#define MP_MAP32_HEAD 5
+#define MP_MAP32 0xdf
+
+static switch_bool_t mp_write_str(event_buffer_t *buf, const char *value)
+{
+    size_t len = strlen(value);
+    switch_bool_t ok;
+
+    if (len < 32) ok = event_buffer_append_char(buf, (char)(0xa0 | len));
+    else if (len <= 0xff) ok = mp_write_be(buf, 0xd9, len, 1);
+    else if (len <= 0xffff) ok = mp_write_be(buf, 0xda, len, 2);
+    else ok = mp_write_be(buf, 0xdb, len, 4);
+
+    return ok && event_buffer_append(buf, value, len);
+}
+
+/* Same document as the JSON encoder: top-level map with a nested headers map */
+switch_bool_t event_encode_msgpack(event_buffer_t *buf, event_record_t *record)
+{
+    switch_event_t *event = record->event;
+    const switch_event_header_t *hp;
+    event_header_iter_t iter;
+    const char *event_name = switch_event_name(event->event_id);
+    const char *uuid = switch_event_get_header(event, "Unique-ID");
+    const event_delta_t *delta = record->delta;
+    uint32_t fields = 2;
+    uint32_t headers = 0;
+    uint32_t i;
+    size_t hole = 0;
+    char head[MP_MAP32_HEAD];
+    event_buffer_t head_buf = { head, 0, sizeof(head) };
+    switch_bool_t ok;
+
+    if (event_name) fields++;
+    if (record->node_id) fields++;
+    if (record->node_seq) fields++;
+    if (record->type_seq) fields++;
+    if (uuid) fields++;
+    if (event->body) fields++;
+    if (delta) fields += delta->removed_count ? 2 : 1;
+
+    ok = mp_write_map(buf, fields);
+
+    if (event_name) {
+        ok = ok && mp_write_str(buf, "event_name") && mp_write_str(buf, event_name);
+    }
+    ok = ok && mp_write_str(buf, "timestamp") && mp_write_uint(buf, record->timestamp);
+    if (record->node_id) {
+        ok = ok && mp_write_str(buf, "node_id") && mp_write_str(buf, record->node_id);
+    }
+    if (record->node_seq) {
+        ok = ok && mp_write_str(buf, "node_seq") && mp_write_uint(buf, record->node_seq);
+    }
+    if (record->type_seq) {
+        ok = ok && mp_write_str(buf, "type_seq") && mp_write_uint(buf, record->type_seq);
+    }
+    if (uuid) {
+        ok = ok && mp_write_str(buf, "uuid") && mp_write_str(buf, uuid);
+    }
+
+    if (delta) {
+        ok = ok && mp_write_str(buf, "delta") && mp_write_map(buf, 2) &&
+             mp_write_str(buf, "keyframe") && event_buffer_append_char(buf, (char)(delta->keyframe ? 0xc3 : 0xc2)) &&
+             mp_write_str(buf, "seq") && mp_write_uint(buf, delta->sequence);
+    }
+
+    ok = ok && mp_write_str(buf, "headers") && event_buffer_hole(buf, MP_MAP32_HEAD, &hole);
+    event_record_iter_init(record, &iter);
+    while (ok && (hp = event_record_next_header(record, &iter, SWITCH_TRUE))) {
+        ok = mp_write_str(buf, hp->name) && mp_write_str(buf, hp->value);
+        headers++;
+    }
+    ok = ok && mp_write_be(&head_buf, MP_MAP32, headers, 4);
+    if (ok) {
+        event_buffer_fill_hole(buf, hole, head, head_buf.len);
+    }
+
+    if (delta && delta->removed_count) {
+        ok = ok && mp_write_str(buf, "removed") && mp_write_array(buf, delta->removed_count);
+        for (i = 0; ok && i < delta->removed_count; i++) {
+            ok = mp_write_str(buf, delta->removed[i]);
+        }
+    }
+
+    if (event->body) {
+        ok = ok && mp_write_str(buf, "body") && mp_write_str(buf, event->body);
+    }
+
+    return ok;
+}
@@ -0,0 +1,243 @@
+#include "subject.h"
+
+#define SUBJECT_CACHE_SLOTS 1024
+#define SUBJECT_CACHE_MAX_ENTRIES 512
+
+typedef struct {
+    uint32_t hash;
+    const char *subclass;
+    const char *subject;
+    uint64_t seq;
+} subject_cache_entry_t;
+
+static const char *g_subjects[SWITCH_EVENT_ALL];
+static uint64_t g_type_seq[SWITCH_EVENT_ALL];
+static subject_cache_entry_t *g_cache[SUBJECT_CACHE_SLOTS];
+static uint32_t g_cache_entries = 0;
+static switch_memory_pool_t *g_cache_pool = NULL;
+static switch_mutex_t *g_cache_mutex = NULL;
+static uint32_t g_shard_width = 2;
+
+/* "CHANNEL_ANSWER" -> "channel.answer" */
+static void append_event_token(char *dst, size_t len, const char *name)
+{
+    size_t i;
+
+    for (i = 0; name[i] && i + 1 < len; i++) {
+        char c = (char)tolower((unsigned char)name[i]);
+        dst[i] = c == '_' ? '.' : c;
+    }
+    dst[i] = '\0';
+}
+
+/* "sofia::register" -> "sofia.register"; anything NATS treats specially becomes '_' */
+static void append_subclass_token(char *dst, size_t len, const char *subclass)
+{
+    size_t o = 0;
+    const char *p;
+
+    for (p = subclass; *p && o + 1 < len; p++) {
+        char c = (char)tolower((unsigned char)*p);
+
+        if (c == ':') {
+            while (p[1] == ':') p++;
+            dst[o++] = '.';
+        } else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-') {
+            dst[o++] = c;
+        } else {
+            dst[o++] = '_';
+        }
+    }
+    dst[o] = '\0';
+}
+
+static void render_custom_subject(char *buf, size_t len, const char *subclass)
+{
+    size_t used = (size_t)switch_snprintf(buf, len, "%s.events.custom.", globals.subject_prefix);
+
+    if (used < len) {
+        append_subclass_token(buf + used, len - used, subclass);
+    }
+}
+
+switch_status_t event_subjects_init(switch_memory_pool_t *pool)
+{
+    char token[128];
+    int id;
+
+    for (id = 0; id < SWITCH_EVENT_ALL; id++) {
+        const char *name = switch_event_name((switch_event_types_t)id);
+
+        if (zstr(name)) {
+            name = "unknown";
+        }
+        append_event_token(token, sizeof(token), name);
+        g_subjects[id] = switch_core_sprintf(pool, "%s.events.%s", globals.subject_prefix, token);
+    }
+
+    memset(g_cache, 0, sizeof(g_cache));
+    memset(g_type_seq, 0, sizeof(g_type_seq));
+    g_cache_entries = 0;
+
+    g_shard_width = 2;
+    for (id = 100; (uint32_t)id < globals.subject_shards; id *= 10) {
+        g_shard_width++;
+    }
+
+    if (switch_core_new_memory_pool(&g_cache_pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Failed to allocate subject cache pool");
+        return SWITCH_STATUS_FALSE;
+    }
+    switch_mutex_init(&g_cache_mutex, SWITCH_MUTEX_NESTED, g_cache_pool);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void event_subjects_destroy(void)
+{
+    memset(g_cache, 0, sizeof(g_cache));
+    g_cache_entries = 0;
+    g_cache_mutex = NULL;
+
+    if (g_cache_pool) {
+        switch_core_destroy_memory_pool(&g_cache_pool);
+    }
+}
+
+static subject_cache_entry_t *cache_find(const char *subclass, uint32_t hash)
+{
+    uint32_t slot = hash & (SUBJECT_CACHE_SLOTS - 1);
+    uint32_t probes;
+    subject_cache_entry_t *entry;
+
+    /* Entries are never removed, so readers only need an acquire load */
+    for (probes = 0; probes < SUBJECT_CACHE_SLOTS; probes++) {
+        entry = __atomic_load_n(&g_cache[(slot + probes) & (SUBJECT_CACHE_SLOTS - 1)], __ATOMIC_ACQUIRE);
+        if (!entry) {
+            break;
+        }
+        if (entry->hash == hash && !strcmp(entry->subclass, subclass)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static const char *custom_subject(const char *subclass, char *buf, size_t len)
+{
+    uint32_t hash = event_agent_hash(subclass);
+    uint32_t slot = hash & (SUBJECT_CACHE_SLOTS - 1);
+    uint32_t probes;
+    subject_cache_entry_t *entry;
+    const char *subject = NULL;
+
+    if ((entry = cache_find(subclass, hash))) {
+        return entry->subject;
+    }
+
+    if (!g_cache_mutex) {
+        render_custom_subject(buf, len, subclass);
+        return buf;
+    }
+
+    switch_mutex_lock(g_cache_mutex);
+
+    for (probes = 0; probes < SUBJECT_CACHE_SLOTS; probes++) {
+        subject_cache_entry_t **cell = &g_cache[(slot + probes) & (SUBJECT_CACHE_SLOTS - 1)];
+
+        entry = *cell;
+        if (entry) {
+            if (entry->hash == hash && !strcmp(entry->subclass, subclass)) {
+                subject = entry->subject;
+                break;
+            }
+            continue;
+        }
+
+        if (g_cache_entries >= SUBJECT_CACHE_MAX_ENTRIES) {
+            break;
+        }
+
+        render_custom_subject(buf, len, subclass);
+        entry = switch_core_alloc(g_cache_pool, sizeof(*entry));
+        entry->hash = hash;
+        entry->subclass = switch_core_strdup(g_cache_pool, subclass);
+        entry->subject = switch_core_strdup(g_cache_pool, buf);
+        entry->seq = 0;
+        __atomic_store_n(cell, entry, __ATOMIC_RELEASE);
+        g_cache_entries++;
+        subject = entry->subject;
+        break;
+    }
+
+    switch_mutex_unlock(g_cache_mutex);
+
+    if (!subject) {
+        render_custom_subject(buf, len, subclass);
+        subject = buf;
+    }
+
+    return subject;
+}
+
+/* Appends ".sNN" to subject inside buf; subject may already live in buf */
+static const char *append_shard(const char *subject, uint32_t shard, char *buf, size_t len)
+{
+    size_t used = strlen(subject);
+    uint32_t i;
+
+    if (used + g_shard_width + 3 > len) {
+        return subject;
+    }
+    if (subject != buf) {
+        memcpy(buf, subject, used);
+    }
+
+    buf[used++] = '.';
+    buf[used++] = 's';
+    for (i = g_shard_width; i > 0; i--) {
+        buf[used + i - 1] = (char)('0' + shard % 10);
+        shard /= 10;
+    }
+    buf[used + g_shard_width] = '\0';
+    return buf;
+}
+
+const char *event_subject_lookup(switch_event_t *event, char *buf, size_t len)
+{
+    const char *subject;
+    const char *uuid;
+
+    if (!event || event->event_id >= SWITCH_EVENT_ALL) {
+        return NULL;
+    }
+
+    if (event->event_id == SWITCH_EVENT_CUSTOM && !zstr(event->subclass_name)) {
+        subject = custom_subject(event->subclass_name, buf, len);
+    } else {
+        subject = g_subjects[event->event_id];
+    }
+
+    if (globals.subject_shards > 1 && (uuid = switch_event_get_header(event, "Unique-ID"))) {
+        subject = append_shard(subject, event_agent_hash(uuid) % globals.subject_shards, buf, len);
+    }
+
+    return subject;
+}
+
+uint64_t event_subject_sequence_next(switch_event_t *event)
+{
+    subject_cache_entry_t *entry;
+
+    if (!event || event->event_id >= SWITCH_EVENT_ALL) {
+        return 0;
+    }
+
+    /* Subclasses past the cache limit share the CUSTOM counter */
+    if (event->event_id == SWITCH_EVENT_CUSTOM && !zstr(event->subclass_name) &&
+        (entry = cache_find(event->subclass_name, event_agent_hash(event->subclass_name)))) {
+        return __atomic_add_fetch(&entry->seq, 1, __ATOMIC_RELAXED);
+    }
+
+    return __atomic_add_fetch(&g_type_seq[event->event_id], 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,28 @@
+#ifndef EVENTS_SUBJECT_H
+#define EVENTS_SUBJECT_H
+
+#include "../mod_event_agent.h"
+
+#define EVENT_SUBJECT_MAX 256
+
+/* Builds the per-type subject table from globals.subject_prefix */
+switch_status_t event_subjects_init(switch_memory_pool_t *pool);
+void event_subjects_destroy(void);
+
+/*
+ * Returns the subject for an event without allocating. CUSTOM subclasses are
+ * cached up to a fixed number of entries; past that the subject is rendered
+ * into buf, which must hold EVENT_SUBJECT_MAX bytes. With subject_shards > 1,
+ * events carrying a Unique-ID get ".sNN" appended (FNV-1a of the Unique-ID
+ * modulo the shard count), also rendered into buf.
+ */
+const char *event_subject_lookup(switch_event_t *event, char *buf, size_t len);
+
+/*
+ * Next type_seq for the event: one counter per event type and one per
+ * cached CUSTOM subclass, starting at 1 on every module load. Subject
+ * shards of the same type share the counter.
+ */
+uint64_t event_subject_sequence_next(switch_event_t *event);
+
+#endif /* EVENTS_SUBJECT_H */
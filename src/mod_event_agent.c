@@ -1,6 +1,7 @@
 #include "mod_event_agent.h"
 #include "dialplan/manager.h"
 #include "dialplan/commands.h"
+#include "core/openmetrics.h"
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_event_agent_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_agent_shutdown);
@@ -8,8 +9,21 @@ SWITCH_MODULE_DEFINITION(mod_event_agent, mod_event_agent_load, mod_event_agent_
 
 mod_event_agent_globals_t globals = {0};
 
+static void api_stream_sink(const char *data, size_t len, void *user_data)
+{
+    switch_stream_handle_t *stream = (switch_stream_handle_t *)user_data;
+    stream->write_function(stream, "%s", data);
+}
+
+SWITCH_STANDARD_API(event_agent_metrics_api)
+{
+    openmetrics_render(api_stream_sink, stream);
+    return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_event_agent_load)
 {
+    switch_api_interface_t *api_interface;
     switch_status_t status;
 
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Entering mod_event_agent_load");
@@ -46,8 +60,11 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_agent_load)
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] NATS driver not compiled (need WITH_NATS=1)");
         return SWITCH_STATUS_FALSE;
 #endif
+    } else if (strcasecmp(globals.driver_name, "loopback") == 0) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Creating loopback driver instance");
+        globals.driver = driver_loopback_create(globals.pool);
     } else {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Unknown driver: %s (only 'nats' is supported)", globals.driver_name);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "[mod_event_agent] Unknown driver: %s (supported: nats, loopback)", globals.driver_name);
         return SWITCH_STATUS_FALSE;
     }
     
@@ -56,6 +73,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_agent_load)
         return SWITCH_STATUS_FALSE;
     }
 
+    globals.driver->failure_handler = event_adapter_publish_failed;
+
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Initializing %s driver", globals.driver->name);
     status = globals.driver->init(globals.driver, globals.config);
     if (status != SWITCH_STATUS_SUCCESS) {
@@ -104,23 +123,31 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_agent_load)
 
     globals.running = SWITCH_TRUE;
 
+    if (openmetrics_publisher_start(globals.pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[mod_event_agent] Failed to start metrics publisher");
+    }
+
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Module loaded successfully (driver: %s)", globals.driver->name);
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Publishing events to: %s.events.*", globals.subject_prefix);
 
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] mod_event_agent_load completed successfully");
 
     *module_interface = switch_loadable_module_create_module_interface(pool, modname);
+    SWITCH_ADD_API(api_interface, "event_agent_metrics", "OpenMetrics exposition of mod_event_agent statistics", event_agent_metrics_api, "");
 
     return SWITCH_STATUS_SUCCESS;
 }
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_agent_shutdown)
 {
+    uint64_t counters[AGENT_COUNTER_MAX];
+
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] Entering mod_event_agent_shutdown");
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[mod_event_agent] Shutting down mod_event_agent");
 
     globals.running = SWITCH_FALSE;
 
+    openmetrics_publisher_stop();
     command_handler_shutdown();
     event_adapter_shutdown();
 
@@ -137,12 +164,13 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_agent_shutdown)
 
     event_agent_config_destroy();
 
+    counter_snapshot(&globals.counters, counters, AGENT_COUNTER_MAX);
     switch_log_printf(SWITCH_CHANNEL_LOG,
                       SWITCH_LOG_INFO,
                       "[mod_event_agent] Shutdown complete. Published %llu events (failed: %llu, skipped: %llu)",
-                      (unsigned long long)globals.events_published,
-                      (unsigned long long)globals.events_failed,
-                      (unsigned long long)globals.events_skipped_no_subscribers);
+                      (unsigned long long)counters[AGENT_COUNTER_EVENTS_PUBLISHED],
+                      (unsigned long long)counters[AGENT_COUNTER_EVENTS_FAILED],
+                      (unsigned long long)counters[AGENT_COUNTER_EVENTS_SKIPPED_NO_SUBSCRIBERS]);
 
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[mod_event_agent] mod_event_agent_shutdown completed");
     return SWITCH_STATUS_SUCCESS;
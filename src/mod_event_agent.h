@@ -3,6 +3,7 @@
 
 #include <switch.h>
 #include "drivers/interface.h"
+#include "core/counters.h"
 
 #define MOD_EVENT_AGENT_VERSION "2.0.0"
 #define DEFAULT_SUBJECT_PREFIX "freeswitch"
@@ -23,6 +24,50 @@ static inline void slugify_node_id(char *node_id) {
     }
 }
 
+static inline uint32_t event_agent_hash(const char *value) {
+    uint32_t hash = 2166136261u;
+
+    for (const unsigned char *p = (const unsigned char *)value; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+typedef enum {
+    AGENT_COUNTER_EVENTS_PUBLISHED,
+    AGENT_COUNTER_EVENTS_FAILED,
+    AGENT_COUNTER_EVENTS_SKIPPED_NO_SUBSCRIBERS,
+    AGENT_COUNTER_BYTES_PUBLISHED,
+    AGENT_COUNTER_MAX
+} agent_counter_t;
+
+typedef enum {
+    EVENT_QUEUE_OVERFLOW_DROP,
+    EVENT_QUEUE_OVERFLOW_BLOCK
+} event_queue_overflow_t;
+
+#define EVENT_FILTER_WORDS ((SWITCH_EVENT_ALL + 32) / 32)
+
+/* include/exclude lists compiled at config load, indexed by switch_event_types_t */
+typedef struct {
+    uint32_t include[EVENT_FILTER_WORDS];
+    uint32_t exclude[EVENT_FILTER_WORDS];
+    switch_hash_t *include_subclasses;
+    switch_hash_t *exclude_subclasses;
+    switch_bool_t has_include;
+} event_filter_t;
+
+static inline switch_bool_t event_filter_test(const uint32_t *bits, switch_event_types_t id) {
+    return (bits[id >> 5] & (1u << (id & 31))) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+typedef enum {
+    EVENT_FORMAT_JSON,
+    EVENT_FORMAT_MSGPACK,
+    EVENT_FORMAT_CBOR
+} event_format_t;
+
 /* Forward declaration for dialplan manager */
 typedef struct dialplan_manager_s dialplan_manager_t;
 
@@ -34,20 +79,64 @@ typedef struct {
     
     char *driver_name;
     char *subject_prefix;
+    uint32_t subject_shards;
     char *node_id;
     switch_bool_t publish_all_events;
+    event_format_t event_format;
     
     char **include_events;
     char **exclude_events;
     uint32_t include_count;
     uint32_t exclude_count;
+    event_filter_t event_filter;
 
     switch_bool_t running;
-    uint64_t events_published;
-    uint64_t events_failed;
-    uint64_t events_skipped_no_subscribers;
+    counter_group_t counters;   /* agent_counter_t */
     time_t startup_time;
-    uint64_t bytes_published;
+
+    /* Publishing pipeline */
+    uint32_t publisher_threads;
+    uint32_t queue_size;
+    event_queue_overflow_t queue_overflow;
+    uint32_t queue_block_timeout_ms;
+    uint32_t queue_drain_timeout_ms;
+
+    /* Batching (disabled when batch_max_events <= 1) */
+    uint32_t batch_max_events;
+    uint32_t batch_max_bytes;
+    uint32_t batch_linger_ms;
+    char *batch_subject;
+
+    /* Delta-encoded channel events */
+    switch_bool_t delta_mode;
+    uint32_t delta_keyframe_interval;
+    uint32_t delta_max_calls;
+    uint32_t delta_max_call_bytes;
+    uint32_t delta_idle_timeout;
+
+    /* Command worker lanes (0 workers runs the lane inline on the subscription thread) */
+    uint32_t command_fast_workers;
+    uint32_t command_bulk_workers;
+    uint32_t command_queue_size;
+    char *command_fast_lane;
+    char *command_bulk_lane;
+
+    /* Jobs for async commands: table bound (and concurrent job threads) and TTL of finished jobs */
+    uint32_t job_max;
+    uint32_t job_ttl_ms;
+
+    /* Per-stage and per-command latency histograms */
+    switch_bool_t latency_metrics;
+
+    /* OpenMetrics published on <prefix>.node.<node_id>.metrics (0 = only via the API) */
+    uint32_t metrics_publish_interval_ms;
+
+    /* Payloads kept for events.replay (disabled when either is 0) */
+    uint32_t retention_max_events;
+    uint64_t retention_max_bytes;
+
+    /* JetStream: events carry a Nats-Msg-Id for server-side de-duplication */
+    switch_bool_t jetstream;
     
     /* Dialplan manager */
     dialplan_manager_t *dialplan_manager;
@@ -62,9 +151,9 @@ void event_agent_config_destroy(void);
 switch_status_t event_adapter_init(void);
 switch_status_t event_adapter_shutdown(void);
 void event_callback(switch_event_t *event);
-
-char *serialize_event_to_json(switch_event_t *event, const char *node_id);
-void free_serialized_event(char *json);
+struct event_publisher_s;
+void event_adapter_publish(switch_event_t *event, struct event_publisher_s *publisher);
+void event_adapter_publish_failed(event_driver_t *driver, const char *subject, uint32_t events, void *user_data);
 
 switch_status_t command_handler_init(event_driver_t *driver, switch_memory_pool_t *pool, dialplan_manager_t *dialplan_manager);
 void command_handler_shutdown(void);
@@ -0,0 +1,268 @@
+/*
+ * bench_commands.c
+ * Command path benchmark: N single requests against the same N commands
+ * sent as "commands" batches, through the real dispatcher, worker lanes
+ * and reply publishing on the loopback driver (src/commands against the
+ * stub in bench/stub). Handlers are a no-op so the numbers are the
+ * per-request overhead (parse, route, queue, envelope, reply).
+ *
+ * Usage: bench_commands [-n commands] [-b batch_size] [-w window]
+ *
+ * At most "window" commands are in flight at once in either mode. Exits
+ * non-zero when batches are not faster per command than single requests,
+ * or when any reply reports a failure. Also times how a broadcast meant
+ * for another node is dropped: by its routing header, before any parse,
+ * against by the "node_id" in its payload.
+ */
+
+#include "mod_event_agent.h"
+#include "commands/core.h"
+#include "commands/call.h"
+#include "commands/api.h"
+#include "commands/status.h"
+#include "commands/replay.h"
+#include "dialplan/commands.h"
+#include "drivers/loopback.h"
+#include <getopt.h>
+#include <sched.h>
+
+#define DEFAULT_COMMANDS 200000
+#define DEFAULT_BATCH 64
+#define DEFAULT_WINDOW 1024
+#define MAX_BATCH 256
+#define REPLY_SUBJECT "bench.reply"
+
+mod_event_agent_globals_t globals;
+
+static event_driver_t *g_loopback = NULL;
+static uint64_t g_replies = 0;
+static uint64_t g_failures = 0;
+
+/* The bench registers its own handler in place of the ones that need a running switch */
+static command_result_t bench_noop(const command_request_t *request)
+{
+    return command_result_ok();
+}
+
+switch_status_t command_api_register(void)
+{
+    return command_register_handler("bench.noop", bench_noop);
+}
+
+switch_status_t command_call_register(void)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t command_status_register(void)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t command_replay_register(void)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t command_dialplan_init(dialplan_manager_t *manager)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void command_dialplan_shutdown(void)
+{
+}
+
+static void reply_receive(const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len,
+                          const char *reply_to, void *user_data)
+{
+    if (!strstr(data, "\"success\":true") && __atomic_add_fetch(&g_failures, 1, __ATOMIC_RELAXED) == 1) {
+        fprintf(stderr, "First failed reply: %.*s\n", (int)(len > 512 ? 512 : len), data);
+    }
+    __atomic_add_fetch(&g_replies, 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void wait_replies(uint64_t target)
+{
+    while (__atomic_load_n(&g_replies, __ATOMIC_ACQUIRE) < target) {
+        sched_yield();
+    }
+}
+
+static void inject(const char *payload, size_t len)
+{
+    while (driver_loopback_inject(g_loopback, "freeswitch.api", REPLY_SUBJECT, payload, len) != SWITCH_STATUS_SUCCESS) {
+        sched_yield();
+    }
+}
+
+/* Messages for another node get no reply, so completion is the loopback's delivered count; returns ns/message */
+static double run_skip(const char *payload, const driver_header_t *headers, size_t header_count, uint64_t messages)
+{
+    driver_loopback_stats_t counts;
+    size_t len = strlen(payload);
+    uint64_t start, target, i;
+
+    driver_loopback_get_counts(g_loopback, &counts);
+    target = counts.delivered + messages;
+
+    start = now_ns();
+    for (i = 0; i < messages; i++) {
+        while (driver_loopback_inject_with_headers(g_loopback, "freeswitch.api", headers, header_count, REPLY_SUBJECT, payload,
+                                                   len) != SWITCH_STATUS_SUCCESS) {
+            sched_yield();
+        }
+    }
+    do {
+        sched_yield();
+        driver_loopback_get_counts(g_loopback, &counts);
+    } while (counts.delivered < target);
+    return (double)(now_ns() - start) / (double)messages;
+}
+
+/* Sends messages requests of per_message commands each, keeping at most window commands in flight; returns ns/command */
+static double run_mode(const char *payload, uint64_t messages, uint32_t per_message, uint64_t window)
+{
+    uint64_t base = __atomic_load_n(&g_replies, __ATOMIC_ACQUIRE);
+    uint64_t in_flight = window / per_message ? window / per_message : 1;
+    size_t len = strlen(payload);
+    uint64_t start, i;
+
+    start = now_ns();
+    for (i = 0; i < messages; i++) {
+        if (i >= in_flight) {
+            wait_replies(base + i - in_flight + 1);
+        }
+        inject(payload, len);
+    }
+    wait_replies(base + messages);
+    return (double)(now_ns() - start) / (double)(messages * per_message);
+}
+
+static char *build_batch(uint32_t count, const char *mode)
+{
+    size_t size = 64 + (size_t)count * 32;
+    char *payload = malloc(size);
+    size_t off;
+    uint32_t i;
+
+    off = (size_t)snprintf(payload, size, "{\"mode\":\"%s\",\"commands\":[", mode);
+    for (i = 0; i < count; i++) {
+        off += (size_t)snprintf(payload + off, size - off, "%s{\"command\":\"bench.noop\"}", i ? "," : "");
+    }
+    snprintf(payload + off, size - off, "]}");
+    return payload;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-n commands] [-b batch_size (1-%d)] [-w window]\n", argv0, MAX_BATCH);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *SINGLE = "{\"command\":\"bench.noop\"}";
+    static const char *ELSEWHERE = "{\"command\":\"originate\",\"endpoint\":\"sofia/gateway/carrier/15551234567\","
+                                   "\"extension\":\"&park\",\"caller_id_name\":\"Bench\",\"caller_id_number\":\"15557654321\","
+                                   "\"timeout\":30,\"variables\":{\"origination_uuid\":\"5f0c8a52-3f3e-4d8e-9a4c-0c8c3c1f2a11\"},"
+                                   "\"node_id\":\"other_node\"}";
+    static const driver_header_t OTHER_NODE[] = { { COMMAND_NODE_ID_HEADER, "other_node" } };
+    uint64_t commands = DEFAULT_COMMANDS, window = DEFAULT_WINDOW, batches;
+    uint32_t batch_size = DEFAULT_BATCH;
+    switch_hash_t *config = NULL;
+    char *parallel, *sequential;
+    double single_ns, parallel_ns, sequential_ns, skip_header_ns, skip_payload_ns;
+    int opt, rc = 0;
+
+    while ((opt = getopt(argc, argv, "n:b:w:h")) != -1) {
+        switch (opt) {
+        case 'n': commands = strtoull(optarg, NULL, 10); break;
+        case 'b': batch_size = (uint32_t)atoi(optarg); break;
+        case 'w': window = strtoull(optarg, NULL, 10); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (!commands || !window || !batch_size || batch_size > MAX_BATCH) {
+        usage(argv[0]);
+        return 2;
+    }
+    batches = (commands + batch_size - 1) / batch_size;
+    commands = batches * batch_size;
+
+    switch_core_new_memory_pool(&globals.pool);
+    globals.node_id = "bench_node";
+    globals.subject_prefix = DEFAULT_SUBJECT_PREFIX;
+    globals.latency_metrics = SWITCH_FALSE;
+    globals.running = SWITCH_TRUE;
+    globals.command_fast_workers = 2;
+    globals.command_bulk_workers = 4;
+    /* Lane queues larger than the window, so no request is turned away as "Command queue full" */
+    globals.command_queue_size = (uint32_t)(window * 4 > 1024 ? window * 4 : 1024);
+    globals.job_max = 16;
+    globals.job_ttl_ms = 1000;
+
+    switch_core_hash_init(&config);
+    g_loopback = driver_loopback_create(globals.pool);
+    if (g_loopback->init(g_loopback, config) != SWITCH_STATUS_SUCCESS || g_loopback->connect(g_loopback) != SWITCH_STATUS_SUCCESS ||
+        g_loopback->subscribe(g_loopback, REPLY_SUBJECT, reply_receive, NULL) != SWITCH_STATUS_SUCCESS) {
+        fprintf(stderr, "❌ Loopback driver failed to start\n");
+        return 1;
+    }
+    globals.driver = g_loopback;
+    if (command_handler_init(g_loopback, globals.pool, NULL) != SWITCH_STATUS_SUCCESS) {
+        fprintf(stderr, "❌ Command handler failed to start\n");
+        return 1;
+    }
+
+    printf("╔════════════════════════════════════════╗\n");
+    printf("║  mod_event_agent command path benchmark║\n");
+    printf("╚════════════════════════════════════════╝\n\n");
+    printf("✓ %llu commands, batches of %u, window %llu, %u fast / %u bulk workers\n\n", (unsigned long long)commands,
+           batch_size, (unsigned long long)window, globals.command_fast_workers, globals.command_bulk_workers);
+
+    parallel = build_batch(batch_size, "parallel");
+    sequential = build_batch(batch_size, "sequential");
+
+    /* Warm up allocators, queues and worker threads */
+    run_mode(SINGLE, commands / 10 + 1, 1, window);
+    run_mode(parallel, batches / 10 + 1, batch_size, window);
+
+    single_ns = run_mode(SINGLE, commands, 1, window);
+    parallel_ns = run_mode(parallel, batches, batch_size, window);
+    sequential_ns = run_mode(sequential, batches, batch_size, window);
+    skip_payload_ns = run_skip(ELSEWHERE, NULL, 0, commands);
+    skip_header_ns = run_skip(ELSEWHERE, OTHER_NODE, 1, commands);
+
+    printf("%-28s %14s %12s %9s\n", "mode", "commands/s", "ns/command", "speedup");
+    printf("%-28s %14.0f %12.1f %8.2fx\n", "single requests", 1e9 / single_ns, single_ns, 1.0);
+    printf("%-28s %14.0f %12.1f %8.2fx\n", "batch (parallel)", 1e9 / parallel_ns, parallel_ns, single_ns / parallel_ns);
+    printf("%-28s %14.0f %12.1f %8.2fx\n", "batch (sequential)", 1e9 / sequential_ns, sequential_ns, single_ns / sequential_ns);
+    printf("\n%-28s %14s %12s %9s\n", "other node's broadcast", "messages/s", "ns/message", "speedup");
+    printf("%-28s %14.0f %12.1f %8.2fx\n", "dropped by payload node_id", 1e9 / skip_payload_ns, skip_payload_ns, 1.0);
+    printf("%-28s %14.0f %12.1f %8.2fx\n", "dropped by routing header", 1e9 / skip_header_ns, skip_header_ns, skip_payload_ns / skip_header_ns);
+
+    if (g_failures) {
+        printf("\n❌ %llu replies reported a failure\n", (unsigned long long)g_failures);
+        rc = 1;
+    } else if (parallel_ns >= single_ns || sequential_ns >= single_ns) {
+        printf("\n❌ Batches are not faster than single requests\n");
+        rc = 1;
+    } else {
+        printf("\n✅ Batches are faster than single requests\n");
+    }
+
+    command_handler_shutdown();
+    g_loopback->shutdown(g_loopback);
+    switch_core_hash_destroy(&config);
+    free(parallel);
+    free(sequential);
+    return rc;
+}
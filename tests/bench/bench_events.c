@@ -0,0 +1,944 @@
+/*
+ * bench_events.c
+ * Microbenchmarks for the event hot path (filtering, subject building,
+ * serialization) built from src/events against the stub in bench/stub.
+ *
+ * Usage: bench_events [-n iterations] [-d fixtures_dir] [-f name_filter]
+ *                     [-w results_file] [-b baseline_file] [-t tolerance_pct]
+ *
+ * Each benchmark runs over two corpora: recorded events (the .txt files in
+ * fixtures/, "event plain" format) and a synthetic mix shaped like a busy
+ * PBX. With -b, exits non-zero when ns/event regresses by more than the
+ * tolerance or allocations/event grow.
+ *
+ * The recorded CHANNEL_CREATE and CHANNEL_HANGUP_COMPLETE events are also
+ * printed through the former cJSON tree and through the streaming writer;
+ * both are timed and any byte difference between them fails the run.
+ */
+
+#include "mod_event_agent.h"
+#include "events/serializer.h"
+#include "events/subject.h"
+#include "events/predicate.h"
+#include "events/projection.h"
+#include "events/retention.h"
+#include "drivers/loopback.h"
+#include <cjson/cJSON.h>
+#include <dirent.h>
+#include <getopt.h>
+
+#define DEFAULT_ITERATIONS 200000
+#define DEFAULT_FIXTURES "tests/bench/fixtures"
+#define DEFAULT_TOLERANCE 10.0
+#define SYNTHETIC_EVENTS 512
+#define MAX_FIXTURE_EVENTS 256
+#define MAX_RESULTS 64
+#define MAX_LINE 8192
+
+mod_event_agent_globals_t globals;
+
+/* Allocation accounting: the bench links with -Wl,--wrap for each of these */
+static uint64_t g_allocs = 0;
+static uint64_t g_alloc_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+char *__real_strndup(const char *s, size_t n);
+
+void *__wrap_malloc(size_t size)
+{
+    g_allocs++;
+    g_alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    g_allocs++;
+    g_alloc_bytes += nmemb * size;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    g_allocs++;
+    g_alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+    g_allocs++;
+    g_alloc_bytes += strlen(s) + 1;
+    return __real_strdup(s);
+}
+
+char *__wrap_strndup(const char *s, size_t n)
+{
+    g_allocs++;
+    g_alloc_bytes += strnlen(s, n) + 1;
+    return __real_strndup(s, n);
+}
+
+/* Broker stand-in: everything has a subscriber and every publish succeeds */
+static switch_status_t null_publish(event_driver_t *driver, const char *subject, const char *data, size_t len)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t null_has_subscribers(event_driver_t *driver, const char *subject, int *num_subscribers)
+{
+    *num_subscribers = 1;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static event_driver_t g_null_driver;
+
+typedef struct {
+    const char *name;
+    switch_event_t *events[SYNTHETIC_EVENTS > MAX_FIXTURE_EVENTS ? SYNTHETIC_EVENTS : MAX_FIXTURE_EVENTS];
+    uint32_t count;
+} bench_corpus_t;
+
+/* Returns the bytes produced for the event (0 when it produces none) */
+typedef size_t (*bench_fn_t)(switch_event_t *event);
+typedef void (*bench_setup_t)(void);
+
+typedef struct {
+    const char *name;
+    bench_fn_t run;
+    bench_setup_t setup;
+    bench_setup_t teardown;
+} bench_t;
+
+typedef struct {
+    char name[96];
+    double events_per_sec;
+    double ns_per_event;
+    double allocs_per_event;
+    double alloc_bytes_per_event;
+    double out_bytes_per_event;
+} bench_result_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------ corpora */
+
+static void url_decode(char *s)
+{
+    char *o = s;
+
+    for (; *s; s++) {
+        if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
+            char hex[3] = { s[1], s[2], '\0' };
+
+            *o++ = (char)strtol(hex, NULL, 16);
+            s += 2;
+        } else {
+            *o++ = *s;
+        }
+    }
+    *o = '\0';
+}
+
+typedef struct {
+    char *names[512];
+    char *values[512];
+    uint32_t count;
+} plain_event_t;
+
+static void plain_event_clear(plain_event_t *plain)
+{
+    uint32_t i;
+
+    for (i = 0; i < plain->count; i++) {
+        free(plain->names[i]);
+        free(plain->values[i]);
+    }
+    plain->count = 0;
+}
+
+/* Builds the event the way FreeSWITCH delivers it: headers in wire order */
+static switch_event_t *plain_event_build(plain_event_t *plain)
+{
+    const char *event_name = NULL, *subclass = NULL;
+    switch_event_types_t id;
+    switch_event_t *event = NULL;
+    uint32_t i;
+
+    for (i = 0; i < plain->count; i++) {
+        if (!strcasecmp(plain->names[i], "Event-Name")) {
+            event_name = plain->values[i];
+        } else if (!strcasecmp(plain->names[i], "Event-Subclass")) {
+            subclass = plain->values[i];
+        }
+    }
+
+    if (!event_name || switch_name_event(event_name, &id) != SWITCH_STATUS_SUCCESS ||
+        switch_event_create(&event, id) != SWITCH_STATUS_SUCCESS) {
+        return NULL;
+    }
+    if (subclass) {
+        event->subclass_name = strdup(subclass);
+    }
+    for (i = 0; i < plain->count; i++) {
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, plain->names[i], plain->values[i]);
+    }
+    return event;
+}
+
+static uint32_t load_fixture_file(bench_corpus_t *corpus, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[MAX_LINE];
+    plain_event_t plain = { { 0 } };
+    uint32_t loaded = 0;
+    switch_event_t *event;
+
+    if (!fp) {
+        return 0;
+    }
+
+    while (1) {
+        char *got = fgets(line, sizeof(line), fp);
+        char *sep;
+        size_t len;
+
+        if (got) {
+            len = strlen(line);
+            while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+                line[--len] = '\0';
+            }
+        }
+
+        if (!got || !*line) {
+            if (plain.count && corpus->count < MAX_FIXTURE_EVENTS && (event = plain_event_build(&plain))) {
+                corpus->events[corpus->count++] = event;
+                loaded++;
+            }
+            plain_event_clear(&plain);
+            if (!got) {
+                break;
+            }
+            continue;
+        }
+
+        if (!(sep = strstr(line, ": ")) || plain.count >= 512) {
+            continue;
+        }
+        *sep = '\0';
+        url_decode(sep + 2);
+        plain.names[plain.count] = strdup(line);
+        plain.values[plain.count] = strdup(sep + 2);
+        plain.count++;
+    }
+
+    fclose(fp);
+    return loaded;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static uint32_t load_fixtures(bench_corpus_t *corpus, const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    char *files[64];
+    uint32_t count = 0, i;
+    char path[1024];
+
+    corpus->name = "recorded";
+    if (!d) {
+        fprintf(stderr, "❌ Cannot open fixtures directory %s\n", dir);
+        return 0;
+    }
+    while ((entry = readdir(d)) && count < 64) {
+        size_t len = strlen(entry->d_name);
+
+        if (len > 4 && !strcmp(entry->d_name + len - 4, ".txt")) {
+            files[count++] = strdup(entry->d_name);
+        }
+    }
+    closedir(d);
+
+    qsort(files, count, sizeof(char *), compare_names);
+    for (i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        load_fixture_file(corpus, path);
+        free(files[i]);
+    }
+    return corpus->count;
+}
+
+static uint32_t g_rng = 0x9e3779b9u;
+
+static uint32_t rng_next(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static void random_token(char *buf, size_t len)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    size_t i;
+
+    for (i = 0; i + 1 < len; i++) {
+        buf[i] = alphabet[rng_next() % (sizeof(alphabet) - 1)];
+    }
+    buf[i] = '\0';
+}
+
+static void random_uuid(char *buf)
+{
+    snprintf(buf, 37, "%08x-%04x-4%03x-%04x-%08x%04x", rng_next(), rng_next() & 0xffff, rng_next() & 0xfff,
+             (rng_next() & 0x3fff) | 0x8000, rng_next(), rng_next() & 0xffff);
+}
+
+/* Call legs dominate a PBX stream; CUSTOM, DTMF and HEARTBEAT make up the rest */
+static const struct {
+    switch_event_types_t id;
+    const char *subclass;
+    uint32_t weight;
+    uint32_t channel;
+} SYNTHETIC_MIX[] = {
+    { SWITCH_EVENT_CHANNEL_STATE, NULL, 20, 1 },
+    { SWITCH_EVENT_CHANNEL_CALLSTATE, NULL, 16, 1 },
+    { SWITCH_EVENT_CHANNEL_EXECUTE, NULL, 10, 1 },
+    { SWITCH_EVENT_CHANNEL_EXECUTE_COMPLETE, NULL, 10, 1 },
+    { SWITCH_EVENT_CHANNEL_CREATE, NULL, 6, 1 },
+    { SWITCH_EVENT_CHANNEL_ANSWER, NULL, 5, 1 },
+    { SWITCH_EVENT_CHANNEL_BRIDGE, NULL, 4, 1 },
+    { SWITCH_EVENT_CHANNEL_HANGUP, NULL, 5, 1 },
+    { SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE, NULL, 5, 1 },
+    { SWITCH_EVENT_CHANNEL_DESTROY, NULL, 5, 1 },
+    { SWITCH_EVENT_DTMF, NULL, 4, 1 },
+    { SWITCH_EVENT_CUSTOM, "sofia::register", 4, 0 },
+    { SWITCH_EVENT_CUSTOM, "sofia::gateway_state", 2, 0 },
+    { SWITCH_EVENT_CUSTOM, "conference::maintenance", 2, 0 },
+    { SWITCH_EVENT_PRESENCE_IN, NULL, 1, 0 },
+    { SWITCH_EVENT_HEARTBEAT, NULL, 1, 0 }
+};
+
+static switch_event_t *synthetic_event(void)
+{
+    uint32_t total = 0, pick, i, n, vars;
+    char uuid[40], value[64], name[64];
+    switch_event_t *event = NULL;
+
+    for (i = 0; i < sizeof(SYNTHETIC_MIX) / sizeof(SYNTHETIC_MIX[0]); i++) {
+        total += SYNTHETIC_MIX[i].weight;
+    }
+    pick = rng_next() % total;
+    for (i = 0; pick >= SYNTHETIC_MIX[i].weight; i++) {
+        pick -= SYNTHETIC_MIX[i].weight;
+    }
+
+    switch_event_create_subclass(&event, SYNTHETIC_MIX[i].id, SYNTHETIC_MIX[i].subclass);
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Name", switch_event_name(event->event_id));
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Core-UUID", "6d2375b0-5183-11ef-8a38-0242ac120003");
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FreeSWITCH-Hostname", "fs-edge-01");
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FreeSWITCH-Switchname", "fs-edge-01");
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FreeSWITCH-IPv4", "10.20.0.11");
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Date-Local", "2024-08-03 14:22:17");
+    snprintf(value, sizeof(value), "%llu", 1722694937000000ULL + rng_next());
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Date-Timestamp", value);
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Calling-File", "switch_channel.c");
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Calling-Function", "switch_channel_perform_set_running_state");
+    snprintf(value, sizeof(value), "%u", rng_next() % 5000);
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Calling-Line-Number", value);
+    snprintf(value, sizeof(value), "%u", rng_next());
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Event-Sequence", value);
+
+    if (SYNTHETIC_MIX[i].channel) {
+        static const char *CALLER_FIELDS[] = {
+            "Direction", "Logical-Direction", "Username", "Dialplan", "Caller-ID-Name", "Caller-ID-Number",
+            "Orig-Caller-ID-Name", "Orig-Caller-ID-Number", "Network-Addr", "ANI", "Destination-Number",
+            "Unique-ID", "Source", "Context", "Channel-Name", "Profile-Index", "Profile-Created-Time",
+            "Channel-Created-Time", "Channel-Answered-Time", "Channel-Hangup-Time", "Screen-Bit"
+        };
+
+        random_uuid(uuid);
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Channel-State", "CS_EXECUTE");
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Channel-Call-State", "ACTIVE");
+        snprintf(value, sizeof(value), "sofia/internal/%u@10.20.0.11", 1000 + rng_next() % 9000);
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Channel-Name", value);
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", uuid);
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Call-Direction", rng_next() & 1 ? "inbound" : "outbound");
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Answer-State", "answered");
+        for (n = 0; n < sizeof(CALLER_FIELDS) / sizeof(CALLER_FIELDS[0]); n++) {
+            snprintf(name, sizeof(name), "Caller-%s", CALLER_FIELDS[n]);
+            random_token(value, 6 + rng_next() % 30);
+            switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, name, value);
+        }
+
+        /* Channel variables vary the most between deployments: 20 to 120 of them */
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "variable_direction", rng_next() & 1 ? "inbound" : "outbound");
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "variable_uuid", uuid);
+        vars = 20 + rng_next() % 100;
+        for (n = 0; n < vars; n++) {
+            char token[16];
+
+            random_token(token, 4 + rng_next() % 10);
+            snprintf(name, sizeof(name), "variable_%s_%u", token, n);
+            random_token(value, 2 + rng_next() % 48);
+            switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, name, value);
+        }
+    } else {
+        vars = 10 + rng_next() % 20;
+        for (n = 0; n < vars; n++) {
+            char token[16];
+
+            random_token(token, 4 + rng_next() % 10);
+            random_token(value, 2 + rng_next() % 40);
+            switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, token, value);
+        }
+    }
+
+    return event;
+}
+
+static void build_synthetic(bench_corpus_t *corpus)
+{
+    corpus->name = "synthetic";
+    for (corpus->count = 0; corpus->count < SYNTHETIC_EVENTS; corpus->count++) {
+        corpus->events[corpus->count] = synthetic_event();
+    }
+}
+
+/* --------------------------------------------------------------- benchmarks */
+
+static void filter_setup(void)
+{
+    static const switch_event_types_t INCLUDE[] = {
+        SWITCH_EVENT_CHANNEL_CREATE, SWITCH_EVENT_CHANNEL_ANSWER, SWITCH_EVENT_CHANNEL_BRIDGE,
+        SWITCH_EVENT_CHANNEL_HANGUP, SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE, SWITCH_EVENT_CHANNEL_DESTROY,
+        SWITCH_EVENT_DTMF
+    };
+    uint32_t i;
+
+    memset(&globals.event_filter, 0, sizeof(globals.event_filter));
+    for (i = 0; i < sizeof(INCLUDE) / sizeof(INCLUDE[0]); i++) {
+        globals.event_filter.include[INCLUDE[i] >> 5] |= 1u << (INCLUDE[i] & 31);
+    }
+    globals.event_filter.exclude[SWITCH_EVENT_HEARTBEAT >> 5] |= 1u << (SWITCH_EVENT_HEARTBEAT & 31);
+    switch_core_hash_init(&globals.event_filter.include_subclasses);
+    switch_core_hash_insert(globals.event_filter.include_subclasses, "sofia::register", (void *)1);
+    globals.event_filter.has_include = SWITCH_TRUE;
+}
+
+static void filter_predicate_setup(void)
+{
+    filter_setup();
+    event_predicate_add(globals.pool, "CHANNEL_*", "variable_direction == 'inbound' and not exists(variable_loopback_from_uuid)");
+    event_predicate_add(globals.pool, "CUSTOM", "profile-name ^= 'internal' or exists(Event-Subclass)");
+}
+
+static void filter_teardown(void)
+{
+    event_predicates_reset();
+    if (globals.event_filter.include_subclasses) {
+        switch_core_hash_destroy(&globals.event_filter.include_subclasses);
+    }
+    memset(&globals.event_filter, 0, sizeof(globals.event_filter));
+}
+
+/* The pipeline is not started, so event_callback stops right after the filter, interest and rate-limit checks */
+static size_t run_filter(switch_event_t *event)
+{
+    event_callback(event);
+    return 0;
+}
+
+static size_t run_subject(switch_event_t *event)
+{
+    char buf[EVENT_SUBJECT_MAX];
+    const char *subject = event_subject_lookup(event, buf, sizeof(buf));
+
+    return subject ? strlen(subject) : 0;
+}
+
+static void sharded_setup(void)
+{
+    event_subjects_destroy();
+    globals.subject_shards = 16;
+    event_subjects_init(globals.pool);
+}
+
+static void sharded_teardown(void)
+{
+    event_subjects_destroy();
+    globals.subject_shards = 0;
+    event_subjects_init(globals.pool);
+}
+
+static size_t serialize_as(event_format_t format, switch_event_t *event)
+{
+    size_t len = 0;
+
+    event_serialize(event_serializer_get(format), event, globals.node_id, 1, 1, NULL, &len);
+    return len;
+}
+
+static size_t run_json(switch_event_t *event)
+{
+    return serialize_as(EVENT_FORMAT_JSON, event);
+}
+
+static size_t run_msgpack(switch_event_t *event)
+{
+    return serialize_as(EVENT_FORMAT_MSGPACK, event);
+}
+
+static size_t run_cbor(switch_event_t *event)
+{
+    return serialize_as(EVENT_FORMAT_CBOR, event);
+}
+
+static void projection_setup(void)
+{
+    event_projection_add(globals.pool, "ALL", SWITCH_FALSE, "Event-*, Core-UUID, Unique-ID, Channel-*, Caller-*, variable_sip_*");
+}
+
+static void projection_teardown(void)
+{
+    event_projections_reset();
+}
+
+/* Subject, sequence, serialization and the driver call, as a publisher thread runs it */
+static size_t run_publish(switch_event_t *event)
+{
+    uint64_t before = counter_read(&globals.counters, AGENT_COUNTER_BYTES_PUBLISHED);
+
+    event_adapter_publish(event, NULL);
+    return (size_t)(counter_read(&globals.counters, AGENT_COUNTER_BYTES_PUBLISHED) - before);
+}
+
+static event_driver_t *g_loopback = NULL;
+static uint64_t g_loopback_bytes = 0;
+
+static void loopback_receive(const char *subject, const driver_header_t *headers, size_t header_count, const char *data, size_t len,
+                             const char *reply_to, void *user_data)
+{
+    g_loopback_bytes += len;
+}
+
+/* Manual dispatch keeps delivery on this thread, so every iteration is publish + ring + handler */
+static void loopback_setup(void)
+{
+    switch_hash_t *config = NULL;
+
+    switch_core_hash_init(&config);
+    switch_core_hash_insert(config, "loopback_dispatch", "manual");
+    g_loopback = driver_loopback_create(globals.pool);
+    g_loopback->init(g_loopback, config);
+    g_loopback->connect(g_loopback);
+    g_loopback->subscribe(g_loopback, "freeswitch.events.>", loopback_receive, NULL);
+    switch_core_hash_destroy(&config);
+    globals.driver = g_loopback;
+}
+
+static void loopback_teardown(void)
+{
+    g_loopback->shutdown(g_loopback);
+    globals.driver = &g_null_driver;
+}
+
+static size_t run_loopback(switch_event_t *event)
+{
+    uint64_t before = g_loopback_bytes;
+
+    event_adapter_publish(event, NULL);
+    driver_loopback_pump(g_loopback, 0);
+    return (size_t)(g_loopback_bytes - before);
+}
+
+static const bench_t BENCHES[] = {
+    { "filter", run_filter, filter_setup, filter_teardown },
+    { "filter+predicate", run_filter, filter_predicate_setup, filter_teardown },
+    { "subject", run_subject, NULL, NULL },
+    { "subject/sharded", run_subject, sharded_setup, sharded_teardown },
+    { "serialize/json", run_json, NULL, NULL },
+    { "serialize/json+projection", run_json, projection_setup, projection_teardown },
+    { "serialize/msgpack", run_msgpack, NULL, NULL },
+    { "serialize/cbor", run_cbor, NULL, NULL },
+    { "publish/json", run_publish, NULL, NULL },
+    { "publish/json+loopback", run_loopback, loopback_setup, loopback_teardown }
+};
+
+static void run_bench(const bench_t *bench, const bench_corpus_t *corpus, uint64_t iterations, bench_result_t *result)
+{
+    uint64_t i, start, elapsed, allocs, alloc_bytes, out = 0;
+    uint64_t warmup = corpus->count * 4;
+
+    if (bench->setup) {
+        bench->setup();
+    }
+
+    /* Warm caches, thread buffers and lazily built subjects before measuring */
+    for (i = 0; i < warmup; i++) {
+        bench->run(corpus->events[i % corpus->count]);
+    }
+
+    allocs = g_allocs;
+    alloc_bytes = g_alloc_bytes;
+    start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        out += bench->run(corpus->events[i % corpus->count]);
+    }
+    elapsed = now_ns() - start;
+    allocs = g_allocs - allocs;
+    alloc_bytes = g_alloc_bytes - alloc_bytes;
+
+    if (bench->teardown) {
+        bench->teardown();
+    }
+
+    snprintf(result->name, sizeof(result->name), "%s [%s]", bench->name, corpus->name);
+    result->ns_per_event = (double)elapsed / (double)iterations;
+    result->events_per_sec = elapsed ? (double)iterations * 1e9 / (double)elapsed : 0;
+    result->allocs_per_event = (double)allocs / (double)iterations;
+    result->alloc_bytes_per_event = (double)alloc_bytes / (double)iterations;
+    result->out_bytes_per_event = (double)out / (double)iterations;
+}
+
+/* ------------------------------------------------------ cJSON tree vs writer */
+
+/* The fixed timestamp both paths print; the fixture's own Event-Date-Timestamp when it has one */
+static uint64_t parity_timestamp(switch_event_t *event)
+{
+    const char *ts = switch_event_get_header(event, "Event-Date-Timestamp");
+
+    return ts ? strtoull(ts, NULL, 10) : 1722694937311004ULL;
+}
+
+/* serialize_event_to_json as it was before the streaming writer: build the tree, print it, free it */
+static char *cjson_print(switch_event_t *event, const char *node_id, uint64_t timestamp)
+{
+    cJSON *json_event = cJSON_CreateObject();
+    cJSON *headers;
+    const char *uuid;
+    switch_event_header_t *hp;
+    char *json_str;
+
+    if (!json_event) {
+        return NULL;
+    }
+
+    cJSON_AddStringToObject(json_event, "event_name", switch_event_name(event->event_id));
+    cJSON_AddNumberToObject(json_event, "timestamp", (double)timestamp);
+    if (node_id) {
+        cJSON_AddStringToObject(json_event, "node_id", node_id);
+    }
+    if ((uuid = switch_event_get_header(event, "Unique-ID"))) {
+        cJSON_AddStringToObject(json_event, "uuid", uuid);
+    }
+
+    if ((headers = cJSON_CreateObject())) {
+        for (hp = event->headers; hp; hp = hp->next) {
+            if (hp->name && hp->value) {
+                cJSON_AddStringToObject(headers, hp->name, hp->value);
+            }
+        }
+        cJSON_AddItemToObject(json_event, "headers", headers);
+    }
+
+    if (event->body) {
+        cJSON_AddStringToObject(json_event, "body", event->body);
+    }
+
+    json_str = cJSON_PrintUnformatted(json_event);
+    cJSON_Delete(json_event);
+    return json_str;
+}
+
+/* The streaming path with the same fixed timestamp; the result lives in the thread buffer */
+static const char *writer_print(switch_event_t *event, const char *node_id, uint64_t timestamp, size_t *len)
+{
+    event_buffer_t *buf = event_buffer_thread_local();
+    event_record_t record = { 0 };
+
+    record.event = event;
+    record.node_id = node_id;
+    record.timestamp = timestamp;
+
+    event_buffer_reset(buf);
+    if (!event_encode_json(buf, &record)) {
+        return NULL;
+    }
+    *len = buf->len;
+    return buf->data;
+}
+
+static uint32_t parity_events(const bench_corpus_t *corpus, switch_event_t **events, uint64_t *timestamps)
+{
+    uint32_t count = 0, i;
+
+    for (i = 0; i < corpus->count; i++) {
+        switch_event_t *event = corpus->events[i];
+
+        if (event->event_id == SWITCH_EVENT_CHANNEL_CREATE || event->event_id == SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE) {
+            timestamps[count] = parity_timestamp(event);
+            events[count++] = event;
+        }
+    }
+    return count;
+}
+
+/* Returns the number of events whose two encodings differ */
+static uint32_t check_parity(switch_event_t **events, const uint64_t *timestamps, uint32_t count)
+{
+    uint32_t mismatches = 0, i;
+
+    for (i = 0; i < count; i++) {
+        char *expected = cjson_print(events[i], globals.node_id, timestamps[i]);
+        size_t len = 0, expected_len = expected ? strlen(expected) : 0;
+        const char *got = writer_print(events[i], globals.node_id, timestamps[i], &len);
+
+        if (!expected || !got || len != expected_len || memcmp(expected, got, len)) {
+            size_t at = 0;
+
+            while (expected && got && at < len && at < expected_len && expected[at] == got[at]) {
+                at++;
+            }
+            printf("   ❌ %s differs at byte %zu (cJSON %zu bytes, writer %zu bytes)\n", switch_event_name(events[i]->event_id), at,
+                   expected_len, len);
+            mismatches++;
+        }
+        cJSON_free(expected);
+    }
+    return mismatches;
+}
+
+static size_t print_one(switch_bool_t tree, switch_event_t *event, uint64_t timestamp)
+{
+    size_t len = 0;
+
+    if (tree) {
+        char *json = cjson_print(event, globals.node_id, timestamp);
+
+        len = json ? strlen(json) : 0;
+        cJSON_free(json);
+    } else {
+        writer_print(event, globals.node_id, timestamp, &len);
+    }
+    return len;
+}
+
+static void time_print(switch_bool_t tree, switch_event_t **events, const uint64_t *timestamps, uint32_t count, uint64_t iterations,
+                       bench_result_t *result)
+{
+    uint64_t i, start, elapsed, allocs, alloc_bytes, out = 0;
+
+    for (i = 0; i < (uint64_t)count * 4; i++) {
+        print_one(tree, events[i % count], timestamps[i % count]);
+    }
+
+    allocs = g_allocs;
+    alloc_bytes = g_alloc_bytes;
+    start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        out += print_one(tree, events[i % count], timestamps[i % count]);
+    }
+    elapsed = now_ns() - start;
+
+    snprintf(result->name, sizeof(result->name), "%s [channel]", tree ? "json/cjson-tree" : "json/writer");
+    result->ns_per_event = (double)elapsed / (double)iterations;
+    result->events_per_sec = elapsed ? (double)iterations * 1e9 / (double)elapsed : 0;
+    result->allocs_per_event = (double)(g_allocs - allocs) / (double)iterations;
+    result->alloc_bytes_per_event = (double)(g_alloc_bytes - alloc_bytes) / (double)iterations;
+    result->out_bytes_per_event = (double)out / (double)iterations;
+}
+
+/* ----------------------------------------------------------------- baseline */
+
+static switch_bool_t write_results(const char *path, const bench_result_t *results, uint32_t count)
+{
+    FILE *fp = fopen(path, "w");
+    uint32_t i;
+
+    if (!fp) {
+        fprintf(stderr, "❌ Cannot write %s\n", path);
+        return SWITCH_FALSE;
+    }
+    fprintf(fp, "# name\tns_per_event\tallocs_per_event\talloc_bytes_per_event\n");
+    for (i = 0; i < count; i++) {
+        fprintf(fp, "%s\t%.2f\t%.3f\t%.1f\n", results[i].name, results[i].ns_per_event, results[i].allocs_per_event,
+                results[i].alloc_bytes_per_event);
+    }
+    fclose(fp);
+    return SWITCH_TRUE;
+}
+
+/* Returns the number of regressions against the baseline */
+static uint32_t compare_baseline(const char *path, const bench_result_t *results, uint32_t count, double tolerance)
+{
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    uint32_t regressions = 0, i;
+
+    if (!fp) {
+        fprintf(stderr, "❌ Cannot read baseline %s\n", path);
+        return 1;
+    }
+
+    printf("\nBaseline %s (tolerance %.0f%%):\n", path, tolerance);
+    while (fgets(line, sizeof(line), fp)) {
+        char *name = line, *fields;
+        double ns, allocs;
+
+        if (*line == '#' || !(fields = strchr(line, '\t'))) {
+            continue;
+        }
+        *fields++ = '\0';
+        if (sscanf(fields, "%lf %lf", &ns, &allocs) != 2) {
+            continue;
+        }
+
+        for (i = 0; i < count; i++) {
+            const bench_result_t *r = &results[i];
+            double delta;
+
+            if (strcmp(r->name, name)) {
+                continue;
+            }
+            delta = ns > 0 ? (r->ns_per_event - ns) * 100.0 / ns : 0;
+            if (delta > tolerance || r->allocs_per_event > allocs + 0.005) {
+                printf("   ❌ %-40s %8.1f -> %8.1f ns (%+.1f%%), %.3f -> %.3f allocs\n", name, ns, r->ns_per_event, delta,
+                       allocs, r->allocs_per_event);
+                regressions++;
+            } else {
+                printf("   ✓ %-40s %8.1f -> %8.1f ns (%+.1f%%)\n", name, ns, r->ns_per_event, delta);
+            }
+        }
+    }
+    fclose(fp);
+    return regressions;
+}
+
+/* --------------------------------------------------------------------- main */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [-d fixtures_dir] [-f name_filter] [-w results_file] [-b baseline_file] [-t tolerance_pct]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t iterations = DEFAULT_ITERATIONS;
+    const char *fixtures = DEFAULT_FIXTURES;
+    const char *name_filter = NULL, *write_path = NULL, *baseline = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    static bench_corpus_t corpora[2];
+    bench_result_t results[MAX_RESULTS];
+    switch_event_t *parity[MAX_FIXTURE_EVENTS];
+    uint64_t parity_ts[MAX_FIXTURE_EVENTS];
+    cJSON_Hooks hooks = { malloc, free };
+    uint32_t result_count = 0, parity_count, b, c, regressions = 0, mismatches = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:f:w:b:t:h")) != -1) {
+        switch (opt) {
+        case 'n': iterations = strtoull(optarg, NULL, 10); break;
+        case 'd': fixtures = optarg; break;
+        case 'f': name_filter = optarg; break;
+        case 'w': write_path = optarg; break;
+        case 'b': baseline = optarg; break;
+        case 't': tolerance = atof(optarg); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (!iterations) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    switch_core_new_memory_pool(&globals.pool);
+    globals.node_id = "bench_node";
+    globals.subject_prefix = DEFAULT_SUBJECT_PREFIX;
+    globals.event_format = EVENT_FORMAT_JSON;
+    globals.latency_metrics = SWITCH_FALSE;
+    globals.running = SWITCH_TRUE;
+    g_null_driver.name = "null";
+    g_null_driver.publish = null_publish;
+    g_null_driver.has_subscribers = null_has_subscribers;
+    globals.driver = &g_null_driver;
+    event_subjects_init(globals.pool);
+    /* Route cJSON through the wrapped allocator so the tree path's allocations are counted too */
+    cJSON_InitHooks(&hooks);
+
+    printf("╔════════════════════════════════════════╗\n");
+    printf("║   mod_event_agent event path benchmark ║\n");
+    printf("╚════════════════════════════════════════╝\n\n");
+
+    if (!load_fixtures(&corpora[0], fixtures)) {
+        fprintf(stderr, "❌ No recorded events found in %s\n", fixtures);
+        return 1;
+    }
+    build_synthetic(&corpora[1]);
+    printf("✓ %u recorded events from %s, %u synthetic, %llu iterations per benchmark\n\n", corpora[0].count, fixtures,
+           corpora[1].count, (unsigned long long)iterations);
+
+    printf("%-40s %12s %10s %13s %14s %12s\n", "benchmark", "events/s", "ns/event", "allocs/event", "alloc B/event", "out B/event");
+    for (b = 0; b < sizeof(BENCHES) / sizeof(BENCHES[0]); b++) {
+        if (name_filter && !strstr(BENCHES[b].name, name_filter)) {
+            continue;
+        }
+        for (c = 0; c < 2 && result_count < MAX_RESULTS; c++) {
+            bench_result_t *r = &results[result_count++];
+
+            run_bench(&BENCHES[b], &corpora[c], iterations, r);
+            printf("%-40s %12.0f %10.1f %13.3f %14.1f %12.1f\n", r->name, r->events_per_sec, r->ns_per_event,
+                   r->allocs_per_event, r->alloc_bytes_per_event, r->out_bytes_per_event);
+        }
+    }
+
+    parity_count = parity_events(&corpora[0], parity, parity_ts);
+    if (parity_count && (!name_filter || strstr("json/cjson-tree json/writer", name_filter)) && result_count + 2 <= MAX_RESULTS) {
+        bench_result_t *tree = &results[result_count++], *writer = &results[result_count++];
+
+        printf("\ncJSON tree vs streaming writer, %u recorded CHANNEL_CREATE/CHANNEL_HANGUP_COMPLETE events:\n", parity_count);
+        mismatches = check_parity(parity, parity_ts, parity_count);
+        time_print(SWITCH_TRUE, parity, parity_ts, parity_count, iterations, tree);
+        time_print(SWITCH_FALSE, parity, parity_ts, parity_count, iterations, writer);
+        printf("%-40s %12.0f %10.1f %13.3f %14.1f %12.1f\n", tree->name, tree->events_per_sec, tree->ns_per_event,
+               tree->allocs_per_event, tree->alloc_bytes_per_event, tree->out_bytes_per_event);
+        printf("%-40s %12.0f %10.1f %13.3f %14.1f %12.1f\n", writer->name, writer->events_per_sec, writer->ns_per_event,
+               writer->allocs_per_event, writer->alloc_bytes_per_event, writer->out_bytes_per_event);
+        if (mismatches) {
+            printf("❌ %u event(s) encode differently from cJSON_PrintUnformatted\n", mismatches);
+        } else {
+            printf("✓ Byte-identical output, writer %.2fx faster\n", tree->ns_per_event / writer->ns_per_event);
+        }
+    }
+
+    if (write_path && write_results(write_path, results, result_count)) {
+        printf("\n✓ Results written to %s\n", write_path);
+    }
+    if (baseline) {
+        regressions = compare_baseline(baseline, results, result_count, tolerance);
+        printf("\n%s %u regression(s)\n", regressions ? "❌" : "✅", regressions);
+    }
+
+    for (c = 0; c < 2; c++) {
+        for (b = 0; b < corpora[c].count; b++) {
+            switch_event_destroy(&corpora[c].events[b]);
+        }
+    }
+    event_subjects_destroy();
+
+    return regressions || mismatches ? 1 : 0;
+}
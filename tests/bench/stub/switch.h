@@ -0,0 +1,332 @@
+/*
+ * switch.h (bench stub)
+ * The subset of the FreeSWITCH core API used by src/events, src/core,
+ * the command dispatch path (src/commands handler/core/workers/jobs)
+ * and the driver helpers (interest tracking, spool), enough to build
+ * them outside FreeSWITCH. Implemented in
+ * switch_stub.c on top of pthreads and malloc; declarations follow
+ * switch_types.h / switch_core.h so the module sources compile unchanged.
+ */
+
+#ifndef SWITCH_H
+#define SWITCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#define SWITCH_DECLARE(type) type
+#define SWITCH_THREAD_FUNC
+#define SWITCH_THREAD_STACKSIZE 240 * 1024
+#define SWITCH_MUTEX_DEFAULT 0x0
+#define SWITCH_MUTEX_NESTED 0x1
+#define SWITCH_MUTEX_UNNESTED 0x2
+#define SWITCH_EVENT_SUBCLASS_ANY NULL
+#define SWITCH_PATH_SEPARATOR "/"
+#define SWITCH_DEFAULT_DIR_PERMS 0755
+
+typedef enum {
+    SWITCH_STATUS_SUCCESS,
+    SWITCH_STATUS_FALSE,
+    SWITCH_STATUS_TIMEOUT,
+    SWITCH_STATUS_RESTART,
+    SWITCH_STATUS_INTR,
+    SWITCH_STATUS_NOTIMPL,
+    SWITCH_STATUS_MEMERR,
+    SWITCH_STATUS_NOOP,
+    SWITCH_STATUS_RESAMPLE,
+    SWITCH_STATUS_GENERR,
+    SWITCH_STATUS_INUSE,
+    SWITCH_STATUS_BREAK,
+    SWITCH_STATUS_SOCKERR,
+    SWITCH_STATUS_MORE_DATA,
+    SWITCH_STATUS_NOTFOUND,
+    SWITCH_STATUS_UNLOAD,
+    SWITCH_STATUS_NOUNLOAD,
+    SWITCH_STATUS_IGNORE,
+    SWITCH_STATUS_TOO_SMALL,
+    SWITCH_STATUS_FOUND,
+    SWITCH_STATUS_CONTINUE,
+    SWITCH_STATUS_TERM,
+    SWITCH_STATUS_NOT_INITALIZED,
+    SWITCH_STATUS_TOO_LATE
+} switch_status_t;
+
+typedef enum {
+    SWITCH_FALSE = 0,
+    SWITCH_TRUE = 1
+} switch_bool_t;
+
+typedef enum {
+    SWITCH_LOG_DEBUG10 = 110,
+    SWITCH_LOG_DEBUG = 7,
+    SWITCH_LOG_INFO = 6,
+    SWITCH_LOG_NOTICE = 5,
+    SWITCH_LOG_WARNING = 4,
+    SWITCH_LOG_ERROR = 3,
+    SWITCH_LOG_CRIT = 2,
+    SWITCH_LOG_ALERT = 1,
+    SWITCH_LOG_CONSOLE = 0
+} switch_log_level_t;
+
+typedef enum {
+    SWITCH_STACK_BOTTOM = (1 << 0),
+    SWITCH_STACK_TOP = (1 << 1)
+} switch_stack_t;
+
+typedef enum {
+    SWITCH_PRIORITY_NORMAL,
+    SWITCH_PRIORITY_LOW,
+    SWITCH_PRIORITY_HIGH
+} switch_priority_t;
+
+typedef int64_t switch_time_t;
+typedef int64_t switch_interval_time_t;
+typedef size_t switch_size_t;
+typedef ssize_t switch_ssize_t;
+
+typedef struct switch_memory_pool switch_memory_pool_t;
+typedef struct switch_mutex switch_mutex_t;
+typedef struct switch_thread switch_thread_t;
+typedef struct switch_threadattr switch_threadattr_t;
+typedef struct switch_thread_cond switch_thread_cond_t;
+typedef struct switch_thread_rwlock switch_thread_rwlock_t;
+typedef struct switch_dir switch_dir_t;
+typedef struct switch_hashtable switch_hash_t;
+typedef struct switch_hashtable_iterator switch_hash_index_t;
+typedef struct switch_event_node switch_event_node_t;
+typedef struct switch_xml_binding switch_xml_binding_t;
+typedef struct switch_stream_handle switch_stream_handle_t;
+
+typedef void *(SWITCH_THREAD_FUNC *switch_thread_start_t)(switch_thread_t *thread, void *obj);
+typedef void (*hashtable_destructor_t)(void *ptr);
+
+/* Events: the full switch_event_types_t list so names and ids match FreeSWITCH */
+typedef enum {
+    SWITCH_EVENT_CUSTOM,
+    SWITCH_EVENT_CLONE,
+    SWITCH_EVENT_CHANNEL_CREATE,
+    SWITCH_EVENT_CHANNEL_DESTROY,
+    SWITCH_EVENT_CHANNEL_STATE,
+    SWITCH_EVENT_CHANNEL_CALLSTATE,
+    SWITCH_EVENT_CHANNEL_ANSWER,
+    SWITCH_EVENT_CHANNEL_HANGUP,
+    SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE,
+    SWITCH_EVENT_CHANNEL_EXECUTE,
+    SWITCH_EVENT_CHANNEL_EXECUTE_COMPLETE,
+    SWITCH_EVENT_CHANNEL_HOLD,
+    SWITCH_EVENT_CHANNEL_UNHOLD,
+    SWITCH_EVENT_CHANNEL_BRIDGE,
+    SWITCH_EVENT_CHANNEL_UNBRIDGE,
+    SWITCH_EVENT_CHANNEL_PROGRESS,
+    SWITCH_EVENT_CHANNEL_PROGRESS_MEDIA,
+    SWITCH_EVENT_CHANNEL_OUTGOING,
+    SWITCH_EVENT_CHANNEL_PARK,
+    SWITCH_EVENT_CHANNEL_UNPARK,
+    SWITCH_EVENT_CHANNEL_APPLICATION,
+    SWITCH_EVENT_CHANNEL_ORIGINATE,
+    SWITCH_EVENT_CHANNEL_UUID,
+    SWITCH_EVENT_API,
+    SWITCH_EVENT_LOG,
+    SWITCH_EVENT_INBOUND_CHAN,
+    SWITCH_EVENT_OUTBOUND_CHAN,
+    SWITCH_EVENT_STARTUP,
+    SWITCH_EVENT_SHUTDOWN,
+    SWITCH_EVENT_PUBLISH,
+    SWITCH_EVENT_UNPUBLISH,
+    SWITCH_EVENT_TALK,
+    SWITCH_EVENT_NOTALK,
+    SWITCH_EVENT_SESSION_CRASH,
+    SWITCH_EVENT_MODULE_LOAD,
+    SWITCH_EVENT_MODULE_UNLOAD,
+    SWITCH_EVENT_DTMF,
+    SWITCH_EVENT_MESSAGE,
+    SWITCH_EVENT_PRESENCE_IN,
+    SWITCH_EVENT_NOTIFY_IN,
+    SWITCH_EVENT_PRESENCE_OUT,
+    SWITCH_EVENT_PRESENCE_PROBE,
+    SWITCH_EVENT_MESSAGE_WAITING,
+    SWITCH_EVENT_MESSAGE_QUERY,
+    SWITCH_EVENT_ROSTER,
+    SWITCH_EVENT_CODEC,
+    SWITCH_EVENT_BACKGROUND_JOB,
+    SWITCH_EVENT_DETECTED_SPEECH,
+    SWITCH_EVENT_DETECTED_TONE,
+    SWITCH_EVENT_PRIVATE_COMMAND,
+    SWITCH_EVENT_HEARTBEAT,
+    SWITCH_EVENT_TRAP,
+    SWITCH_EVENT_ADD_SCHEDULE,
+    SWITCH_EVENT_DEL_SCHEDULE,
+    SWITCH_EVENT_EXE_SCHEDULE,
+    SWITCH_EVENT_RE_SCHEDULE,
+    SWITCH_EVENT_RELOADXML,
+    SWITCH_EVENT_NOTIFY,
+    SWITCH_EVENT_PHONE_FEATURE,
+    SWITCH_EVENT_PHONE_FEATURE_SUBSCRIBE,
+    SWITCH_EVENT_SEND_MESSAGE,
+    SWITCH_EVENT_RECV_MESSAGE,
+    SWITCH_EVENT_REQUEST_PARAMS,
+    SWITCH_EVENT_CHANNEL_DATA,
+    SWITCH_EVENT_GENERAL,
+    SWITCH_EVENT_COMMAND,
+    SWITCH_EVENT_SESSION_HEARTBEAT,
+    SWITCH_EVENT_CLIENT_DISCONNECTED,
+    SWITCH_EVENT_SERVER_DISCONNECTED,
+    SWITCH_EVENT_SEND_INFO,
+    SWITCH_EVENT_RECV_INFO,
+    SWITCH_EVENT_RECV_RTCP_MESSAGE,
+    SWITCH_EVENT_SEND_RTCP_MESSAGE,
+    SWITCH_EVENT_CALL_SECURE,
+    SWITCH_EVENT_NAT,
+    SWITCH_EVENT_RECORD_START,
+    SWITCH_EVENT_RECORD_STOP,
+    SWITCH_EVENT_PLAYBACK_START,
+    SWITCH_EVENT_PLAYBACK_STOP,
+    SWITCH_EVENT_CALL_UPDATE,
+    SWITCH_EVENT_FAILURE,
+    SWITCH_EVENT_SOCKET_DATA,
+    SWITCH_EVENT_MEDIA_BUG_START,
+    SWITCH_EVENT_MEDIA_BUG_STOP,
+    SWITCH_EVENT_CONFERENCE_DATA_QUERY,
+    SWITCH_EVENT_CONFERENCE_DATA,
+    SWITCH_EVENT_CALL_SETUP_REQ,
+    SWITCH_EVENT_CALL_SETUP_RESULT,
+    SWITCH_EVENT_CALL_DETAIL,
+    SWITCH_EVENT_DEVICE_STATE,
+    SWITCH_EVENT_TEXT,
+    SWITCH_EVENT_SHUTDOWN_REQUESTED,
+    SWITCH_EVENT_ALL
+} switch_event_types_t;
+
+typedef struct switch_event_header {
+    char *name;
+    char *value;
+    char **array;
+    int idx;
+    unsigned long hash;
+    struct switch_event_header *next;
+} switch_event_header_t;
+
+typedef struct switch_event {
+    switch_event_types_t event_id;
+    switch_priority_t priority;
+    char *owner;
+    char *subclass_name;
+    switch_event_header_t *headers;
+    switch_event_header_t *last_header;
+    char *body;
+    void *bind_user_data;
+    void *event_user_data;
+    unsigned long key;
+    struct switch_event *next;
+    int flags;
+} switch_event_t;
+
+typedef void (*switch_event_callback_t)(switch_event_t *event);
+
+/* Logging: dropped unless BENCH_LOG is set in the environment */
+#define SWITCH_CHANNEL_LOG 0, __FILE__, __func__, __LINE__, NULL
+void switch_log_printf(int channel, const char *file, const char *func, int line, const char *userdata,
+                       switch_log_level_t level, const char *fmt, ...) __attribute__((format(printf, 7, 8)));
+/* Stub only: the last message logged on this thread, whether printed or not */
+const char *switch_stub_last_log(void);
+
+/* Memory pools: every allocation is freed with the pool */
+switch_status_t switch_core_perform_new_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line);
+#define switch_core_new_memory_pool(p) switch_core_perform_new_memory_pool(p, __FILE__, __func__, __LINE__)
+switch_status_t switch_core_perform_destroy_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line);
+#define switch_core_destroy_memory_pool(p) switch_core_perform_destroy_memory_pool(p, __FILE__, __func__, __LINE__)
+void *switch_core_perform_alloc(switch_memory_pool_t *pool, switch_size_t memory, const char *file, const char *func, int line);
+#define switch_core_alloc(_pool, _mem) switch_core_perform_alloc(_pool, _mem, __FILE__, __func__, __LINE__)
+char *switch_core_perform_strdup(switch_memory_pool_t *pool, const char *todup, const char *file, const char *func, int line);
+#define switch_core_strdup(_pool, _todup) switch_core_perform_strdup(_pool, _todup, __FILE__, __func__, __LINE__)
+char *switch_core_perform_strndup(switch_memory_pool_t *pool, const char *todup, size_t len, const char *file, const char *func, int line);
+#define switch_core_strndup(_pool, _todup, _len) switch_core_perform_strndup(_pool, _todup, _len, __FILE__, __func__, __LINE__)
+char *switch_core_sprintf(switch_memory_pool_t *pool, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Hash tables */
+switch_status_t switch_core_hash_init_case(switch_hash_t **hash, switch_bool_t case_sensitive);
+#define switch_core_hash_init(_hash) switch_core_hash_init_case(_hash, SWITCH_TRUE)
+#define switch_core_hash_init_nocase(_hash) switch_core_hash_init_case(_hash, SWITCH_FALSE)
+switch_status_t switch_core_hash_destroy(switch_hash_t **hash);
+switch_status_t switch_core_hash_insert_destructor(switch_hash_t *hash, const char *key, const void *data, hashtable_destructor_t destructor);
+#define switch_core_hash_insert(_h, _k, _d) switch_core_hash_insert_destructor(_h, _k, _d, NULL)
+void *switch_core_hash_delete(switch_hash_t *hash, const char *key);
+void *switch_core_hash_find(switch_hash_t *hash, const char *key);
+switch_hash_index_t *switch_core_hash_first_iter(switch_hash_t *hash, switch_hash_index_t *hi);
+#define switch_core_hash_first(_h) switch_core_hash_first_iter(_h, NULL)
+switch_hash_index_t *switch_core_hash_next(switch_hash_index_t **hi);
+void switch_core_hash_this(switch_hash_index_t *hi, const void **key, switch_ssize_t *klen, void **val);
+
+/* Threads */
+switch_status_t switch_mutex_init(switch_mutex_t **lock, unsigned int flags, switch_memory_pool_t *pool);
+switch_status_t switch_mutex_lock(switch_mutex_t *lock);
+switch_status_t switch_mutex_unlock(switch_mutex_t *lock);
+switch_status_t switch_thread_cond_create(switch_thread_cond_t **cond, switch_memory_pool_t *pool);
+switch_status_t switch_thread_cond_timedwait(switch_thread_cond_t *cond, switch_mutex_t *mutex, switch_interval_time_t timeout);
+switch_status_t switch_thread_cond_signal(switch_thread_cond_t *cond);
+switch_status_t switch_thread_cond_broadcast(switch_thread_cond_t *cond);
+switch_status_t switch_threadattr_create(switch_threadattr_t **new_attr, switch_memory_pool_t *pool);
+switch_status_t switch_threadattr_stacksize_set(switch_threadattr_t *attr, switch_size_t stacksize);
+switch_status_t switch_threadattr_detach_set(switch_threadattr_t *attr, int32_t on);
+switch_status_t switch_thread_create(switch_thread_t **new_thread, switch_threadattr_t *attr, switch_thread_start_t func,
+                                     void *data, switch_memory_pool_t *cont);
+switch_status_t switch_thread_join(switch_status_t *retval, switch_thread_t *thd);
+switch_status_t switch_thread_rwlock_create(switch_thread_rwlock_t **rwlock, switch_memory_pool_t *pool);
+switch_status_t switch_thread_rwlock_rdlock(switch_thread_rwlock_t *rwlock);
+switch_status_t switch_thread_rwlock_wrlock(switch_thread_rwlock_t *rwlock);
+switch_status_t switch_thread_rwlock_unlock(switch_thread_rwlock_t *rwlock);
+
+/* Directories */
+switch_status_t switch_dir_make_recursive(const char *path, int perm, switch_memory_pool_t *pool);
+switch_status_t switch_dir_open(switch_dir_t **new_dir, const char *dirname, switch_memory_pool_t *pool);
+const char *switch_dir_next_file(switch_dir_t *thedir, char *buf, switch_size_t len);
+switch_status_t switch_dir_close(switch_dir_t *thedir);
+
+/* Time */
+switch_time_t switch_micro_time_now(void);
+switch_time_t switch_time_now(void);
+void switch_cond_next(void);
+void switch_yield(switch_interval_time_t t);
+
+/* Strings */
+static inline int zstr(const char *s)
+{
+    return !s || *s == '\0';
+}
+#define switch_strlen_zero(x) zstr(x)
+#define switch_safe_free(it) if (it) {free(it);it=NULL;}
+#define switch_safe_strdup(it) (it ? strdup(it) : NULL)
+int switch_snprintf(char *buf, switch_size_t len, const char *format, ...) __attribute__((format(printf, 3, 4)));
+char *switch_copy_string(char *dst, const char *src, switch_size_t dst_size);
+unsigned int switch_separate_string(char *buf, char delim, char **array, unsigned int arraylen);
+
+/* UUIDs */
+#define SWITCH_UUID_FORMATTED_LENGTH 36
+char *switch_uuid_str(char *buf, switch_size_t len);
+
+/* Events */
+const char *switch_event_name(switch_event_types_t event);
+switch_status_t switch_name_event(const char *name, switch_event_types_t *type);
+switch_status_t switch_event_create_subclass_detailed(const char *file, const char *func, int line, switch_event_t **event,
+                                                      switch_event_types_t event_id, const char *subclass_name);
+#define switch_event_create(event, id) switch_event_create_subclass_detailed(__FILE__, __func__, __LINE__, event, id, SWITCH_EVENT_SUBCLASS_ANY)
+#define switch_event_create_subclass(_e, _eid, _sn) switch_event_create_subclass_detailed(__FILE__, __func__, __LINE__, _e, _eid, _sn)
+switch_status_t switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *data);
+char *switch_event_get_header_idx(switch_event_t *event, const char *header_name, int idx);
+#define switch_event_get_header(_e, _h) switch_event_get_header_idx(_e, _h, -1)
+switch_status_t switch_event_dup(switch_event_t **event, switch_event_t *todup);
+void switch_event_destroy(switch_event_t **event);
+switch_status_t switch_event_bind_removable(const char *id, switch_event_types_t event, const char *subclass_name,
+                                            switch_event_callback_t callback, void *user_data, switch_event_node_t **node);
+#define switch_event_bind(id, event, subclass_name, callback, user_data) switch_event_bind_removable(id, event, subclass_name, callback, user_data, NULL)
+switch_status_t switch_event_unbind_callback(switch_event_callback_t callback);
+
+#endif /* SWITCH_H */
@@ -0,0 +1,817 @@
+/*
+ * switch_stub.c
+ * pthread/malloc implementation of the bench switch.h. Events are built
+ * the way switch_event.c builds them (one malloc per header, name and
+ * value; case-insensitive hashed lookup) so allocation and lookup costs
+ * measured here track the real core.
+ */
+
+#include <switch.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#define POOL_CHUNK_SIZE (8 * 1024)
+#define HASH_BUCKETS 64
+
+/* ---------------------------------------------------------------- logging */
+
+static int g_log_enabled = -1;
+static __thread char g_last_log[1024];
+
+void switch_log_printf(int channel, const char *file, const char *func, int line, const char *userdata,
+                       switch_log_level_t level, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(g_last_log, sizeof(g_last_log), fmt, ap);
+    va_end(ap);
+
+    if (g_log_enabled < 0) {
+        g_log_enabled = getenv("BENCH_LOG") ? 1 : 0;
+    }
+    if (g_log_enabled) {
+        fprintf(stderr, "[%d] %s:%d %s\n", (int)level, file, line, g_last_log);
+    }
+}
+
+const char *switch_stub_last_log(void)
+{
+    return g_last_log;
+}
+
+/* ------------------------------------------------------------ memory pool */
+
+typedef struct pool_chunk {
+    struct pool_chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} pool_chunk_t;
+
+struct switch_memory_pool {
+    pthread_mutex_t lock;
+    pool_chunk_t *chunks;
+};
+
+switch_status_t switch_core_perform_new_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line)
+{
+    switch_memory_pool_t *p = calloc(1, sizeof(*p));
+
+    if (!p) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    *pool = p;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_perform_destroy_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line)
+{
+    pool_chunk_t *chunk, *next;
+
+    if (!pool || !*pool) {
+        return SWITCH_STATUS_FALSE;
+    }
+    for (chunk = (*pool)->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    pthread_mutex_destroy(&(*pool)->lock);
+    free(*pool);
+    *pool = NULL;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Bump allocation out of 8KB chunks, zero-filled like apr_pcalloc */
+void *switch_core_perform_alloc(switch_memory_pool_t *pool, switch_size_t memory, const char *file, const char *func, int line)
+{
+    pool_chunk_t *chunk;
+    size_t need = (memory + 15) & ~(size_t)15;
+    void *ptr;
+
+    pthread_mutex_lock(&pool->lock);
+    chunk = pool->chunks;
+    if (!chunk || chunk->size - chunk->used < need) {
+        size_t size = need > POOL_CHUNK_SIZE ? need : POOL_CHUNK_SIZE;
+
+        if (!(chunk = calloc(1, sizeof(*chunk) + size))) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        chunk->size = size;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+    }
+    ptr = chunk->data + chunk->used;
+    chunk->used += need;
+    pthread_mutex_unlock(&pool->lock);
+
+    memset(ptr, 0, memory);
+    return ptr;
+}
+
+char *switch_core_perform_strndup(switch_memory_pool_t *pool, const char *todup, size_t len, const char *file, const char *func, int line)
+{
+    char *dup;
+
+    if (!todup) {
+        return NULL;
+    }
+    if ((dup = switch_core_perform_alloc(pool, len + 1, file, func, line))) {
+        memcpy(dup, todup, len);
+        dup[len] = '\0';
+    }
+    return dup;
+}
+
+char *switch_core_perform_strdup(switch_memory_pool_t *pool, const char *todup, const char *file, const char *func, int line)
+{
+    return todup ? switch_core_perform_strndup(pool, todup, strlen(todup), file, func, line) : NULL;
+}
+
+char *switch_core_sprintf(switch_memory_pool_t *pool, const char *fmt, ...)
+{
+    va_list ap;
+    char *buf;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    if (len < 0 || !(buf = switch_core_alloc(pool, (size_t)len + 1))) {
+        return NULL;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(buf, (size_t)len + 1, fmt, ap);
+    va_end(ap);
+    return buf;
+}
+
+/* ------------------------------------------------------------- hash table */
+
+typedef struct hash_entry {
+    struct hash_entry *next;
+    char *key;
+    void *val;
+    unsigned long hash;
+    hashtable_destructor_t destructor;
+} hash_entry_t;
+
+struct switch_hashtable {
+    hash_entry_t *buckets[HASH_BUCKETS];
+    switch_bool_t case_sensitive;
+};
+
+struct switch_hashtable_iterator {
+    switch_hash_t *hash;
+    uint32_t bucket;
+    hash_entry_t *entry;
+};
+
+static unsigned long key_hash(const char *key, switch_bool_t case_sensitive)
+{
+    unsigned long hash = 5381;
+    const unsigned char *p;
+
+    for (p = (const unsigned char *)key; *p; p++) {
+        hash = ((hash << 5) + hash) + (case_sensitive ? *p : (unsigned char)tolower(*p));
+    }
+    return hash;
+}
+
+static hash_entry_t **hash_slot(switch_hash_t *hash, const char *key, unsigned long h)
+{
+    hash_entry_t **slot = &hash->buckets[h % HASH_BUCKETS];
+
+    for (; *slot; slot = &(*slot)->next) {
+        if ((*slot)->hash == h && !(hash->case_sensitive ? strcmp((*slot)->key, key) : strcasecmp((*slot)->key, key))) {
+            break;
+        }
+    }
+    return slot;
+}
+
+switch_status_t switch_core_hash_init_case(switch_hash_t **hash, switch_bool_t case_sensitive)
+{
+    if (!(*hash = calloc(1, sizeof(switch_hash_t)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    (*hash)->case_sensitive = case_sensitive;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_hash_destroy(switch_hash_t **hash)
+{
+    hash_entry_t *entry, *next;
+    uint32_t i;
+
+    if (!hash || !*hash) {
+        return SWITCH_STATUS_FALSE;
+    }
+    for (i = 0; i < HASH_BUCKETS; i++) {
+        for (entry = (*hash)->buckets[i]; entry; entry = next) {
+            next = entry->next;
+            if (entry->destructor) {
+                entry->destructor(entry->val);
+            }
+            free(entry->key);
+            free(entry);
+        }
+    }
+    free(*hash);
+    *hash = NULL;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_hash_insert_destructor(switch_hash_t *hash, const char *key, const void *data, hashtable_destructor_t destructor)
+{
+    unsigned long h = key_hash(key, hash->case_sensitive);
+    hash_entry_t **slot = hash_slot(hash, key, h);
+    hash_entry_t *entry = *slot;
+
+    if (entry) {
+        if (entry->destructor) {
+            entry->destructor(entry->val);
+        }
+    } else {
+        if (!(entry = calloc(1, sizeof(*entry))) || !(entry->key = strdup(key))) {
+            free(entry);
+            return SWITCH_STATUS_MEMERR;
+        }
+        entry->hash = h;
+        *slot = entry;
+    }
+    entry->val = (void *)data;
+    entry->destructor = destructor;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void *switch_core_hash_find(switch_hash_t *hash, const char *key)
+{
+    hash_entry_t *entry = *hash_slot(hash, key, key_hash(key, hash->case_sensitive));
+
+    return entry ? entry->val : NULL;
+}
+
+void *switch_core_hash_delete(switch_hash_t *hash, const char *key)
+{
+    hash_entry_t **slot = hash_slot(hash, key, key_hash(key, hash->case_sensitive));
+    hash_entry_t *entry = *slot;
+    void *val;
+
+    if (!entry) {
+        return NULL;
+    }
+    *slot = entry->next;
+    val = entry->val;
+    free(entry->key);
+    free(entry);
+    return val;
+}
+
+static switch_hash_index_t *hash_advance(switch_hash_index_t *hi)
+{
+    while (!hi->entry && ++hi->bucket < HASH_BUCKETS) {
+        hi->entry = hi->hash->buckets[hi->bucket];
+    }
+    if (!hi->entry) {
+        free(hi);
+        return NULL;
+    }
+    return hi;
+}
+
+switch_hash_index_t *switch_core_hash_first_iter(switch_hash_t *hash, switch_hash_index_t *hi)
+{
+    if (!hash) {
+        return NULL;
+    }
+    if (!hi && !(hi = malloc(sizeof(*hi)))) {
+        return NULL;
+    }
+    hi->hash = hash;
+    hi->bucket = 0;
+    hi->entry = hash->buckets[0];
+    return hash_advance(hi);
+}
+
+switch_hash_index_t *switch_core_hash_next(switch_hash_index_t **hi)
+{
+    (*hi)->entry = (*hi)->entry->next;
+    return (*hi = hash_advance(*hi));
+}
+
+void switch_core_hash_this(switch_hash_index_t *hi, const void **key, switch_ssize_t *klen, void **val)
+{
+    if (key) {
+        *key = hi->entry->key;
+    }
+    if (klen) {
+        *klen = (switch_ssize_t)strlen(hi->entry->key) + 1;
+    }
+    if (val) {
+        *val = hi->entry->val;
+    }
+}
+
+/* ---------------------------------------------------------------- threads */
+
+struct switch_mutex {
+    pthread_mutex_t mutex;
+};
+
+struct switch_thread_cond {
+    pthread_cond_t cond;
+};
+
+struct switch_thread_rwlock {
+    pthread_rwlock_t rwlock;
+};
+
+struct switch_threadattr {
+    size_t stacksize;
+    int detach;
+};
+
+struct switch_thread {
+    pthread_t thread;
+    switch_thread_start_t func;
+    void *data;
+};
+
+switch_status_t switch_mutex_init(switch_mutex_t **lock, unsigned int flags, switch_memory_pool_t *pool)
+{
+    pthread_mutexattr_t attr;
+
+    if (!(*lock = switch_core_alloc(pool, sizeof(switch_mutex_t)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    pthread_mutexattr_init(&attr);
+    if (flags & SWITCH_MUTEX_NESTED) {
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    }
+    pthread_mutex_init(&(*lock)->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_lock(switch_mutex_t *lock)
+{
+    return pthread_mutex_lock(&lock->mutex) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_unlock(switch_mutex_t *lock)
+{
+    return pthread_mutex_unlock(&lock->mutex) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_create(switch_thread_cond_t **cond, switch_memory_pool_t *pool)
+{
+    if (!(*cond = switch_core_alloc(pool, sizeof(switch_thread_cond_t)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    pthread_cond_init(&(*cond)->cond, NULL);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_timedwait(switch_thread_cond_t *cond, switch_mutex_t *mutex, switch_interval_time_t timeout)
+{
+    struct timespec ts;
+    int rc;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout / 1000000;
+    ts.tv_nsec += (timeout % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    rc = pthread_cond_timedwait(&cond->cond, &mutex->mutex, &ts);
+    return rc == ETIMEDOUT ? SWITCH_STATUS_TIMEOUT : (rc ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS);
+}
+
+switch_status_t switch_thread_cond_signal(switch_thread_cond_t *cond)
+{
+    pthread_cond_signal(&cond->cond);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_broadcast(switch_thread_cond_t *cond)
+{
+    pthread_cond_broadcast(&cond->cond);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_create(switch_threadattr_t **new_attr, switch_memory_pool_t *pool)
+{
+    return (*new_attr = switch_core_alloc(pool, sizeof(switch_threadattr_t))) ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_MEMERR;
+}
+
+switch_status_t switch_threadattr_stacksize_set(switch_threadattr_t *attr, switch_size_t stacksize)
+{
+    attr->stacksize = stacksize;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_detach_set(switch_threadattr_t *attr, int32_t on)
+{
+    attr->detach = on;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static void *thread_trampoline(void *obj)
+{
+    switch_thread_t *thread = obj;
+
+    return thread->func(thread, thread->data);
+}
+
+switch_status_t switch_thread_create(switch_thread_t **new_thread, switch_threadattr_t *attr, switch_thread_start_t func,
+                                     void *data, switch_memory_pool_t *cont)
+{
+    switch_thread_t *thread;
+    pthread_attr_t pattr;
+    int rc;
+
+    if (!(thread = switch_core_alloc(cont, sizeof(*thread)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    thread->func = func;
+    thread->data = data;
+
+    pthread_attr_init(&pattr);
+    if (attr && attr->stacksize) {
+        pthread_attr_setstacksize(&pattr, attr->stacksize);
+    }
+    if (attr && attr->detach) {
+        pthread_attr_setdetachstate(&pattr, PTHREAD_CREATE_DETACHED);
+    }
+    rc = pthread_create(&thread->thread, &pattr, thread_trampoline, thread);
+    pthread_attr_destroy(&pattr);
+
+    if (rc) {
+        return SWITCH_STATUS_FALSE;
+    }
+    *new_thread = thread;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_join(switch_status_t *retval, switch_thread_t *thd)
+{
+    pthread_join(thd->thread, NULL);
+    if (retval) {
+        *retval = SWITCH_STATUS_SUCCESS;
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_rwlock_create(switch_thread_rwlock_t **rwlock, switch_memory_pool_t *pool)
+{
+    if (!(*rwlock = switch_core_alloc(pool, sizeof(switch_thread_rwlock_t)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    pthread_rwlock_init(&(*rwlock)->rwlock, NULL);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_rwlock_rdlock(switch_thread_rwlock_t *rwlock)
+{
+    return pthread_rwlock_rdlock(&rwlock->rwlock) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_rwlock_wrlock(switch_thread_rwlock_t *rwlock)
+{
+    return pthread_rwlock_wrlock(&rwlock->rwlock) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_rwlock_unlock(switch_thread_rwlock_t *rwlock)
+{
+    return pthread_rwlock_unlock(&rwlock->rwlock) ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+}
+
+/* ------------------------------------------------------------ directories */
+
+struct switch_dir {
+    DIR *dir;
+};
+
+switch_status_t switch_dir_make_recursive(const char *path, int perm, switch_memory_pool_t *pool)
+{
+    char buf[1024];
+    char *p;
+
+    switch_copy_string(buf, path, sizeof(buf));
+    for (p = buf + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buf, (mode_t)perm) != 0 && errno != EEXIST) {
+                return SWITCH_STATUS_FALSE;
+            }
+            *p = '/';
+        }
+    }
+    return (mkdir(buf, (mode_t)perm) == 0 || errno == EEXIST) ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+switch_status_t switch_dir_open(switch_dir_t **new_dir, const char *dirname, switch_memory_pool_t *pool)
+{
+    DIR *dir;
+
+    if (!(dir = opendir(dirname))) {
+        return SWITCH_STATUS_FALSE;
+    }
+    *new_dir = switch_core_alloc(pool, sizeof(switch_dir_t));
+    (*new_dir)->dir = dir;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* Regular entries only, like the APR-backed original */
+const char *switch_dir_next_file(switch_dir_t *thedir, char *buf, switch_size_t len)
+{
+    struct dirent *entry;
+
+    while ((entry = readdir(thedir->dir))) {
+        if (entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) {
+            switch_copy_string(buf, entry->d_name, len);
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+switch_status_t switch_dir_close(switch_dir_t *thedir)
+{
+    closedir(thedir->dir);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* ------------------------------------------------------------------- time */
+
+switch_time_t switch_micro_time_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (switch_time_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+switch_time_t switch_time_now(void)
+{
+    return switch_micro_time_now();
+}
+
+void switch_cond_next(void)
+{
+    sched_yield();
+}
+
+void switch_yield(switch_interval_time_t t)
+{
+    usleep((useconds_t)t);
+}
+
+/* ---------------------------------------------------------------- strings */
+
+int switch_snprintf(char *buf, switch_size_t len, const char *format, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, format);
+    ret = vsnprintf(buf, len, format, ap);
+    va_end(ap);
+    return ret;
+}
+
+char *switch_copy_string(char *dst, const char *src, switch_size_t dst_size)
+{
+    size_t len;
+
+    if (!dst_size) {
+        return dst;
+    }
+    len = src ? strlen(src) : 0;
+    if (len >= dst_size) {
+        len = dst_size - 1;
+    }
+    memcpy(dst, src ? src : "", len);
+    dst[len] = '\0';
+    return dst + len;
+}
+
+/* Splits in place, trimming blanks around each element */
+unsigned int switch_separate_string(char *buf, char delim, char **array, unsigned int arraylen)
+{
+    unsigned int count = 0;
+    char *p = buf, *start, *end;
+
+    if (!buf || !array || !arraylen) {
+        return 0;
+    }
+
+    while (p && count < arraylen) {
+        start = p;
+        if (count == arraylen - 1) {
+            p = NULL;
+        } else if ((p = strchr(p, delim))) {
+            *p++ = '\0';
+        }
+        while (*start == ' ' || *start == '\t') {
+            start++;
+        }
+        end = start + strlen(start);
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) {
+            *--end = '\0';
+        }
+        array[count++] = start;
+    }
+    return count;
+}
+
+/* ------------------------------------------------------------------ uuids */
+
+/* Clock plus a sequence in the formatted uuid shape; unique within a run */
+char *switch_uuid_str(char *buf, switch_size_t len)
+{
+    static uint64_t seq;
+    uint64_t n = __atomic_add_fetch(&seq, 1, __ATOMIC_RELAXED);
+    uint64_t t = (uint64_t)switch_micro_time_now();
+
+    snprintf(buf, len, "%08x-%04x-4%03x-8%03x-%012llx", (unsigned int)(t & 0xffffffff), (unsigned int)((t >> 32) & 0xffff),
+             (unsigned int)(n >> 48) & 0xfff, (unsigned int)(n >> 36) & 0xfff, (unsigned long long)(n & 0xffffffffffffULL));
+    return buf;
+}
+
+/* ----------------------------------------------------------------- events */
+
+static const char *EVENT_NAMES[] = {
+    "CUSTOM", "CLONE", "CHANNEL_CREATE", "CHANNEL_DESTROY", "CHANNEL_STATE", "CHANNEL_CALLSTATE", "CHANNEL_ANSWER",
+    "CHANNEL_HANGUP", "CHANNEL_HANGUP_COMPLETE", "CHANNEL_EXECUTE", "CHANNEL_EXECUTE_COMPLETE", "CHANNEL_HOLD",
+    "CHANNEL_UNHOLD", "CHANNEL_BRIDGE", "CHANNEL_UNBRIDGE", "CHANNEL_PROGRESS", "CHANNEL_PROGRESS_MEDIA",
+    "CHANNEL_OUTGOING", "CHANNEL_PARK", "CHANNEL_UNPARK", "CHANNEL_APPLICATION", "CHANNEL_ORIGINATE", "CHANNEL_UUID",
+    "API", "LOG", "INBOUND_CHAN", "OUTBOUND_CHAN", "STARTUP", "SHUTDOWN", "PUBLISH", "UNPUBLISH", "TALK", "NOTALK",
+    "SESSION_CRASH", "MODULE_LOAD", "MODULE_UNLOAD", "DTMF", "MESSAGE", "PRESENCE_IN", "NOTIFY_IN", "PRESENCE_OUT",
+    "PRESENCE_PROBE", "MESSAGE_WAITING", "MESSAGE_QUERY", "ROSTER", "CODEC", "BACKGROUND_JOB", "DETECTED_SPEECH",
+    "DETECTED_TONE", "PRIVATE_COMMAND", "HEARTBEAT", "TRAP", "ADD_SCHEDULE", "DEL_SCHEDULE", "EXE_SCHEDULE",
+    "RE_SCHEDULE", "RELOADXML", "NOTIFY", "PHONE_FEATURE", "PHONE_FEATURE_SUBSCRIBE", "SEND_MESSAGE", "RECV_MESSAGE",
+    "REQUEST_PARAMS", "CHANNEL_DATA", "GENERAL", "COMMAND", "SESSION_HEARTBEAT", "CLIENT_DISCONNECTED",
+    "SERVER_DISCONNECTED", "SEND_INFO", "RECV_INFO", "RECV_RTCP_MESSAGE", "SEND_RTCP_MESSAGE", "CALL_SECURE", "NAT",
+    "RECORD_START", "RECORD_STOP", "PLAYBACK_START", "PLAYBACK_STOP", "CALL_UPDATE", "FAILURE", "SOCKET_DATA",
+    "MEDIA_BUG_START", "MEDIA_BUG_STOP", "CONFERENCE_DATA_QUERY", "CONFERENCE_DATA", "CALL_SETUP_REQ",
+    "CALL_SETUP_RESULT", "CALL_DETAIL", "DEVICE_STATE", "TEXT", "SHUTDOWN_REQUESTED", "ALL"
+};
+
+const char *switch_event_name(switch_event_types_t event)
+{
+    return (unsigned)event <= SWITCH_EVENT_ALL ? EVENT_NAMES[event] : NULL;
+}
+
+switch_status_t switch_name_event(const char *name, switch_event_types_t *type)
+{
+    uint32_t i;
+
+    if (!strncasecmp(name, "SWITCH_EVENT_", 13)) {
+        name += 13;
+    }
+    for (i = 0; i <= SWITCH_EVENT_ALL; i++) {
+        if (!strcasecmp(name, EVENT_NAMES[i])) {
+            *type = (switch_event_types_t)i;
+            return SWITCH_STATUS_SUCCESS;
+        }
+    }
+    return SWITCH_STATUS_FALSE;
+}
+
+/* Same case-insensitive hash switch_event.c keys headers with */
+static unsigned long header_hash(const char *name)
+{
+    unsigned long hash = 0;
+    const unsigned char *p;
+
+    for (p = (const unsigned char *)name; *p; p++) {
+        hash = tolower(*p) + (hash << 6) + (hash << 16) - hash;
+    }
+    return hash;
+}
+
+switch_status_t switch_event_create_subclass_detailed(const char *file, const char *func, int line, switch_event_t **event,
+                                                      switch_event_types_t event_id, const char *subclass_name)
+{
+    if (!(*event = calloc(1, sizeof(switch_event_t)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    (*event)->event_id = event_id;
+    if (subclass_name) {
+        (*event)->subclass_name = strdup(subclass_name);
+        switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, "Event-Subclass", subclass_name);
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *data)
+{
+    switch_event_header_t *header;
+
+    if (!(header = calloc(1, sizeof(*header)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    header->name = strdup(header_name);
+    header->value = strdup(data ? data : "");
+    header->hash = header_hash(header_name);
+
+    if (stack == SWITCH_STACK_TOP) {
+        header->next = event->headers;
+        event->headers = header;
+        if (!event->last_header) {
+            event->last_header = header;
+        }
+    } else {
+        if (event->last_header) {
+            event->last_header->next = header;
+        } else {
+            event->headers = header;
+        }
+        event->last_header = header;
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+char *switch_event_get_header_idx(switch_event_t *event, const char *header_name, int idx)
+{
+    switch_event_header_t *hp;
+    unsigned long hash;
+
+    if (!event || !header_name) {
+        return NULL;
+    }
+    hash = header_hash(header_name);
+    for (hp = event->headers; hp; hp = hp->next) {
+        if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
+            return hp->value;
+        }
+    }
+    return NULL;
+}
+
+switch_status_t switch_event_dup(switch_event_t **event, switch_event_t *todup)
+{
+    switch_event_header_t *hp;
+
+    if (!(*event = calloc(1, sizeof(switch_event_t)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    (*event)->event_id = todup->event_id;
+    (*event)->priority = todup->priority;
+    (*event)->event_user_data = todup->event_user_data;
+    (*event)->bind_user_data = todup->bind_user_data;
+    (*event)->flags = todup->flags;
+    if (todup->subclass_name) {
+        (*event)->subclass_name = strdup(todup->subclass_name);
+    }
+    if (todup->body) {
+        (*event)->body = strdup(todup->body);
+    }
+    for (hp = todup->headers; hp; hp = hp->next) {
+        switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, hp->name, hp->value);
+    }
+    (*event)->key = todup->key;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_event_destroy(switch_event_t **event)
+{
+    switch_event_header_t *hp, *next;
+
+    if (!event || !*event) {
+        return;
+    }
+    for (hp = (*event)->headers; hp; hp = next) {
+        next = hp->next;
+        free(hp->name);
+        free(hp->value);
+        free(hp);
+    }
+    free((*event)->subclass_name);
+    free((*event)->body);
+    free(*event);
+    *event = NULL;
+}
+
+switch_status_t switch_event_bind_removable(const char *id, switch_event_types_t event, const char *subclass_name,
+                                            switch_event_callback_t callback, void *user_data, switch_event_node_t **node)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_unbind_callback(switch_event_callback_t callback)
+{
+    return SWITCH_STATUS_SUCCESS;
+}
@@ -0,0 +1,160 @@
+/*
+ * jetstream_bench.c
+ * Compares plain NATS publish with JetStream async publish (pipelined acks)
+ * against a local nats-server started with -js.
+ *
+ * Usage: jetstream_bench [url] [messages] [max_pending] [payload_bytes]
+ * Exits non-zero when JetStream throughput falls more than 20% below plain.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <nats/nats.h>
+
+#define DEFAULT_URL "nats://127.0.0.1:4222"
+#define STREAM_NAME "EVENT_AGENT_BENCH"
+#define PLAIN_SUBJECT "bench.plain.events"
+#define JS_SUBJECT "bench.js.events"
+
+static int64_t g_acked = 0;
+static int64_t g_failed = 0;
+
+static void ack_cb(jsCtx *js, natsMsg *msg, jsPubAck *pa, jsPubAckErr *pae, void *closure)
+{
+    if (pa) {
+        g_acked++;
+    } else {
+        g_failed++;
+    }
+    natsMsg_Destroy(msg);
+}
+
+/* Same message shape as the module: a few headers plus a JSON-sized body */
+static natsStatus build_msg(natsMsg **msg, const char *subject, const char *payload, int len, int64_t seq)
+{
+    char msg_id[96];
+    natsStatus s;
+
+    snprintf(msg_id, sizeof(msg_id), "bench-node-%lld-00000000-0000-0000-0000-000000000000", (long long)seq);
+    s = natsMsg_Create(msg, subject, NULL, payload, len);
+    if (s == NATS_OK) {
+        s = natsMsgHeader_Set(*msg, "Nats-Msg-Id", msg_id);
+    }
+    return s;
+}
+
+static double run_plain(natsConnection *conn, const char *payload, int len, int64_t count)
+{
+    int64_t start = nats_Now();
+    natsMsg *msg = NULL;
+    int64_t i;
+
+    for (i = 0; i < count; i++) {
+        if (build_msg(&msg, PLAIN_SUBJECT, payload, len, i) != NATS_OK ||
+            natsConnection_PublishMsg(conn, msg) != NATS_OK) {
+            fprintf(stderr, "❌ Plain publish failed at %lld\n", (long long)i);
+            natsMsg_Destroy(msg);
+            return 0;
+        }
+        natsMsg_Destroy(msg);
+    }
+    natsConnection_FlushTimeout(conn, 30000);
+
+    return (double)count * 1000.0 / (double)(nats_Now() - start + 1);
+}
+
+static double run_jetstream(jsCtx *js, const char *payload, int len, int64_t count)
+{
+    int64_t start = nats_Now();
+    jsPubOptions opts;
+    natsMsg *msg = NULL;
+    int64_t i;
+
+    jsPubOptions_Init(&opts);
+    opts.MaxWait = 5000;
+
+    for (i = 0; i < count; i++) {
+        if (build_msg(&msg, JS_SUBJECT, payload, len, i) != NATS_OK ||
+            js_PublishMsgAsync(js, &msg, &opts) != NATS_OK) {
+            fprintf(stderr, "❌ JetStream publish failed at %lld\n", (long long)i);
+            natsMsg_Destroy(msg);
+            return 0;
+        }
+    }
+    js_PublishAsyncComplete(js, &opts);
+
+    return (double)count * 1000.0 / (double)(nats_Now() - start + 1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *url = argc > 1 ? argv[1] : DEFAULT_URL;
+    int64_t count = argc > 2 ? atoll(argv[2]) : 200000;
+    int64_t max_pending = argc > 3 ? atoll(argv[3]) : 4096;
+    int len = argc > 4 ? atoi(argv[4]) : 1024;
+    natsConnection *conn = NULL;
+    jsCtx *js = NULL;
+    jsOptions js_opts;
+    jsStreamConfig cfg;
+    jsErrCode err = 0;
+    const char *subjects[] = { JS_SUBJECT };
+    double plain_rate, js_rate, ratio;
+    char *payload;
+    natsStatus s;
+
+    printf("╔════════════════════════════════════════╗\n");
+    printf("║   JetStream vs plain publish benchmark ║\n");
+    printf("╚════════════════════════════════════════╝\n\n");
+
+    if (!(payload = malloc(len))) {
+        return 1;
+    }
+    memset(payload, 'x', len);
+
+    s = natsConnection_ConnectTo(&conn, url);
+    if (s != NATS_OK) {
+        fprintf(stderr, "❌ Failed to connect to NATS: %s\n", natsStatus_GetText(s));
+        return 1;
+    }
+
+    jsOptions_Init(&js_opts);
+    js_opts.PublishAsync.MaxPending = max_pending;
+    js_opts.PublishAsync.AckHandler = ack_cb;
+    s = natsConnection_JetStream(&js, conn, &js_opts);
+
+    if (s == NATS_OK) {
+        jsStreamConfig_Init(&cfg);
+        cfg.Name = STREAM_NAME;
+        cfg.Subjects = subjects;
+        cfg.SubjectsLen = 1;
+        cfg.Storage = js_MemoryStorage;
+        js_DeleteStream(js, STREAM_NAME, NULL, NULL);
+        s = js_AddStream(NULL, js, &cfg, NULL, &err);
+    }
+    if (s != NATS_OK) {
+        fprintf(stderr, "❌ JetStream unavailable (run nats-server -js): %s (%d)\n", natsStatus_GetText(s), (int)err);
+        jsCtx_Destroy(js);
+        natsConnection_Destroy(conn);
+        return 1;
+    }
+
+    printf("✓ Connected to %s, %lld messages of %d bytes, window %lld\n\n", url, (long long)count, len, (long long)max_pending);
+
+    plain_rate = run_plain(conn, payload, len, count);
+    printf("   plain publish:      %10.0f msg/s\n", plain_rate);
+
+    js_rate = run_jetstream(js, payload, len, count);
+    printf("   jetstream async:    %10.0f msg/s (acked %lld, failed %lld)\n", js_rate, (long long)g_acked, (long long)g_failed);
+
+    ratio = plain_rate > 0 ? js_rate / plain_rate : 0;
+    printf("\n%s JetStream at %.0f%% of plain throughput\n", ratio >= 0.8 ? "✅" : "⚠️ ", ratio * 100.0);
+
+    js_DeleteStream(js, STREAM_NAME, NULL, NULL);
+    jsCtx_Destroy(js);
+    natsConnection_Destroy(conn);
+    free(payload);
+
+    return (ratio >= 0.8 && g_failed == 0 && g_acked == count) ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/*
+ * test_interest.c
+ * Table-driven checks for the NATS wildcard matcher shared by the drivers
+ * (driver_interest_match: '*' one token, '>' one or more trailing tokens)
+ * and for the interest tracker's per-subject counts: announce, refresh,
+ * withdraw, expiry and the reconnect grace period must all show up in
+ * driver_interest_count even though counts are cached.
+ */
+
+#include "drivers/interest.h"
+#include <sched.h>
+
+typedef struct {
+    const char *pattern;
+    const char *subject;
+    switch_bool_t match;
+} match_case_t;
+
+static const match_case_t MATCH_CASES[] = {
+    /* literals */
+    { "a", "a", SWITCH_TRUE },
+    { "a", "b", SWITCH_FALSE },
+    { "a.b", "a.b", SWITCH_TRUE },
+    { "a.b", "a", SWITCH_FALSE },
+    { "a", "a.b", SWITCH_FALSE },
+    { "ab", "a", SWITCH_FALSE },
+    { "a", "ab", SWITCH_FALSE },
+    { "a.b", "a.bc", SWITCH_FALSE },
+    { "", "", SWITCH_TRUE },
+    { "", "a", SWITCH_FALSE },
+    /* '>' needs at least one more token */
+    { ">", "a", SWITCH_TRUE },
+    { ">", "a.b.c", SWITCH_TRUE },
+    { "a.>", "a", SWITCH_FALSE },
+    { "a.>", "a.b", SWITCH_TRUE },
+    { "a.>", "a.b.c", SWITCH_TRUE },
+    { "a.>", "ab.c", SWITCH_FALSE },
+    { "a.>", "b.a", SWITCH_FALSE },
+    { "a.b.>", "a.b", SWITCH_FALSE },
+    { "freeswitch.events.>", "freeswitch.events.channel.create", SWITCH_TRUE },
+    /* '*' is exactly one token */
+    { "*", "a", SWITCH_TRUE },
+    { "*", "a.b", SWITCH_FALSE },
+    { "a.*", "a", SWITCH_FALSE },
+    { "a.*", "a.b", SWITCH_TRUE },
+    { "a.*", "a.b.c", SWITCH_FALSE },
+    { "*.b", "a.b", SWITCH_TRUE },
+    { "*.b", "a.c", SWITCH_FALSE },
+    { "a.*.c", "a.b.c", SWITCH_TRUE },
+    { "a.*.c", "a.b.d", SWITCH_FALSE },
+    { "*.*", "a.b", SWITCH_TRUE },
+    { "*.>", "a", SWITCH_FALSE },
+    { "*.>", "a.b", SWITCH_TRUE },
+    /* wildcard characters inside a token are literals */
+    { "a*", "ab", SWITCH_FALSE },
+    { "a*", "a*", SWITCH_TRUE },
+    { "*a", "ba", SWITCH_FALSE },
+    { "a.b*", "a.bc", SWITCH_FALSE },
+    { "a.>b", "a.cb", SWITCH_FALSE },
+    { "a.>b", "a.>b", SWITCH_TRUE },
+    /* empty tokens: a wildcard never stands for one */
+    { "a..b", "a..b", SWITCH_TRUE },
+    { "a..b", "a.b", SWITCH_FALSE },
+    { "a.*.b", "a..b", SWITCH_FALSE },
+    { "*.b", ".b", SWITCH_FALSE },
+    { "a.*", "a.", SWITCH_FALSE },
+    { "a.>", "a.", SWITCH_FALSE },
+    { "a.>", "a..b", SWITCH_FALSE },
+};
+
+static const char *SHORT_TTL = "{\"subjects\":[\"fs.events.heartbeat\"],\"ttl_ms\":50}";
+static int g_failures = 0;
+
+static void expect_count(driver_interest_t *interest, const char *subject, int expected, const char *step)
+{
+    int count = driver_interest_count(interest, subject);
+
+    if (count != expected) {
+        printf("❌ %s: count(%s) = %d, expected %d\n", step, subject, count, expected);
+        g_failures++;
+    }
+}
+
+static void check_matcher(void)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(MATCH_CASES) / sizeof(MATCH_CASES[0]); i++) {
+        const match_case_t *c = &MATCH_CASES[i];
+
+        if (driver_interest_match(c->pattern, c->subject) != c->match) {
+            printf("❌ match('%s', '%s') should be %s\n", c->pattern, c->subject, c->match ? "true" : "false");
+            g_failures++;
+        }
+    }
+}
+
+static void check_counts(switch_memory_pool_t *pool)
+{
+    driver_interest_t *interest = driver_interest_create(pool, 60000);
+    switch_time_t deadline;
+
+    expect_count(interest, "fs.events.channel.create", 0, "empty");
+
+    driver_interest_announce(interest, "fs.events.channel.>", 60000);
+    expect_count(interest, "fs.events.channel.create", 1, "announce");
+    expect_count(interest, "fs.events.heartbeat", 0, "announce");
+
+    driver_interest_announce(interest, "fs.events.*.create", 60000);
+    expect_count(interest, "fs.events.channel.create", 2, "second pattern");
+    expect_count(interest, "fs.events.channel.create", 2, "cached");
+
+    driver_interest_announce(interest, "fs.events.channel.>", 60000);
+    expect_count(interest, "fs.events.channel.create", 2, "refresh");
+
+    driver_interest_announce(interest, "fs.events.*.create", 0);
+    expect_count(interest, "fs.events.channel.create", 1, "withdraw");
+
+    driver_interest_handle_message(interest, SHORT_TTL, strlen(SHORT_TTL));
+    expect_count(interest, "fs.events.heartbeat", 1, "short ttl");
+    deadline = switch_micro_time_now() + 60000;
+    while (switch_micro_time_now() < deadline) {
+        sched_yield();
+    }
+    expect_count(interest, "fs.events.heartbeat", 0, "expired");
+    expect_count(interest, "fs.events.channel.create", 1, "after expiry");
+
+    driver_interest_start_grace(interest, 60000);
+    expect_count(interest, "fs.events.heartbeat", 1, "grace");
+
+    driver_interest_destroy(interest);
+}
+
+int main(void)
+{
+    switch_memory_pool_t *pool;
+
+    switch_core_new_memory_pool(&pool);
+
+    check_matcher();
+    check_counts(pool);
+
+    switch_core_destroy_memory_pool(&pool);
+
+    if (g_failures) {
+        printf("❌ interest: %d checks failed\n", g_failures);
+        return 1;
+    }
+    printf("✅ interest: %zu match cases and tracker counts as expected\n", sizeof(MATCH_CASES) / sizeof(MATCH_CASES[0]));
+    return 0;
+}
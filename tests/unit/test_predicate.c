@@ -0,0 +1,221 @@
+/*
+ * test_predicate.c
+ * Table-driven checks for the header predicate compiler (src/events
+ * predicate.c): every expression is evaluated against the eight events
+ * that set headers A, B and C to "1" or "0" (D exists only when C is
+ * "1") and compared with its expected truth table, which pins operator
+ * precedence and the short-circuit jump targets. Malformed and oversized
+ * expressions must fail with the expected error.
+ */
+
+#include "mod_event_agent.h"
+#include "events/predicate.h"
+
+#define TOO_DEEP 40
+
+mod_event_agent_globals_t globals;
+
+typedef struct {
+    const char *expression;
+    uint8_t truth;  /* bit (a | b << 1 | c << 2) set when the expression holds */
+} truth_case_t;
+
+static const truth_case_t TRUTH_CASES[] = {
+    { "A == 1", 0xaa },
+    { "not A == 1", 0x55 },
+    { "not not A == 1", 0xaa },
+    { "A == 1 and B == 1", 0x88 },
+    { "A == 1 or B == 1", 0xee },
+    { "A == 1 or B == 1 and C == 1", 0xea },
+    { "A == 1 and B == 1 or C == 1", 0xf8 },
+    { "(A == 1 or B == 1) and C == 1", 0xe0 },
+    { "not A == 1 and B == 1", 0x44 },
+    { "not (A == 1 and B == 1)", 0x77 },
+    { "A == 1 && B == 1 || !C == 1", 0x8f },
+    { "A == 1 and B == 1 and C == 1", 0x80 },
+    { "A == 1 or B == 1 or C == 1", 0xfe },
+    { "A == 1 and (B == 1 or C == 1) and not C == 1", 0x08 },
+    { "A == 1 or B == 1 and not C == 1 or B == 0 and C == 1", 0xbe },
+    { "not (A == 1 or B == 1) or not (B == 1 or C == 1)", 0x13 },
+    { "A != 1 or exists(D) and B ^= 1", 0xd5 },
+    { "A == '1' AND B == \"1\"", 0x88 },
+    { "Missing == 1", 0x00 },
+    { "Missing != 1", 0xff },
+    { "exists(Missing) or not exists(D)", 0x0f },
+};
+
+typedef struct {
+    const char *expression;
+    const char *error;  /* NULL: must compile */
+} error_case_t;
+
+static int g_failures = 0;
+
+static void fail(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void fail(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    fputs("❌ ", stdout);
+    vprintf(fmt, ap);
+    fputc('\n', stdout);
+    va_end(ap);
+    g_failures++;
+}
+
+static switch_event_t *build_event(int row)
+{
+    switch_event_t *event;
+
+    switch_event_create(&event, SWITCH_EVENT_CHANNEL_ANSWER);
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "A", (row & 1) ? "1" : "0");
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "B", (row & 2) ? "1" : "0");
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "C", (row & 4) ? "1" : "0");
+    if (row & 4) {
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "D", "present");
+    }
+    return event;
+}
+
+/* count conditions joined by op, e.g. "A == 1 or A == 1 or ..." */
+static char *repeat_terms(const char *term, const char *op, int count)
+{
+    size_t size = (strlen(term) + strlen(op) + 2) * (size_t)count + 1;
+    char *out = malloc(size);
+    size_t off = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        off += (size_t)snprintf(out + off, size - off, "%s%s", i ? op : "", term);
+    }
+    return out;
+}
+
+/* prefix count times, then term, then suffix count times */
+static char *nest(const char *prefix, const char *term, const char *suffix, int count)
+{
+    size_t size = (strlen(prefix) + strlen(suffix)) * (size_t)count + strlen(term) + 1;
+    char *out = malloc(size);
+    size_t off = 0;
+    int i;
+
+    for (i = 0; i < count; i++) off += (size_t)snprintf(out + off, size - off, "%s", prefix);
+    off += (size_t)snprintf(out + off, size - off, "%s", term);
+    for (i = 0; i < count; i++) off += (size_t)snprintf(out + off, size - off, "%s", suffix);
+    return out;
+}
+
+static void check_truth_tables(switch_memory_pool_t *pool)
+{
+    switch_event_t *events[8];
+    size_t i;
+    int row;
+
+    for (row = 0; row < 8; row++) {
+        events[row] = build_event(row);
+    }
+
+    for (i = 0; i < sizeof(TRUTH_CASES) / sizeof(TRUTH_CASES[0]); i++) {
+        event_predicate_t *predicate = event_predicate_compile(pool, TRUTH_CASES[i].expression);
+        uint8_t truth = 0;
+
+        if (!predicate) {
+            fail("'%s' did not compile: %s", TRUTH_CASES[i].expression, switch_stub_last_log());
+            continue;
+        }
+        for (row = 0; row < 8; row++) {
+            if (event_predicate_eval(predicate, events[row])) {
+                truth |= (uint8_t)(1 << row);
+            }
+        }
+        if (truth != TRUTH_CASES[i].truth) {
+            fail("'%s' truth table 0x%02x, expected 0x%02x", TRUTH_CASES[i].expression, truth, TRUTH_CASES[i].truth);
+        }
+    }
+
+    for (row = 0; row < 8; row++) {
+        switch_event_destroy(&events[row]);
+    }
+}
+
+static void check_errors(switch_memory_pool_t *pool)
+{
+    /* Code holds 128 instructions: n conditions joined by or take 2n - 1 */
+    char *longest = repeat_terms("A == 1", " or ", 64);
+    char *too_long = repeat_terms("A == 1", " or ", 65);
+    /* Depth counts every unary level, the condition included, up to 32 */
+    char *deepest_not = nest("not ", "A == 1", "", 31);
+    char *too_deep_not = nest("not ", "A == 1", "", 32);
+    char *too_deep_parens = nest("(", "A == 1", ")", TOO_DEEP);
+    const error_case_t cases[] = {
+        { longest, NULL },
+        { too_long, "expression too long" },
+        { deepest_not, NULL },
+        { too_deep_not, "expression nested too deeply" },
+        { too_deep_parens, "expression nested too deeply" },
+        { "A == 1 and", "expected condition" },
+        { "(A == 1", "expected ')'" },
+        { "A == 1)", "unexpected token" },
+        { "A 1", "expected ==, != or ^= after header name" },
+        { "A ==", "expected value" },
+        { "exists(A", "expected ')' after exists(" },
+        { "exists()", "expected header name in exists()" },
+        { "A == 1 # B", "unexpected character" },
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const char *shown = strlen(cases[i].expression) > 40 ? "<generated>" : cases[i].expression;
+        event_predicate_t *predicate = event_predicate_compile(pool, cases[i].expression);
+
+        if (!cases[i].error) {
+            if (!predicate) {
+                fail("'%s' should compile: %s", shown, switch_stub_last_log());
+            }
+        } else if (predicate) {
+            fail("'%s' compiled, expected \"%s\"", shown, cases[i].error);
+        } else if (!strstr(switch_stub_last_log(), cases[i].error)) {
+            fail("'%s' failed with \"%s\", expected \"%s\"", shown, switch_stub_last_log(), cases[i].error);
+        }
+    }
+
+    /* A true first term hops over every remaining condition through the chain of 63 jumps */
+    {
+        event_predicate_t *predicate = event_predicate_compile(pool, longest);
+        switch_event_t *yes = build_event(1);
+        switch_event_t *no = build_event(0);
+
+        if (predicate && (!event_predicate_eval(predicate, yes) || event_predicate_eval(predicate, no))) {
+            fail("64-term or chain evaluates wrongly");
+        }
+        switch_event_destroy(&yes);
+        switch_event_destroy(&no);
+    }
+
+    free(longest);
+    free(too_long);
+    free(deepest_not);
+    free(too_deep_not);
+    free(too_deep_parens);
+}
+
+int main(void)
+{
+    switch_memory_pool_t *pool;
+
+    switch_core_new_memory_pool(&pool);
+
+    check_truth_tables(pool);
+    check_errors(pool);
+
+    switch_core_destroy_memory_pool(&pool);
+
+    if (g_failures) {
+        printf("❌ predicate: %d checks failed\n", g_failures);
+        return 1;
+    }
+    printf("✅ predicate: %zu expressions, all truth tables and errors as expected\n", sizeof(TRUTH_CASES) / sizeof(TRUTH_CASES[0]));
+    return 0;
+}